@@ -4,6 +4,7 @@
 #cmakedefine HAVE_BACKTRACE_SYMBOLS
 #cmakedefine HAVE_PIPE2
 #cmakedefine HAVE_VFORK
+#cmakedefine HAVE_EPOLL
 #cmakedefine HAVE_DLADDR
 #cmakedefine HAVE_LIBEXECINFO
 #cmakedefine HAVE_CXXABI_H
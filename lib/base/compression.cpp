@@ -0,0 +1,91 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "base/compression.hpp"
+#include "base/exception.hpp"
+#include <boost/iostreams/concepts.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_streambuf.hpp>
+#include <stdexcept>
+
+using namespace icinga;
+
+namespace
+{
+
+/**
+ * Appends to a string, but not beyond a maximum length.
+ */
+class LimitedStringSink : public boost::iostreams::sink
+{
+public:
+	LimitedStringSink(std::string& out, size_t maxLength) : m_Out(out), m_MaxLength(maxLength)
+	{
+	}
+
+	std::streamsize write(const char *s, std::streamsize n)
+	{
+		if (static_cast<size_t>(n) > m_MaxLength - m_Out.size()) {
+			BOOST_THROW_EXCEPTION(std::length_error("Decompressed data exceeds " + std::to_string(m_MaxLength) + " bytes."));
+		}
+
+		m_Out.append(s, n);
+		return n;
+	}
+
+private:
+	std::string& m_Out;
+	size_t m_MaxLength;
+};
+
+}
+
+/**
+ * Compresses data into a zlib stream.
+ *
+ * @param data The data
+ * @param level The compression level from 1 (fastest) to 9 (smallest)
+ *
+ * @return The compressed data
+ */
+String Compression::Compress(const String& data, int level)
+{
+	namespace io = boost::iostreams;
+
+	String result;
+	io::filtering_ostreambuf out;
+
+	out.push(io::zlib_compressor(io::zlib_params(level)));
+	out.push(io::back_inserter(result.GetData()));
+
+	io::copy(io::array_source(data.CStr(), data.GetLength()), out);
+
+	return result;
+}
+
+/**
+ * Decompresses a zlib stream.
+ *
+ * @param data The compressed data
+ * @param maxLength The maximum length of the decompressed data, limits what a tiny input can blow up to
+ *
+ * @return The data
+ * @throws boost::iostreams::zlib_error if the data is corrupted
+ * @throws std::length_error if the decompressed data would exceed maxLength
+ */
+String Compression::Decompress(const String& data, size_t maxLength)
+{
+	namespace io = boost::iostreams;
+
+	String result;
+	io::filtering_ostreambuf out;
+
+	out.push(io::zlib_decompressor());
+	out.push(LimitedStringSink(result.GetData(), maxLength));
+
+	io::copy(io::array_source(data.CStr(), data.GetLength()), out);
+
+	return result;
+}
@@ -0,0 +1,26 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include "base/i2-base.hpp"
+#include "base/string.hpp"
+#include <cstdint>
+
+namespace icinga
+{
+
+/**
+ * zlib (deflate) compression
+ *
+ * @ingroup base
+ */
+struct Compression
+{
+	static String Compress(const String& data, int level = 6);
+	static String Decompress(const String& data, size_t maxLength = SIZE_MAX);
+};
+
+}
+
+#endif /* COMPRESSION_H */
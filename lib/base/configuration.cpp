@@ -38,6 +38,7 @@ String Configuration::ObjectsPath;
 String Configuration::PidPath;
 String Configuration::PkgDataDir;
 String Configuration::PrefixDir;
+int Configuration::ProcessIOThreads{4};
 String Configuration::ProgramData;
 int Configuration::RLimitFiles;
 int Configuration::RLimitProcesses;
@@ -228,6 +229,16 @@ void Configuration::SetPrefixDir(const String& val, bool suppress_events, const
 	HandleUserWrite("PrefixDir", &Configuration::PrefixDir, val, m_ReadOnly);
 }
 
+int Configuration::GetProcessIOThreads() const
+{
+	return Configuration::ProcessIOThreads;
+}
+
+void Configuration::SetProcessIOThreads(int val, bool suppress_events, const Value& cookie)
+{
+	HandleUserWrite("ProcessIOThreads", &Configuration::ProcessIOThreads, val, m_ReadOnly);
+}
+
 String Configuration::GetProgramData() const
 {
 	return Configuration::ProgramData;
@@ -67,6 +67,9 @@ public:
 	String GetPrefixDir() const override;
 	void SetPrefixDir(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
+	int GetProcessIOThreads() const override;
+	void SetProcessIOThreads(int value, bool suppress_events = false, const Value& cookie = Empty) override;
+
 	String GetProgramData() const override;
 	void SetProgramData(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
@@ -130,6 +133,7 @@ public:
 	static String PidPath;
 	static String PkgDataDir;
 	static String PrefixDir;
+	static int ProcessIOThreads;
 	static String ProgramData;
 	static int RLimitFiles;
 	static int RLimitProcesses;
@@ -0,0 +1,221 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "base/histogram.hpp"
+#include <cmath>
+
+using namespace icinga;
+
+Histogram::Histogram()
+{
+	for (auto& bucket : m_Buckets) {
+		bucket.store(0, std::memory_order_relaxed);
+	}
+}
+
+/**
+ * Records a duration.
+ *
+ * @param duration The duration in seconds, negative values are treated as 0
+ */
+void Histogram::Record(double duration) noexcept
+{
+	uint_fast64_t value = 0;
+
+	if (duration > 0) {
+		double us = std::round(duration * 1e6);
+
+		value = us < double(uint_fast64_t(1) << MaxValueBits) ? static_cast<uint_fast64_t>(us) : (uint_fast64_t(1) << MaxValueBits) - 1u;
+	}
+
+	m_Buckets[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+	m_Count.fetch_add(1, std::memory_order_relaxed);
+
+	auto max (m_Max.load(std::memory_order_relaxed));
+
+	while (value > max && !m_Max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+		;
+}
+
+/**
+ * Adds the durations recorded by another histogram to this one.
+ */
+void Histogram::Add(const Histogram& other) noexcept
+{
+	for (size_t i = 0; i < m_Buckets.size(); i++) {
+		m_Buckets[i].fetch_add(other.m_Buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+
+	m_Count.fetch_add(other.m_Count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+	auto value (other.m_Max.load(std::memory_order_relaxed));
+	auto max (m_Max.load(std::memory_order_relaxed));
+
+	while (value > max && !m_Max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+		;
+}
+
+/**
+ * Forgets all recorded durations.
+ */
+void Histogram::Clear() noexcept
+{
+	for (auto& bucket : m_Buckets) {
+		bucket.store(0, std::memory_order_relaxed);
+	}
+
+	m_Count.store(0, std::memory_order_relaxed);
+	m_Max.store(0, std::memory_order_relaxed);
+}
+
+uint_fast64_t Histogram::GetCount() const noexcept
+{
+	return m_Count.load(std::memory_order_relaxed);
+}
+
+/**
+ * @return The largest recorded duration in seconds
+ */
+double Histogram::GetMax() const noexcept
+{
+	return m_Max.load(std::memory_order_relaxed) / 1e6;
+}
+
+/**
+ * Calculates the duration which the specified share of all recorded durations doesn't exceed.
+ *
+ * @param percentile The percentile, e.g. 99 for the 99th percentile
+ *
+ * @return The duration in seconds or 0 if nothing has been recorded yet
+ */
+double Histogram::GetPercentile(double percentile) const noexcept
+{
+	uint_fast64_t total = 0;
+
+	for (auto& bucket : m_Buckets) {
+		total += bucket.load(std::memory_order_relaxed);
+	}
+
+	if (total == 0) {
+		return 0;
+	}
+
+	auto target (static_cast<uint_fast64_t>(std::ceil(percentile / 100.0 * total)));
+
+	if (target < 1u) {
+		target = 1;
+	}
+
+	auto max (m_Max.load(std::memory_order_relaxed));
+	uint_fast64_t seen = 0;
+
+	for (size_t i = 0; i < m_Buckets.size(); i++) {
+		seen += m_Buckets[i].load(std::memory_order_relaxed);
+
+		if (seen >= target) {
+			auto value (GetBucketValue(i));
+
+			return (value < max ? value : max) / 1e6;
+		}
+	}
+
+	return max / 1e6;
+}
+
+/**
+ * Values below SubBuckets get a bucket each. Beyond that every power of two
+ * is split into SubBuckets buckets of equal width.
+ */
+size_t Histogram::GetBucketIndex(uint_fast64_t value) noexcept
+{
+	if (value < SubBuckets) {
+		return value;
+	}
+
+	unsigned int msb = 0;
+
+	for (auto v (value); v > 1u; v >>= 1u) {
+		msb++;
+	}
+
+	unsigned int shift = msb - SubBucketBits;
+
+	return SubBuckets + shift * SubBuckets + ((value >> shift) & (SubBuckets - 1u));
+}
+
+/**
+ * @return The middle of the value range the specified bucket covers
+ */
+uint_fast64_t Histogram::GetBucketValue(size_t index) noexcept
+{
+	if (index < SubBuckets) {
+		return index;
+	}
+
+	unsigned int shift = (index - SubBuckets) / SubBuckets;
+	uint_fast64_t lower = (SubBuckets + (index - SubBuckets) % SubBuckets) << shift;
+
+	return lower + ((uint_fast64_t(1) << shift) >> 1u);
+}
+
+/**
+ * @param sliceLength The length of a slice in seconds
+ * @param slices The number of slices the window consists of
+ */
+WindowedHistogram::WindowedHistogram(double sliceLength, size_t slices)
+	: m_SliceLength(sliceLength), m_SliceCount(slices), m_Slices(new Slice[slices])
+{
+}
+
+int_fast64_t WindowedHistogram::GetSliceNumber(double now) const noexcept
+{
+	return now > 0 ? static_cast<int_fast64_t>(now / m_SliceLength) : 0;
+}
+
+/**
+ * Records a duration.
+ *
+ * @param duration The duration in seconds, see Histogram::Record()
+ * @param now The current time
+ */
+void WindowedHistogram::Record(double duration, double now)
+{
+	auto number (GetSliceNumber(now));
+	auto& slice (m_Slices[number % m_SliceCount]);
+
+	if (slice.Number.load() != number) {
+		std::unique_lock<std::mutex> lock (m_RotateMutex);
+		auto current (slice.Number.load());
+
+		/* Too late, the slice has been reused already. */
+		if (current > number) {
+			return;
+		}
+
+		if (current < number) {
+			slice.Durations.Clear();
+			slice.Number.store(number);
+		}
+	}
+
+	slice.Durations.Record(duration);
+}
+
+/**
+ * Gets the durations recorded during the window.
+ *
+ * @param now The current time, the end of the window
+ * @param result Receives the durations, should be empty
+ */
+void WindowedHistogram::GetWindow(double now, Histogram& result) const noexcept
+{
+	auto number (GetSliceNumber(now));
+
+	for (size_t i = 0; i < m_SliceCount; i++) {
+		auto& slice (m_Slices[i]);
+		auto current (slice.Number.load());
+
+		if (current >= 0 && current <= number && number - current < static_cast<int_fast64_t>(m_SliceCount)) {
+			result.Add(slice.Durations);
+		}
+	}
+}
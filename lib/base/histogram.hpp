@@ -0,0 +1,92 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include "base/i2-base.hpp"
+#include "base/atomic.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace icinga
+{
+
+/**
+ * A histogram of durations with logarithmic buckets in the spirit of HdrHistogram.
+ *
+ * Durations are recorded with microsecond resolution and a relative error of at most
+ * 1/16 (four significant bits) for values of up to about 19 hours. Larger values are
+ * counted in the last bucket. Recording is lock-free, reading the percentiles while
+ * other threads are recording yields a slightly inconsistent but still useful snapshot.
+ *
+ * @ingroup base
+ */
+class Histogram final
+{
+public:
+	Histogram();
+
+	Histogram(const Histogram&) = delete;
+	Histogram& operator=(const Histogram&) = delete;
+
+	void Record(double duration) noexcept;
+	void Add(const Histogram& other) noexcept;
+	void Clear() noexcept;
+
+	uint_fast64_t GetCount() const noexcept;
+	double GetMax() const noexcept;
+	double GetPercentile(double percentile) const noexcept;
+
+private:
+	static constexpr unsigned int SubBucketBits = 4;
+	static constexpr uint_fast64_t SubBuckets = uint_fast64_t(1) << SubBucketBits;
+	static constexpr unsigned int MaxValueBits = 36;
+	static constexpr size_t BucketCount = SubBuckets + (MaxValueBits - SubBucketBits) * SubBuckets;
+
+	std::array<std::atomic<uint_fast64_t>, BucketCount> m_Buckets;
+	Atomic<uint_fast64_t> m_Count {0};
+	Atomic<uint_fast64_t> m_Max {0};
+
+	static size_t GetBucketIndex(uint_fast64_t value) noexcept;
+	static uint_fast64_t GetBucketValue(size_t index) noexcept;
+};
+
+/**
+ * A histogram of the durations recorded during the last minutes rather than since its creation.
+ *
+ * The window is split into slices of equal length, each with a Histogram of its own. Durations
+ * are recorded in the slice of the current time, which is cleared first if it's reused.
+ * So the durations of the current slice and of the complete ones before it are available,
+ * i.e. of the last (slices - 1) * slice length up to slices * slice length.
+ *
+ * @ingroup base
+ */
+class WindowedHistogram final
+{
+public:
+	WindowedHistogram(double sliceLength, size_t slices);
+
+	void Record(double duration, double now);
+	void GetWindow(double now, Histogram& result) const noexcept;
+
+private:
+	struct Slice
+	{
+		Histogram Durations;
+		Atomic<int_fast64_t> Number {-1};
+	};
+
+	double m_SliceLength;
+	size_t m_SliceCount;
+	std::unique_ptr<Slice[]> m_Slices;
+	std::mutex m_RotateMutex;
+
+	int_fast64_t GetSliceNumber(double now) const noexcept;
+};
+
+}
+
+#endif /* HISTOGRAM_H */
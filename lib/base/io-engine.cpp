@@ -5,6 +5,7 @@
 #include "base/io-engine.hpp"
 #include "base/lazy-init.hpp"
 #include "base/logger.hpp"
+#include <algorithm>
 #include <exception>
 #include <memory>
 #include <thread>
@@ -16,61 +17,37 @@
 
 using namespace icinga;
 
-CpuBoundWork::CpuBoundWork(boost::asio::yield_context yc)
-	: m_Done(false)
+CpuBoundWork::CpuBoundWork(boost::asio::yield_context yc, CpuBoundWorkPool pool)
+	: m_Pool(pool), m_Done(false)
 {
-	auto& ioEngine (IoEngine::Get());
-
-	for (;;) {
-		auto availableSlots (ioEngine.m_CpuBoundSemaphore.fetch_sub(1));
-
-		if (availableSlots < 1) {
-			ioEngine.m_CpuBoundSemaphore.fetch_add(1);
-			IoEngine::YieldCurrentCoroutine(yc);
-			continue;
-		}
-
-		break;
-	}
+	IoEngine::Get().AcquireCpuBoundSlot(yc, pool);
 }
 
 CpuBoundWork::~CpuBoundWork()
 {
 	if (!m_Done) {
-		IoEngine::Get().m_CpuBoundSemaphore.fetch_add(1);
+		IoEngine::Get().ReleaseCpuBoundSlot(m_Pool);
 	}
 }
 
 void CpuBoundWork::Done()
 {
 	if (!m_Done) {
-		IoEngine::Get().m_CpuBoundSemaphore.fetch_add(1);
+		IoEngine::Get().ReleaseCpuBoundSlot(m_Pool);
 
 		m_Done = true;
 	}
 }
 
-IoBoundWorkSlot::IoBoundWorkSlot(boost::asio::yield_context yc)
-	: yc(yc)
+IoBoundWorkSlot::IoBoundWorkSlot(boost::asio::yield_context yc, CpuBoundWorkPool pool)
+	: yc(yc), m_Pool(pool)
 {
-	IoEngine::Get().m_CpuBoundSemaphore.fetch_add(1);
+	IoEngine::Get().ReleaseCpuBoundSlot(pool);
 }
 
 IoBoundWorkSlot::~IoBoundWorkSlot()
 {
-	auto& ioEngine (IoEngine::Get());
-
-	for (;;) {
-		auto availableSlots (ioEngine.m_CpuBoundSemaphore.fetch_sub(1));
-
-		if (availableSlots < 1) {
-			ioEngine.m_CpuBoundSemaphore.fetch_add(1);
-			IoEngine::YieldCurrentCoroutine(yc);
-			continue;
-		}
-
-		break;
-	}
+	IoEngine::Get().AcquireCpuBoundSlot(yc, m_Pool);
 }
 
 LazyInit<std::unique_ptr<IoEngine>> IoEngine::m_Instance ([]() { return std::unique_ptr<IoEngine>(new IoEngine()); });
@@ -88,7 +65,18 @@ boost::asio::io_context& IoEngine::GetIoContext()
 IoEngine::IoEngine() : m_IoContext(), m_KeepAlive(boost::asio::make_work_guard(m_IoContext)), m_Threads(decltype(m_Threads)::size_type(Configuration::Concurrency * 2u)), m_AlreadyExpiredTimer(m_IoContext)
 {
 	m_AlreadyExpiredTimer.expires_at(boost::posix_time::neg_infin);
-	m_CpuBoundSemaphore.store(Configuration::Concurrency * 3u / 2u);
+
+	int_fast32_t slots = Configuration::Concurrency * 3u / 2u;
+	int_fast32_t httpSlots = std::max<int_fast32_t>(slots / 3, 1);
+	int_fast32_t pluginResultSlots = std::max<int_fast32_t>(slots / 6, 1);
+
+	m_CpuBoundSlots[(size_t)CpuBoundWorkPool::JsonRpc].Slots = std::max<int_fast32_t>(slots - httpSlots - pluginResultSlots, 1);
+	m_CpuBoundSlots[(size_t)CpuBoundWorkPool::Http].Slots = httpSlots;
+	m_CpuBoundSlots[(size_t)CpuBoundWorkPool::PluginResults].Slots = pluginResultSlots;
+
+	for (auto& pool : m_CpuBoundSlots) {
+		pool.Free = pool.Slots;
+	}
 
 	for (auto& thread : m_Threads) {
 		thread = std::thread(&IoEngine::RunEventLoop, this);
@@ -106,6 +94,86 @@ IoEngine::~IoEngine()
 	}
 }
 
+/**
+ * Takes a slot of the pool, waits for one if there's none left.
+ *
+ * Waiting coroutines are resumed in the order they started waiting, by ReleaseCpuBoundSlot().
+ */
+void IoEngine::AcquireCpuBoundSlot(boost::asio::yield_context& yc, CpuBoundWorkPool pool)
+{
+	auto& slots (m_CpuBoundSlots[(size_t)pool]);
+
+	{
+		std::unique_lock<std::mutex> lock (slots.Mutex);
+
+		if (slots.Free > 0) {
+			slots.Free--;
+			return;
+		}
+	}
+
+	auto start (AtomicDuration::Clock::now());
+
+	boost::asio::async_initiate<boost::asio::yield_context, void()>([&slots](auto handler) {
+		std::unique_lock<std::mutex> lock (slots.Mutex);
+
+		if (slots.Free > 0) {
+			slots.Free--;
+			lock.unlock();
+
+			boost::asio::post(std::move(handler));
+			return;
+		}
+
+		// The handler may be move-only, but std::function has to be copyable.
+		auto sharedHandler (std::make_shared<decltype(handler)>(std::move(handler)));
+
+		slots.Waiters.emplace_back([sharedHandler]() {
+			// Resumes the coroutine on its own strand, not in the thread releasing the slot.
+			boost::asio::post(std::move(*sharedHandler));
+		});
+	}, yc);
+
+	slots.Waits.fetch_add(1);
+	slots.WaitTime += AtomicDuration::Clock::now() - start;
+}
+
+/**
+ * Gives a slot back to the pool or hands it over to the coroutine waiting the longest for it.
+ */
+void IoEngine::ReleaseCpuBoundSlot(CpuBoundWorkPool pool)
+{
+	auto& slots (m_CpuBoundSlots[(size_t)pool]);
+	std::function<void()> resume;
+
+	{
+		std::unique_lock<std::mutex> lock (slots.Mutex);
+
+		if (slots.Waiters.empty()) {
+			slots.Free++;
+			return;
+		}
+
+		resume = std::move(slots.Waiters.front());
+		slots.Waiters.pop_front();
+	}
+
+	resume();
+}
+
+CpuBoundWorkStats IoEngine::GetCpuBoundWorkStats(CpuBoundWorkPool pool)
+{
+	auto& slots (m_CpuBoundSlots[(size_t)pool]);
+	size_t queueLength;
+
+	{
+		std::unique_lock<std::mutex> lock (slots.Mutex);
+		queueLength = slots.Waiters.size();
+	}
+
+	return { slots.Slots, queueLength, slots.Waits.load(), slots.WaitTime };
+}
+
 void IoEngine::RunEventLoop()
 {
 	for (;;) {
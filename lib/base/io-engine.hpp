@@ -9,9 +9,14 @@
 #include "base/lazy-init.hpp"
 #include "base/logger.hpp"
 #include "base/shared.hpp"
+#include <array>
 #include <atomic>
+#include <cstdint>
+#include <deque>
 #include <exception>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -29,15 +34,46 @@
 namespace icinga
 {
 
+/**
+ * The kinds of CPU-bound work done in I/O threads, each of them has its own share of the slots
+ *
+ * @ingroup base
+ */
+enum class CpuBoundWorkPool : uint_fast8_t
+{
+	/* JSON-RPC messages, half of the slots. */
+	JsonRpc = 0,
+	/* HTTP requests, a third of the slots. */
+	Http = 1,
+	/* Check results of plugin workers, the remaining sixth of the slots. */
+	PluginResults = 2
+};
+
+/**
+ * Statistics of a CpuBoundWorkPool
+ *
+ * @ingroup base
+ */
+struct CpuBoundWorkStats
+{
+	int_fast32_t Slots;
+	size_t QueueLength;
+	uint_fast64_t Waits;
+	double WaitTime;
+};
+
 /**
  * Scope lock for CPU-bound work done in an I/O thread
  *
+ * If all slots of the pool are taken, the coroutine is suspended and queued.
+ * Every released slot is handed over to the longest waiting coroutine.
+ *
  * @ingroup base
  */
 class CpuBoundWork
 {
 public:
-	CpuBoundWork(boost::asio::yield_context yc);
+	CpuBoundWork(boost::asio::yield_context yc, CpuBoundWorkPool pool);
 	CpuBoundWork(const CpuBoundWork&) = delete;
 	CpuBoundWork(CpuBoundWork&&) = delete;
 	CpuBoundWork& operator=(const CpuBoundWork&) = delete;
@@ -47,6 +83,7 @@ public:
 	void Done();
 
 private:
+	CpuBoundWorkPool m_Pool;
 	bool m_Done;
 };
 
@@ -58,7 +95,7 @@ private:
 class IoBoundWorkSlot
 {
 public:
-	IoBoundWorkSlot(boost::asio::yield_context yc);
+	IoBoundWorkSlot(boost::asio::yield_context yc, CpuBoundWorkPool pool);
 	IoBoundWorkSlot(const IoBoundWorkSlot&) = delete;
 	IoBoundWorkSlot(IoBoundWorkSlot&&) = delete;
 	IoBoundWorkSlot& operator=(const IoBoundWorkSlot&) = delete;
@@ -67,6 +104,7 @@ public:
 
 private:
 	boost::asio::yield_context yc;
+	CpuBoundWorkPool m_Pool;
 };
 
 /**
@@ -90,6 +128,8 @@ public:
 
 	boost::asio::io_context& GetIoContext();
 
+	CpuBoundWorkStats GetCpuBoundWorkStats(CpuBoundWorkPool pool);
+
 	static inline size_t GetCoroutineStackSize() {
 #ifdef _WIN32
 		// Increase the stack size for Windows coroutines to prevent exception corruption.
@@ -140,17 +180,34 @@ public:
 	}
 
 private:
+	/**
+	 * The slots of a CpuBoundWorkPool. Free is only positive while nobody is waiting.
+	 */
+	struct CpuBoundSlots
+	{
+		std::mutex Mutex;
+		int_fast32_t Slots{0};
+		int_fast32_t Free{0};
+		std::deque<std::function<void()>> Waiters;
+
+		Atomic<uint_fast64_t> Waits{0};
+		AtomicDuration WaitTime;
+	};
+
 	IoEngine();
 
 	void RunEventLoop();
 
+	void AcquireCpuBoundSlot(boost::asio::yield_context& yc, CpuBoundWorkPool pool);
+	void ReleaseCpuBoundSlot(CpuBoundWorkPool pool);
+
 	static LazyInit<std::unique_ptr<IoEngine>> m_Instance;
 
 	boost::asio::io_context m_IoContext;
 	boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_KeepAlive;
 	std::vector<std::thread> m_Threads;
 	boost::asio::deadline_timer m_AlreadyExpiredTimer;
-	std::atomic_int_fast32_t m_CpuBoundSemaphore;
+	std::array<CpuBoundSlots, 3> m_CpuBoundSlots;
 };
 
 class TerminateIoThread : public std::exception
@@ -332,3 +332,23 @@ void NetString::WriteStringToStream(std::ostream& stream, const String& str)
 {
 	stream << str.GetLength() << ":" << str << ",";
 }
+
+/**
+ * Appends data in the netstring format to a buffer and returns bytes appended.
+ *
+ * @param buffer The buffer.
+ * @param str The String that is to be appended.
+ *
+ * @return The amount of bytes appended.
+ */
+size_t NetString::WriteStringToBuffer(std::string& buffer, const String& str)
+{
+	auto oldSize (buffer.size());
+
+	buffer += std::to_string(str.GetLength());
+	buffer += ':';
+	buffer.append(str.CStr(), str.GetLength());
+	buffer += ',';
+
+	return buffer.size() - oldSize;
+}
@@ -7,6 +7,7 @@
 #include "base/stream.hpp"
 #include "base/tlsstream.hpp"
 #include <memory>
+#include <string>
 #include <boost/asio/spawn.hpp>
 
 namespace icinga
@@ -33,6 +34,7 @@ public:
 	static size_t WriteStringToStream(const Shared<AsioTlsStream>::Ptr& stream, const String& message);
 	static size_t WriteStringToStream(const Shared<AsioTlsStream>::Ptr& stream, const String& message, boost::asio::yield_context yc);
 	static void WriteStringToStream(std::ostream& stream, const String& message);
+	static size_t WriteStringToBuffer(std::string& buffer, const String& message);
 
 private:
 	NetString();
@@ -2,12 +2,15 @@
 
 #include "base/object-packer.hpp"
 #include "base/debug.hpp"
+#include "base/exception.hpp"
 #include "base/dictionary.hpp"
 #include "base/array.hpp"
 #include "base/objectlock.hpp"
 #include <algorithm>
 #include <climits>
 #include <cstdint>
+#include <cstring>
+#include <stdexcept>
 #include <string>
 #include <utility>
 
@@ -244,3 +247,192 @@ String icinga::PackObject(const Value& value)
 
 	return builder;
 }
+
+/**
+ * Append the given value packed by PackObject(const Value&) to builder
+ */
+void icinga::PackObject(const Value& value, std::string& builder)
+{
+	PackAny(value, builder);
+}
+
+/* Packed values may come from peers. Arrays and dictionaries nested deeper than this are rejected
+ * rather than overflowing the stack, as unpacking them recurses once per level.
+ */
+static constexpr unsigned int l_UnpackMaxDepth = 128;
+
+static Value UnpackAny(const char*& begin, const char *end, unsigned int depth);
+
+/**
+ * Ensure that at least the given number of bytes is left
+ */
+static inline void UnpackRequire(const char *begin, const char *end, uint_least64_t bytes)
+{
+	if (uint_least64_t(end - begin) < bytes) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Unexpected end of packed value."));
+	}
+}
+
+/**
+ * Ensure that an array or dictionary isn't nested too deeply
+ */
+static inline void UnpackRequireDepth(unsigned int depth)
+{
+	if (depth > l_UnpackMaxDepth) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Packed value is nested too deeply."));
+	}
+}
+
+/**
+ * Read a big-endian 64-bit unsigned int
+ */
+static inline uint_least64_t UnpackUInt64BE(const char*& begin, const char *end)
+{
+	UnpackRequire(begin, end, 8);
+
+	uint_least64_t i = 0;
+
+	for (int n = 0; n < 8; n++) {
+		i = (i << 8u) | (unsigned char)*begin++;
+	}
+
+	return i;
+}
+
+/**
+ * Read a big-endian IEEE 754 binary64
+ */
+static inline double UnpackFloat64BE(const char*& begin, const char *end)
+{
+	UnpackRequire(begin, end, 8);
+
+	Double2BytesConverter converter;
+
+	memcpy(converter.buf, begin, 8);
+	begin += 8;
+
+	if (MACHINE_LITTLE_ENDIAN) {
+		SwapBytes(converter.buf[0], converter.buf[7]);
+		SwapBytes(converter.buf[1], converter.buf[6]);
+		SwapBytes(converter.buf[2], converter.buf[5]);
+		SwapBytes(converter.buf[3], converter.buf[4]);
+	}
+
+	return converter.f;
+}
+
+/**
+ * Read a string's length (BE uint64) and the string itself
+ */
+static inline String UnpackString(const char*& begin, const char *end)
+{
+	auto length (UnpackUInt64BE(begin, end));
+
+	UnpackRequire(begin, end, length);
+
+	String string (begin, begin + length);
+	begin += length;
+
+	return string;
+}
+
+/**
+ * Read an array nested in depth arrays and dictionaries (including itself)
+ */
+static inline Array::Ptr UnpackArray(const char*& begin, const char *end, unsigned int depth)
+{
+	UnpackRequireDepth(depth);
+
+	auto length (UnpackUInt64BE(begin, end));
+
+	// Every value takes at least one byte, don't let a bogus length allocate memory.
+	UnpackRequire(begin, end, length);
+
+	ArrayData values;
+	values.reserve(length);
+
+	for (uint_least64_t i = 0; i < length; i++) {
+		values.emplace_back(UnpackAny(begin, end, depth));
+	}
+
+	return new Array(std::move(values));
+}
+
+/**
+ * Read a dictionary nested in depth arrays and dictionaries (including itself)
+ */
+static inline Dictionary::Ptr UnpackDictionary(const char*& begin, const char *end, unsigned int depth)
+{
+	UnpackRequireDepth(depth);
+
+	auto length (UnpackUInt64BE(begin, end));
+
+	// Every key takes at least eight bytes and every value at least one.
+	UnpackRequire(begin, end, length);
+	UnpackRequire(begin, end, length * 9u);
+
+	Dictionary::Ptr dict = new Dictionary();
+
+	for (uint_least64_t i = 0; i < length; i++) {
+		String key = UnpackString(begin, end);
+		dict->Set(std::move(key), UnpackAny(begin, end, depth));
+	}
+
+	return dict;
+}
+
+/**
+ * Read any value packed by PackAny(), nested in depth arrays and dictionaries
+ */
+static Value UnpackAny(const char*& begin, const char *end, unsigned int depth)
+{
+	UnpackRequire(begin, end, 1);
+
+	switch (*begin++) {
+		case '\0':
+			return Empty;
+		case '\1':
+			return false;
+		case '\2':
+			return true;
+		case '\3':
+			return UnpackFloat64BE(begin, end);
+		case '\4':
+			return UnpackString(begin, end);
+		case '\5':
+			return UnpackArray(begin, end, depth + 1);
+		case '\6':
+			return UnpackDictionary(begin, end, depth + 1);
+		default:
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid packed value type."));
+	}
+}
+
+/**
+ * Unpack a value packed by PackObject(), the inverse of it
+ *
+ * Throws std::invalid_argument if packed is not exactly one packed value.
+ */
+Value icinga::UnpackObject(const String& packed)
+{
+	const char *begin = packed.CStr();
+	const char *end = begin + packed.GetLength();
+
+	Value value = UnpackAny(begin, end, 0);
+
+	if (begin != end) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Trailing data after packed value."));
+	}
+
+	return value;
+}
+
+/**
+ * Unpack the value packed by PackObject() at begin and advance begin behind it
+ *
+ * Throws std::invalid_argument if there's no complete packed value between begin and end.
+ */
+Value icinga::UnpackObject(const char*& begin, const char *end)
+{
+	return UnpackAny(begin, end, 0);
+}
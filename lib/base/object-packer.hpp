@@ -4,6 +4,7 @@
 #define OBJECT_PACKER
 
 #include "base/i2-base.hpp"
+#include <string>
 
 namespace icinga
 {
@@ -12,6 +13,10 @@ class String;
 class Value;
 
 String PackObject(const Value& value);
+void PackObject(const Value& value, std::string& builder);
+
+Value UnpackObject(const String& packed);
+Value UnpackObject(const char*& begin, const char *end);
 
 }
 
@@ -10,9 +10,13 @@
 #include "base/logger.hpp"
 #include "base/utility.hpp"
 #include "base/scriptglobal.hpp"
-#include "base/json.hpp"
+#include "base/configuration.hpp"
 #include <boost/algorithm/string/join.hpp>
 #include <boost/thread/once.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <set>
 #include <thread>
 #include <iostream>
 
@@ -21,6 +25,10 @@
 #	include <poll.h>
 #	include <signal.h>
 #	include <string.h>
+#	ifdef HAVE_EPOLL
+#		include <sys/epoll.h>
+#		include <sys/syscall.h>
+#	endif /* HAVE_EPOLL */
 
 #	ifndef __APPLE__
 extern char **environ;
@@ -32,19 +40,32 @@ extern char **environ;
 
 using namespace icinga;
 
-#define IOTHREADS 4
-
-static std::mutex l_ProcessMutex[IOTHREADS];
-static std::map<Process::ProcessHandle, Process::Ptr> l_Processes[IOTHREADS];
+/**
+ * The state of one of the threads which read the output of child processes.
+ */
+struct ProcessIOThread
+{
+	std::mutex Mutex;
+	std::map<Process::ProcessHandle, Process::Ptr> Processes;
 #ifdef _WIN32
-static HANDLE l_Events[IOTHREADS];
+	HANDLE Event;
 #else /* _WIN32 */
-static int l_EventFDs[IOTHREADS][2];
-static std::map<Process::ConsoleHandle, Process::ProcessHandle> l_FDs[IOTHREADS];
+	int EventFDs[2];
+	std::map<Process::ConsoleHandle, Process::ProcessHandle> FDs;
+#	ifdef HAVE_EPOLL
+	int EpollFD;
+	std::set<std::pair<double, Process::ProcessHandle>> Deadlines;
+#	endif /* HAVE_EPOLL */
+#endif /* _WIN32 */
+};
 
-static std::mutex l_ProcessControlMutex;
+static std::vector<std::unique_ptr<ProcessIOThread>> l_IOThreads;
+
+#ifndef _WIN32
+
+
+/* The control socket of the spawn helper we're running in (if any). */
 static int l_ProcessControlFD = -1;
-static pid_t l_ProcessControlPID;
 #endif /* _WIN32 */
 static boost::once_flag l_ProcessOnceFlag = BOOST_ONCE_INIT;
 static boost::once_flag l_SpawnHelperOnceFlag = BOOST_ONCE_INIT;
@@ -55,7 +76,7 @@ Process::Process(Process::Arguments arguments, Dictionary::Ptr extraEnvironment)
 #ifdef _WIN32
 	, m_ReadPending(false), m_ReadFailed(false), m_Overlapped()
 #else /* _WIN32 */
-	, m_SentSigterm(false)
+	, m_SentSigterm(false), m_SpawnHelper(0), m_PidFD(-1), m_OutputClosed(false)
 #endif /* _WIN32 */
 	, m_AdjustPriority(false), m_ResultAvailable(false)
 {
@@ -72,183 +93,297 @@ Process::~Process()
 }
 
 #ifndef _WIN32
-static Value ProcessSpawnImpl(struct msghdr *msgh, const Dictionary::Ptr& request)
+/**
+ * Returns the environment for child processes without the variables we set for each
+ * of them. It's built only once per spawn helper process as the helper's environment
+ * never changes after it has been started.
+ */
+static const std::vector<char *>& GetBaseEnvironment()
 {
-	struct cmsghdr *cmsg = CMSG_FIRSTHDR(msgh);
+	static const std::vector<char *> envp ([]() {
+		std::vector<char *> result;
+		const char* lcnumeric = "LC_NUMERIC=";
+		const char* notifySocket = "NOTIFY_SOCKET=";
 
-	if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * 3)) {
-		std::cerr << "Invalid 'spawn' request: FDs missing" << std::endl;
-		return Empty;
-	}
+		for (int i = 0; environ[i]; i++) {
+			if (strncmp(environ[i], lcnumeric, strlen(lcnumeric)) == 0) {
+				continue;
+			}
 
-	auto *fds = (int *)CMSG_DATA(cmsg);
+			if (strncmp(environ[i], notifySocket, strlen(notifySocket)) == 0) {
+				continue;
+			}
 
-	Array::Ptr arguments = request->Get("arguments");
-	Dictionary::Ptr extraEnvironment = request->Get("extraEnvironment");
-	bool adjustPriority = request->Get("adjustPriority");
+			result.emplace_back(environ[i]);
+		}
 
-	// build argv
-	auto **argv = new char *[arguments->GetLength() + 1];
+		return result;
+	}());
 
-	for (unsigned int i = 0; i < arguments->GetLength(); i++) {
-		String arg = arguments->Get(i);
-		argv[i] = strdup(arg.CStr());
-	}
+	return envp;
+}
 
-	argv[arguments->GetLength()] = nullptr;
+/**
+ * Reports a failure in a child process which has not called exec*() yet.
+ *
+ * Only uses async-signal-safe functions and doesn't touch any stdio buffers
+ * as the child may share its memory with the spawn helper (vfork).
+ */
+static void ProcessChildError(const char *message)
+{
+	const char *error = strerror(errno);
 
-	// build envp
-	int envc = 0;
+	(void)!write(STDERR_FILENO, message, strlen(message));
+	(void)!write(STDERR_FILENO, ": ", 2);
+	(void)!write(STDERR_FILENO, error, strlen(error));
+	(void)!write(STDERR_FILENO, "\n", 1);
+}
 
-	/* count existing environment variables */
-	while (environ[envc])
-		envc++;
+/**
+ * Sets up a freshly forked child process and executes the command.
+ */
+[[noreturn]] static void ProcessChildImpl(char **argv, char **envp, const int fds[3], bool adjustPriority)
+{
+	(void)close(l_ProcessControlFD);
 
-	auto **envp = new char *[envc + (extraEnvironment ? extraEnvironment->GetLength() : 0) + 2];
-	const char* lcnumeric = "LC_NUMERIC=";
-	const char* notifySocket = "NOTIFY_SOCKET=";
-	int j = 0;
+	if (setsid() < 0) {
+		ProcessChildError("setsid() failed");
+		_exit(128);
+	}
 
-	for (int i = 0; i < envc; i++) {
-		if (strncmp(environ[i], lcnumeric, strlen(lcnumeric)) == 0) {
-			continue;
-		}
+	if (dup2(fds[0], STDIN_FILENO) < 0 || dup2(fds[1], STDOUT_FILENO) < 0 || dup2(fds[2], STDERR_FILENO) < 0) {
+		ProcessChildError("dup2() failed");
+		_exit(128);
+	}
 
-		if (strncmp(environ[i], notifySocket, strlen(notifySocket)) == 0) {
-			continue;
-		}
+	(void)close(fds[0]);
+	(void)close(fds[1]);
+	(void)close(fds[2]);
 
-		envp[j] = strdup(environ[i]);
-		++j;
+#ifdef HAVE_NICE
+	if (adjustPriority) {
+		// Cheating the compiler on "warning: ignoring return value of 'int nice(int)', declared with attribute warn_unused_result [-Wunused-result]".
+		auto x (nice(5));
+		(void)x;
 	}
+#endif /* HAVE_NICE */
 
-	if (extraEnvironment) {
-		ObjectLock olock(extraEnvironment);
+	{
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
 
-		for (const Dictionary::Pair& kv : extraEnvironment) {
-			String skv = kv.first + "=" + Convert::ToString(kv.second);
-			envp[j] = strdup(skv.CStr());
-			j++;
+		sa.sa_handler = SIG_DFL;
+
+		for (int sig = 1; sig <= 31; ++sig) {
+			(void)sigaction(sig, &sa, nullptr);
 		}
 	}
 
-	envp[j] = strdup("LC_NUMERIC=C");
-	envp[j + 1] = nullptr;
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigprocmask(SIG_SETMASK, &mask, nullptr);
 
-	extraEnvironment.reset();
+	if (icinga2_execvpe(argv[0], argv, envp) < 0) {
+		char errmsg[512];
+		strcpy(errmsg, "execvpe(");
+		strncat(errmsg, argv[0], sizeof(errmsg) - strlen(errmsg) - 1);
+		strncat(errmsg, ") failed", sizeof(errmsg) - strlen(errmsg) - 1);
+		errmsg[sizeof(errmsg) - 1] = '\0';
+		ProcessChildError(errmsg);
+	}
 
-	pid_t pid = fork();
+	_exit(128);
+}
 
-	int errorCode = 0;
+/**
+ * The commands understood by the spawn helper.
+ */
+enum ProcessCommand : std::uint32_t
+{
+	ProcessCommandSpawn,
+	ProcessCommandWaitPID,
+	ProcessCommandKill
+};
+
+/**
+ * A request sent to a spawn helper.
+ *
+ * The spawn helpers are forked from the daemon itself, so both sides always
+ * agree on the layout and we can send the structs as they are. A spawn request
+ * is followed by PayloadLength bytes containing ArgumentCount arguments and
+ * EnvironmentCount "name=value" environment variables, each NUL-terminated.
+ */
+struct ProcessRequest
+{
+	std::uint32_t Command;
+	std::uint32_t AdjustPriority;
+	std::int32_t PID;
+	std::int32_t Signal;
+	std::uint32_t ArgumentCount;
+	std::uint32_t EnvironmentCount;
+	std::uint32_t PayloadLength;
+};
+
+/**
+ * A spawn helper's response to a request.
+ */
+struct ProcessResponse
+{
+	std::int32_t RC;
+	std::int32_t Errno;
+	std::int32_t Status;
+};
+
+/**
+ * A forked helper process which spawns, waits for and kills child processes
+ * on behalf of the daemon. Each helper handles one request at a time.
+ */
+struct SpawnHelper
+{
+	std::mutex Mutex;
+	int FD{-1};
+	pid_t PID{-1};
+};
 
-	if (pid < 0)
-		errorCode = errno;
+#define SPAWNHELPERS_MAX 8
 
-	if (pid == 0) {
-		// child process
+static SpawnHelper l_SpawnHelpers[SPAWNHELPERS_MAX];
+static unsigned int l_SpawnHelperCount = 1;
+static std::atomic<unsigned int> l_NextSpawnHelper (0);
+
+static bool ProcessRecvAll(int fd, void *buffer, size_t length)
+{
+	auto *data = static_cast<char *>(buffer);
 
-		(void)close(l_ProcessControlFD);
+	while (length > 0) {
+		ssize_t rc = recv(fd, data, length, 0);
 
-		if (setsid() < 0) {
-			perror("setsid() failed");
-			_exit(128);
-		}
+		if (rc <= 0) {
+			if (rc < 0 && errno == EINTR)
+				continue;
 
-		if (dup2(fds[0], STDIN_FILENO) < 0 || dup2(fds[1], STDOUT_FILENO) < 0 || dup2(fds[2], STDERR_FILENO) < 0) {
-			perror("dup2() failed");
-			_exit(128);
+			return false;
 		}
 
-		(void)close(fds[0]);
-		(void)close(fds[1]);
-		(void)close(fds[2]);
+		data += rc;
+		length -= rc;
+	}
 
-#ifdef HAVE_NICE
-		if (adjustPriority) {
-			// Cheating the compiler on "warning: ignoring return value of 'int nice(int)', declared with attribute warn_unused_result [-Wunused-result]".
-			auto x (nice(5));
-			(void)x;
-		}
-#endif /* HAVE_NICE */
+	return true;
+}
 
-		{
-			struct sigaction sa;
-			memset(&sa, 0, sizeof(sa));
+static bool ProcessSendAll(int fd, const void *buffer, size_t length)
+{
+	auto *data = static_cast<const char *>(buffer);
 
-			sa.sa_handler = SIG_DFL;
+	while (length > 0) {
+		ssize_t rc = send(fd, data, length, 0);
 
-			for (int sig = 1; sig <= 31; ++sig) {
-				(void)sigaction(sig, &sa, nullptr);
-			}
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return false;
 		}
 
-		sigset_t mask;
-		sigemptyset(&mask);
-		sigprocmask(SIG_SETMASK, &mask, nullptr);
-
-		if (icinga2_execvpe(argv[0], argv, envp) < 0) {
-			char errmsg[512];
-			strcpy(errmsg, "execvpe(");
-			strncat(errmsg, argv[0], sizeof(errmsg) - strlen(errmsg) - 1);
-			strncat(errmsg, ") failed", sizeof(errmsg) - strlen(errmsg) - 1);
-			errmsg[sizeof(errmsg) - 1] = '\0';
-			perror(errmsg);
+		data += rc;
+		length -= rc;
+	}
+
+	return true;
+}
+
+static ProcessResponse ProcessSpawnImpl(const int fds[3], const ProcessRequest& request, char *payload)
+{
+	ProcessResponse response = { -1, 0, 0 };
+
+	/* The arguments and environment variables are used right from the request's
+	 * payload which stays alive until the child has called exec*() (or exited). */
+	std::vector<char *> argv;
+	argv.reserve(request.ArgumentCount + 1u);
+
+	// build envp
+	static char lcnumeric[] = "LC_NUMERIC=C";
+	const std::vector<char *>& baseEnvironment = GetBaseEnvironment();
+
+	std::vector<char *> envp;
+	envp.reserve(baseEnvironment.size() + request.EnvironmentCount + 2u);
+	envp.insert(envp.end(), baseEnvironment.begin(), baseEnvironment.end());
+
+	char *end = payload + request.PayloadLength;
+
+	for (std::uint32_t i = 0; i < request.ArgumentCount + request.EnvironmentCount; i++) {
+		char *item = payload;
+
+		payload = static_cast<char *>(memchr(payload, '\0', end - payload));
+
+		if (!payload) {
+			response.Errno = EINVAL;
+			return response;
 		}
 
-		_exit(128);
+		payload++;
+
+		if (i < request.ArgumentCount)
+			argv.emplace_back(item);
+		else
+			envp.emplace_back(item);
 	}
 
-	(void)close(fds[0]);
-	(void)close(fds[1]);
-	(void)close(fds[2]);
+	if (argv.empty()) {
+		response.Errno = EINVAL;
+		return response;
+	}
+
+	argv.emplace_back(nullptr);
 
-	// free arguments
-	for (int i = 0; argv[i]; i++)
-		free(argv[i]);
+	envp.emplace_back(lcnumeric);
+	envp.emplace_back(nullptr);
 
-	delete[] argv;
+	/* The spawn helper is single-threaded, so we can use vfork() which neither copies
+	 * the page tables nor any memory. The parent is suspended until the child has called
+	 * exec*() or exited and ProcessChildImpl() is safe to be used in this situation. */
+#ifdef HAVE_VFORK
+	pid_t pid = vfork();
 
-	// free environment
-	for (int i = 0; envp[i]; i++)
-		free(envp[i]);
+	if (pid < 0)
+		pid = fork();
+#else /* HAVE_VFORK */
+	pid_t pid = fork();
+#endif /* HAVE_VFORK */
 
-	delete[] envp;
+	if (pid < 0)
+		response.Errno = errno;
 
-	Dictionary::Ptr response = new Dictionary({
-		{ "rc", pid },
-		{ "errno", errorCode }
-	});
+	if (pid == 0) {
+		// child process
+		ProcessChildImpl(argv.data(), envp.data(), fds, request.AdjustPriority);
+	}
+
+	response.RC = pid;
 
 	return response;
 }
 
-static Value ProcessKillImpl(const Dictionary::Ptr& request)
+static ProcessResponse ProcessKillImpl(const ProcessRequest& request)
 {
-	pid_t pid = request->Get("pid");
-	int signum = request->Get("signum");
+	ProcessResponse response = { 0, 0, 0 };
 
 	errno = 0;
-	kill(pid, signum);
-	int error = errno;
-
-	Dictionary::Ptr response = new Dictionary({
-		{ "errno", error }
-	});
+	response.RC = kill(request.PID, request.Signal);
+	response.Errno = errno;
 
 	return response;
 }
 
-static Value ProcessWaitPIDImpl(const Dictionary::Ptr& request)
+static ProcessResponse ProcessWaitPIDImpl(const ProcessRequest& request)
 {
-	pid_t pid = request->Get("pid");
+	ProcessResponse response = { 0, 0, 0 };
 
-	int status;
-	int rc = waitpid(pid, &status, 0);
-
-	Dictionary::Ptr response = new Dictionary({
-		{ "status", status },
-		{ "rc", rc }
-	});
+	int status = 0;
+	response.RC = waitpid(request.PID, &status, 0);
+	response.Errno = errno;
+	response.Status = status;
 
 	return response;
 }
@@ -261,24 +396,26 @@ static void ProcessHandler()
 
 	Utility::CloseAllFDs({0, 1, 2, l_ProcessControlFD});
 
+	std::vector<char> payload;
+
 	for (;;) {
-		size_t length;
+		ProcessRequest request;
 
 		struct msghdr msg;
 		memset(&msg, 0, sizeof(msg));
 
 		struct iovec io;
-		io.iov_base = &length;
-		io.iov_len = sizeof(length);
+		io.iov_base = &request;
+		io.iov_len = sizeof(request);
 
 		msg.msg_iov = &io;
 		msg.msg_iovlen = 1;
 
-		char cbuf[4096];
+		char cbuf[CMSG_SPACE(sizeof(int) * 3)];
 		msg.msg_control = cbuf;
 		msg.msg_controllen = sizeof(cbuf);
 
-		int rc = recvmsg(l_ProcessControlFD, &msg, 0);
+		ssize_t rc = recvmsg(l_ProcessControlFD, &msg, 0);
 
 		if (rc <= 0) {
 			if (rc < 0 && (errno == EINTR || errno == EAGAIN))
@@ -287,49 +424,44 @@ static void ProcessHandler()
 			break;
 		}
 
-		auto *mbuf = new char[length];
+		int fds[3] = { -1, -1, -1 };
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
 
-		size_t count = 0;
-		while (count < length) {
-			rc = recv(l_ProcessControlFD, mbuf + count, length - count, 0);
+		if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(int) * 3))
+			memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * 3);
 
-			if (rc <= 0) {
-				if (rc < 0 && (errno == EINTR || errno == EAGAIN))
-					continue;
+		if (!ProcessRecvAll(l_ProcessControlFD, reinterpret_cast<char *>(&request) + rc, sizeof(request) - rc))
+			_exit(0);
 
-				delete [] mbuf;
+		if (payload.size() < request.PayloadLength)
+			payload.resize(request.PayloadLength);
 
-				_exit(0);
-			}
+		if (!ProcessRecvAll(l_ProcessControlFD, payload.data(), request.PayloadLength))
+			_exit(0);
 
-			count += rc;
+		ProcessResponse response = { -1, EINVAL, 0 };
 
-			if (rc == 0)
+		switch (request.Command) {
+			case ProcessCommandSpawn:
+				if (fds[0] == -1)
+					std::cerr << "Invalid 'spawn' request: FDs missing" << std::endl;
+				else
+					response = ProcessSpawnImpl(fds, request, payload.data());
+				break;
+			case ProcessCommandWaitPID:
+				response = ProcessWaitPIDImpl(request);
+				break;
+			case ProcessCommandKill:
+				response = ProcessKillImpl(request);
 				break;
 		}
 
-		String jrequest = String(mbuf, mbuf + count);
-
-		delete [] mbuf;
-
-		Dictionary::Ptr request = JsonDecode(jrequest);
-
-		String command = request->Get("command");
-
-		Value response;
-
-		if (command == "spawn")
-			response = ProcessSpawnImpl(&msg, request);
-		else if (command == "waitpid")
-			response = ProcessWaitPIDImpl(request);
-		else if (command == "kill")
-			response = ProcessKillImpl(request);
-		else
-			response = Empty;
-
-		String jresponse = JsonEncode(response);
+		for (int fd : fds) {
+			if (fd != -1)
+				(void)close(fd);
+		}
 
-		if (send(l_ProcessControlFD, jresponse.CStr(), jresponse.GetLength(), 0) < 0) {
+		if (!ProcessSendAll(l_ProcessControlFD, &response, sizeof(response))) {
 			BOOST_THROW_EXCEPTION(posix_error()
 				<< boost::errinfo_api_function("send")
 				<< boost::errinfo_errno(errno));
@@ -339,13 +471,13 @@ static void ProcessHandler()
 	_exit(0);
 }
 
-static void StartSpawnProcessHelper()
+static void StartSpawnProcessHelper(SpawnHelper& helper)
 {
-	if (l_ProcessControlFD != -1) {
-		(void)close(l_ProcessControlFD);
+	if (helper.FD != -1) {
+		(void)close(helper.FD);
 
 		int status;
-		(void)waitpid(l_ProcessControlPID, &status, 0);
+		(void)waitpid(helper.PID, &status, 0);
 	}
 
 	int controlFDs[2];
@@ -366,6 +498,7 @@ static void StartSpawnProcessHelper()
 	if (pid == 0) {
 		(void)close(controlFDs[1]);
 
+		/* The other helpers' sockets are closed by ProcessHandler(). */
 		l_ProcessControlFD = controlFDs[0];
 
 		ProcessHandler();
@@ -375,179 +508,320 @@ static void StartSpawnProcessHelper()
 
 	(void)close(controlFDs[0]);
 
-	l_ProcessControlFD = controlFDs[1];
-	l_ProcessControlPID = pid;
+	helper.FD = controlFDs[1];
+	helper.PID = pid;
 }
 
-static pid_t ProcessSpawn(const std::vector<String>& arguments, const Dictionary::Ptr& extraEnvironment, bool adjustPriority, int fds[3])
+/**
+ * Sends a request to a spawn helper and waits for its response, restarting
+ * the helper if it has died. The caller must hold the helper's mutex.
+ */
+static ProcessResponse ProcessRequestHelper(SpawnHelper& helper, const ProcessRequest& request, const String& payload = String(), const int *fds = nullptr)
 {
-	Dictionary::Ptr request = new Dictionary({
-		{ "command", "spawn" },
-		{ "arguments", Array::FromVector(arguments) },
-		{ "extraEnvironment", extraEnvironment },
-		{ "adjustPriority", adjustPriority }
-	});
+	for (;;) {
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
 
-	String jrequest = JsonEncode(request);
-	size_t length = jrequest.GetLength();
+		struct iovec io[2];
+		io[0].iov_base = const_cast<ProcessRequest *>(&request);
+		io[0].iov_len = sizeof(request);
+		io[1].iov_base = const_cast<char *>(payload.CStr());
+		io[1].iov_len = payload.GetLength();
 
-	std::unique_lock<std::mutex> lock(l_ProcessControlMutex);
+		msg.msg_iov = io;
+		msg.msg_iovlen = payload.IsEmpty() ? 1 : 2;
 
-	struct msghdr msg;
-	memset(&msg, 0, sizeof(msg));
+		char cbuf[CMSG_SPACE(sizeof(int) * 3)];
 
-	struct iovec io;
-	io.iov_base = &length;
-	io.iov_len = sizeof(length);
+		if (fds) {
+			msg.msg_control = cbuf;
+			msg.msg_controllen = sizeof(cbuf);
 
-	msg.msg_iov = &io;
-	msg.msg_iovlen = 1;
+			struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+			cmsg->cmsg_level = SOL_SOCKET;
+			cmsg->cmsg_type = SCM_RIGHTS;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 3);
 
-	char cbuf[CMSG_SPACE(sizeof(int) * 3)];
-	msg.msg_control = cbuf;
-	msg.msg_controllen = sizeof(cbuf);
+			memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * 3);
 
-	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
-	cmsg->cmsg_level = SOL_SOCKET;
-	cmsg->cmsg_type = SCM_RIGHTS;
-	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 3);
+			msg.msg_controllen = cmsg->cmsg_len;
+		}
 
-	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * 3);
+		ssize_t rc = sendmsg(helper.FD, &msg, 0);
 
-	msg.msg_controllen = cmsg->cmsg_len;
+		if (rc < 0) {
+			if (errno != EINTR)
+				StartSpawnProcessHelper(helper);
 
-	do {
-		while (sendmsg(l_ProcessControlFD, &msg, 0) < 0) {
-			StartSpawnProcessHelper();
+			continue;
 		}
-	} while (send(l_ProcessControlFD, jrequest.CStr(), jrequest.GetLength(), 0) < 0);
 
-	char buf[4096];
+		/* The file descriptors have been passed along with the first byte, only send the rest. */
+		size_t sent = rc;
 
-	ssize_t rc = recv(l_ProcessControlFD, buf, sizeof(buf), 0);
-
-	if (rc <= 0)
-		return -1;
+		if (sent < sizeof(request)) {
+			if (!ProcessSendAll(helper.FD, reinterpret_cast<const char *>(&request) + sent, sizeof(request) - sent)
+				|| !ProcessSendAll(helper.FD, payload.CStr(), payload.GetLength())) {
+				StartSpawnProcessHelper(helper);
+				continue;
+			}
+		} else if (!ProcessSendAll(helper.FD, payload.CStr() + (sent - sizeof(request)), payload.GetLength() - (sent - sizeof(request)))) {
+			StartSpawnProcessHelper(helper);
+			continue;
+		}
 
-	String jresponse = String(buf, buf + rc);
+		break;
+	}
 
-	Dictionary::Ptr response = JsonDecode(jresponse);
+	ProcessResponse response;
 
-	if (response->Get("rc") == -1)
-		errno = response->Get("errno");
+	if (!ProcessRecvAll(helper.FD, &response, sizeof(response)))
+		return { -1, EIO, 0 };
 
-	return response->Get("rc");
+	return response;
 }
 
-static int ProcessKill(pid_t pid, int signum)
+static pid_t ProcessSpawn(const std::vector<String>& arguments, const Dictionary::Ptr& extraEnvironment, bool adjustPriority, int fds[3], unsigned int& helperIndex)
 {
-	Dictionary::Ptr request = new Dictionary({
-		{ "command", "kill" },
-		{ "pid", pid },
-		{ "signum", signum }
-	});
+	ProcessRequest request = { ProcessCommandSpawn, adjustPriority, 0, 0, 0, 0, 0 };
+	String payload;
+
+	for (const String& argument : arguments) {
+		payload += argument;
+		payload += String(1, '\0');
+	}
 
-	String jrequest = JsonEncode(request);
-	size_t length = jrequest.GetLength();
+	request.ArgumentCount = arguments.size();
 
-	std::unique_lock<std::mutex> lock(l_ProcessControlMutex);
+	if (extraEnvironment) {
+		ObjectLock olock(extraEnvironment);
 
-	do {
-		while (send(l_ProcessControlFD, &length, sizeof(length), 0) < 0) {
-			StartSpawnProcessHelper();
+		for (const Dictionary::Pair& kv : extraEnvironment) {
+			payload += kv.first + "=" + Convert::ToString(kv.second);
+			payload += String(1, '\0');
 		}
-	} while (send(l_ProcessControlFD, jrequest.CStr(), jrequest.GetLength(), 0) < 0);
 
-	char buf[4096];
+		request.EnvironmentCount = extraEnvironment->GetLength();
+	}
 
-	ssize_t rc = recv(l_ProcessControlFD, buf, sizeof(buf), 0);
+	request.PayloadLength = payload.GetLength();
 
-	if (rc <= 0)
-		return -1;
+	/* Prefer an idle helper, but don't spin if all of them are busy. */
+	unsigned int start = l_NextSpawnHelper.fetch_add(1) % l_SpawnHelperCount;
+	std::unique_lock<std::mutex> lock;
+
+	for (unsigned int i = 0; i < l_SpawnHelperCount; i++) {
+		helperIndex = (start + i) % l_SpawnHelperCount;
+		lock = std::unique_lock<std::mutex>(l_SpawnHelpers[helperIndex].Mutex, std::try_to_lock);
+
+		if (lock)
+			break;
+	}
+
+	if (!lock) {
+		helperIndex = start;
+		lock = std::unique_lock<std::mutex>(l_SpawnHelpers[helperIndex].Mutex);
+	}
+
+	ProcessResponse response = ProcessRequestHelper(l_SpawnHelpers[helperIndex], request, payload, fds);
 
-	String jresponse = String(buf, buf + rc);
+	if (response.RC == -1)
+		errno = response.Errno;
 
-	Dictionary::Ptr response = JsonDecode(jresponse);
-	return response->Get("errno");
+	return response.RC;
 }
 
-static int ProcessWaitPID(pid_t pid, int *status)
+static int ProcessKill(unsigned int helperIndex, pid_t pid, int signum)
 {
-	Dictionary::Ptr request = new Dictionary({
-		{ "command", "waitpid" },
-		{ "pid", pid }
-	});
+	ProcessRequest request = { ProcessCommandKill, 0, pid, signum, 0, 0, 0 };
 
-	String jrequest = JsonEncode(request);
-	size_t length = jrequest.GetLength();
+	std::unique_lock<std::mutex> lock(l_SpawnHelpers[helperIndex].Mutex);
 
-	std::unique_lock<std::mutex> lock(l_ProcessControlMutex);
+	ProcessResponse response = ProcessRequestHelper(l_SpawnHelpers[helperIndex], request);
 
-	do {
-		while (send(l_ProcessControlFD, &length, sizeof(length), 0) < 0) {
-			StartSpawnProcessHelper();
-		}
-	} while (send(l_ProcessControlFD, jrequest.CStr(), jrequest.GetLength(), 0) < 0);
+	if (response.RC == -1 && response.Errno == EIO)
+		return -1;
 
-	char buf[4096];
+	return response.Errno;
+}
 
-	ssize_t rc = recv(l_ProcessControlFD, buf, sizeof(buf), 0);
+static int ProcessWaitPID(unsigned int helperIndex, pid_t pid, int *status)
+{
+	ProcessRequest request = { ProcessCommandWaitPID, 0, pid, 0, 0, 0, 0 };
 
-	if (rc <= 0)
-		return -1;
+	std::unique_lock<std::mutex> lock(l_SpawnHelpers[helperIndex].Mutex);
 
-	String jresponse = String(buf, buf + rc);
+	ProcessResponse response = ProcessRequestHelper(l_SpawnHelpers[helperIndex], request);
 
-	Dictionary::Ptr response = JsonDecode(jresponse);
-	*status = response->Get("status");
-	return response->Get("rc");
+	*status = response.Status;
+	return response.RC;
 }
 
+/**
+ * Starts the spawn helpers. Child processes are spawned by one helper per
+ * available core (up to SPAWNHELPERS_MAX), so that spawning doesn't serialize
+ * on a single helper's socket round-trips.
+ */
 void Process::InitializeSpawnHelper()
 {
-	if (l_ProcessControlFD == -1)
-		StartSpawnProcessHelper();
+	if (l_SpawnHelpers[0].FD != -1)
+		return;
+
+	l_SpawnHelperCount = std::max(1, std::min(Configuration::Concurrency, SPAWNHELPERS_MAX));
+
+	for (unsigned int i = 0; i < l_SpawnHelperCount; i++)
+		StartSpawnProcessHelper(l_SpawnHelpers[i]);
+}
+
+/**
+ * Spawns a child process which isn't managed by Run(), e.g. a long-running
+ * worker which the caller talks to over its standard input and output.
+ *
+ * @param arguments The command
+ * @param extraEnvironment Additional environment variables
+ * @param adjustPriority Whether to lower the child's priority
+ * @param fds The child's stdin, stdout and stderr
+ * @param spawnHelper Receives the spawn helper which owns the child,
+ *                    it has to be passed to KillChild() and WaitChild()
+ * @return The child's PID or -1 (with errno set)
+ */
+pid_t Process::SpawnChild(const Arguments& arguments, const Dictionary::Ptr& extraEnvironment,
+	bool adjustPriority, int fds[3], unsigned int& spawnHelper)
+{
+	boost::call_once(l_SpawnHelperOnceFlag, &Process::InitializeSpawnHelper);
+
+	return ProcessSpawn(arguments, extraEnvironment, adjustPriority, fds, spawnHelper);
+}
+
+/**
+ * Sends a signal to a child spawned with SpawnChild().
+ *
+ * @return 0 or the error number
+ */
+int Process::KillChild(unsigned int spawnHelper, pid_t pid, int signum)
+{
+	return ProcessKill(spawnHelper, pid, signum);
+}
+
+/**
+ * Waits for a child spawned with SpawnChild() to exit and reaps it.
+ *
+ * @return The PID or -1
+ */
+int Process::WaitChild(unsigned int spawnHelper, pid_t pid, int *status)
+{
+	return ProcessWaitPID(spawnHelper, pid, status);
 }
 #endif /* _WIN32 */
 
-static void InitializeProcess()
+static void InitializeIOThread(ProcessIOThread& thread)
 {
 #ifdef _WIN32
-	for (auto& event : l_Events) {
-		event = CreateEvent(nullptr, TRUE, FALSE, nullptr);
-	}
+	thread.Event = CreateEvent(nullptr, TRUE, FALSE, nullptr);
 #else /* _WIN32 */
-	for (auto& eventFD : l_EventFDs) {
-#	ifdef HAVE_PIPE2
-		if (pipe2(eventFD, O_CLOEXEC) < 0) {
-			if (errno == ENOSYS) {
-#	endif /* HAVE_PIPE2 */
-				if (pipe(eventFD) < 0) {
-					BOOST_THROW_EXCEPTION(posix_error()
-						<< boost::errinfo_api_function("pipe")
-						<< boost::errinfo_errno(errno));
-				}
+	int *eventFD = thread.EventFDs;
 
-				Utility::SetCloExec(eventFD[0]);
-				Utility::SetCloExec(eventFD[1]);
 #	ifdef HAVE_PIPE2
-			} else {
+	if (pipe2(eventFD, O_CLOEXEC) < 0) {
+		if (errno == ENOSYS) {
+#	endif /* HAVE_PIPE2 */
+			if (pipe(eventFD) < 0) {
 				BOOST_THROW_EXCEPTION(posix_error()
-					<< boost::errinfo_api_function("pipe2")
+					<< boost::errinfo_api_function("pipe")
 					<< boost::errinfo_errno(errno));
 			}
+
+			Utility::SetCloExec(eventFD[0]);
+			Utility::SetCloExec(eventFD[1]);
+#	ifdef HAVE_PIPE2
+		} else {
+			BOOST_THROW_EXCEPTION(posix_error()
+				<< boost::errinfo_api_function("pipe2")
+				<< boost::errinfo_errno(errno));
 		}
+	}
 #	endif /* HAVE_PIPE2 */
+
+#	ifdef HAVE_EPOLL
+	thread.EpollFD = epoll_create1(EPOLL_CLOEXEC);
+
+	if (thread.EpollFD < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("epoll_create1")
+			<< boost::errinfo_errno(errno));
+	}
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = eventFD[0];
+
+	if (epoll_ctl(thread.EpollFD, EPOLL_CTL_ADD, eventFD[0], &event) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("epoll_ctl")
+			<< boost::errinfo_errno(errno));
 	}
+#	endif /* HAVE_EPOLL */
 #endif /* _WIN32 */
 }
 
-INITIALIZE_ONCE(InitializeProcess);
+#ifdef HAVE_EPOLL
+/**
+ * Registers one of a process' file descriptors with an I/O thread's epoll instance.
+ * The caller must hold the thread's mutex.
+ */
+static void AddIOThreadFD(ProcessIOThread& thread, int fd, Process::ProcessHandle process, uint32_t events)
+{
+	epoll_event event = {};
+	event.events = events;
+	event.data.fd = fd;
+
+	if (epoll_ctl(thread.EpollFD, EPOLL_CTL_ADD, fd, &event) < 0) {
+		Log(LogCritical, "Process")
+			<< "epoll_ctl() failed for PID " << process << ": " << Utility::FormatErrorNumber(errno);
+		return;
+	}
+
+	thread.FDs[fd] = process;
+}
+
+/**
+ * Closes one of a process' file descriptors which also removes it from the epoll instance.
+ * The caller must hold the thread's mutex.
+ */
+static void RemoveIOThreadFD(ProcessIOThread& thread, int fd)
+{
+	thread.FDs.erase(fd);
+	(void)close(fd);
+}
+
+/**
+ * Opens a file descriptor which becomes readable once the process has exited.
+ *
+ * The children belong to the spawn helpers which don't reap them before we ask
+ * them to, so the PID can't be reused in the meantime.
+ */
+static int OpenPidFD(pid_t pid)
+{
+#	ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#	else /* SYS_pidfd_open */
+	errno = ENOSYS;
+	return -1;
+#	endif /* SYS_pidfd_open */
+}
+#endif /* HAVE_EPOLL */
 
 void Process::ThreadInitialize()
 {
 	/* Note to self: Make sure this runs _after_ we've daemonized. */
-	for (int tid = 0; tid < IOTHREADS; tid++) {
+	int count = std::max(1, Configuration::ProcessIOThreads);
+
+	for (int tid = 0; tid < count; tid++) {
+		l_IOThreads.emplace_back(new ProcessIOThread());
+		InitializeIOThread(*l_IOThreads.back());
+	}
+
+	for (int tid = 0; tid < count; tid++) {
 		std::thread t([tid]() { IOThreadProc(tid); });
 		t.detach();
 	}
@@ -608,6 +882,96 @@ bool Process::GetAdjustPriority() const
 
 void Process::IOThreadProc(int tid)
 {
+	ProcessIOThread& thread (*l_IOThreads[tid]);
+
+	Utility::SetThreadName("ProcessIO");
+
+#ifdef HAVE_EPOLL
+	/* Processes are looked up by their handle as an earlier event of the same
+	 * batch may have finished (and released) them already. */
+	auto handleEvents ([&thread](Process::ProcessHandle handle) {
+		auto it (thread.Processes.find(handle));
+
+		if (it == thread.Processes.end())
+			return; /* This should never happen. */
+
+		Process::Ptr process = it->second;
+		bool hasDeadline = process->m_Timeout != 0;
+		double deadline = process->m_Result.ExecutionStart + process->GetNextTimeout();
+
+		if (process->DoEvents()) {
+			if (process->m_OutputClosed && process->m_FD != -1) {
+				RemoveIOThreadFD(thread, process->m_FD);
+				process->m_FD = -1;
+			}
+
+			double nextDeadline = process->m_Result.ExecutionStart + process->GetNextTimeout();
+
+			if (hasDeadline && nextDeadline != deadline) {
+				thread.Deadlines.erase({ deadline, handle });
+				thread.Deadlines.emplace(nextDeadline, handle);
+			}
+
+			return;
+		}
+
+		if (hasDeadline)
+			thread.Deadlines.erase({ deadline, handle });
+
+		if (process->m_FD != -1)
+			RemoveIOThreadFD(thread, process->m_FD);
+
+		if (process->m_PidFD != -1)
+			RemoveIOThreadFD(thread, process->m_PidFD);
+
+		thread.Processes.erase(it);
+	});
+
+	epoll_event events[128];
+
+	for (;;) {
+		int timeout = -1;
+
+		{
+			std::unique_lock<std::mutex> lock(thread.Mutex);
+
+			if (!thread.Deadlines.empty()) {
+				double delta = std::min(thread.Deadlines.begin()->first - Utility::GetTime(), 3600.0);
+
+				timeout = std::max(10, static_cast<int>(std::ceil(delta * 1000)));
+			}
+		}
+
+		int rc = epoll_wait(thread.EpollFD, events, sizeof(events) / sizeof(events[0]), timeout);
+
+		if (rc < 0)
+			continue;
+
+		std::unique_lock<std::mutex> lock(thread.Mutex);
+
+		for (int i = 0; i < rc; i++) {
+			int fd = events[i].data.fd;
+
+			if (fd == thread.EventFDs[0]) {
+				char buffer[512];
+				if (read(fd, buffer, sizeof(buffer)) < 0)
+					Log(LogCritical, "base", "Read from event FD failed.");
+
+				continue;
+			}
+
+			auto it (thread.FDs.find(fd));
+
+			if (it != thread.FDs.end())
+				handleEvents(it->second);
+		}
+
+		double now = Utility::GetTime();
+
+		while (!thread.Deadlines.empty() && thread.Deadlines.begin()->first < now)
+			handleEvents(thread.Deadlines.begin()->second);
+	}
+#else /* HAVE_EPOLL */
 #ifdef _WIN32
 	HANDLE *handles = nullptr;
 	HANDLE *fhandles = nullptr;
@@ -617,33 +981,31 @@ void Process::IOThreadProc(int tid)
 	int count = 0;
 	double now;
 
-	Utility::SetThreadName("ProcessIO");
-
 	for (;;) {
 		double timeout = -1;
 
 		now = Utility::GetTime();
 
 		{
-			std::unique_lock<std::mutex> lock(l_ProcessMutex[tid]);
+			std::unique_lock<std::mutex> lock(thread.Mutex);
 
-			count = 1 + l_Processes[tid].size();
+			count = 1 + thread.Processes.size();
 #ifdef _WIN32
 			handles = reinterpret_cast<HANDLE *>(realloc(handles, sizeof(HANDLE) * count));
 			fhandles = reinterpret_cast<HANDLE *>(realloc(fhandles, sizeof(HANDLE) * count));
 
-			fhandles[0] = l_Events[tid];
+			fhandles[0] = thread.Event;
 
 #else /* _WIN32 */
 			pfds = reinterpret_cast<pollfd *>(realloc(pfds, sizeof(pollfd) * count));
 
-			pfds[0].fd = l_EventFDs[tid][0];
+			pfds[0].fd = thread.EventFDs[0];
 			pfds[0].events = POLLIN;
 			pfds[0].revents = 0;
 #endif /* _WIN32 */
 
 			int i = 1;
-			for (auto& kv : l_Processes[tid]) {
+			for (auto& kv : thread.Processes) {
 				const Process::Ptr& process = kv.second;
 #ifdef _WIN32
 				handles[i] = kv.first;
@@ -693,32 +1055,32 @@ void Process::IOThreadProc(int tid)
 		now = Utility::GetTime();
 
 		{
-			std::unique_lock<std::mutex> lock(l_ProcessMutex[tid]);
+			std::unique_lock<std::mutex> lock(thread.Mutex);
 
 #ifdef _WIN32
 			if (rc == WAIT_OBJECT_0)
-				ResetEvent(l_Events[tid]);
+				ResetEvent(thread.Event);
 #else /* _WIN32 */
 			if (pfds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
 				char buffer[512];
-				if (read(l_EventFDs[tid][0], buffer, sizeof(buffer)) < 0)
+				if (read(thread.EventFDs[0], buffer, sizeof(buffer)) < 0)
 					Log(LogCritical, "base", "Read from event FD failed.");
 			}
 #endif /* _WIN32 */
 
 			for (int i = 1; i < count; i++) {
 #ifdef _WIN32
-				auto it = l_Processes[tid].find(handles[i]);
+				auto it = thread.Processes.find(handles[i]);
 #else /* _WIN32 */
-				auto it2 = l_FDs[tid].find(pfds[i].fd);
+				auto it2 = thread.FDs.find(pfds[i].fd);
 
-				if (it2 == l_FDs[tid].end())
+				if (it2 == thread.FDs.end())
 					continue; /* This should never happen. */
 
-				auto it = l_Processes[tid].find(it2->second);
+				auto it = thread.Processes.find(it2->second);
 #endif /* _WIN32 */
 
-				if (it == l_Processes[tid].end())
+				if (it == thread.Processes.end())
 					continue; /* This should never happen. */
 
 				bool is_timeout = false;
@@ -740,15 +1102,16 @@ void Process::IOThreadProc(int tid)
 						CloseHandle(it->first);
 						CloseHandle(it->second->m_FD);
 #else /* _WIN32 */
-						l_FDs[tid].erase(it->second->m_FD);
+						thread.FDs.erase(it->second->m_FD);
 						(void)close(it->second->m_FD);
 #endif /* _WIN32 */
-						l_Processes[tid].erase(it);
+						thread.Processes.erase(it);
 					}
 				}
 			}
 		}
 	}
+#endif /* HAVE_EPOLL */
 }
 
 String Process::PrettyPrintArguments(const Process::Arguments& arguments)
@@ -940,7 +1303,7 @@ void Process::Run(const std::function<void(const ProcessResult&)>& callback)
 			 * callback is active and making it crash safe
 			 */
 			Process::Ptr process(this);
-			Utility::QueueAsyncCallback([this, process, callback]() { callback(m_Result); });
+			Utility::QueueAsyncCallback([this, process, callback]() { callback(m_Result); }, LowLatencyScheduler);
 		}
 
 		return;
@@ -991,7 +1354,7 @@ void Process::Run(const std::function<void(const ProcessResult&)>& callback)
 	fds[1] = outfds[1];
 	fds[2] = outfds[1];
 
-	m_Process = ProcessSpawn(m_Arguments, m_ExtraEnvironment, m_AdjustPriority, fds);
+	m_Process = ProcessSpawn(m_Arguments, m_ExtraEnvironment, m_AdjustPriority, fds, m_SpawnHelper);
 	m_PID = m_Process;
 
 	if (m_PID == -1) {
@@ -1007,24 +1370,49 @@ void Process::Run(const std::function<void(const ProcessResult&)>& callback)
 	Utility::SetNonBlocking(outfds[0]);
 
 	m_FD = outfds[0];
+
+#ifdef HAVE_EPOLL
+	if (m_PID != -1)
+		m_PidFD = OpenPidFD(m_PID);
+#endif /* HAVE_EPOLL */
 #endif /* _WIN32 */
 
 	m_Callback = callback;
 
-	int tid = GetTID();
+	ProcessIOThread& thread (*l_IOThreads[GetTID()]);
+	bool wakeup = true;
 
 	{
-		std::unique_lock<std::mutex> lock(l_ProcessMutex[tid]);
-		l_Processes[tid][m_Process] = this;
-#ifndef _WIN32
-		l_FDs[tid][m_FD] = m_Process;
-#endif /* _WIN32 */
+		std::unique_lock<std::mutex> lock(thread.Mutex);
+		thread.Processes[m_Process] = this;
+#ifdef HAVE_EPOLL
+		AddIOThreadFD(thread, m_FD, m_Process, EPOLLIN | EPOLLET);
+
+		/* Edge-triggered, as a process which has exited may still have its output open. */
+		if (m_PidFD != -1)
+			AddIOThreadFD(thread, m_PidFD, m_Process, EPOLLIN | EPOLLET);
+
+		/* The thread only needs to be woken up if it has to wait for a shorter time now. */
+		wakeup = false;
+
+		if (m_Timeout != 0) {
+			double deadline = m_Result.ExecutionStart + GetNextTimeout();
+
+			wakeup = thread.Deadlines.empty() || deadline < thread.Deadlines.begin()->first;
+			thread.Deadlines.emplace(deadline, m_Process);
+		}
+#elif !defined(_WIN32) /* HAVE_EPOLL */
+		thread.FDs[m_FD] = m_Process;
+#endif /* HAVE_EPOLL */
 	}
 
+	if (!wakeup)
+		return;
+
 #ifdef _WIN32
-	SetEvent(l_Events[tid]);
+	SetEvent(thread.Event);
 #else /* _WIN32 */
-	if (write(l_EventFDs[tid][1], "T", 1) < 0 && errno != EINTR && errno != EAGAIN)
+	if (write(thread.EventFDs[1], "T", 1) < 0 && errno != EINTR && errno != EAGAIN)
 		Log(LogCritical, "base", "Write to event FD failed.");
 #endif /* _WIN32 */
 }
@@ -1057,7 +1445,7 @@ bool Process::DoEvents()
 
 				m_OutputStream << "<Timeout exceeded.>";
 
-				int error = ProcessKill(m_Process, SIGTERM);
+				int error = ProcessKill(m_SpawnHelper, m_Process, SIGTERM);
 				if (error) {
 					Log(LogWarning, "Process")
 						<< "Couldn't terminate the process " << m_PID << " (" << PrettyPrintArguments(m_Arguments)
@@ -1081,7 +1469,7 @@ bool Process::DoEvents()
 			m_OutputStream << "<Timeout exceeded.>";
 			TerminateProcess(m_Process, 3);
 #else /* _WIN32 */
-			int error = ProcessKill(-m_Process, SIGKILL);
+			int error = ProcessKill(m_SpawnHelper, -m_Process, SIGKILL);
 			if (error) {
 				Log(LogWarning, "Process")
 					<< "Couldn't kill the process group " << m_PID << " (" << PrettyPrintArguments(m_Arguments)
@@ -1108,6 +1496,9 @@ bool Process::DoEvents()
 #else /* _WIN32 */
 		char buffer[512];
 		for (;;) {
+			if (m_OutputClosed)
+				break;
+
 			int rc = read(m_FD, buffer, sizeof(buffer));
 
 			if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
@@ -1120,6 +1511,19 @@ bool Process::DoEvents()
 
 			break;
 		}
+
+#	ifdef HAVE_EPOLL
+		/* The process may have closed its output while it's still running. Wait for it to exit
+		 * rather than blocking this thread and the spawn helper in waitpid(). */
+		if (m_PidFD != -1) {
+			pollfd pfd = { m_PidFD, POLLIN, 0 };
+
+			if (poll(&pfd, 1, 0) == 0) {
+				m_OutputClosed = true;
+				return true;
+			}
+		}
+#	endif /* HAVE_EPOLL */
 #endif /* _WIN32 */
 	}
 
@@ -1137,7 +1541,7 @@ bool Process::DoEvents()
 	int status, exitcode;
 	if (could_not_kill || m_PID == -1) {
 		exitcode = 128;
-	} else if (ProcessWaitPID(m_Process, &status) != m_Process) {
+	} else if (ProcessWaitPID(m_SpawnHelper, m_Process, &status) != m_Process) {
 		exitcode = 128;
 
 		Log(LogWarning, "Process")
@@ -1193,7 +1597,7 @@ bool Process::DoEvents()
 		 * callback is active and making it crash safe
 		 */
 		Process::Ptr process(this);
-		Utility::QueueAsyncCallback([this, process]() { m_Callback(m_Result); });
+		Utility::QueueAsyncCallback([this, process]() { m_Callback(m_Result); }, LowLatencyScheduler);
 	}
 
 	return false;
@@ -1207,7 +1611,7 @@ pid_t Process::GetPID() const
 
 int Process::GetTID() const
 {
-	return (reinterpret_cast<uintptr_t>(this) / sizeof(void *)) % IOTHREADS;
+	return (reinterpret_cast<uintptr_t>(this) / sizeof(void *)) % l_IOThreads.size();
 }
 
 double Process::GetNextTimeout() const
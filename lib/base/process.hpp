@@ -76,6 +76,11 @@ public:
 
 #ifndef _WIN32
 	static void InitializeSpawnHelper();
+
+	static pid_t SpawnChild(const Arguments& arguments, const Dictionary::Ptr& extraEnvironment,
+		bool adjustPriority, int fds[3], unsigned int& spawnHelper);
+	static int KillChild(unsigned int spawnHelper, pid_t pid, int signum);
+	static int WaitChild(unsigned int spawnHelper, pid_t pid, int *status);
 #endif /* _WIN32 */
 
 private:
@@ -85,6 +90,9 @@ private:
 	double m_Timeout;
 #ifndef _WIN32
 	bool m_SentSigterm;
+	unsigned int m_SpawnHelper;
+	int m_PidFD;
+	bool m_OutputClosed;
 #endif /* _WIN32 */
 
 	bool m_AdjustPriority;
@@ -1,11 +1,16 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/threadpool.hpp"
-#include <boost/thread/locks.hpp>
+#include "base/defer.hpp"
 
 using namespace icinga;
 
-ThreadPool::ThreadPool() : m_Pending(0)
+/* The pool and the index of the current thread's worker, if it's a pool thread. */
+static thread_local ThreadPool *l_CurrentPool = nullptr;
+static thread_local size_t l_CurrentWorker = 0;
+
+ThreadPool::ThreadPool()
+	: m_Running(false), m_Enqueuing(0), m_Pending(0), m_LanePending{{0}, {0}}, m_Stolen(0), m_NextWorker(0), m_Idle(0)
 {
 	Start();
 }
@@ -17,35 +22,251 @@ ThreadPool::~ThreadPool()
 
 void ThreadPool::Start()
 {
-	boost::unique_lock<decltype(m_Mutex)> lock (m_Mutex);
+	std::unique_lock<std::mutex> lock (m_Mutex);
 
-	if (!m_Pool) {
+	if (!m_Running.load()) {
 		InitializePool();
 	}
 }
 
 void ThreadPool::InitializePool()
 {
-	m_Pool = decltype(m_Pool)(new boost::asio::thread_pool(Configuration::Concurrency * 2u));
+	size_t threads = Configuration::Concurrency * 2u;
+
+	m_Workers.clear();
+
+	for (size_t i = 0; i < threads; i++) {
+		m_Workers.emplace_back(new Worker());
+	}
+
+	/* Publishes m_Workers before the threads are started and work items are accepted. */
+	m_Running.store(true);
+
+	for (size_t i = 0; i < threads; i++) {
+		m_Workers[i]->Thread = std::thread([this, i]() { WorkerThreadProc(i); });
+	}
+}
+
+/**
+ * Stops accepting new work items and waits for the threads to finish all queued ones.
+ */
+void ThreadPool::JoinPool()
+{
+	m_Running.store(false);
+
+	/* Enqueue() calls which have seen m_Running being true are still using m_Workers.
+	 * Once they're done, m_Pending covers all accepted work items.
+	 */
+	while (m_Enqueuing.load()) {
+		std::this_thread::yield();
+	}
+
+	{
+		std::unique_lock<std::mutex> lock (m_IdleMutex);
+		m_IdleCV.notify_all();
+	}
+
+	for (auto& worker : m_Workers) {
+		if (worker->Thread.joinable()) {
+			worker->Thread.join();
+		}
+	}
+
+	/* The threads don't exit before the queues are empty, this just makes sure accepted work items run. */
+	for (auto& worker : m_Workers) {
+		for (int lane = 0; lane < m_LaneCount; lane++) {
+			while (!worker->Queues[lane].empty()) {
+				WorkFunction callback (std::move(worker->Queues[lane].front()));
+				worker->Queues[lane].pop_front();
+
+				m_LanePending[lane].fetch_sub(1);
+				m_Pending.fetch_sub(1);
+
+				RunWork(callback);
+			}
+		}
+	}
+
+	m_Workers.clear();
 }
 
 void ThreadPool::Stop()
 {
-	boost::unique_lock<decltype(m_Mutex)> lock (m_Mutex);
+	std::unique_lock<std::mutex> lock (m_Mutex);
 
-	if (m_Pool) {
-		m_Pool->join();
-		m_Pool = nullptr;
+	if (m_Running.load()) {
+		JoinPool();
 	}
 }
 
 void ThreadPool::Restart()
 {
-	boost::unique_lock<decltype(m_Mutex)> lock (m_Mutex);
+	std::unique_lock<std::mutex> lock (m_Mutex);
 
-	if (m_Pool) {
-		m_Pool->join();
+	if (m_Running.load()) {
+		JoinPool();
 	}
 
 	InitializePool();
 }
+
+/**
+ * Returns the amount of queued tasks of the given policy not started yet.
+ *
+ * @param policy The scheduling lane.
+ * @returns amount of queued tasks.
+ */
+uint_fast64_t ThreadPool::GetPending(SchedulerPolicy policy)
+{
+	return m_LanePending[policy].load();
+}
+
+/**
+ * Returns the amount of tasks which have been started by another thread than the one they were queued for.
+ *
+ * @returns amount of stolen tasks.
+ */
+uint_fast64_t ThreadPool::GetStolen()
+{
+	return m_Stolen.load();
+}
+
+bool ThreadPool::Enqueue(WorkFunction callback, SchedulerPolicy policy)
+{
+	/* Keeps JoinPool() from stopping the threads and InitializePool() from replacing m_Workers meanwhile.
+	 * m_Enqueuing first: if JoinPool() has missed it, we'll see m_Running being false.
+	 */
+	m_Enqueuing.fetch_add(1);
+
+	Defer enqueued ([this]() { m_Enqueuing.fetch_sub(1); });
+
+	if (!m_Running.load()) {
+		return false;
+	}
+
+	m_Pending.fetch_add(1);
+
+	size_t index;
+
+	if (l_CurrentPool == this) {
+		index = l_CurrentWorker;
+	} else {
+		index = m_NextWorker.fetch_add(1) % m_Workers.size();
+	}
+
+	m_LanePending[policy].fetch_add(1);
+
+	{
+		auto& worker (*m_Workers[index]);
+		std::unique_lock<std::mutex> lock (worker.Mutex);
+
+		worker.Queues[policy].emplace_back(std::move(callback));
+	}
+
+	if (m_Idle.load()) {
+		std::unique_lock<std::mutex> lock (m_IdleMutex);
+		m_IdleCV.notify_one();
+	}
+
+	return true;
+}
+
+bool ThreadPool::Dequeue(size_t index, int lane, WorkFunction& callback)
+{
+	auto& worker (*m_Workers[index]);
+	std::unique_lock<std::mutex> lock (worker.Mutex);
+	auto& queue (worker.Queues[lane]);
+
+	if (queue.empty()) {
+		return false;
+	}
+
+	callback = std::move(queue.front());
+	queue.pop_front();
+
+	return true;
+}
+
+/**
+ * Takes the next work item from the thread's own queues or steals one from the other threads' queues.
+ *
+ * @param index The thread's worker index.
+ * @param round Counts the work items taken by the thread, used to prefer the default lane now and then.
+ * @param callback Receives the work item.
+ * @returns true if a work item was taken, false otherwise.
+ */
+bool ThreadPool::TakeWork(size_t index, unsigned int round, WorkFunction& callback)
+{
+	int lanes[m_LaneCount] = { LowLatencyScheduler, DefaultScheduler };
+
+	if (round % m_DefaultLaneInterval == 0) {
+		std::swap(lanes[0], lanes[1]);
+	}
+
+	for (int lane : lanes) {
+		if (!m_LanePending[lane].load()) {
+			continue;
+		}
+
+		for (size_t i = 0; i < m_Workers.size(); i++) {
+			if (Dequeue((index + i) % m_Workers.size(), lane, callback)) {
+				m_LanePending[lane].fetch_sub(1);
+
+				if (i) {
+					m_Stolen.fetch_add(1);
+				}
+
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::WorkerThreadProc(size_t index)
+{
+	l_CurrentPool = this;
+	l_CurrentWorker = index;
+
+	for (unsigned int round = 1;; round++) {
+		WorkFunction callback;
+
+		while (!TakeWork(index, round, callback)) {
+			std::unique_lock<std::mutex> lock (m_IdleMutex);
+
+			m_Idle.fetch_add(1);
+
+			/* m_Pending is also non-zero while a work item is being queued and not visible yet. */
+			m_IdleCV.wait(lock, [this]() { return m_Pending.load() || !m_Running.load(); });
+
+			m_Idle.fetch_sub(1);
+
+			/* m_Running first: once it's false, no more work items are accepted and m_Pending only decreases. */
+			if (!m_Running.load() && !m_Pending.load()) {
+				l_CurrentPool = nullptr;
+				return;
+			}
+
+			lock.unlock();
+			std::this_thread::yield();
+		}
+
+		m_Pending.fetch_sub(1);
+
+		RunWork(callback);
+	}
+}
+
+void ThreadPool::RunWork(WorkFunction& callback)
+{
+	try {
+		callback();
+	} catch (const std::exception& ex) {
+		Log(LogCritical, "ThreadPool")
+			<< "Exception thrown in event handler:\n"
+			<< DiagnosticInformation(ex);
+	} catch (...) {
+		Log(LogCritical, "ThreadPool", "Exception of unknown type thrown in event handler.");
+	}
+}
@@ -7,15 +7,16 @@
 #include "base/configuration.hpp"
 #include "base/exception.hpp"
 #include "base/logger.hpp"
+#include <condition_variable>
 #include <cstddef>
+#include <deque>
 #include <exception>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <thread>
-#include <boost/asio/post.hpp>
-#include <boost/asio/thread_pool.hpp>
-#include <boost/thread/locks.hpp>
-#include <boost/thread/shared_mutex.hpp>
+#include <utility>
+#include <vector>
 #include <cstdint>
 
 namespace icinga
@@ -28,7 +29,14 @@ enum SchedulerPolicy
 };
 
 /**
- * A thread pool.
+ * A work-stealing thread pool.
+ *
+ * Each thread has its own queue per scheduler policy. Work items posted by a pool thread
+ * go to that thread's queue, others are distributed round-robin. Idle threads steal work
+ * from the other threads' queues. Work items posted with LowLatencyScheduler are preferred
+ * over those posted with DefaultScheduler.
+ *
+ * Work items are only started in FIFO order per thread, not across the whole pool.
  *
  * @ingroup base
  */
@@ -45,37 +53,17 @@ public:
 	void Restart();
 
 	/**
-	 * Appends a work item to the work queue. Work items will be processed in FIFO order.
+	 * Appends a work item to the work queue. Work items of the same policy posted to the
+	 * same thread will be started in FIFO order.
 	 *
 	 * @param callback The callback function for the work item.
+	 * @param policy The scheduling lane for the work item.
 	 * @returns true if the item was queued, false otherwise.
 	 */
 	template<class T>
-	bool Post(T callback, SchedulerPolicy)
+	bool Post(T callback, SchedulerPolicy policy)
 	{
-		boost::shared_lock<decltype(m_Mutex)> lock (m_Mutex);
-
-		if (m_Pool) {
-			m_Pending.fetch_add(1);
-
-			boost::asio::post(*m_Pool, [this, callback]() {
-				m_Pending.fetch_sub(1);
-
-				try {
-					callback();
-				} catch (const std::exception& ex) {
-					Log(LogCritical, "ThreadPool")
-						<< "Exception thrown in event handler:\n"
-						<< DiagnosticInformation(ex);
-				} catch (...) {
-					Log(LogCritical, "ThreadPool", "Exception of unknown type thrown in event handler.");
-				}
-			});
-
-			return true;
-		} else {
-			return false;
-		}
+		return Enqueue(WorkFunction(std::move(callback)), policy);
 	}
 
 	/**
@@ -88,12 +76,45 @@ public:
 		return m_Pending.load();
 	}
 
+	uint_fast64_t GetPending(SchedulerPolicy policy);
+	uint_fast64_t GetStolen();
+
 private:
-	boost::shared_mutex m_Mutex;
-	std::unique_ptr<boost::asio::thread_pool> m_Pool;
+	/* Indexed by SchedulerPolicy. */
+	static constexpr int m_LaneCount = 2;
+
+	/* Every n-th work item is taken from the default lane first, so that it can't starve. */
+	static constexpr unsigned int m_DefaultLaneInterval = 16;
+
+	struct Worker
+	{
+		std::mutex Mutex;
+		std::deque<WorkFunction> Queues[m_LaneCount];
+		std::thread Thread;
+	};
+
+	std::mutex m_Mutex;
+	std::vector<std::unique_ptr<Worker>> m_Workers;
+	Atomic<bool> m_Running;
+	/* The Enqueue() calls in progress, JoinPool() waits for them before it stops the threads. */
+	Atomic<uint_fast64_t> m_Enqueuing;
 	Atomic<uint_fast64_t> m_Pending;
+	Atomic<uint_fast64_t> m_LanePending[m_LaneCount];
+	Atomic<uint_fast64_t> m_Stolen;
+	Atomic<size_t> m_NextWorker;
+
+	std::mutex m_IdleMutex;
+	std::condition_variable m_IdleCV;
+	Atomic<size_t> m_Idle;
 
 	void InitializePool();
+	void JoinPool();
+	void RunWork(WorkFunction& callback);
+
+	bool Enqueue(WorkFunction callback, SchedulerPolicy policy);
+	bool Dequeue(size_t index, int lane, WorkFunction& callback);
+	bool TakeWork(size_t index, unsigned int round, WorkFunction& callback);
+	void WorkerThreadProc(size_t index);
 };
 
 }
@@ -0,0 +1,428 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+namespace icinga
+{
+
+/**
+ * A hierarchical timing wheel which keeps items ordered by their due time
+ * with a granularity of a configurable resolution.
+ *
+ * Inserting, rescheduling and removing an item which stays in the wheel's slots are
+ * O(1) operations. Those items are kept in doubly-linked lists per slot whose nodes
+ * live inside a hash map, so rescheduling them doesn't allocate any memory.
+ *
+ * Items which are due within the current tick or already overdue are kept ordered by
+ * their exact due time instead, so that the next one is found in O(1). Inserting and
+ * removing those takes O(log n) in their number and allocates an entry each. Otherwise
+ * items which are due within the same tick are not ordered by their exact due time.
+ *
+ * This class is not thread-safe.
+ *
+ * @ingroup base
+ */
+template<class T, class Hash = std::hash<T>>
+class TimingWheel
+{
+public:
+	explicit TimingWheel(double resolution = 0.01, double now = 0);
+
+	TimingWheel(const TimingWheel&) = delete;
+	TimingWheel& operator=(const TimingWheel&) = delete;
+
+	void Insert(const T& item, double when);
+	bool Remove(const T& item);
+	bool Contains(const T& item) const;
+
+	bool PopExpired(double now, T& item, double& when);
+	bool GetNextExpiry(double now, double& when);
+
+	inline std::size_t GetLength() const noexcept
+	{
+		return m_Nodes.size();
+	}
+
+	inline bool IsEmpty() const noexcept
+	{
+		return m_Nodes.empty();
+	}
+
+	inline double GetResolution() const noexcept
+	{
+		return m_Resolution;
+	}
+
+private:
+	static constexpr unsigned int LevelBits = 8;
+	static constexpr unsigned int Levels = 4;
+	static constexpr std::uint64_t SlotsPerLevel = std::uint64_t(1) << LevelBits;
+	static constexpr std::uint64_t SlotMask = SlotsPerLevel - 1u;
+
+	struct Node;
+
+	struct Slot
+	{
+		Node *Head = nullptr;
+	};
+
+	typedef std::multimap<double, Node*> DueMap;
+
+	struct Node
+	{
+		const T *Item = nullptr;
+		double When = 0;
+		std::uint64_t Tick = 0;
+		Slot *Owner = nullptr;
+		Node *Prev = nullptr;
+		Node *Next = nullptr;
+
+		/* Set if the node is in m_Due rather than in a slot. */
+		bool Due = false;
+		typename DueMap::iterator DueEntry;
+	};
+
+	double m_Resolution;
+	std::uint64_t m_CurrentTick;
+
+	std::unordered_map<T, Node, Hash> m_Nodes;
+	std::array<std::array<Slot, SlotsPerLevel>, Levels> m_Wheels;
+
+	/* Items which are due within the current tick (or already overdue), by their due time. */
+	DueMap m_Due;
+
+	/* Items which are too far in the future for the wheel's range. */
+	Slot m_Overflow;
+
+	std::uint64_t ToTick(double when) const;
+
+	void Link(Node *node);
+	void Unlink(Node *node);
+	static void Push(Slot& slot, Node *node);
+
+	void Cascade(Slot& slot);
+	void Advance(std::uint64_t tick);
+	bool GetNextTick(std::uint64_t& tick) const;
+};
+
+/**
+ * Creates a new timing wheel.
+ *
+ * @param resolution The duration of one tick in seconds
+ * @param now The current time, i.e. the position the wheel starts at
+ */
+template<class T, class Hash>
+TimingWheel<T, Hash>::TimingWheel(double resolution, double now)
+	: m_Resolution(resolution), m_CurrentTick(0)
+{
+	m_CurrentTick = ToTick(now);
+}
+
+/**
+ * Adds an item to the wheel or reschedules it if it's already known.
+ *
+ * @param item The item
+ * @param when The time the item is due at
+ */
+template<class T, class Hash>
+void TimingWheel<T, Hash>::Insert(const T& item, double when)
+{
+	auto res (m_Nodes.try_emplace(item));
+	Node *node = &res.first->second;
+
+	if (res.second) {
+		node->Item = &res.first->first;
+	} else {
+		Unlink(node);
+	}
+
+	node->When = when;
+	node->Tick = ToTick(when);
+
+	Link(node);
+}
+
+/**
+ * Removes an item from the wheel.
+ *
+ * @param item The item
+ * @return Whether the item has been scheduled before
+ */
+template<class T, class Hash>
+bool TimingWheel<T, Hash>::Remove(const T& item)
+{
+	auto it (m_Nodes.find(item));
+
+	if (it == m_Nodes.end()) {
+		return false;
+	}
+
+	Unlink(&it->second);
+	m_Nodes.erase(it);
+
+	return true;
+}
+
+template<class T, class Hash>
+bool TimingWheel<T, Hash>::Contains(const T& item) const
+{
+	return m_Nodes.find(item) != m_Nodes.end();
+}
+
+/**
+ * Advances the wheel to the specified time and removes one item which is due.
+ *
+ * @param now The current time
+ * @param item Receives the item
+ * @param when Receives the time the item was due at
+ * @return Whether an item was due
+ */
+template<class T, class Hash>
+bool TimingWheel<T, Hash>::PopExpired(double now, T& item, double& when)
+{
+	Advance(ToTick(now));
+
+	if (m_Due.empty() || m_Due.begin()->first > now) {
+		return false;
+	}
+
+	Node *node = m_Due.begin()->second;
+
+	Unlink(node);
+
+	item = *node->Item;
+	when = node->When;
+
+	m_Nodes.erase(item);
+
+	return true;
+}
+
+/**
+ * Advances the wheel to the specified time and determines when the next item will be due.
+ *
+ * The returned time is exact for items which are due within the current tick. Otherwise
+ * it's a lower bound which is never later than the real due time of the next item.
+ *
+ * @param now The current time
+ * @param when Receives the time
+ * @return Whether there are any items at all
+ */
+template<class T, class Hash>
+bool TimingWheel<T, Hash>::GetNextExpiry(double now, double& when)
+{
+	Advance(ToTick(now));
+
+	if (!m_Due.empty()) {
+		when = m_Due.begin()->first;
+		return true;
+	}
+
+	std::uint64_t tick;
+
+	if (!GetNextTick(tick)) {
+		return false;
+	}
+
+	when = tick * m_Resolution;
+	return true;
+}
+
+template<class T, class Hash>
+std::uint64_t TimingWheel<T, Hash>::ToTick(double when) const
+{
+	if (!(when > 0)) {
+		return 0;
+	}
+
+	auto tick (static_cast<std::uint64_t>(std::floor(when / m_Resolution)));
+
+	/* Compensate for rounding errors, so that the time of a tick maps back to it. */
+	if ((tick + 1u) * m_Resolution <= when) {
+		tick++;
+	}
+
+	return tick;
+}
+
+/**
+ * Puts a node into the slot which matches its tick relative to the current tick.
+ *
+ * A node is put into the lowest level whose slot index is the only difference
+ * between its tick and the current tick, so that it gets cascaded down into
+ * the lower levels once the current tick approaches it.
+ */
+template<class T, class Hash>
+void TimingWheel<T, Hash>::Link(Node *node)
+{
+	if (node->Tick <= m_CurrentTick) {
+		node->Owner = nullptr;
+		node->Due = true;
+		node->DueEntry = m_Due.emplace(node->When, node);
+		return;
+	}
+
+	for (unsigned int level = 0; level < Levels; level++) {
+		unsigned int shift = LevelBits * (level + 1u);
+
+		if ((node->Tick >> shift) == (m_CurrentTick >> shift)) {
+			Push(m_Wheels[level][(node->Tick >> (LevelBits * level)) & SlotMask], node);
+			return;
+		}
+	}
+
+	Push(m_Overflow, node);
+}
+
+template<class T, class Hash>
+void TimingWheel<T, Hash>::Unlink(Node *node)
+{
+	if (node->Due) {
+		m_Due.erase(node->DueEntry);
+		node->Due = false;
+		return;
+	}
+
+	if (node->Prev) {
+		node->Prev->Next = node->Next;
+	} else {
+		node->Owner->Head = node->Next;
+	}
+
+	if (node->Next) {
+		node->Next->Prev = node->Prev;
+	}
+
+	node->Owner = nullptr;
+	node->Prev = nullptr;
+	node->Next = nullptr;
+}
+
+template<class T, class Hash>
+void TimingWheel<T, Hash>::Push(Slot& slot, Node *node)
+{
+	node->Owner = &slot;
+	node->Prev = nullptr;
+	node->Next = slot.Head;
+
+	if (slot.Head) {
+		slot.Head->Prev = node;
+	}
+
+	slot.Head = node;
+}
+
+/**
+ * Re-distributes all nodes of the specified slot according to the current tick.
+ */
+template<class T, class Hash>
+void TimingWheel<T, Hash>::Cascade(Slot& slot)
+{
+	Node *node = slot.Head;
+
+	slot.Head = nullptr;
+
+	while (node) {
+		Node *next = node->Next;
+
+		Link(node);
+
+		node = next;
+	}
+}
+
+/**
+ * Moves the current tick forward, cascading higher level slots into lower ones
+ * and collecting the nodes which became due.
+ */
+template<class T, class Hash>
+void TimingWheel<T, Hash>::Advance(std::uint64_t tick)
+{
+	while (m_CurrentTick < tick) {
+		std::uint64_t following = m_CurrentTick + 1u;
+
+		if ((following & SlotMask) == 0u || !m_Wheels[0][following & SlotMask].Head) {
+			std::uint64_t next;
+
+			/* Nothing can happen before the next non-empty slot is reached,
+			 * neither expiration nor cascading, so we can skip ahead. */
+			if (!GetNextTick(next) || next > tick) {
+				m_CurrentTick = tick;
+				return;
+			}
+
+			if (next > following) {
+				m_CurrentTick = next - 1u;
+			}
+		}
+
+		m_CurrentTick++;
+
+		if ((m_CurrentTick & ((std::uint64_t(1) << (LevelBits * Levels)) - 1u)) == 0u) {
+			Cascade(m_Overflow);
+		}
+
+		for (unsigned int level = Levels - 1u; level > 0; level--) {
+			if ((m_CurrentTick & ((std::uint64_t(1) << (LevelBits * level)) - 1u)) == 0u) {
+				Cascade(m_Wheels[level][(m_CurrentTick >> (LevelBits * level)) & SlotMask]);
+			}
+		}
+
+		Cascade(m_Wheels[0][m_CurrentTick & SlotMask]);
+	}
+}
+
+/**
+ * Determines the earliest tick at which either a slot expires or cascades.
+ *
+ * @param tick Receives the tick
+ * @return Whether any slot is non-empty
+ */
+template<class T, class Hash>
+bool TimingWheel<T, Hash>::GetNextTick(std::uint64_t& tick) const
+{
+	bool found = false;
+
+	for (unsigned int level = 0; level < Levels; level++) {
+		unsigned int shift = LevelBits * level;
+		std::uint64_t base = (m_CurrentTick >> (shift + LevelBits)) << (shift + LevelBits);
+
+		for (std::uint64_t index = ((m_CurrentTick >> shift) & SlotMask) + 1u; index < SlotsPerLevel; index++) {
+			if (m_Wheels[level][index].Head) {
+				std::uint64_t candidate = base | (index << shift);
+
+				if (!found || candidate < tick) {
+					tick = candidate;
+					found = true;
+				}
+
+				break;
+			}
+		}
+	}
+
+	if (m_Overflow.Head) {
+		unsigned int shift = LevelBits * Levels;
+		std::uint64_t candidate = ((m_CurrentTick >> shift) + 1u) << shift;
+
+		if (!found || candidate < tick) {
+			tick = candidate;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+}
+
+#endif /* TIMINGWHEEL_H */
@@ -981,6 +981,15 @@ void Utility::SetNonBlockingSocket(SOCKET s, bool nb)
 #endif /* _WIN32 */
 }
 
+/**
+ * Runs a callback in the global thread pool.
+ *
+ * Only callbacks queued by the same thread of the pool are started in the order they were queued in.
+ * Others are spread across the pool's threads and may start in any order, see ThreadPool.
+ *
+ * @param callback The callback
+ * @param policy The scheduling lane
+ */
 void Utility::QueueAsyncCallback(const std::function<void ()>& callback, SchedulerPolicy policy)
 {
 	Application::GetTP().Post(callback, policy);
@@ -14,6 +14,7 @@
 #include "base/exception.hpp"
 #include "base/convert.hpp"
 #include "base/statsfunction.hpp"
+#include <algorithm>
 #include <chrono>
 
 using namespace icinga;
@@ -29,15 +30,20 @@ void CheckerComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr
 	for (const CheckerComponent::Ptr& checker : ConfigType::GetObjectsByType<CheckerComponent>()) {
 		unsigned long idle = checker->GetIdleCheckables();
 		unsigned long pending = checker->GetPendingCheckables();
-
-		nodes.emplace_back(checker->GetName(), new Dictionary({
-			{ "idle", idle },
-			{ "pending", pending }
-		}));
+		double slotWaitTime = checker->GetSlotWaitTime();
 
 		String perfdata_prefix = "checkercomponent_" + checker->GetName() + "_";
 		perfdata->Add(new PerfdataValue(perfdata_prefix + "idle", Convert::ToDouble(idle)));
 		perfdata->Add(new PerfdataValue(perfdata_prefix + "pending", Convert::ToDouble(pending)));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "slot_wait_time", slotWaitTime, true, "seconds"));
+
+		nodes.emplace_back(checker->GetName(), new Dictionary({
+			{ "idle", idle },
+			{ "pending", pending },
+			{ "shards", checker->GetSchedulerShards() },
+			{ "slot_wait_time", slotWaitTime },
+			{ "check_latency", checker->GetCheckLatencyStats(perfdata_prefix, perfdata) }
+		}));
 	}
 
 	status->Set("checkercomponent", new Dictionary(std::move(nodes)));
@@ -45,6 +51,17 @@ void CheckerComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr
 
 void CheckerComponent::OnConfigLoaded()
 {
+	int shards = GetSchedulerShards();
+
+	m_Shards.reserve(shards);
+
+	for (int i = 0; i < shards; i++) {
+		m_Shards.emplace_back(new Shard());
+
+		if (GetUseTimingWheel())
+			m_Shards.back()->IdleWheel.reset(new TimingWheel<Checkable::Ptr>(0.01, Utility::GetTime()));
+	}
+
 	ConfigObject::OnActiveChanged.connect([this](const ConfigObject::Ptr& object, const Value&) {
 		ObjectHandler(object);
 	});
@@ -55,6 +72,14 @@ void CheckerComponent::OnConfigLoaded()
 	Checkable::OnNextCheckChanged.connect([this](const Checkable::Ptr& checkable, const Value&) {
 		NextCheckChangedHandler(checkable);
 	});
+
+	Checkable::OnPendingCheckSlotReleased.connect([this]() {
+		PendingCheckSlotReleasedHandler();
+	});
+
+	Checkable::OnNewCheckResult.connect([this](const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, const MessageOrigin::Ptr& origin) {
+		CheckResultHandler(checkable, cr, origin);
+	});
 }
 
 void CheckerComponent::Start(bool runtimeCreated)
@@ -64,8 +89,18 @@ void CheckerComponent::Start(bool runtimeCreated)
 	Log(LogInformation, "CheckerComponent")
 		<< "'" << GetName() << "' started.";
 
+	for (size_t i = 0; i < m_Shards.size(); i++) {
+		Shard& shard = *m_Shards[i];
 
-	m_Thread = std::thread([this]() { CheckThreadProc(); });
+		shard.Thread = std::thread([this, &shard, i]() {
+			if (m_Shards.size() > 1)
+				Utility::SetThreadName("Check Sched #" + Convert::ToString(i));
+			else
+				Utility::SetThreadName("Check Scheduler");
+
+			CheckThreadProc(shard);
+		});
+	}
 
 	m_ResultTimer = Timer::Create();
 	m_ResultTimer->SetInterval(5);
@@ -75,15 +110,17 @@ void CheckerComponent::Start(bool runtimeCreated)
 
 void CheckerComponent::Stop(bool runtimeRemoved)
 {
-	{
-		std::unique_lock<std::mutex> lock(m_Mutex);
-		m_Stopped = true;
-		m_CV.notify_all();
+	for (auto& shard : m_Shards) {
+		std::unique_lock<std::mutex> lock(shard->Mutex);
+		shard->Stopped = true;
+		shard->CV.notify_all();
 	}
 
 	m_WaitGroup->Join();
 	m_ResultTimer->Stop(true);
-	m_Thread.join();
+
+	for (auto& shard : m_Shards)
+		shard->Thread.join();
 
 	Log(LogInformation, "CheckerComponent")
 		<< "'" << GetName() << "' stopped.";
@@ -91,27 +128,43 @@ void CheckerComponent::Stop(bool runtimeRemoved)
 	ObjectImpl<CheckerComponent>::Stop(runtimeRemoved);
 }
 
-void CheckerComponent::CheckThreadProc()
+void CheckerComponent::ValidateSchedulerShards(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<CheckerComponent>::ValidateSchedulerShards(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "scheduler_shards" }, "Value must be greater than 0."));
+}
+
+/**
+ * Returns the shard responsible for scheduling the specified checkable.
+ *
+ * @param checkable The checkable.
+ * @return The shard.
+ */
+CheckerComponent::Shard& CheckerComponent::GetShard(const Checkable::Ptr& checkable)
+{
+	if (m_Shards.size() == 1)
+		return *m_Shards.front();
+
+	return *m_Shards[std::hash<String>()(checkable->GetName()) % m_Shards.size()];
+}
+
+void CheckerComponent::CheckThreadProc(Shard& shard)
 {
-	Utility::SetThreadName("Check Scheduler");
 	IcingaApplication::Ptr icingaApp = IcingaApplication::GetInstance();
 
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	std::unique_lock<std::mutex> lock(shard.Mutex);
 
 	for (;;) {
-		typedef boost::multi_index::nth_index<CheckableSet, 1>::type CheckTimeView;
-		CheckTimeView& idx = boost::get<1>(m_IdleCheckables);
-
-		while (idx.begin() == idx.end() && !m_Stopped)
-			m_CV.wait(lock);
+		while (shard.GetIdleCount() == 0 && !shard.Stopped)
+			shard.CV.wait(lock);
 
-		if (m_Stopped)
+		if (shard.Stopped)
 			break;
 
-		auto it = idx.begin();
-		CheckableScheduleInfo csi = *it;
-
-		double wait = csi.NextCheck - Utility::GetTime();
+		double now = Utility::GetTime();
+		double wait = shard.GetNextIdleCheck(now) - now;
 
 //#ifdef I2_DEBUG
 //		Log(LogDebug, "CheckerComponent")
@@ -119,80 +172,157 @@ void CheckerComponent::CheckThreadProc()
 //			<< " vs. max concurrent checks " << icingaApp->GetMaxConcurrentChecks() << ".";
 //#endif /* I2_DEBUG */
 
-		if (Checkable::GetPendingChecks() >= icingaApp->GetMaxConcurrentChecks())
-			wait = 0.5;
+		int budget = icingaApp->GetMaxConcurrentChecks() - Checkable::GetPendingChecks();
 
-		if (wait > 0) {
-			/* Wait for the next check. */
-			m_CV.wait_for(lock, std::chrono::duration<double>(wait));
+		if (budget <= 0 && wait <= 0) {
+			/* Wait for a running check to release its slot, see PendingCheckSlotReleasedHandler(). */
+			if (shard.BlockedSince == 0)
+				shard.BlockedSince = now;
+
+			shard.CV.wait(lock);
 
 			continue;
 		}
 
-		Checkable::Ptr checkable = csi.Object;
+		if (shard.BlockedSince > 0) {
+			shard.SlotWaitTime += now - shard.BlockedSince;
+			shard.BlockedSince = 0;
+		}
 
-		m_IdleCheckables.erase(checkable);
+		if (wait > 0) {
+			/* Wait for the next check. */
+			shard.CV.wait_for(lock, std::chrono::duration<double>(wait));
 
-		bool forced = checkable->GetForceNextCheck();
-		bool check = true;
-		bool notifyNextCheck = false;
-		double nextCheck = -1;
+			continue;
+		}
 
-		if (!forced) {
-			if (!checkable->IsReachable(DependencyCheckExecution)) {
-				Log(LogNotice, "CheckerComponent")
-					<< "Skipping check for object '" << checkable->GetName() << "': Dependency failed.";
+		/* Take all checkables which are due right now, as many as the concurrency limit allows.
+		 * The other shards take slots at the same time, so each one is reserved right away.
+		 */
+		std::vector<Checkable::Ptr> batch;
 
-				check = false;
-				notifyNextCheck = true;
-			}
+		for (;;) {
+			Checkable::Ptr checkable = shard.TakeIdle(now);
 
-			Host::Ptr host;
-			Service::Ptr service;
-			tie(host, service) = GetHostService(checkable);
+			if (!checkable)
+				break;
 
-			if (host && !service && (!checkable->GetEnableActiveChecks() || !icingaApp->GetEnableHostChecks())) {
-				Log(LogNotice, "CheckerComponent")
-					<< "Skipping check for host '" << host->GetName() << "': active host checks are disabled";
-				check = false;
-			}
-			if (host && service && (!checkable->GetEnableActiveChecks() || !icingaApp->GetEnableServiceChecks())) {
-				Log(LogNotice, "CheckerComponent")
-					<< "Skipping check for service '" << service->GetName() << "': active service checks are disabled";
-				check = false;
+			if (!Checkable::TryAquirePendingCheckSlot(icingaApp->GetMaxConcurrentChecks())) {
+				shard.InsertIdle(checkable);
+				break;
 			}
 
-			TimePeriod::Ptr tp = checkable->GetCheckPeriod();
-
-			if (tp) {
-				auto ts (Utility::GetTime());
-				ObjectLock oLock (tp);
+			batch.emplace_back(std::move(checkable));
+		}
 
-				if (!tp->IsInside(ts)) {
-					nextCheck = tp->FindNextTransition(ts);
+		if (batch.empty())
+			continue;
 
-					if (nextCheck <= 0) {
-						nextCheck = tp->GetValidEnd();
-					}
+		lock.unlock();
 
+		struct SkippedCheck
+		{
+			Checkable::Ptr Object;
+			double NextCheck;
+			bool NotifyNextCheck;
+		};
+
+		std::vector<Checkable::Ptr> checks;
+		std::vector<SkippedCheck> skipped;
+		std::vector<Checkable::Ptr> forcedChecks;
+
+		for (auto& checkable : batch) {
+			bool forced = checkable->GetForceNextCheck();
+			bool check = true;
+			bool notifyNextCheck = false;
+			double nextCheck = -1;
+
+			if (!forced) {
+				if (!checkable->IsReachable(DependencyCheckExecution)) {
 					Log(LogNotice, "CheckerComponent")
-						<< "Skipping check for object '" << checkable->GetName()
-						<< "', as not in check period '" << tp->GetName() << "', until "
-						<< Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", nextCheck);
+						<< "Skipping check for object '" << checkable->GetName() << "': Dependency failed.";
 
 					check = false;
 					notifyNextCheck = true;
 				}
+
+				Host::Ptr host;
+				Service::Ptr service;
+				tie(host, service) = GetHostService(checkable);
+
+				if (host && !service && (!checkable->GetEnableActiveChecks() || !icingaApp->GetEnableHostChecks())) {
+					Log(LogNotice, "CheckerComponent")
+						<< "Skipping check for host '" << host->GetName() << "': active host checks are disabled";
+					check = false;
+				}
+				if (host && service && (!checkable->GetEnableActiveChecks() || !icingaApp->GetEnableServiceChecks())) {
+					Log(LogNotice, "CheckerComponent")
+						<< "Skipping check for service '" << service->GetName() << "': active service checks are disabled";
+					check = false;
+				}
+
+				TimePeriod::Ptr tp = checkable->GetCheckPeriod();
+
+				if (tp) {
+					auto ts (Utility::GetTime());
+					ObjectLock oLock (tp);
+
+					if (!tp->IsInside(ts)) {
+						nextCheck = tp->FindNextTransition(ts);
+
+						if (nextCheck <= 0) {
+							nextCheck = tp->GetValidEnd();
+						}
+
+						Log(LogNotice, "CheckerComponent")
+							<< "Skipping check for object '" << checkable->GetName()
+							<< "', as not in check period '" << tp->GetName() << "', until "
+							<< Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", nextCheck);
+
+						check = false;
+						notifyNextCheck = true;
+					}
+				}
+			}
+
+			if (check) {
+				if (forced)
+					forcedChecks.emplace_back(checkable);
+
+				checks.emplace_back(std::move(checkable));
+			} else {
+				skipped.push_back({ std::move(checkable), nextCheck, notifyNextCheck });
 			}
 		}
 
-		/* reschedule the checkable if checks are disabled */
-		if (!check) {
-			m_IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
-			lock.unlock();
+		lock.lock();
+
+		/* The checkables weren't known to the shard while the lock was released, so they might
+		 * have been deactivated, paused, moved to another zone (or re-added by ObjectHandler)
+		 * in the meantime. */
+		for (auto& item : skipped) {
+			if (IsSchedulable(item.Object))
+				shard.InsertIdle(item.Object);
+		}
+
+		std::vector<Checkable::Ptr> dropped = SetChecksPending(shard, checks);
+
+		lock.unlock();
+
+		for (auto& checkable : dropped) {
+			Checkable::DecreasePendingChecks();
+
+			forcedChecks.erase(std::remove(forcedChecks.begin(), forcedChecks.end(), checkable), forcedChecks.end());
+		}
+
+		/* reschedule the checkables if checks are disabled */
+		for (auto& item : skipped) {
+			const Checkable::Ptr& checkable = item.Object;
 
-			if (nextCheck > 0) {
-				checkable->SetNextCheck(nextCheck);
+			Checkable::DecreasePendingChecks();
+
+			if (item.NextCheck > 0) {
+				checkable->SetNextCheck(item.NextCheck);
 			} else {
 				Log(LogDebug, "CheckerComponent")
 					<< "Checks for checkable '" << checkable->GetName() << "' are disabled. Rescheduling check.";
@@ -200,18 +330,56 @@ void CheckerComponent::CheckThreadProc()
 				checkable->UpdateNextCheck();
 			}
 
-			if (notifyNextCheck) {
+			if (item.NotifyNextCheck) {
 				// Trigger update event for Icinga DB
 				Checkable::OnNextCheckUpdated(checkable);
 			}
+		}
 
-			lock.lock();
-
-			continue;
+		for (auto& checkable : forcedChecks) {
+			ObjectLock olock(checkable);
+			checkable->SetForceNextCheck(false);
 		}
 
+		if (!checks.empty())
+			DispatchChecks(shard, std::move(checks));
+
+		lock.lock();
+	}
+}
+
+/**
+ * Moves due checks to the shard's pending checkables. Must be called with the shard's mutex held.
+ *
+ * The checkables weren't known to the shard while the checks were prepared, so they might have
+ * been paused or moved to another zone in the meantime. These are removed from the checks and
+ * returned, the caller has to release their pending check slots.
+ *
+ * @param shard The shard the checkables belong to.
+ * @param checks The checkables to check.
+ * @return The checkables which mustn't be checked anymore.
+ */
+std::vector<Checkable::Ptr> CheckerComponent::SetChecksPending(Shard& shard, std::vector<Checkable::Ptr>& checks)
+{
+	std::vector<Checkable::Ptr> dropped;
+
+	auto end (std::remove_if(checks.begin(), checks.end(), [&dropped](const Checkable::Ptr& checkable) {
+		if (IsSchedulable(checkable))
+			return false;
 
-		csi = GetCheckableScheduleInfo(checkable);
+		Log(LogNotice, "CheckerComponent")
+			<< "Skipping check for object '" << checkable->GetName() << "': No longer scheduled by this endpoint.";
+
+		dropped.emplace_back(checkable);
+		return true;
+	}));
+
+	checks.erase(end, checks.end());
+
+	for (auto& checkable : checks) {
+		shard.EraseIdle(checkable);
+
+		CheckableScheduleInfo csi = GetCheckableScheduleInfo(checkable);
 
 		Log(LogDebug, "CheckerComponent")
 			<< "Scheduling info for checkable '" << checkable->GetName() << "' ("
@@ -220,34 +388,45 @@ void CheckerComponent::CheckThreadProc()
 			<< Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", csi.NextCheck)
 			<< " (" << std::fixed << std::setprecision(0) << csi.NextCheck << ").";
 
-		m_PendingCheckables.insert(csi);
+		shard.PendingCheckables.insert(csi);
+	}
 
-		lock.unlock();
+	return dropped;
+}
 
-		if (forced) {
-			ObjectLock olock(checkable);
-			checkable->SetForceNextCheck(false);
-		}
+/**
+ * Hands a batch of checks over to the thread pool. Every check gets a callback of its own,
+ * so that a slow check doesn't hold up the others. The checks' pending check slots
+ * must have been taken already.
+ *
+ * @param shard The shard the checkables belong to.
+ * @param checks The checkables to check.
+ */
+void CheckerComponent::DispatchChecks(Shard& shard, std::vector<Checkable::Ptr> checks)
+{
+	/*
+	 * Explicitly use CheckerComponent::Ptr to keep the reference counted while the
+	 * callback is active and making it crash safe
+	 */
+	CheckerComponent::Ptr checkComponent(this);
 
+	for (auto& checkable : checks) {
 		Log(LogDebug, "CheckerComponent")
 			<< "Executing check for '" << checkable->GetName() << "'";
 
-		Checkable::IncreasePendingChecks();
-
-		/*
-		 * Explicitly use CheckerComponent::Ptr to keep the reference counted while the
-		 * callback is active and making it crash safe
-		 */
-		CheckerComponent::Ptr checkComponent(this);
-
-		Utility::QueueAsyncCallback([this, checkComponent, checkable]() { ExecuteCheckHelper(checkable); });
-
-		lock.lock();
+		Utility::QueueAsyncCallback([this, checkComponent, &shard, checkable]() {
+			ExecuteCheckHelper(shard, checkable);
+		});
 	}
 }
 
-void CheckerComponent::ExecuteCheckHelper(const Checkable::Ptr& checkable)
+void CheckerComponent::ExecuteCheckHelper(Shard& shard, const Checkable::Ptr& checkable)
 {
+	/* Measured when the check actually starts, including the time spent in the thread pool's queue. */
+	double now = Utility::GetTime();
+
+	GetCheckLatency(checkable->GetCheckCommandRaw()).Lag.Record(now - checkable->GetNextCheck(), now);
+
 	try {
 		checkable->ExecuteCheck(m_WaitGroup);
 	} catch (const std::exception& ex) {
@@ -271,20 +450,20 @@ void CheckerComponent::ExecuteCheckHelper(const Checkable::Ptr& checkable)
 	Checkable::DecreasePendingChecks();
 
 	{
-		std::unique_lock<std::mutex> lock(m_Mutex);
+		std::unique_lock<std::mutex> lock(shard.Mutex);
 
 		/* remove the object from the list of pending objects; if it's not in the
 		 * list this was a manual (i.e. forced) check and we must not re-add the
 		 * object to the list because it's already there. */
-		auto it = m_PendingCheckables.find(checkable);
+		auto it = shard.PendingCheckables.find(checkable);
 
-		if (it != m_PendingCheckables.end()) {
-			m_PendingCheckables.erase(it);
+		if (it != shard.PendingCheckables.end()) {
+			shard.PendingCheckables.erase(it);
 
-			if (checkable->IsActive())
-				m_IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+			if (IsSchedulable(checkable))
+				shard.InsertIdle(checkable);
 
-			m_CV.notify_all();
+			shard.CV.notify_all();
 		}
 	}
 
@@ -296,12 +475,8 @@ void CheckerComponent::ResultTimerHandler()
 {
 	std::ostringstream msgbuf;
 
-	{
-		std::unique_lock<std::mutex> lock(m_Mutex);
-
-		msgbuf << "Pending checkables: " << m_PendingCheckables.size() << "; Idle checkables: " << m_IdleCheckables.size() << "; Checks/s: "
-			<< (CIB::GetActiveHostChecksStatistics(60) + CIB::GetActiveServiceChecksStatistics(60)) / 60.0;
-	}
+	msgbuf << "Pending checkables: " << GetPendingCheckables() << "; Idle checkables: " << GetIdleCheckables() << "; Checks/s: "
+		<< (CIB::GetActiveHostChecksStatistics(60) + CIB::GetActiveServiceChecksStatistics(60)) / 60.0;
 
 	Log(LogNotice, "CheckerComponent", msgbuf.str());
 }
@@ -313,26 +488,39 @@ void CheckerComponent::ObjectHandler(const ConfigObject::Ptr& object)
 	if (!checkable)
 		return;
 
-	Zone::Ptr zone = Zone::GetByName(checkable->GetZoneName());
-	bool same_zone = (!zone || Zone::GetLocalZone() == zone);
+	Shard& shard = GetShard(checkable);
 
 	{
-		std::unique_lock<std::mutex> lock(m_Mutex);
+		std::unique_lock<std::mutex> lock(shard.Mutex);
 
-		if (object->IsActive() && !object->IsPaused() && same_zone) {
-			if (m_PendingCheckables.find(checkable) != m_PendingCheckables.end())
+		if (IsSchedulable(checkable)) {
+			if (shard.PendingCheckables.find(checkable) != shard.PendingCheckables.end())
 				return;
 
-			m_IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+			shard.InsertIdle(checkable);
 		} else {
-			m_IdleCheckables.erase(checkable);
-			m_PendingCheckables.erase(checkable);
+			shard.EraseIdle(checkable);
+			shard.PendingCheckables.erase(checkable);
 		}
 
-		m_CV.notify_all();
+		shard.CV.notify_all();
 	}
 }
 
+/**
+ * @returns Whether the checkable is to be checked by this endpoint, i.e. it's active,
+ *          not paused and in the local zone.
+ */
+bool CheckerComponent::IsSchedulable(const Checkable::Ptr& checkable)
+{
+	if (!checkable->IsActive() || checkable->IsPaused())
+		return false;
+
+	Zone::Ptr zone = Zone::GetByName(checkable->GetZoneName());
+
+	return !zone || Zone::GetLocalZone() == zone;
+}
+
 CheckableScheduleInfo CheckerComponent::GetCheckableScheduleInfo(const Checkable::Ptr& checkable)
 {
 	CheckableScheduleInfo csi;
@@ -343,35 +531,276 @@ CheckableScheduleInfo CheckerComponent::GetCheckableScheduleInfo(const Checkable
 
 void CheckerComponent::NextCheckChangedHandler(const Checkable::Ptr& checkable)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	Shard& shard = GetShard(checkable);
+	std::unique_lock<std::mutex> lock(shard.Mutex);
+
+	if (!shard.RescheduleIdle(checkable))
+		return;
+
+	shard.CV.notify_all();
+}
+
+/**
+ * Returns the latency histograms of the specified check command, creating them if necessary.
+ *
+ * @param checkCommand The name of the check command.
+ * @return The histograms.
+ */
+CheckerComponent::CheckLatency& CheckerComponent::GetCheckLatency(const String& checkCommand)
+{
+	{
+		std::shared_lock<std::shared_mutex> lock(m_LatencyMutex);
+
+		auto it = m_Latency.find(checkCommand);
+
+		if (it != m_Latency.end())
+			return *it->second;
+	}
+
+	std::unique_lock<std::shared_mutex> lock(m_LatencyMutex);
+
+	auto& latency = m_Latency[checkCommand];
+
+	if (!latency)
+		latency.reset(new CheckLatency());
+
+	return *latency;
+}
+
+/**
+ * Records the execution time of active checks executed on this node.
+ */
+void CheckerComponent::CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, const MessageOrigin::Ptr& origin)
+{
+	if (!cr->GetActive() || (origin && !origin->IsLocal()))
+		return;
+
+	GetCheckLatency(checkable->GetCheckCommandRaw()).ExecutionTime.Record(cr->GetExecutionEnd() - cr->GetExecutionStart(), Utility::GetTime());
+}
+
+static Dictionary::Ptr HistogramToDictionary(const WindowedHistogram& durations, double now, const String& perfdataPrefix, const Array::Ptr& perfdata)
+{
+	Histogram histogram;
+
+	durations.GetWindow(now, histogram);
+
+	double p50 = histogram.GetPercentile(50);
+	double p90 = histogram.GetPercentile(90);
+	double p99 = histogram.GetPercentile(99);
+	double max = histogram.GetMax();
+
+	perfdata->Add(new PerfdataValue(perfdataPrefix + "p50", p50, false, "seconds"));
+	perfdata->Add(new PerfdataValue(perfdataPrefix + "p90", p90, false, "seconds"));
+	perfdata->Add(new PerfdataValue(perfdataPrefix + "p99", p99, false, "seconds"));
+	perfdata->Add(new PerfdataValue(perfdataPrefix + "max", max, false, "seconds"));
+
+	return new Dictionary({
+		{ "count", histogram.GetCount() },
+		{ "p50", p50 },
+		{ "p90", p90 },
+		{ "p99", p99 },
+		{ "max", max }
+	});
+}
+
+/**
+ * Summarizes the scheduling lag (start of a check compared to its next check
+ * timestamp) and the execution time of the checks per check command during
+ * the last 15 minutes, see CheckLatency.
+ *
+ * @param perfdataPrefix The prefix for the perfdata labels.
+ * @param perfdata Receives the percentiles as perfdata.
+ * @return The percentiles per check command.
+ */
+Dictionary::Ptr CheckerComponent::GetCheckLatencyStats(const String& perfdataPrefix, const Array::Ptr& perfdata)
+{
+	DictionaryData commands;
+	double now = Utility::GetTime();
+
+	std::shared_lock<std::shared_mutex> lock(m_LatencyMutex);
+
+	for (auto& kv : m_Latency) {
+		commands.emplace_back(kv.first, new Dictionary({
+			{ "lag", HistogramToDictionary(kv.second->Lag, now, perfdataPrefix + "lag_" + kv.first + "_", perfdata) },
+			{ "execution_time", HistogramToDictionary(kv.second->ExecutionTime, now, perfdataPrefix + "execution_time_" + kv.first + "_", perfdata) }
+		}));
+	}
+
+	return new Dictionary(std::move(commands));
+}
+
+/**
+ * Wakes up the scheduler threads which are waiting for a free check slot.
+ */
+void CheckerComponent::PendingCheckSlotReleasedHandler()
+{
+	for (auto& shard : m_Shards) {
+		std::unique_lock<std::mutex> lock(shard->Mutex);
+
+		if (shard->BlockedSince > 0)
+			shard->CV.notify_all();
+	}
+}
+
+unsigned long CheckerComponent::GetIdleCheckables()
+{
+	unsigned long count = 0;
+
+	for (auto& shard : m_Shards) {
+		std::unique_lock<std::mutex> lock(shard->Mutex);
+		count += shard->GetIdleCount();
+	}
+
+	return count;
+}
+
+unsigned long CheckerComponent::GetPendingCheckables()
+{
+	unsigned long count = 0;
+
+	for (auto& shard : m_Shards) {
+		std::unique_lock<std::mutex> lock(shard->Mutex);
+		count += shard->PendingCheckables.size();
+	}
+
+	return count;
+}
+
+/**
+ * Returns the total time the scheduler threads spent waiting for a free check slot
+ * while checks were due, including the currently ongoing wait.
+ *
+ * @return The time in seconds.
+ */
+double CheckerComponent::GetSlotWaitTime()
+{
+	double now = Utility::GetTime();
+	double total = 0;
+
+	for (auto& shard : m_Shards) {
+		std::unique_lock<std::mutex> lock(shard->Mutex);
+		total += shard->SlotWaitTime;
+
+		if (shard->BlockedSince > 0)
+			total += now - shard->BlockedSince;
+	}
+
+	return total;
+}
+
+void CheckerComponent::Shard::InsertIdle(const Checkable::Ptr& checkable)
+{
+	if (IdleWheel) {
+		if (!IdleWheel->Contains(checkable))
+			IdleWheel->Insert(checkable, checkable->GetNextCheck());
+	} else {
+		IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+	}
+}
+
+void CheckerComponent::Shard::EraseIdle(const Checkable::Ptr& checkable)
+{
+	if (IdleWheel)
+		IdleWheel->Remove(checkable);
+	else
+		IdleCheckables.erase(checkable);
+}
+
+/**
+ * Updates the position of an idle checkable after its next check has changed.
+ *
+ * @param checkable The checkable.
+ * @return Whether the checkable is idle.
+ */
+bool CheckerComponent::Shard::RescheduleIdle(const Checkable::Ptr& checkable)
+{
+	if (IdleWheel) {
+		if (!IdleWheel->Contains(checkable))
+			return false;
+
+		IdleWheel->Insert(checkable, checkable->GetNextCheck());
+		return true;
+	}
 
 	/* remove and re-insert the object from the set in order to force an index update */
 	typedef boost::multi_index::nth_index<CheckableSet, 0>::type CheckableView;
-	CheckableView& idx = boost::get<0>(m_IdleCheckables);
+	CheckableView& idx = boost::get<0>(IdleCheckables);
 
 	auto it = idx.find(checkable);
 
 	if (it == idx.end())
-		return;
+		return false;
 
-	idx.erase(checkable);
+	idx.erase(it);
+	idx.insert(GetCheckableScheduleInfo(checkable));
 
-	CheckableScheduleInfo csi = GetCheckableScheduleInfo(checkable);
-	idx.insert(csi);
+	return true;
+}
+
+size_t CheckerComponent::Shard::GetIdleCount() const
+{
+	if (IdleWheel)
+		return IdleWheel->GetLength();
 
-	m_CV.notify_all();
+	return IdleCheckables.size();
 }
 
-unsigned long CheckerComponent::GetIdleCheckables()
+/**
+ * Returns the time of the next idle check. With the timing wheel this may be
+ * slightly earlier than the actual time, i.e. the start of the wheel's slot.
+ *
+ * @param now The current time.
+ * @return The time; only meaningful if there are any idle checkables.
+ */
+double CheckerComponent::Shard::GetNextIdleCheck(double now)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	if (IdleWheel) {
+		double nextCheck;
+
+		if (!IdleWheel->GetNextExpiry(now, nextCheck))
+			return now;
 
-	return m_IdleCheckables.size();
+		return nextCheck;
+	}
+
+	typedef boost::multi_index::nth_index<CheckableSet, 1>::type CheckTimeView;
+	CheckTimeView& idx = boost::get<1>(IdleCheckables);
+
+	if (idx.begin() == idx.end())
+		return now;
+
+	return idx.begin()->NextCheck;
 }
 
-unsigned long CheckerComponent::GetPendingCheckables()
+/**
+ * Removes an idle checkable whose next check is due.
+ *
+ * @param now The current time.
+ * @return The checkable or nullptr if none is due.
+ */
+Checkable::Ptr CheckerComponent::Shard::TakeIdle(double now)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	if (IdleWheel) {
+		Checkable::Ptr checkable;
+		double nextCheck;
+
+		if (!IdleWheel->PopExpired(now, checkable, nextCheck))
+			return nullptr;
+
+		return checkable;
+	}
+
+	typedef boost::multi_index::nth_index<CheckableSet, 1>::type CheckTimeView;
+	CheckTimeView& idx = boost::get<1>(IdleCheckables);
+
+	auto it = idx.begin();
+
+	if (it == idx.end() || it->NextCheck > now)
+		return nullptr;
+
+	Checkable::Ptr checkable = it->Object;
+
+	idx.erase(it);
 
-	return m_PendingCheckables.size();
+	return checkable;
 }
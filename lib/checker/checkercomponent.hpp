@@ -6,15 +6,21 @@
 #include "checker/checkercomponent-ti.hpp"
 #include "icinga/service.hpp"
 #include "base/configobject.hpp"
+#include "base/histogram.hpp"
 #include "base/timer.hpp"
+#include "base/timingwheel.hpp"
 #include "base/utility.hpp"
 #include "base/wait-group.hpp"
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/key_extractors.hpp>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace icinga
 {
@@ -68,32 +74,85 @@ public:
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 	unsigned long GetIdleCheckables();
 	unsigned long GetPendingCheckables();
+	double GetSlotWaitTime();
+
+	void ValidateSchedulerShards(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
 
 private:
-	std::mutex m_Mutex;
-	std::condition_variable m_CV;
-	bool m_Stopped{false};
-	std::thread m_Thread;
+	/**
+	 * A partition of the scheduled checkables, selected by the checkable's name.
+	 * Each shard is served by its own scheduler thread.
+	 *
+	 * @ingroup checker
+	 */
+	struct Shard
+	{
+		std::mutex Mutex;
+		std::condition_variable CV;
+		bool Stopped{false};
+		std::thread Thread;
+
+		/* Time spent waiting for a free check slot (max_concurrent_checks) while checks were due. */
+		double BlockedSince{0};
+		double SlotWaitTime{0};
+
+		CheckableSet IdleCheckables;
+		CheckableSet PendingCheckables;
+
+		/* Replaces IdleCheckables if use_timing_wheel is enabled. */
+		std::unique_ptr<TimingWheel<Checkable::Ptr>> IdleWheel;
+
+		void InsertIdle(const Checkable::Ptr& checkable);
+		void EraseIdle(const Checkable::Ptr& checkable);
+		bool RescheduleIdle(const Checkable::Ptr& checkable);
+		size_t GetIdleCount() const;
+		double GetNextIdleCheck(double now);
+		Checkable::Ptr TakeIdle(double now);
+	};
 
-	CheckableSet m_IdleCheckables;
-	CheckableSet m_PendingCheckables;
+	std::vector<std::unique_ptr<Shard>> m_Shards;
+
+	/**
+	 * Scheduling lag and execution time of the checks of one check command
+	 * during the last 15 minutes, in slices of 3 minutes.
+	 *
+	 * @ingroup checker
+	 */
+	struct CheckLatency
+	{
+		WindowedHistogram Lag {3 * 60, 5};
+		WindowedHistogram ExecutionTime {3 * 60, 5};
+	};
+
+	std::shared_mutex m_LatencyMutex;
+	std::unordered_map<String, std::unique_ptr<CheckLatency>> m_Latency;
 
 	StoppableWaitGroup::Ptr m_WaitGroup = new StoppableWaitGroup();
 	Timer::Ptr m_ResultTimer;
 
-	void CheckThreadProc();
+	Shard& GetShard(const Checkable::Ptr& checkable);
+
+	void CheckThreadProc(Shard& shard);
+	std::vector<Checkable::Ptr> SetChecksPending(Shard& shard, std::vector<Checkable::Ptr>& checks);
+	void DispatchChecks(Shard& shard, std::vector<Checkable::Ptr> checks);
+
+	CheckLatency& GetCheckLatency(const String& checkCommand);
+	Dictionary::Ptr GetCheckLatencyStats(const String& perfdataPrefix, const Array::Ptr& perfdata);
 	void ResultTimerHandler();
 
-	void ExecuteCheckHelper(const Checkable::Ptr& checkable);
+	void ExecuteCheckHelper(Shard& shard, const Checkable::Ptr& checkable);
 
 	void AdjustCheckTimer();
 
 	void ObjectHandler(const ConfigObject::Ptr& object);
 	void NextCheckChangedHandler(const Checkable::Ptr& checkable);
+	void PendingCheckSlotReleasedHandler();
+	void CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, const MessageOrigin::Ptr& origin);
 
 	void RescheduleCheckTimer();
 
 	static CheckableScheduleInfo GetCheckableScheduleInfo(const Checkable::Ptr& checkable);
+	static bool IsSchedulable(const Checkable::Ptr& checkable);
 };
 
 }
@@ -14,8 +14,11 @@
 #include "base/reference.hpp"
 #include "base/namespace.hpp"
 #include "base/defer.hpp"
+#include "base/utility.hpp"
 #include <boost/exception_ptr.hpp>
 #include <boost/exception/errinfo_nested_exception.hpp>
+#include <algorithm>
+#include <typeinfo>
 
 using namespace icinga;
 
@@ -333,6 +336,29 @@ ExpressionResult EqualExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhin
 	return operand1.GetValue() == operand2.GetValue();
 }
 
+LiteralEqualExpression::LiteralEqualExpression(std::unique_ptr<Expression> operand1, std::unique_ptr<Expression> operand2, const DebugInfo& debugInfo)
+	: EqualExpression(std::move(operand1), std::move(operand2), debugInfo)
+{
+	auto *literal = dynamic_cast<LiteralExpression *>(m_Operand1.get());
+
+	m_LiteralFirst = literal;
+
+	if (!literal)
+		literal = dynamic_cast<LiteralExpression *>(m_Operand2.get());
+
+	VERIFY(literal);
+
+	m_Literal = literal->GetValue();
+}
+
+ExpressionResult LiteralEqualExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const
+{
+	ExpressionResult operand = (m_LiteralFirst ? m_Operand2 : m_Operand1)->Evaluate(frame);
+	CHECK_RESULT(operand);
+
+	return m_LiteralFirst ? m_Literal == operand.GetValue() : operand.GetValue() == m_Literal;
+}
+
 ExpressionResult NotEqualExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const
 {
 	ExpressionResult operand1 = m_Operand1->Evaluate(frame);
@@ -405,6 +431,33 @@ ExpressionResult InExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhint)
 	return arr->Contains(operand1.GetValue());
 }
 
+LiteralInExpression::LiteralInExpression(std::unique_ptr<Expression> operand1, std::unique_ptr<Expression> operand2, Array::Ptr values, const DebugInfo& debugInfo)
+	: InExpression(std::move(operand1), std::move(operand2), debugInfo), m_Values(std::move(values)), m_OnlyStrings(true)
+{
+	ObjectLock olock (m_Values);
+
+	for (const Value& value : m_Values) {
+		if (value.IsString())
+			m_Strings.emplace(value.Get<String>());
+		else
+			m_OnlyStrings = false;
+	}
+}
+
+ExpressionResult LiteralInExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const
+{
+	ExpressionResult operand1 = m_Operand1->Evaluate(frame);
+	CHECK_RESULT(operand1);
+
+	const Value& value = operand1.GetValue();
+
+	/* Strings only equal other strings with the same characters. */
+	if (m_OnlyStrings && value.IsString())
+		return m_Strings.find(value.Get<String>()) != m_Strings.end();
+
+	return m_Values->Contains(value);
+}
+
 ExpressionResult NotInExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const
 {
 	ExpressionResult operand2 = m_Operand2->Evaluate(frame);
@@ -454,18 +507,35 @@ ExpressionResult LogicalOrExpression::DoEvaluate(ScriptFrame& frame, DebugHint *
 
 ExpressionResult FunctionCallExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const
 {
-	Value self, vfunc;
+	Value self;
+	ExpressionResult vfunc = GetFunction(frame, &self);
+	CHECK_RESULT(vfunc);
+
+	return Call(frame, self, vfunc.GetValue());
+}
+
+/**
+ * Looks up the function to call.
+ *
+ * @param frame The frame to look it up in
+ * @param self Receives the object to call a method on, if any
+ * @return The function
+ */
+ExpressionResult FunctionCallExpression::GetFunction(ScriptFrame& frame, Value *self) const
+{
 	String index;
 
-	if (m_FName->GetReference(frame, false, &self, &index))
-		vfunc = VMOps::GetField(self, index, frame.Sandboxed, m_DebugInfo);
-	else {
-		ExpressionResult vfuncres = m_FName->Evaluate(frame);
-		CHECK_RESULT(vfuncres);
+	if (m_FName->GetReference(frame, false, self, &index))
+		return VMOps::GetField(*self, index, frame.Sandboxed, m_DebugInfo);
 
-		vfunc = vfuncres.GetValue();
-	}
+	return m_FName->Evaluate(frame);
+}
 
+/**
+ * Calls the function or constructor looked up by GetFunction() with the evaluated arguments.
+ */
+ExpressionResult FunctionCallExpression::Call(ScriptFrame& frame, const Value& self, const Value& vfunc) const
+{
 	if (vfunc.IsObjectType<Type>()) {
 		std::vector<Value> arguments;
 		arguments.reserve(m_Args.size());
@@ -499,6 +569,37 @@ ExpressionResult FunctionCallExpression::DoEvaluate(ScriptFrame& frame, DebugHin
 	return VMOps::FunctionCall(self, func, arguments);
 }
 
+LiteralMatchExpression::LiteralMatchExpression(std::unique_ptr<Expression> fname, std::vector<std::unique_ptr<Expression> >&& args,
+	Function::Ptr match, const DebugInfo& debugInfo)
+	: FunctionCallExpression(std::move(fname), std::move(args), debugInfo), m_Match(std::move(match))
+{
+	auto *literal = m_Args.size() == 2 ? dynamic_cast<LiteralExpression *>(m_Args[0].get()) : nullptr;
+
+	VERIFY(literal && literal->GetValue().IsString());
+
+	m_Pattern = literal->GetValue();
+}
+
+ExpressionResult LiteralMatchExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const
+{
+	Value self;
+	ExpressionResult vfunc = GetFunction(frame, &self);
+	CHECK_RESULT(vfunc);
+
+	/* Some other function, e.g. a local variable named match. */
+	if (!vfunc.GetValue().IsObject() || vfunc.GetValue().Get<Object::Ptr>() != m_Match)
+		return Call(frame, self, vfunc.GetValue());
+
+	ExpressionResult text = m_Args[1]->Evaluate(frame);
+	CHECK_RESULT(text);
+
+	/* Arrays of texts and the errors for other objects are left to match() itself. */
+	if (text.GetValue().IsObject())
+		return VMOps::FunctionCall(self, m_Match, { m_Pattern, text.GetValue() });
+
+	return Utility::Match(m_Pattern, text.GetValue());
+}
+
 ExpressionResult ArrayExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const
 {
 	ArrayData result;
@@ -746,6 +847,24 @@ ExpressionResult IndexerExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dh
 	return VMOps::GetField(operand1.GetValue(), operand2.GetValue(), frame.Sandboxed, m_DebugInfo);
 }
 
+LiteralIndexerExpression::LiteralIndexerExpression(std::unique_ptr<Expression> operand1, std::unique_ptr<Expression> operand2, const DebugInfo& debugInfo)
+	: IndexerExpression(std::move(operand1), std::move(operand2), debugInfo)
+{
+	auto *literal = dynamic_cast<LiteralExpression *>(m_Operand2.get());
+
+	VERIFY(literal && literal->GetValue().IsString());
+
+	m_Index = literal->GetValue();
+}
+
+ExpressionResult LiteralIndexerExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const
+{
+	ExpressionResult operand1 = m_Operand1->Evaluate(frame, dhint);
+	CHECK_RESULT(operand1);
+
+	return VMOps::GetField(operand1.GetValue(), m_Index, frame.Sandboxed, m_DebugInfo);
+}
+
 bool IndexerExpression::GetReference(ScriptFrame& frame, bool init_dict, Value *parent, String *index, DebugHint **dhint) const
 {
 	Value vparent;
@@ -840,6 +959,224 @@ void icinga::BindToScope(std::unique_ptr<Expression>& expr, ScopeSpecifier scope
 	}
 }
 
+/**
+ * @returns Whether evaluating the given expression can't change any variables.
+ */
+static bool IsPureExpression(const Expression *expr)
+{
+	if (dynamic_cast<const LiteralExpression *>(expr) || dynamic_cast<const VariableExpression *>(expr))
+		return true;
+
+	if (dynamic_cast<const NegateExpression *>(expr) || dynamic_cast<const LogicalNegateExpression *>(expr))
+		return IsPureExpression(static_cast<const UnaryExpression *>(expr)->GetOperand().get());
+
+	auto *bexpr = dynamic_cast<const BinaryExpression *>(expr);
+
+	if (bexpr) {
+		return !dynamic_cast<const SetExpression *>(expr) && IsPureExpression(bexpr->GetOperand1().get())
+			&& IsPureExpression(bexpr->GetOperand2().get());
+	}
+
+	auto *fexpr = dynamic_cast<const FunctionCallExpression *>(expr);
+
+	if (fexpr) {
+		return IsPureExpression(fexpr->m_FName.get()) && std::all_of(fexpr->m_Args.begin(), fexpr->m_Args.end(),
+			[](const std::unique_ptr<Expression>& arg) { return IsPureExpression(arg.get()); });
+	}
+
+	auto *aexpr = dynamic_cast<const ArrayExpression *>(expr);
+
+	if (aexpr) {
+		return std::all_of(aexpr->GetExpressions().begin(), aexpr->GetExpressions().end(),
+			[](const std::unique_ptr<Expression>& element) { return IsPureExpression(element.get()); });
+	}
+
+	return false;
+}
+
+/**
+ * @returns The values of the given array of literals or constant array, or nullptr if it isn't one.
+ */
+static Array::Ptr GetLiteralArray(const Expression *expr, const Dictionary::Ptr& constants)
+{
+	auto *vexpr = dynamic_cast<const VariableExpression *>(expr);
+
+	if (vexpr) {
+		Value value;
+
+		/* A copy, as the filter may change the array itself, e.g. by add(). */
+		if (constants && constants->Get(vexpr->GetVariable(), &value) && value.IsObjectType<Array>())
+			return Array::Ptr(value)->ShallowClone();
+
+		return nullptr;
+	}
+
+	auto *aexpr = dynamic_cast<const ArrayExpression *>(expr);
+
+	if (!aexpr)
+		return nullptr;
+
+	ArrayData values;
+
+	for (auto& element : aexpr->GetExpressions()) {
+		auto *literal = dynamic_cast<const LiteralExpression *>(element.get());
+
+		if (!literal)
+			return nullptr;
+
+		values.emplace_back(literal->GetValue());
+	}
+
+	return new Array(std::move(values));
+}
+
+/**
+ * Replaces the given binary expression with literal operands by a specialized one, if any,
+ * which doesn't evaluate the literals again and again, e.g. host.vars.os == "Linux".
+ *
+ * @param expr The expression, with its operands already folded
+ * @param operand1 The expression's first operand
+ * @param operand2 The expression's second operand
+ * @param constants The constants which haven't been folded into the operands, see FoldConstants()
+ */
+static void SpecializeExpression(std::unique_ptr<Expression>& expr, std::unique_ptr<Expression>& operand1,
+	std::unique_ptr<Expression>& operand2, const Dictionary::Ptr& constants)
+{
+	auto *bexpr = static_cast<BinaryExpression *>(expr.get());
+	auto *literal2 = dynamic_cast<LiteralExpression *>(operand2.get());
+	DebugInfo debugInfo = expr->GetDebugInfo();
+
+	if (typeid(*bexpr) == typeid(EqualExpression)) {
+		if (dynamic_cast<LiteralExpression *>(operand1.get()) || literal2)
+			expr.reset(new LiteralEqualExpression(std::move(operand1), std::move(operand2), debugInfo));
+	} else if (typeid(*bexpr) == typeid(InExpression)) {
+		Array::Ptr values = GetLiteralArray(operand2.get(), constants);
+
+		if (values)
+			expr.reset(new LiteralInExpression(std::move(operand1), std::move(operand2), std::move(values), debugInfo));
+	} else if (typeid(*bexpr) == typeid(IndexerExpression)) {
+		if (literal2 && literal2->GetValue().IsString())
+			expr.reset(new LiteralIndexerExpression(std::move(operand1), std::move(operand2), debugInfo));
+	}
+}
+
+/**
+ * Replaces the given constants in the given expression by their values and operations on
+ * literals by their results, so that they aren't evaluated again and again.
+ *
+ * Constants are only replaced if nothing in the expression may change variables.
+ * Arrays and dictionaries aren't replaced at all, as the expression may change them.
+ * Function calls aren't replaced by their results, calls of match() with a literal pattern
+ * are replaced by LiteralMatchExpression. Other operations on literals are replaced by
+ * specialized ones, see SpecializeExpression().
+ *
+ * @param expr The expression, e.g. an API filter
+ * @param constants The variables which have the same values whenever the expression is evaluated
+ */
+void icinga::FoldConstants(std::unique_ptr<Expression>& expr, const Dictionary::Ptr& constants)
+{
+	auto *dexpr = dynamic_cast<DictExpression *>(expr.get());
+
+	if (dexpr) {
+		/* Otherwise variables are looked up in the new dictionary first. */
+		if (!dexpr->m_Inline)
+			return;
+
+		bool pure = std::all_of(dexpr->m_Expressions.begin(), dexpr->m_Expressions.end(),
+			[](const std::unique_ptr<Expression>& sub) { return IsPureExpression(sub.get()); });
+
+		for (auto& sub : dexpr->m_Expressions)
+			FoldConstants(sub, pure ? constants : nullptr);
+
+		return;
+	}
+
+	if (!IsPureExpression(expr.get()))
+		return;
+
+	auto *vexpr = dynamic_cast<VariableExpression *>(expr.get());
+
+	if (vexpr) {
+		Value value;
+
+		/* The folded expression is shared by all evaluations, which could change a container, e.g. by add(). */
+		if (constants && constants->Get(vexpr->GetVariable(), &value) && !value.IsObject())
+			expr = MakeLiteral(value);
+
+		return;
+	}
+
+	auto isLiteral ([](const std::unique_ptr<Expression>& sub) {
+		return dynamic_cast<LiteralExpression *>(sub.get()) != nullptr;
+	});
+
+	auto *uexpr = dynamic_cast<UnaryExpression *>(expr.get());
+	auto *bexpr = dynamic_cast<BinaryExpression *>(expr.get());
+	auto *fexpr = dynamic_cast<FunctionCallExpression *>(expr.get());
+	auto *aexpr = dynamic_cast<ArrayExpression *>(expr.get());
+
+	if (uexpr) {
+		FoldConstants(uexpr->m_Operand, constants);
+
+		if (!isLiteral(uexpr->m_Operand))
+			return;
+	} else if (bexpr) {
+		FoldConstants(bexpr->m_Operand1, constants);
+		FoldConstants(bexpr->m_Operand2, constants);
+
+		if (!isLiteral(bexpr->m_Operand1) || !isLiteral(bexpr->m_Operand2)) {
+			SpecializeExpression(expr, bexpr->m_Operand1, bexpr->m_Operand2, constants);
+			return;
+		}
+	} else if (fexpr) {
+		/* Methods have to be looked up on each call, so that they get their object as this. */
+		auto *iexpr = dynamic_cast<IndexerExpression *>(fexpr->m_FName.get());
+
+		if (iexpr) {
+			FoldConstants(static_cast<BinaryExpression *>(iexpr)->m_Operand1, constants);
+			FoldConstants(static_cast<BinaryExpression *>(iexpr)->m_Operand2, constants);
+		}
+
+		for (auto& arg : fexpr->m_Args)
+			FoldConstants(arg, constants);
+
+		auto *fname = dynamic_cast<VariableExpression *>(fexpr->m_FName.get());
+		auto *pattern = fexpr->m_Args.size() == 2 ? dynamic_cast<LiteralExpression *>(fexpr->m_Args[0].get()) : nullptr;
+
+		if (typeid(*fexpr) == typeid(FunctionCallExpression) && fname && fname->GetVariable() == "match"
+			&& pattern && pattern->GetValue().IsString()) {
+			Namespace::Ptr systemNS = ScriptGlobal::Get("System");
+			Value match;
+
+			if (systemNS->Get("match", &match) && match.IsObjectType<Function>()) {
+				DebugInfo debugInfo = expr->GetDebugInfo();
+				expr.reset(new LiteralMatchExpression(std::move(fexpr->m_FName), std::move(fexpr->m_Args), match, debugInfo));
+			}
+		}
+
+		return;
+	} else {
+		if (aexpr) {
+			for (auto& element : aexpr->m_Expressions)
+				FoldConstants(element, constants);
+		}
+
+		return;
+	}
+
+	try {
+		ScriptFrame frame(false);
+		frame.Sandboxed = true;
+
+		Value result = expr->Evaluate(frame).GetValue();
+
+		if (!result.IsObject())
+			expr = MakeLiteral(result);
+	} catch (const std::exception&) {
+		/* Leave it to fail whenever it's evaluated, as it would have without folding. */
+	}
+}
+
 ExpressionResult ThrowExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const
 {
 	ExpressionResult messageres = m_Message->Evaluate(frame);
@@ -13,6 +13,7 @@
 #include "base/shared-object.hpp"
 #include "base/convert.hpp"
 #include <map>
+#include <unordered_set>
 
 namespace icinga
 {
@@ -272,8 +273,15 @@ public:
 		: DebuggableExpression(debugInfo), m_Operand(std::move(operand))
 	{ }
 
+	inline const std::unique_ptr<Expression>& GetOperand() const noexcept
+	{
+		return m_Operand;
+	}
+
 protected:
 	std::unique_ptr<Expression> m_Operand;
+
+	friend void FoldConstants(std::unique_ptr<Expression>& expr, const Dictionary::Ptr& constants);
 };
 
 class BinaryExpression : public DebuggableExpression
@@ -296,6 +304,8 @@ public:
 protected:
 	std::unique_ptr<Expression> m_Operand1;
 	std::unique_ptr<Expression> m_Operand2;
+
+	friend void FoldConstants(std::unique_ptr<Expression>& expr, const Dictionary::Ptr& constants);
 };
 
 class VariableExpression final : public DebuggableExpression
@@ -474,7 +484,7 @@ protected:
 	ExpressionResult DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const override;
 };
 
-class EqualExpression final : public BinaryExpression
+class EqualExpression : public BinaryExpression
 {
 public:
 	EqualExpression(std::unique_ptr<Expression> operand1, std::unique_ptr<Expression> operand2, const DebugInfo& debugInfo = DebugInfo())
@@ -485,6 +495,22 @@ protected:
 	ExpressionResult DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const override;
 };
 
+/**
+ * An EqualExpression with a literal operand, see FoldConstants(). Only evaluates the other operand.
+ */
+class LiteralEqualExpression final : public EqualExpression
+{
+public:
+	LiteralEqualExpression(std::unique_ptr<Expression> operand1, std::unique_ptr<Expression> operand2, const DebugInfo& debugInfo = DebugInfo());
+
+protected:
+	ExpressionResult DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const override;
+
+private:
+	Value m_Literal;
+	bool m_LiteralFirst;
+};
+
 class NotEqualExpression final : public BinaryExpression
 {
 public:
@@ -540,7 +566,7 @@ protected:
 	ExpressionResult DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const override;
 };
 
-class InExpression final : public BinaryExpression
+class InExpression : public BinaryExpression
 {
 public:
 	InExpression(std::unique_ptr<Expression> operand1, std::unique_ptr<Expression> operand2, const DebugInfo& debugInfo = DebugInfo())
@@ -551,6 +577,24 @@ protected:
 	ExpressionResult DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const override;
 };
 
+/**
+ * An InExpression with an array of literals on the right side, see FoldConstants().
+ * Looks up strings in a hash set rather than comparing them to each element.
+ */
+class LiteralInExpression final : public InExpression
+{
+public:
+	LiteralInExpression(std::unique_ptr<Expression> operand1, std::unique_ptr<Expression> operand2, Array::Ptr values, const DebugInfo& debugInfo = DebugInfo());
+
+protected:
+	ExpressionResult DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const override;
+
+private:
+	Array::Ptr m_Values;
+	std::unordered_set<String> m_Strings;
+	bool m_OnlyStrings;
+};
+
 class NotInExpression final : public BinaryExpression
 {
 public:
@@ -584,7 +628,7 @@ protected:
 	ExpressionResult DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const override;
 };
 
-class FunctionCallExpression final : public DebuggableExpression
+class FunctionCallExpression : public DebuggableExpression
 {
 public:
 	FunctionCallExpression(std::unique_ptr<Expression> fname, std::vector<std::unique_ptr<Expression> >&& args, const DebugInfo& debugInfo = DebugInfo())
@@ -593,12 +637,31 @@ public:
 
 protected:
 	ExpressionResult DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const override;
+	ExpressionResult GetFunction(ScriptFrame& frame, Value *self) const;
+	ExpressionResult Call(ScriptFrame& frame, const Value& self, const Value& vfunc) const;
 
 public:
 	std::unique_ptr<Expression> m_FName;
 	std::vector<std::unique_ptr<Expression> > m_Args;
 };
 
+/**
+ * A call of match() with a string literal as pattern and one text, see FoldConstants().
+ * Matches the text without an argument vector and a script frame per call.
+ */
+class LiteralMatchExpression final : public FunctionCallExpression
+{
+public:
+	LiteralMatchExpression(std::unique_ptr<Expression> fname, std::vector<std::unique_ptr<Expression> >&& args, Function::Ptr match, const DebugInfo& debugInfo = DebugInfo());
+
+protected:
+	ExpressionResult DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const override;
+
+private:
+	Function::Ptr m_Match;
+	String m_Pattern;
+};
+
 class ArrayExpression final : public DebuggableExpression
 {
 public:
@@ -606,11 +669,18 @@ public:
 		: DebuggableExpression(debugInfo), m_Expressions(std::move(expressions))
 	{ }
 
+	inline const std::vector<std::unique_ptr<Expression>>& GetExpressions() const noexcept
+	{
+		return m_Expressions;
+	}
+
 protected:
 	ExpressionResult DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const override;
 
 private:
 	std::vector<std::unique_ptr<Expression> > m_Expressions;
+
+	friend void FoldConstants(std::unique_ptr<Expression>& expr, const Dictionary::Ptr& constants);
 };
 
 class DictExpression final : public DebuggableExpression
@@ -635,6 +705,7 @@ private:
 	bool m_Inline{false};
 
 	friend void BindToScope(std::unique_ptr<Expression>& expr, ScopeSpecifier scopeSpec);
+	friend void FoldConstants(std::unique_ptr<Expression>& expr, const Dictionary::Ptr& constants);
 };
 
 class SetConstExpression final : public UnaryExpression
@@ -745,7 +816,7 @@ private:
 	ScopeSpecifier m_ScopeSpec;
 };
 
-class IndexerExpression final : public BinaryExpression
+class IndexerExpression : public BinaryExpression
 {
 public:
 	IndexerExpression(std::unique_ptr<Expression> operand1, std::unique_ptr<Expression> operand2, const DebugInfo& debugInfo = DebugInfo())
@@ -759,7 +830,24 @@ protected:
 	friend void BindToScope(std::unique_ptr<Expression>& expr, ScopeSpecifier scopeSpec);
 };
 
+/**
+ * An IndexerExpression with a string literal as index, e.g. host.vars, see FoldConstants().
+ * Only evaluates the indexed operand.
+ */
+class LiteralIndexerExpression final : public IndexerExpression
+{
+public:
+	LiteralIndexerExpression(std::unique_ptr<Expression> operand1, std::unique_ptr<Expression> operand2, const DebugInfo& debugInfo = DebugInfo());
+
+protected:
+	ExpressionResult DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const override;
+
+private:
+	String m_Index;
+};
+
 void BindToScope(std::unique_ptr<Expression>& expr, ScopeSpecifier scopeSpec);
+void FoldConstants(std::unique_ptr<Expression>& expr, const Dictionary::Ptr& constants);
 
 class ThrowExpression final : public DebuggableExpression
 {
@@ -23,6 +23,7 @@ boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, St
 boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, std::set<Checkable::Ptr>, const MessageOrigin::Ptr&)> Checkable::OnReachabilityChanged;
 boost::signals2::signal<void (const Checkable::Ptr&, NotificationType, const CheckResult::Ptr&, const String&, const String&, const MessageOrigin::Ptr&)> Checkable::OnNotificationsRequested;
 boost::signals2::signal<void (const Checkable::Ptr&)> Checkable::OnNextCheckUpdated;
+boost::signals2::signal<void ()> Checkable::OnPendingCheckSlotReleased;
 
 Atomic<uint_fast64_t> Checkable::CurrentConcurrentChecks (0);
 
@@ -703,9 +704,13 @@ void Checkable::IncreasePendingChecks()
 
 void Checkable::DecreasePendingChecks()
 {
-	std::unique_lock<std::mutex> lock(m_StatsMutex);
-	m_PendingChecks--;
-	m_PendingChecksCV.notify_one();
+	{
+		std::unique_lock<std::mutex> lock(m_StatsMutex);
+		m_PendingChecks--;
+		m_PendingChecksCV.notify_one();
+	}
+
+	OnPendingCheckSlotReleased();
 }
 
 int Checkable::GetPendingChecks()
@@ -722,3 +727,20 @@ void Checkable::AquirePendingCheckSlot(int maxPendingChecks)
 
 	m_PendingChecks++;
 }
+
+/**
+ * Takes a pending check slot unless all of them are in use, without waiting.
+ *
+ * @param maxPendingChecks The number of slots.
+ * @return Whether a slot has been taken, release it with DecreasePendingChecks().
+ */
+bool Checkable::TryAquirePendingCheckSlot(int maxPendingChecks)
+{
+	std::unique_lock<std::mutex> lock(m_StatsMutex);
+
+	if (m_PendingChecks >= maxPendingChecks)
+		return false;
+
+	m_PendingChecks++;
+	return true;
+}
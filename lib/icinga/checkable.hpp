@@ -147,6 +147,7 @@ public:
 	static boost::signals2::signal<void (const Checkable::Ptr&, const String&, double, const MessageOrigin::Ptr&)> OnAcknowledgementCleared;
 	static boost::signals2::signal<void (const Checkable::Ptr&, double)> OnFlappingChange;
 	static boost::signals2::signal<void (const Checkable::Ptr&)> OnNextCheckUpdated;
+	static boost::signals2::signal<void ()> OnPendingCheckSlotReleased;
 	static boost::signals2::signal<void (const Checkable::Ptr&)> OnEventCommandExecuted;
 
 	static Atomic<uint_fast64_t> CurrentConcurrentChecks;
@@ -215,6 +216,7 @@ public:
 	static void DecreasePendingChecks();
 	static int GetPendingChecks();
 	static void AquirePendingCheckSlot(int maxPendingChecks);
+	static bool TryAquirePendingCheckSlot(int maxPendingChecks);
 
 protected:
 	void Start(bool runtimeCreated) override;
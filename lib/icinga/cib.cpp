@@ -304,6 +304,7 @@ void CIB::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata) {
 	// Checker related stats
 	status->Set("remote_check_queue", ClusterEvents::GetCheckRequestQueueSize());
 	status->Set("current_pending_callbacks", Application::GetTP().GetPending());
+	status->Set("current_pending_low_latency_callbacks", Application::GetTP().GetPending(LowLatencyScheduler));
 	status->Set("current_concurrent_checks", Checkable::CurrentConcurrentChecks.load());
 
 	CheckableCheckStatistics scs = CalculateServiceCheckStats();
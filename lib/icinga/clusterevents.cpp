@@ -7,6 +7,7 @@
 #include "remote/messageorigin.hpp"
 #include "remote/zone.hpp"
 #include "remote/apifunction.hpp"
+#include "remote/binarymessage.hpp"
 #include "remote/eventqueue.hpp"
 #include "base/application.hpp"
 #include "base/configtype.hpp"
@@ -16,7 +17,9 @@
 #include "base/initialize.hpp"
 #include "base/serializer.hpp"
 #include "base/json.hpp"
+#include "base/object-packer.hpp"
 #include <fstream>
+#include <iterator>
 
 using namespace icinga;
 
@@ -107,14 +110,6 @@ void ClusterEvents::CheckResultHandler(const Checkable::Ptr& checkable, const Ch
 
 Value ClusterEvents::CheckResultAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
 {
-	Endpoint::Ptr endpoint = origin->FromClient->GetEndpoint();
-
-	if (!endpoint) {
-		Log(LogNotice, "ClusterEvents")
-			<< "Discarding 'check result' message from '" << origin->FromClient->GetIdentity() << "': Invalid endpoint origin (client not allowed).";
-		return Empty;
-	}
-
 	CheckResult::Ptr cr;
 	Array::Ptr vperf;
 
@@ -135,6 +130,21 @@ Value ClusterEvents::CheckResultAPIHandler(const MessageOrigin::Ptr& origin, con
 	if (!cr)
 		return Empty;
 
+	cr->SetPerformanceData(DeserializePerformanceData(vperf));
+
+	CheckResultMessageHandler(origin, params->Get("host"), params->Get("service"), cr);
+
+	return Empty;
+}
+
+/**
+ * Converts the performance data of a received check result into PerfdataValue objects where serialized as such.
+ *
+ * @param vperf The received performance data, may be null
+ * @return The performance data
+ */
+Array::Ptr ClusterEvents::DeserializePerformanceData(const Array::Ptr& vperf)
+{
 	ArrayData rperf;
 
 	if (vperf) {
@@ -151,36 +161,63 @@ Value ClusterEvents::CheckResultAPIHandler(const MessageOrigin::Ptr& origin, con
 		}
 	}
 
-	cr->SetPerformanceData(new Array(std::move(rperf)));
-
-	Host::Ptr host = Host::GetByName(params->Get("host"));
+	return new Array(std::move(rperf));
+}
 
-	if (!host)
-		return Empty;
+/**
+ * Processes a check result received as 'event::CheckResult' message, either as JSON or as binary message.
+ *
+ * @param origin Where the message comes from
+ * @param hostName The checkable's host
+ * @param serviceName The checkable's service short name, empty for the host itself
+ * @param cr The check result
+ */
+void ClusterEvents::CheckResultMessageHandler(const MessageOrigin::Ptr& origin, const String& hostName, const String& serviceName, const CheckResult::Ptr& cr)
+{
+	Endpoint::Ptr endpoint = origin->FromClient->GetEndpoint();
 
-	Checkable::Ptr checkable;
+	if (!endpoint) {
+		Log(LogNotice, "ClusterEvents")
+			<< "Discarding 'check result' message from '" << origin->FromClient->GetIdentity() << "': Invalid endpoint origin (client not allowed).";
+		return;
+	}
 
-	if (params->Contains("service"))
-		checkable = host->GetServiceByShortName(params->Get("service"));
-	else
-		checkable = host;
+	Checkable::Ptr checkable = GetMessageCheckable(hostName, serviceName);
 
 	if (!checkable)
-		return Empty;
+		return;
 
 	if (origin->FromZone && !origin->FromZone->CanAccessObject(checkable) && endpoint != checkable->GetCommandEndpoint()) {
 		Log(LogNotice, "ClusterEvents")
 			<< "Discarding 'check result' message for checkable '" << checkable->GetName()
 			<< "' from '" << origin->FromClient->GetIdentity() << "': Unauthorized access.";
-		return Empty;
+		return;
 	}
 
 	if (!checkable->IsPaused() && Zone::GetLocalZone() == checkable->GetZone() && endpoint == checkable->GetCommandEndpoint())
 		checkable->ProcessCheckResult(cr, ApiListener::GetInstance()->GetWaitGroup());
 	else
 		checkable->ProcessCheckResult(cr, ApiListener::GetInstance()->GetWaitGroup(), origin);
+}
 
-	return Empty;
+/**
+ * Looks up the checkable a message is about.
+ *
+ * @param hostName The checkable's host
+ * @param serviceName The checkable's service short name, empty for the host itself
+ * @return The checkable or nullptr if it doesn't exist
+ */
+Checkable::Ptr ClusterEvents::GetMessageCheckable(const String& hostName, const String& serviceName)
+{
+	Host::Ptr host = Host::GetByName(hostName);
+
+	if (!host)
+		return nullptr;
+
+	if (!serviceName.IsEmpty())
+		return host->GetServiceByShortName(serviceName);
+
+	return host;
 }
 
 void ClusterEvents::NextCheckChangedHandler(const Checkable::Ptr& checkable, const MessageOrigin::Ptr& origin)
@@ -209,45 +246,38 @@ void ClusterEvents::NextCheckChangedHandler(const Checkable::Ptr& checkable, con
 }
 
 Value ClusterEvents::NextCheckChangedAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
+{
+	NextCheckChangedMessageHandler(origin, params->Get("host"), params->Get("service"), params->Get("next_check"));
+
+	return Empty;
+}
+
+void ClusterEvents::NextCheckChangedMessageHandler(const MessageOrigin::Ptr& origin, const String& hostName, const String& serviceName, double nextCheck)
 {
 	Endpoint::Ptr endpoint = origin->FromClient->GetEndpoint();
 
 	if (!endpoint) {
 		Log(LogNotice, "ClusterEvents")
 			<< "Discarding 'next check changed' message from '" << origin->FromClient->GetIdentity() << "': Invalid endpoint origin (client not allowed).";
-		return Empty;
+		return;
 	}
 
-	Host::Ptr host = Host::GetByName(params->Get("host"));
-
-	if (!host)
-		return Empty;
-
-	Checkable::Ptr checkable;
-
-	if (params->Contains("service"))
-		checkable = host->GetServiceByShortName(params->Get("service"));
-	else
-		checkable = host;
+	Checkable::Ptr checkable = GetMessageCheckable(hostName, serviceName);
 
 	if (!checkable)
-		return Empty;
+		return;
 
 	if (origin->FromZone && !origin->FromZone->CanAccessObject(checkable)) {
 		Log(LogNotice, "ClusterEvents")
 			<< "Discarding 'next check changed' message for checkable '" << checkable->GetName()
 			<< "' from '" << origin->FromClient->GetIdentity() << "': Unauthorized access.";
-		return Empty;
+		return;
 	}
 
-	double nextCheck = params->Get("next_check");
-
 	if (nextCheck < Application::GetStartTime() + 60)
-		return Empty;
-
-	checkable->SetNextCheck(params->Get("next_check"), false, origin);
+		return;
 
-	return Empty;
+	checkable->SetNextCheck(nextCheck, false, origin);
 }
 
 void ClusterEvents::LastCheckStartedChangedHandler(const Checkable::Ptr& checkable, const MessageOrigin::Ptr& origin)
@@ -276,42 +306,146 @@ void ClusterEvents::LastCheckStartedChangedHandler(const Checkable::Ptr& checkab
 }
 
 Value ClusterEvents::LastCheckStartedChangedAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
+{
+	LastCheckStartedChangedMessageHandler(origin, params->Get("host"), params->Get("service"), params->Get("last_check_started"));
+
+	return Empty;
+}
+
+void ClusterEvents::LastCheckStartedChangedMessageHandler(const MessageOrigin::Ptr& origin, const String& hostName, const String& serviceName, double lastCheckStarted)
 {
 	Endpoint::Ptr endpoint = origin->FromClient->GetEndpoint();
 
 	if (!endpoint) {
 		Log(LogNotice, "ClusterEvents")
 			<< "Discarding 'last_check_started changed' message from '" << origin->FromClient->GetIdentity() << "': Invalid endpoint origin (client not allowed).";
-		return Empty;
+		return;
 	}
 
-	Host::Ptr host = Host::GetByName(params->Get("host"));
-
-	if (!host)
-		return Empty;
-
-	Checkable::Ptr checkable;
-
-	if (params->Contains("service"))
-		checkable = host->GetServiceByShortName(params->Get("service"));
-	else
-		checkable = host;
+	Checkable::Ptr checkable = GetMessageCheckable(hostName, serviceName);
 
 	if (!checkable)
-		return Empty;
+		return;
 
 	if (origin->FromZone && !origin->FromZone->CanAccessObject(checkable)) {
 		Log(LogNotice, "ClusterEvents")
 			<< "Discarding 'last_check_started changed' message for checkable '" << checkable->GetName()
 			<< "' from '" << origin->FromClient->GetIdentity() << "': Unauthorized access.";
-		return Empty;
+		return;
 	}
 
-	checkable->SetLastCheckStarted(params->Get("last_check_started"), false, origin);
+	checkable->SetLastCheckStarted(lastCheckStarted, false, origin);
+}
 
-	return Empty;
+/* The fields of a serialized check result in the order of the binary 'event::CheckResult' message. */
+static const char * const l_BinaryCheckResultFields[] = {
+	"schedule_start", "schedule_end", "execution_start", "execution_end", "command", "exit_status", "state",
+	"previous_hard_state", "output", "performance_data", "active", "check_source", "scheduling_source", "ttl",
+	"vars_before", "vars_after"
+};
+
+/**
+ * Checks whether the params of a message about a checkable are exactly the host, the service and the given ones.
+ */
+static bool HasOnlyCheckableParams(const Dictionary::Ptr& params, size_t count)
+{
+	return params->GetLength() == (params->Contains("service") ? 2u : 1u) + count;
+}
+
+static bool EncodeBinaryCheckResult(const Dictionary::Ptr& params, std::string& builder)
+{
+	Dictionary::Ptr cr = params->Get("cr");
+
+	/* Check results with fields we don't know, e.g. from newer versions, are sent as JSON. */
+	if (!cr || !HasOnlyCheckableParams(params, 1) || cr->GetLength() != std::size(l_BinaryCheckResultFields) + 1 /* type */)
+		return false;
+
+	PackObject(params->Get("host"), builder);
+	PackObject(params->Get("service"), builder);
+
+	for (auto field : l_BinaryCheckResultFields) {
+		Value value;
+
+		if (!cr->Get(field, &value))
+			return false;
+
+		PackObject(value, builder);
+	}
+
+	return true;
+}
+
+static void HandleBinaryCheckResult(const MessageOrigin::Ptr& origin, BinaryMessageReader& reader)
+{
+	String host = reader.ReadString();
+	Value service = reader.Read();
+
+	CheckResult::Ptr cr = new CheckResult();
+
+	cr->SetScheduleStart(reader.ReadNumber(), true);
+	cr->SetScheduleEnd(reader.ReadNumber(), true);
+	cr->SetExecutionStart(reader.ReadNumber(), true);
+	cr->SetExecutionEnd(reader.ReadNumber(), true);
+	cr->SetCommand(reader.Read(), true);
+	cr->SetExitStatus(reader.ReadNumber(), true);
+	cr->SetState(static_cast<ServiceState>(static_cast<int>(reader.ReadNumber())), true);
+	cr->SetPreviousHardState(static_cast<ServiceState>(static_cast<int>(reader.ReadNumber())), true);
+	cr->SetOutput(reader.ReadString(), true);
+	cr->SetPerformanceData(ClusterEvents::DeserializePerformanceData(reader.ReadArray()), true);
+	cr->SetActive(reader.ReadBoolean(), true);
+	cr->SetCheckSource(reader.ReadString(), true);
+	cr->SetSchedulingSource(reader.ReadString(), true);
+	cr->SetTtl(reader.ReadNumber(), true);
+	cr->SetVarsBefore(reader.ReadDictionary(), true);
+	cr->SetVarsAfter(reader.ReadDictionary(), true);
+
+	ClusterEvents::CheckResultMessageHandler(origin, host, service, cr);
 }
 
+/**
+ * Encodes an 'event::SetNextCheck' or 'event::SetLastCheckStarted' message, which only has a timestamp besides the checkable.
+ */
+static bool EncodeBinaryCheckableTimestamp(const Dictionary::Ptr& params, const char *field, std::string& builder)
+{
+	Value ts;
+
+	if (!HasOnlyCheckableParams(params, 1) || !params->Get(field, &ts) || !ts.IsNumber())
+		return false;
+
+	PackObject(params->Get("host"), builder);
+	PackObject(params->Get("service"), builder);
+	PackObject(ts, builder);
+
+	return true;
+}
+
+static void HandleBinaryNextCheck(const MessageOrigin::Ptr& origin, BinaryMessageReader& reader)
+{
+	String host = reader.ReadString();
+	Value service = reader.Read();
+	double nextCheck = reader.ReadNumber();
+
+	ClusterEvents::NextCheckChangedMessageHandler(origin, host, service, nextCheck);
+}
+
+static void HandleBinaryLastCheckStarted(const MessageOrigin::Ptr& origin, BinaryMessageReader& reader)
+{
+	String host = reader.ReadString();
+	Value service = reader.Read();
+	double lastCheckStarted = reader.ReadNumber();
+
+	ClusterEvents::LastCheckStartedChangedMessageHandler(origin, host, service, lastCheckStarted);
+}
+
+/* The IDs identify the messages on the wire, never reuse them. */
+REGISTER_BINARY_MESSAGE(1, CheckResult, event, &EncodeBinaryCheckResult, &HandleBinaryCheckResult);
+REGISTER_BINARY_MESSAGE(2, SetNextCheck, event, [](const Dictionary::Ptr& params, std::string& builder) {
+	return EncodeBinaryCheckableTimestamp(params, "next_check", builder);
+}, &HandleBinaryNextCheck);
+REGISTER_BINARY_MESSAGE(3, SetLastCheckStarted, event, [](const Dictionary::Ptr& params, std::string& builder) {
+	return EncodeBinaryCheckableTimestamp(params, "last_check_started", builder);
+}, &HandleBinaryLastCheckStarted);
+
 void ClusterEvents::StateBeforeSuppressionChangedHandler(const Checkable::Ptr& checkable, const MessageOrigin::Ptr& origin)
 {
 	ApiListener::Ptr listener = ApiListener::GetInstance();
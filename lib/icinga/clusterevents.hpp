@@ -22,12 +22,16 @@ public:
 
 	static void CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, const MessageOrigin::Ptr& origin);
 	static Value CheckResultAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+	static void CheckResultMessageHandler(const MessageOrigin::Ptr& origin, const String& hostName, const String& serviceName, const CheckResult::Ptr& cr);
+	static Array::Ptr DeserializePerformanceData(const Array::Ptr& vperf);
 
 	static void NextCheckChangedHandler(const Checkable::Ptr& checkable, const MessageOrigin::Ptr& origin);
 	static Value NextCheckChangedAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+	static void NextCheckChangedMessageHandler(const MessageOrigin::Ptr& origin, const String& hostName, const String& serviceName, double nextCheck);
 
 	static void LastCheckStartedChangedHandler(const Checkable::Ptr& checkable, const MessageOrigin::Ptr& origin);
 	static Value LastCheckStartedChangedAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+	static void LastCheckStartedChangedMessageHandler(const MessageOrigin::Ptr& origin, const String& hostName, const String& serviceName, double lastCheckStarted);
 
 	static void StateBeforeSuppressionChangedHandler(const Checkable::Ptr& checkable, const MessageOrigin::Ptr& origin);
 	static Value StateBeforeSuppressionChangedAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
@@ -93,6 +97,7 @@ private:
 	static Timer::Ptr m_LogTimer;
 
 	static void RemoteCheckThreadProc();
+	static Checkable::Ptr GetMessageCheckable(const String& hostName, const String& serviceName);
 	static void EnqueueCheck(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 	static void ExecuteCheckFromQueue(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 };
@@ -44,6 +44,26 @@ void PluginUtility::ExecuteCommand(const Command::Ptr& commandObj,
 		return;
 	}
 
+	Dictionary::Ptr envMacros = ResolveEnvironment(commandObj, cr, macroResolvers, resolvedMacros, useResolvedMacros);
+
+	if (resolvedMacros && !useResolvedMacros)
+		return;
+
+	Process::Ptr process = new Process(Process::PrepareCommand(command), envMacros);
+
+	process->SetTimeout(timeout);
+	process->SetAdjustPriority(true);
+
+	process->Run([callback, command](const ProcessResult& pr) { callback(command, pr); });
+}
+
+/**
+ * Resolves the macros in the environment variables of a command.
+ */
+Dictionary::Ptr PluginUtility::ResolveEnvironment(const Command::Ptr& commandObj,
+	const CheckResult::Ptr& cr, const MacroProcessor::ResolverList& macroResolvers,
+	const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros)
+{
 	Dictionary::Ptr envMacros = new Dictionary();
 
 	Dictionary::Ptr env = commandObj->GetEnv();
@@ -71,15 +91,7 @@ void PluginUtility::ExecuteCommand(const Command::Ptr& commandObj,
 		}
 	}
 
-	if (resolvedMacros && !useResolvedMacros)
-		return;
-
-	Process::Ptr process = new Process(Process::PrepareCommand(command), envMacros);
-
-	process->SetTimeout(timeout);
-	process->SetAdjustPriority(true);
-
-	process->Run([callback, command](const ProcessResult& pr) { callback(command, pr); });
+	return envMacros;
 }
 
 ServiceState PluginUtility::ExitStatusToState(int exitStatus)
@@ -473,7 +473,7 @@ void IfwApiCheckTask::ScriptFunc(const Checkable::Ptr& checkable, const CheckRes
 
 			// Post the check result processing to the global pool not to block the I/O threads,
 			// which could affect processing important RPC messages and HTTP connections.
-			Utility::QueueAsyncCallback(reportResult);
+			Utility::QueueAsyncCallback(reportResult, LowLatencyScheduler);
 		}
 	);
 }
@@ -0,0 +1,138 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "methods/pluginworkerchecktask.hpp"
+#include "methods/pluginchecktask.hpp"
+#include "methods/pluginworkerpool.hpp"
+#include "icinga/pluginutility.hpp"
+#include "icinga/checkcommand.hpp"
+#include "icinga/macroprocessor.hpp"
+#include "base/function.hpp"
+#include "base/logger.hpp"
+#include "base/utility.hpp"
+#include "base/process.hpp"
+#include "base/convert.hpp"
+
+using namespace icinga;
+
+REGISTER_FUNCTION_NONCONST(Internal, PluginWorkerCheck, &PluginWorkerCheckTask::ScriptFunc, "checkable:cr:producer:resolvedMacros:useResolvedMacros");
+
+void PluginWorkerCheckTask::ScriptFunc(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr,
+	const WaitGroup::Ptr& producer, const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros)
+{
+	REQUIRE_NOT_NULL(checkable);
+	REQUIRE_NOT_NULL(cr);
+
+	CheckCommand::Ptr commandObj = CheckCommand::ExecuteOverride ? CheckCommand::ExecuteOverride : checkable->GetCheckCommand();
+
+	Host::Ptr host;
+	Service::Ptr service;
+	tie(host, service) = GetHostService(checkable);
+
+	MacroProcessor::ResolverList resolvers;
+
+	if (MacroResolver::OverrideMacros)
+		resolvers.emplace_back("override", MacroResolver::OverrideMacros);
+
+	if (service)
+		resolvers.emplace_back("service", service);
+	resolvers.emplace_back("host", host);
+	resolvers.emplace_back("command", commandObj);
+
+	/* All checks of the command share its workers, so these don't depend on the checkable. */
+	MacroProcessor::ResolverList commandResolvers;
+	commandResolvers.emplace_back("command", commandObj);
+
+	int timeout = commandObj->GetTimeout();
+
+	if (!checkable->GetCheckTimeout().IsEmpty())
+		timeout = checkable->GetCheckTimeout();
+
+	std::function<void(const Value& commandLine, const ProcessResult&)> callback;
+
+	if (Checkable::ExecuteCommandProcessFinishedHandler) {
+		callback = Checkable::ExecuteCommandProcessFinishedHandler;
+	} else {
+		callback = [checkable, cr, producer](const Value& commandLine, const ProcessResult& pr) {
+			PluginCheckTask::ProcessFinishedHandler(checkable, cr, producer, commandLine, pr);
+		};
+	}
+
+	CheckResult::Ptr lastCr = checkable->GetLastCheckResult();
+
+	Value workerCommand, commandLine, checkArguments;
+	Dictionary::Ptr env;
+	long processes, concurrency, maxChecks;
+
+	try {
+		/* The worker is started with the command only, the arguments are sent along with each check. */
+		workerCommand = MacroProcessor::ResolveArguments(commandObj->GetCommandLine(), nullptr,
+			commandResolvers, lastCr, resolvedMacros, useResolvedMacros);
+
+		commandLine = MacroProcessor::ResolveArguments(commandObj->GetCommandLine(), commandObj->GetArguments(),
+			resolvers, lastCr, resolvedMacros, useResolvedMacros);
+
+		/* Resolved on their own, as a string command line becomes e.g. sh -c "..." and the arguments can't be told apart. */
+		checkArguments = MacroProcessor::ResolveArguments(new Array(), commandObj->GetArguments(),
+			resolvers, lastCr, resolvedMacros, useResolvedMacros);
+
+		env = PluginUtility::ResolveEnvironment(commandObj, lastCr, resolvers, resolvedMacros, useResolvedMacros);
+
+		processes = Convert::ToLong(MacroProcessor::ResolveMacros("$plugin_worker_processes$", commandResolvers, lastCr,
+			nullptr, MacroProcessor::EscapeCallback(), resolvedMacros, useResolvedMacros));
+
+		concurrency = Convert::ToLong(MacroProcessor::ResolveMacros("$plugin_worker_concurrency$", commandResolvers, lastCr,
+			nullptr, MacroProcessor::EscapeCallback(), resolvedMacros, useResolvedMacros));
+
+		maxChecks = Convert::ToLong(MacroProcessor::ResolveMacros("$plugin_worker_max_checks$", commandResolvers, lastCr,
+			nullptr, MacroProcessor::EscapeCallback(), resolvedMacros, useResolvedMacros));
+	} catch (const std::exception& ex) {
+		String message = DiagnosticInformation(ex);
+
+		Log(LogWarning, "PluginWorkerCheckTask", message);
+
+		if (resolvedMacros && !useResolvedMacros)
+			return;
+
+		Checkable::CurrentConcurrentChecks.fetch_add(1);
+		Checkable::IncreasePendingChecks();
+
+		ProcessResult pr;
+		pr.PID = -1;
+		pr.ExecutionStart = Utility::GetTime();
+		pr.ExecutionEnd = pr.ExecutionStart;
+		pr.ExitStatus = 3; /* Unknown */
+		pr.Output = message;
+		callback(Empty, pr);
+
+		return;
+	}
+
+	if (resolvedMacros && !useResolvedMacros)
+		return;
+
+	Checkable::CurrentConcurrentChecks.fetch_add(1);
+	Checkable::IncreasePendingChecks();
+
+#ifdef _WIN32
+	ProcessResult pr;
+	pr.PID = -1;
+	pr.ExecutionStart = Utility::GetTime();
+	pr.ExecutionEnd = pr.ExecutionStart;
+	pr.ExitStatus = 3; /* Unknown */
+	pr.Output = "Plugin workers are not supported on Windows.";
+	callback(commandLine, pr);
+#else /* _WIN32 */
+	Process::Arguments workerArguments = Process::PrepareCommand(workerCommand);
+
+	Dictionary::Ptr request = new Dictionary({
+		{ "arguments", checkArguments },
+		{ "env", env },
+		{ "timeout", timeout }
+	});
+
+	PluginWorkerPool::Ptr pool = PluginWorkerPool::GetPool(commandObj->GetName());
+
+	pool->Configure(workerArguments, processes, concurrency, maxChecks);
+	pool->Execute(request, timeout, [callback, commandLine](const ProcessResult& pr) { callback(commandLine, pr); });
+#endif /* _WIN32 */
+}
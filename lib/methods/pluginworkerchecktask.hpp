@@ -0,0 +1,31 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#ifndef PLUGINWORKERCHECKTASK_H
+#define PLUGINWORKERCHECKTASK_H
+
+#include "methods/i2-methods.hpp"
+#include "icinga/service.hpp"
+#include "base/dictionary.hpp"
+
+namespace icinga
+{
+
+/**
+ * Implements service checks based on long-running plugin workers which serve
+ * many checks without being executed again for each of them.
+ *
+ * @ingroup methods
+ */
+class PluginWorkerCheckTask
+{
+public:
+	static void ScriptFunc(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr,
+		const WaitGroup::Ptr& producer, const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros);
+
+private:
+	PluginWorkerCheckTask();
+};
+
+}
+
+#endif /* PLUGINWORKERCHECKTASK_H */
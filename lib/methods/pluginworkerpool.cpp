@@ -0,0 +1,575 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#ifndef _WIN32
+
+#include "methods/pluginworkerpool.hpp"
+#include "base/convert.hpp"
+#include "base/defer.hpp"
+#include "base/exception.hpp"
+#include "base/json.hpp"
+#include "base/logger.hpp"
+#include "base/utility.hpp"
+#include <algorithm>
+#include <boost/asio/buffers_iterator.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+using namespace icinga;
+
+/* The maximum length of a single result line. */
+static const size_t l_MaxResultLength = 16 * 1024 * 1024;
+
+/* How long a recycled worker may take to exit after its input has been closed. */
+static const double l_ExitTimeout = 10;
+
+static std::mutex l_PoolsMutex;
+static std::map<String, PluginWorkerPool::Ptr> l_Pools;
+
+PluginWorker::PluginWorker(PluginWorkerPool *pool, Process::Arguments command)
+	: m_Pool(pool), m_Command(std::move(command)), m_Strand(IoEngine::Get().GetIoContext()),
+	m_Input(IoEngine::Get().GetIoContext()), m_Output(IoEngine::Get().GetIoContext()),
+	m_OutgoingMessagesQueued(IoEngine::Get().GetIoContext()), m_ExitTimer(IoEngine::Get().GetIoContext())
+{
+}
+
+/**
+ * Spawns the worker process.
+ *
+ * @return Whether the process has been spawned
+ */
+bool PluginWorker::Start()
+{
+	int input[2], output[2];
+
+	if (pipe2(input, O_CLOEXEC) < 0) {
+		return false;
+	}
+
+	if (pipe2(output, O_CLOEXEC) < 0) {
+		int error = errno;
+		(void)close(input[0]);
+		(void)close(input[1]);
+		errno = error;
+		return false;
+	}
+
+	int fds[3] = { input[0], output[1], STDERR_FILENO };
+
+	m_PID = Process::SpawnChild(m_Command, nullptr, true, fds, m_SpawnHelper);
+
+	int error = errno;
+
+	(void)close(input[0]);
+	(void)close(output[1]);
+
+	if (m_PID == -1) {
+		(void)close(input[1]);
+		(void)close(output[0]);
+		errno = error;
+		return false;
+	}
+
+	Log(LogNotice, "PluginWorker")
+		<< "Started plugin worker " << Process::PrettyPrintArguments(m_Command) << ": PID " << m_PID;
+
+	m_Input.assign(input[1]);
+	m_Output.assign(output[0]);
+
+	PluginWorker::Ptr keepAlive (this);
+
+	IoEngine::SpawnCoroutine(m_Strand, [this, keepAlive](boost::asio::yield_context yc) { ReadResults(yc); });
+	IoEngine::SpawnCoroutine(m_Strand, [this, keepAlive](boost::asio::yield_context yc) { WriteRequests(yc); });
+
+	return true;
+}
+
+/**
+ * Sends a check to the worker. The callback is invoked in the thread pool.
+ *
+ * @param request The check's arguments and environment
+ * @param timeout The check timeout (0 for none)
+ * @param callback Receives the check's result
+ */
+void PluginWorker::Execute(const Dictionary::Ptr& request, double timeout, const Callback& callback)
+{
+	PluginWorker::Ptr keepAlive (this);
+
+	boost::asio::post(m_Strand, [this, keepAlive, request, timeout, callback]() {
+		double now = Utility::GetTime();
+
+		if (m_Dead) {
+			ProcessResult pr;
+			pr.PID = m_PID;
+			pr.ExecutionStart = now;
+			pr.ExecutionEnd = now;
+			pr.ExitStatus = 128;
+			pr.Output = "<Plugin worker terminated.>";
+
+			Utility::QueueAsyncCallback([callback, pr]() { callback(pr); }, LowLatencyScheduler);
+			return;
+		}
+
+		std::uint64_t id = m_NextID++;
+
+		request->Set("id", id);
+
+		PendingCheck& pending (m_Pending[id]);
+		pending.Callback = callback;
+		pending.ExecutionStart = now;
+
+		if (timeout > 0) {
+			pending.Timer.reset(new boost::asio::deadline_timer(m_Strand.context(),
+				boost::posix_time::microseconds(intmax_t(timeout * 1000000))));
+
+			pending.Timer->async_wait(boost::asio::bind_executor(m_Strand, [this, keepAlive, id](boost::system::error_code ec) {
+				if (!ec) {
+					HandleTimeout(id);
+				}
+			}));
+		}
+
+		m_OutgoingMessages.emplace_back(JsonEncode(request) + "\n");
+		m_OutgoingMessagesQueued.Set();
+	});
+}
+
+/**
+ * Closes the worker's input once all queued checks have been sent, so that it exits
+ * after it has finished them. The worker is killed if it doesn't exit in time
+ * after its last check has finished, the checks themselves are subject to their timeouts.
+ */
+void PluginWorker::Stop()
+{
+	PluginWorker::Ptr keepAlive (this);
+
+	boost::asio::post(m_Strand, [this, keepAlive]() {
+		if (m_Closing || m_Dead) {
+			return;
+		}
+
+		m_Closing = true;
+		m_OutgoingMessagesQueued.Set();
+
+		if (m_Pending.empty()) {
+			StartExitTimer();
+		}
+	});
+}
+
+/**
+ * Kills the stopped worker unless it exits in time.
+ */
+void PluginWorker::StartExitTimer()
+{
+	PluginWorker::Ptr keepAlive (this);
+
+	m_ExitTimer.expires_from_now(boost::posix_time::microseconds(intmax_t(l_ExitTimeout * 1000000)));
+	m_ExitTimer.async_wait(boost::asio::bind_executor(m_Strand, [this, keepAlive](boost::system::error_code ec) {
+		if (!ec) {
+			Terminate("Plugin worker didn't exit after " + Convert::ToString(l_ExitTimeout) + " seconds.");
+		}
+	}));
+}
+
+pid_t PluginWorker::GetPID() const
+{
+	return m_PID;
+}
+
+void PluginWorker::ReadResults(boost::asio::yield_context yc)
+{
+	boost::asio::streambuf buffer (l_MaxResultLength);
+
+	for (;;) {
+		boost::system::error_code ec;
+		size_t length = boost::asio::async_read_until(m_Output, buffer, '\n', yc[ec]);
+
+		if (ec) {
+			if (ec == boost::asio::error::not_found) {
+				Terminate("Result exceeds " + Convert::ToString(l_MaxResultLength) + " bytes.");
+			}
+
+			break;
+		}
+
+		auto begin (boost::asio::buffers_begin(buffer.data()));
+		String line (begin, begin + (length - 1u));
+
+		buffer.consume(length);
+
+		CpuBoundWork handleResult (yc, CpuBoundWorkPool::PluginResults);
+
+		HandleResult(line);
+
+		if (m_Dead) {
+			break;
+		}
+	}
+
+	Reap();
+}
+
+void PluginWorker::WriteRequests(boost::asio::yield_context yc)
+{
+	Defer closeInput ([this]() {
+		boost::system::error_code ec;
+		m_Input.close(ec);
+	});
+
+	for (;;) {
+		m_OutgoingMessagesQueued.Wait(yc);
+
+		auto queue (std::move(m_OutgoingMessages));
+
+		m_OutgoingMessages.clear();
+		m_OutgoingMessagesQueued.Clear();
+
+		if (m_Dead) {
+			break;
+		}
+
+		for (auto& message : queue) {
+			boost::system::error_code ec;
+			boost::asio::async_write(m_Input, boost::asio::buffer(message.CStr(), message.GetLength()), yc[ec]);
+
+			if (ec) {
+				Terminate("Error while sending check: " + ec.message());
+				return;
+			}
+		}
+
+		/* More checks may have been queued while we were writing. */
+		if (m_Closing && m_OutgoingMessages.empty()) {
+			break;
+		}
+	}
+}
+
+void PluginWorker::HandleResult(const String& line)
+{
+	Dictionary::Ptr result;
+	std::uint64_t id;
+
+	try {
+		result = JsonDecode(line);
+		id = result->Get("id");
+	} catch (const std::exception& ex) {
+		Terminate("Invalid result: " + DiagnosticInformation(ex, false));
+		return;
+	}
+
+	auto it (m_Pending.find(id));
+
+	if (it == m_Pending.end()) {
+		/* The check has timed out already. */
+		return;
+	}
+
+	ProcessResult pr;
+	pr.PID = m_PID;
+	pr.ExecutionStart = it->second.ExecutionStart;
+	pr.ExecutionEnd = Utility::GetTime();
+	pr.Output = result->Get("output");
+
+	Value exitStatus = result->Get("exit_status");
+	pr.ExitStatus = exitStatus.IsEmpty() ? 3 : static_cast<int>(exitStatus);
+
+	auto callback (std::move(it->second.Callback));
+
+	m_Pending.erase(it);
+
+	Utility::QueueAsyncCallback([callback, pr]() { callback(pr); }, LowLatencyScheduler);
+
+	m_Pool->CheckFinished(this);
+
+	if (m_Closing && m_Pending.empty()) {
+		StartExitTimer();
+	}
+}
+
+void PluginWorker::HandleTimeout(std::uint64_t id)
+{
+	auto it (m_Pending.find(id));
+
+	if (it == m_Pending.end()) {
+		return;
+	}
+
+	double timeout = Utility::GetTime() - it->second.ExecutionStart;
+
+	Log(LogWarning, "PluginWorker")
+		<< "Terminating plugin worker " << m_PID << " (" << Process::PrettyPrintArguments(m_Command)
+		<< ") after timeout of " << timeout << " seconds";
+
+	ProcessResult pr;
+	pr.PID = m_PID;
+	pr.ExecutionStart = it->second.ExecutionStart;
+	pr.ExecutionEnd = Utility::GetTime();
+	pr.ExitStatus = 128;
+	pr.Output = "<Timeout exceeded.>";
+
+	auto callback (std::move(it->second.Callback));
+
+	m_Pending.erase(it);
+
+	Utility::QueueAsyncCallback([callback, pr]() { callback(pr); }, LowLatencyScheduler);
+
+	/* The worker's state is unknown, so it's killed just like a timed out plugin. */
+	Terminate("Timeout exceeded.");
+}
+
+/**
+ * Fails all pending checks and stops talking to the worker. Its process group is killed by Reap()
+ * once ReadResults() has finished, so that it's never signalled after it has been waited for.
+ */
+void PluginWorker::Terminate(const String& reason)
+{
+	if (m_Dead) {
+		return;
+	}
+
+	m_Dead = true;
+	m_Pool->WorkerFailed(this);
+
+	if (!m_Pending.empty()) {
+		Log(LogWarning, "PluginWorker")
+			<< "Plugin worker " << m_PID << " (" << Process::PrettyPrintArguments(m_Command) << ") failed with "
+			<< m_Pending.size() << " pending checks: " << reason;
+	}
+
+	double now = Utility::GetTime();
+
+	for (auto& kv : m_Pending) {
+		if (kv.second.Timer) {
+			kv.second.Timer->cancel();
+		}
+
+		ProcessResult pr;
+		pr.PID = m_PID;
+		pr.ExecutionStart = kv.second.ExecutionStart;
+		pr.ExecutionEnd = now;
+		pr.ExitStatus = 128;
+		pr.Output = "<Plugin worker terminated: " + reason + ">";
+
+		auto callback (std::move(kv.second.Callback));
+
+		Utility::QueueAsyncCallback([callback, pr]() { callback(pr); }, LowLatencyScheduler);
+	}
+
+	m_Pending.clear();
+	m_OutgoingMessagesQueued.Set();
+
+	/* Makes a pending read or write return even if the worker is stuck, so ReadResults() reaps it. */
+	boost::system::error_code ec;
+	m_Output.cancel(ec);
+	m_Input.cancel(ec);
+}
+
+/**
+ * Kills the worker's process group and reaps the worker after its output has been closed.
+ */
+void PluginWorker::Reap()
+{
+	boost::system::error_code ec;
+
+	m_ExitTimer.cancel(ec);
+	m_Output.close(ec);
+
+	Terminate("Plugin worker exited unexpectedly.");
+
+	PluginWorker::Ptr keepAlive (this);
+
+	Utility::QueueAsyncCallback([this, keepAlive]() {
+		/* The group can't be taken over by others before its leader has been waited for. */
+		(void)Process::KillChild(m_SpawnHelper, -m_PID, SIGKILL);
+
+		int status;
+		if (Process::WaitChild(m_SpawnHelper, m_PID, &status) == m_PID) {
+			Log(LogNotice, "PluginWorker")
+				<< "Plugin worker " << m_PID << " (" << Process::PrettyPrintArguments(m_Command) << ") exited";
+		}
+
+		m_Pool->WorkerExited(this);
+	});
+}
+
+/**
+ * Returns the pool for the specified CheckCommand, creating it if necessary.
+ */
+PluginWorkerPool::Ptr PluginWorkerPool::GetPool(const String& name)
+{
+	std::unique_lock<std::mutex> lock (l_PoolsMutex);
+
+	auto& pool (l_Pools[name]);
+
+	if (!pool) {
+		pool = new PluginWorkerPool();
+	}
+
+	return pool;
+}
+
+/**
+ * Updates the pool's worker command and limits. If the command has changed,
+ * the running workers are recycled once they have finished their checks.
+ *
+ * @param command The worker command
+ * @param processes The maximum number of workers
+ * @param concurrency The maximum number of checks in flight per worker
+ * @param maxChecks The number of checks after which a worker is recycled (0 for unlimited)
+ */
+void PluginWorkerPool::Configure(const Process::Arguments& command, int processes, int concurrency, int maxChecks)
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	if (command != m_Command) {
+		m_Command = command;
+
+		for (auto& worker : m_Workers) {
+			if (!worker->m_Retired) {
+				worker->m_Retired = true;
+				worker->Stop();
+			}
+		}
+	}
+
+	m_Processes = std::max(processes, 1);
+	m_Concurrency = std::max(concurrency, 1);
+	m_MaxChecks = std::max(maxChecks, 0);
+}
+
+void PluginWorkerPool::Execute(const Dictionary::Ptr& request, double timeout, const PluginWorker::Callback& callback)
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	m_Queue.push_back({ request, timeout, callback });
+
+	Dispatch();
+}
+
+/**
+ * Assigns queued checks to workers, starting new ones if necessary.
+ * The caller must hold the mutex.
+ */
+void PluginWorkerPool::Dispatch()
+{
+	while (!m_Queue.empty()) {
+		PluginWorker::Ptr target;
+		int running = 0;
+
+		for (auto& worker : m_Workers) {
+			if (worker->m_Retired) {
+				continue;
+			}
+
+			running++;
+
+			if (worker->m_InFlight >= m_Concurrency) {
+				continue;
+			}
+
+			if (!target || worker->m_InFlight < target->m_InFlight) {
+				target = worker;
+			}
+		}
+
+		QueuedCheck& check (m_Queue.front());
+
+		if (!target) {
+			if (running >= m_Processes) {
+				break;
+			}
+
+			target = new PluginWorker(this, m_Command);
+
+			if (!target->Start()) {
+				int error = errno;
+
+				Log(LogCritical, "PluginWorker")
+					<< "Couldn't start plugin worker " << Process::PrettyPrintArguments(m_Command) << ": "
+					<< Utility::FormatErrorNumber(error);
+
+				ProcessResult pr;
+				pr.PID = -1;
+				pr.ExecutionStart = Utility::GetTime();
+				pr.ExecutionEnd = pr.ExecutionStart;
+				pr.ExitStatus = 128;
+				pr.Output = "Fork failed with error code " + Convert::ToString(error) + " (" + Utility::FormatErrorNumber(error) + ")";
+
+				auto callback (std::move(check.Callback));
+
+				m_Queue.pop_front();
+
+				Utility::QueueAsyncCallback([callback, pr]() { callback(pr); }, LowLatencyScheduler);
+				continue;
+			}
+
+			m_Workers.emplace_back(target);
+		}
+
+		target->m_InFlight++;
+		target->m_Assigned++;
+
+		target->Execute(check.Request, check.Timeout, check.Callback);
+
+		m_Queue.pop_front();
+
+		if (m_MaxChecks > 0 && target->m_Assigned >= m_MaxChecks) {
+			/* Recycle the worker once it has finished its checks, a new one is started for the next check. */
+			target->m_Retired = true;
+			target->Stop();
+		}
+	}
+}
+
+/**
+ * Dispatches queued checks in the thread pool. Used by the workers which
+ * run in the I/O threads where we shouldn't start new workers.
+ */
+void PluginWorkerPool::DispatchAsync()
+{
+	PluginWorkerPool::Ptr pool (this);
+
+	Utility::QueueAsyncCallback([pool]() {
+		std::unique_lock<std::mutex> lock (pool->m_Mutex);
+
+		pool->Dispatch();
+	});
+}
+
+void PluginWorkerPool::CheckFinished(PluginWorker *worker)
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	worker->m_InFlight--;
+
+	if (!m_Queue.empty()) {
+		DispatchAsync();
+	}
+}
+
+void PluginWorkerPool::WorkerFailed(PluginWorker *worker)
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	worker->m_Retired = true;
+
+	if (!m_Queue.empty()) {
+		DispatchAsync();
+	}
+}
+
+void PluginWorkerPool::WorkerExited(PluginWorker *worker)
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	m_Workers.erase(std::remove(m_Workers.begin(), m_Workers.end(), worker), m_Workers.end());
+
+	Dispatch();
+}
+
+#endif /* _WIN32 */
@@ -0,0 +1,143 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#ifndef PLUGINWORKERPOOL_H
+#define PLUGINWORKERPOOL_H
+
+#include "methods/i2-methods.hpp"
+#include "base/dictionary.hpp"
+#include "base/io-engine.hpp"
+#include "base/object.hpp"
+#include "base/process.hpp"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/io_context_strand.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/spawn.hpp>
+
+#ifndef _WIN32
+
+namespace icinga
+{
+
+class PluginWorkerPool;
+
+/**
+ * A long-running plugin process which serves checks sent to its standard input
+ * and writes their results to its standard output, one JSON object per line.
+ *
+ * @ingroup methods
+ */
+class PluginWorker final : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(PluginWorker);
+
+	typedef std::function<void (const ProcessResult&)> Callback;
+
+	PluginWorker(PluginWorkerPool *pool, Process::Arguments command);
+
+	bool Start();
+	void Execute(const Dictionary::Ptr& request, double timeout, const Callback& callback);
+	void Stop();
+
+	pid_t GetPID() const;
+
+private:
+	friend class PluginWorkerPool;
+
+	struct PendingCheck
+	{
+		PluginWorker::Callback Callback;
+		double ExecutionStart;
+		std::unique_ptr<boost::asio::deadline_timer> Timer;
+	};
+
+	/* Used by the pool only, guarded by its mutex. */
+	int m_InFlight{0};
+	int m_Assigned{0};
+	bool m_Retired{false};
+
+	PluginWorkerPool *m_Pool;
+	Process::Arguments m_Command;
+
+	boost::asio::io_context::strand m_Strand;
+	boost::asio::posix::stream_descriptor m_Input;
+	boost::asio::posix::stream_descriptor m_Output;
+	pid_t m_PID{-1};
+	unsigned int m_SpawnHelper{0};
+
+	/* Used in m_Strand only. */
+	std::uint64_t m_NextID{0};
+	std::map<std::uint64_t, PendingCheck> m_Pending;
+	std::vector<String> m_OutgoingMessages;
+	AsioEvent m_OutgoingMessagesQueued;
+	boost::asio::deadline_timer m_ExitTimer;
+	bool m_Closing{false};
+	bool m_Dead{false};
+
+	void ReadResults(boost::asio::yield_context yc);
+	void WriteRequests(boost::asio::yield_context yc);
+	void HandleResult(const String& line);
+	void HandleTimeout(std::uint64_t id);
+	void StartExitTimer();
+	void Terminate(const String& reason);
+	void Reap();
+};
+
+/**
+ * The workers for one CheckCommand.
+ *
+ * Checks are assigned to the worker with the least checks in flight. Workers are started on demand
+ * up to a limit and recycled after a number of checks. Checks which can't be assigned to any worker
+ * are queued until one becomes available.
+ *
+ * @ingroup methods
+ */
+class PluginWorkerPool final : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(PluginWorkerPool);
+
+	static PluginWorkerPool::Ptr GetPool(const String& name);
+
+	void Configure(const Process::Arguments& command, int processes, int concurrency, int maxChecks);
+	void Execute(const Dictionary::Ptr& request, double timeout, const PluginWorker::Callback& callback);
+
+private:
+	friend class PluginWorker;
+
+	struct QueuedCheck
+	{
+		Dictionary::Ptr Request;
+		double Timeout;
+		PluginWorker::Callback Callback;
+	};
+
+	std::mutex m_Mutex;
+	Process::Arguments m_Command;
+	int m_Processes{1};
+	int m_Concurrency{1};
+	int m_MaxChecks{0};
+	std::vector<PluginWorker::Ptr> m_Workers;
+	std::deque<QueuedCheck> m_Queue;
+
+	PluginWorkerPool() = default;
+
+	void Dispatch();
+	void DispatchAsync();
+	void CheckFinished(PluginWorker *worker);
+	void WorkerFailed(PluginWorker *worker);
+	void WorkerExited(PluginWorker *worker);
+};
+
+}
+
+#endif /* _WIN32 */
+
+#endif /* PLUGINWORKERPOOL_H */
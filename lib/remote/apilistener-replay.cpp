@@ -0,0 +1,399 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "remote/apilistener.hpp"
+#include "remote/replaylog.hpp"
+#include "remote/zone.hpp"
+#include "base/context.hpp"
+#include "base/convert.hpp"
+#include "base/exception.hpp"
+#include "base/logger.hpp"
+#include "base/objectlock.hpp"
+#include "base/utility.hpp"
+#include <algorithm>
+#include <limits>
+
+using namespace icinga;
+
+/**
+ * Replays the log to an endpoint which has just connected.
+ *
+ * The endpoint joins the next pass over the log. A pass reads the log files once and sends
+ * each message to all endpoints catching up at that time which need it, so that many
+ * endpoints reconnecting at once don't read the same files over and over again.
+ *
+ * @param client The endpoint's connection
+ * @param callback Called once the endpoint has caught up or failed to
+ */
+void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client, const std::function<void()>& callback)
+{
+	Endpoint::Ptr endpoint = client->GetEndpoint();
+	Zone::Ptr target_zone = endpoint->GetZone();
+
+	if (endpoint->GetLogDuration() == 0 || !target_zone) {
+		{
+			ObjectLock olock(endpoint);
+			endpoint->SetSyncing(false);
+		}
+
+		callback();
+		return;
+	}
+
+	auto participant (std::make_shared<ReplayParticipant>());
+
+	participant->Client = client;
+	participant->TargetZone = target_zone;
+	participant->Callback = callback;
+	participant->PeerTs = endpoint->GetLocalLogPosition();
+	participant->LogPosTs = participant->PeerTs;
+
+	std::unique_lock<std::mutex> lock (m_ReplayMutex);
+
+	m_ReplayParticipants.emplace_back(std::move(participant));
+
+	if (!m_ReplayRunning) {
+		m_ReplayRunning = true;
+		m_SyncQueue.Enqueue([this]() { RunReplay(); });
+	}
+}
+
+/**
+ * Lets an endpoint which falls behind, i.e. whose outgoing queue is full, catch up via the log
+ * while its connection stays open. Messages for it are written to the log until it has caught up.
+ *
+ * @param client The endpoint's connection
+ * @return false if the endpoint is catching up already, true otherwise
+ */
+bool ApiListener::CatchUp(const JsonRpcConnection::Ptr& client)
+{
+	Endpoint::Ptr endpoint = client->GetEndpoint();
+
+	{
+		ObjectLock olock(endpoint);
+
+		if (endpoint->GetSyncing())
+			return false;
+
+		endpoint->SetSyncing(true);
+	}
+
+	ReplayLog(client, [endpoint]() {
+		Log(LogInformation, "ApiListener")
+			<< "Endpoint '" << endpoint->GetName() << "' has caught up via the replay log.";
+	});
+
+	return true;
+}
+
+/**
+ * Runs passes over the log until no endpoint is catching up anymore.
+ */
+void ApiListener::RunReplay()
+{
+	for (;;) {
+		std::vector<std::shared_ptr<ReplayParticipant>> participants;
+
+		{
+			std::unique_lock<std::mutex> lock (m_ReplayMutex);
+
+			if (m_ReplayParticipants.empty()) {
+				m_ReplayRunning = false;
+				return;
+			}
+
+			/* Endpoints joining during the pass wait for the next one. */
+			participants = m_ReplayParticipants;
+		}
+
+		/* The final rounds run separately, so that only they hold m_LogLock,
+		 * and only from where the finishing endpoints are.
+		 */
+		std::vector<std::shared_ptr<ReplayParticipant>> catchingUp, finishing;
+
+		for (auto& participant : participants) {
+			participant->LastSync = participant->Count != -1 && participant->Count <= 50000;
+
+			(participant->LastSync ? finishing : catchingUp).emplace_back(participant);
+		}
+
+		for (auto group : { &catchingUp, &finishing }) {
+			if (group->empty())
+				continue;
+
+			try {
+				RunReplayPass(*group, group == &finishing);
+			} catch (const std::exception& ex) {
+				Log(LogCritical, "ApiListener")
+					<< "Error while replaying log: " << DiagnosticInformation(ex, false);
+
+				for (auto& participant : *group) {
+					participant->Failed = true;
+				}
+			}
+
+			m_ReplayPasses.fetch_add(1);
+		}
+
+		std::vector<std::shared_ptr<ReplayParticipant>> finished;
+
+		{
+			std::unique_lock<std::mutex> lock (m_ReplayMutex);
+
+			for (auto& participant : participants) {
+				if (participant->Failed || (participant->LastSync && !participant->Detached)) {
+					finished.emplace_back(participant);
+					m_ReplayParticipants.erase(std::find(m_ReplayParticipants.begin(), m_ReplayParticipants.end(), participant));
+				}
+			}
+		}
+
+		for (auto& participant : finished) {
+			FinishReplay(*participant);
+		}
+	}
+}
+
+/**
+ * Reads the log once and sends the messages to the endpoints catching up.
+ *
+ * Every endpoint takes part in at least two passes. The last one holds m_LogLock, so that
+ * no new messages are written to the log meanwhile. An endpoint's last pass is the one after
+ * a pass which replayed at most 50000 messages to it.
+ *
+ * @param participants The endpoints catching up
+ * @param lastSync Whether this is the last pass of all the endpoints
+ */
+void ApiListener::RunReplayPass(const std::vector<std::shared_ptr<ReplayParticipant>>& participants, bool lastSync)
+{
+	size_t active = participants.size();
+
+	for (auto& participant : participants) {
+		participant->Detached = false;
+		participant->Count = 0;
+	}
+
+	std::unique_lock<std::mutex> lock(m_LogLock);
+
+	/* Make the messages written so far readable, the file stays open for new ones. */
+	if (m_LogFile)
+		m_LogFile->Flush();
+
+	if (!lastSync)
+		lock.unlock();
+
+	auto minPeerTs ([&participants]() {
+		double ts = std::numeric_limits<double>::max();
+
+		for (auto& participant : participants) {
+			if (!participant->Detached && !participant->Failed)
+				ts = std::min(ts, participant->PeerTs);
+		}
+
+		return ts;
+	});
+
+	std::vector<std::uint64_t> files;
+	Utility::Glob(GetApiDir() + "log/*", [&files](const String& file) { LogGlobHandler(files, file); }, GlobFile);
+	std::sort(files.begin(), files.end());
+
+	std::vector<std::pair<std::uint64_t, String>> allFiles;
+	double peerTs = minPeerTs();
+
+	for (auto ts : files) {
+		if (ts >= peerTs) {
+			allFiles.emplace_back(ts, GetApiDir() + "log/" + Convert::ToString(ts));
+		}
+	}
+
+	allFiles.emplace_back(static_cast<std::uint64_t>(Utility::GetTime()) + 1, GetApiDir() + "log/current");
+
+	/* Which of the participants the current record is for. */
+	std::vector<char> wanted (participants.size());
+
+	auto filter ([&participants, &wanted](const ReplayLogRecord& record) {
+		bool any = false;
+
+		for (size_t i = 0; i < participants.size(); i++) {
+			auto& participant (*participants[i]);
+
+			wanted[i] = !participant.Detached && !participant.Failed && participant.Wants(record);
+			any = any || wanted[i];
+		}
+
+		return any;
+	});
+
+	for (auto& file : allFiles) {
+		if (!active)
+			break;
+
+		Log(LogNotice, "ApiListener")
+			<< "Replaying log: " << file.second << " for " << active << " endpoint(s)";
+
+		ReplayLogReader reader (file.second);
+
+		/* Skip the messages all endpoints already got, as far as the file's index allows. */
+		reader.Seek(minPeerTs());
+
+		ReplayLogRecord record;
+
+		while (active) {
+			try {
+				if (!reader.Read(record, filter))
+					break;
+			} catch (const std::exception&) {
+				Log(LogWarning, "ApiListener")
+					<< "Unexpected end-of-file for cluster log: " << file.second;
+
+				/* Log files may be incomplete or corrupted. This is perfectly OK. */
+				break;
+			}
+
+			/* Shared by all endpoints the message is sent to. */
+			EncodedJsonRpcMessage::Ptr message = new EncodedJsonRpcMessage(record.Message);
+
+			for (size_t i = 0; i < participants.size(); i++) {
+				if (!wanted[i])
+					continue;
+
+				auto& participant (*participants[i]);
+				auto& client (participant.Client);
+
+				/* Don't let the replayed messages exceed the outgoing queue's byte budget.
+				 * Rather than holding up the other endpoints or, during the last pass,
+				 * the writers of the log, a slow one continues with the next pass.
+				 */
+				while (client->IsOutgoingQueueFull()) {
+					if (lastSync || active > 1) {
+						participant.Detached = true;
+						break;
+					}
+
+					Utility::Sleep(0.01);
+				}
+
+				if (participant.Detached) {
+					active--;
+					continue;
+				}
+
+				try {
+					client->SendEncodedMessage(message, true);
+					participant.Count++;
+				} catch (const std::exception& ex) {
+					String name = client->GetEndpoint()->GetName();
+
+					Log(LogWarning, "ApiListener")
+						<< "Error while replaying log for endpoint '" << name << "': " << ex.what();
+
+					Log(LogDebug, "ApiListener")
+						<< "Error while replaying log for endpoint '" << name << "': " << DiagnosticInformation(ex);
+
+					participant.Failed = true;
+					active--;
+					continue;
+				}
+
+				m_ReplayedMessages.fetch_add(1);
+				participant.PeerTs = record.Timestamp;
+
+				if (file.first > participant.LogPosTs + 10) {
+					participant.LogPosTs = file.first;
+
+					Dictionary::Ptr lmessage = new Dictionary({
+						{ "jsonrpc", "2.0" },
+						{ "method", "log::SetLogPosition" },
+						{ "params", new Dictionary({
+							{ "log_position", participant.LogPosTs }
+						}) }
+					});
+
+					client->SendMessage(lmessage);
+				}
+			}
+		}
+	}
+
+	for (auto& participant : participants) {
+		if (participant->Failed)
+			continue;
+
+		if (participant->Detached) {
+			/* The pass didn't get through, so the next one can't be the last one. */
+			participant->Count = -1;
+			continue;
+		}
+
+		Endpoint::Ptr endpoint = participant->Client->GetEndpoint();
+		String name = endpoint->GetName();
+
+		if (lastSync) {
+			/* Still holding m_LogLock, so that the endpoint gets all messages written to the log after this one directly. */
+			ObjectLock olock(endpoint);
+			endpoint->SetSyncing(false);
+		}
+
+		if (participant->Count > 0) {
+			Log(LogInformation, "ApiListener")
+				<< "Replayed " << participant->Count << " messages to endpoint '" << name << "'.";
+		} else {
+			Log(LogNotice, "ApiListener")
+				<< "Replayed " << participant->Count << " messages to endpoint '" << name << "'.";
+		}
+	}
+}
+
+/**
+ * Decides based on a record's metadata whether the endpoint needs the message.
+ *
+ * @param record The record, without the message
+ * @return Whether the endpoint needs the message
+ */
+bool ApiListener::ReplayParticipant::Wants(const ReplayLogRecord& record)
+{
+	if (record.Timestamp <= PeerTs)
+		return false;
+
+	if (record.SecobjType.IsEmpty())
+		return true;
+
+	/* Converted from the old format, which didn't contain the zone. */
+	if (record.Zone.IsEmpty()) {
+		ConfigObject::Ptr secobj = ConfigObject::GetObject(record.SecobjType, record.SecobjName);
+
+		return secobj && TargetZone->CanAccessObject(secobj);
+	}
+
+	auto access (ZoneAccess.find(record.Zone));
+
+	if (access == ZoneAccess.end()) {
+		/* The zone may have been removed since. */
+		Zone::Ptr zone = Zone::GetByName(record.Zone);
+
+		access = ZoneAccess.emplace(record.Zone, zone && TargetZone->CanAccessZone(zone)).first;
+	}
+
+	return access->second;
+}
+
+/**
+ * Ends the replay for an endpoint, which receives the messages directly from now on.
+ *
+ * @param participant The endpoint catching up
+ */
+void ApiListener::FinishReplay(const ReplayParticipant& participant)
+{
+	Endpoint::Ptr endpoint = participant.Client->GetEndpoint();
+
+	{
+		ObjectLock olock(endpoint);
+		endpoint->SetSyncing(false);
+	}
+
+	try {
+		participant.Callback();
+	} catch (const std::exception& ex) {
+		Log(LogCritical, "ApiListener")
+			<< "Error while syncing endpoint '" << endpoint->GetName() << "': " << DiagnosticInformation(ex, false);
+	}
+}
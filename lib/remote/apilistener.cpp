@@ -6,24 +6,24 @@
 #include "remote/endpoint.hpp"
 #include "remote/jsonrpc.hpp"
 #include "remote/apifunction.hpp"
+#include "remote/binarymessage.hpp"
 #include "remote/configpackageutility.hpp"
 #include "remote/configobjectutility.hpp"
 #include "base/atomic-file.hpp"
 #include "base/convert.hpp"
 #include "base/defer.hpp"
 #include "base/io-engine.hpp"
-#include "base/netstring.hpp"
 #include "base/json.hpp"
 #include "base/configtype.hpp"
 #include "base/logger.hpp"
 #include "base/objectlock.hpp"
-#include "base/stdiostream.hpp"
 #include "base/perfdatavalue.hpp"
 #include "base/application.hpp"
 #include "base/context.hpp"
 #include "base/statsfunction.hpp"
 #include "base/exception.hpp"
 #include "base/tcpsocket.hpp"
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/asio/buffer.hpp>
 #include <boost/asio/io_context_strand.hpp>
 #include <boost/asio/ip/tcp.hpp>
@@ -34,9 +34,13 @@
 #include <boost/regex.hpp>
 #include <boost/system/error_code.hpp>
 #include <boost/thread/locks.hpp>
+#include <algorithm>
 #include <climits>
+#include <cmath>
 #include <cstdint>
 #include <fstream>
+#include <limits>
+#include <map>
 #include <memory>
 #include <openssl/ssl.h>
 #include <openssl/tls1.h>
@@ -57,7 +61,13 @@ REGISTER_APIFUNCTION(Hello, icinga, &ApiListener::HelloAPIHandler);
 
 ApiListener::ApiListener()
 {
-	m_RelayQueue.SetName("ApiListener, RelayQueue");
+	int relayQueues = std::max(Configuration::Concurrency, 1);
+
+	for (int i = 0; i < relayQueues; i++) {
+		m_RelayQueues.emplace_back(new WorkQueue());
+		m_RelayQueues.back()->SetName("ApiListener, RelayQueue #" + Convert::ToString(i));
+	}
+
 	m_SyncQueue.SetName("ApiListener, SyncQueue");
 }
 
@@ -267,6 +277,7 @@ void ApiListener::Start(bool runtimeCreated)
 
 	{
 		std::unique_lock<std::mutex> lock(m_LogLock);
+		ConvertLegacyLogFiles();
 		OpenLogFile();
 	}
 
@@ -976,13 +987,19 @@ void ApiListener::SyncClient(const JsonRpcConnection::Ptr& aclient, const Endpoi
 		Log(LogInformation, "ApiListener")
 			<< "Sending replay log for endpoint '" << endpoint->GetName() << "' in zone '" << eZone->GetName() << "'.";
 
-		ReplayLog(aclient);
+		ReplayLog(aclient, [endpoint, eZone]() {
+			if (eZone == Zone::GetLocalZone())
+				UpdateObjectAuthority();
 
-		if (eZone == Zone::GetLocalZone())
-			UpdateObjectAuthority();
+			Log(LogInformation, "ApiListener")
+				<< "Finished sending replay log for endpoint '" << endpoint->GetName() << "' in zone '" << eZone->GetName() << "'.";
 
-		Log(LogInformation, "ApiListener")
-			<< "Finished sending replay log for endpoint '" << endpoint->GetName() << "' in zone '" << eZone->GetName() << "'.";
+			Log(LogInformation, "ApiListener")
+				<< "Finished syncing endpoint '" << endpoint->GetName() << "' in zone '" << eZone->GetName() << "'.";
+		});
+
+		/* The replay continues in the background, see ReplayLog(). */
+		return;
 	} catch (const std::exception& ex) {
 		{
 			ObjectLock olock2(endpoint);
@@ -1036,6 +1053,9 @@ void ApiListener::ApiTimerHandler()
 			String path = GetApiDir() + "log/" + Convert::ToString(ts);
 			Log(LogNotice, "ApiListener")
 				<< "Removing old log file: " << path;
+
+			/* See CompressLogFile(). */
+			std::unique_lock<std::mutex> lock (m_LogLock);
 			(void)unlink(path.CStr());
 		}
 	}
@@ -1189,30 +1209,126 @@ void ApiListener::RelayMessage(const MessageOrigin::Ptr& origin,
 	if (!IsActive())
 		return;
 
-	m_RelayQueue.Enqueue([this, origin, secobj, message, log]() { SyncRelayMessage(origin, secobj, message, log); }, PriorityNormal, true);
+	/* Messages for the same zone, and thus for the same object, are routed and encoded in order by the same queue.
+	 * Different zones don't have to wait for each other. But one endpoint may get messages from several queues,
+	 * so the messages are stamped here and m_RelaySequencer sends them to each endpoint in that order.
+	 */
+	Zone::Ptr targetZone = GetRelayTargetZone(secobj);
+	size_t partition = targetZone ? std::hash<String>()(targetZone->GetName()) % m_RelayQueues.size() : 0;
+	RelayTicket ticket = m_RelaySequencer.Stamp(targetZone ? GetRelayEndpoints(targetZone) : std::vector<Endpoint::Ptr>());
+
+	/* Not interleaved: running the message right away on a relay queue thread would wait for the
+	 * message that queue is currently relaying, i.e. for the caller itself.
+	 */
+	m_RelayQueues[partition]->Enqueue([this, origin, secobj, message, log, ticket]() {
+		SyncRelayMessage(origin, secobj, message, log, ticket);
+	});
 }
 
-void ApiListener::PersistMessage(const Dictionary::Ptr& message, const ConfigObject::Ptr& secobj)
+/**
+ * Determines the zone a message about an object is relayed to.
+ *
+ * @param secobj The object, if any
+ * @return The object's zone or the local zone
+ */
+Zone::Ptr ApiListener::GetRelayTargetZone(const ConfigObject::Ptr& secobj)
+{
+	Zone::Ptr target_zone;
+
+	if (secobj) {
+		if (secobj->GetReflectionType() == Zone::TypeInstance)
+			target_zone = static_pointer_cast<Zone>(secobj);
+		else
+			target_zone = static_pointer_cast<Zone>(secobj->GetZone());
+	}
+
+	if (!target_zone)
+		target_zone = Zone::GetLocalZone();
+
+	return target_zone;
+}
+
+/**
+ * Determines the endpoints a message for a zone may be relayed to, i.e. the endpoints of the zones
+ * RelayMessageOne() considers for the zone and its parents. Which of them actually get the message
+ * is only decided when the message is routed.
+ *
+ * @param targetZone The zone the message is relayed to
+ * @return The endpoints, each of them once
+ */
+std::vector<Endpoint::Ptr> ApiListener::GetRelayEndpoints(const Zone::Ptr& targetZone)
+{
+	Zone::Ptr localZone = Zone::GetLocalZone();
+
+	if (!localZone)
+		return {};
+
+	Endpoint::Ptr localEndpoint = GetLocalEndpoint();
+	auto parentZone (localZone->GetParent());
+
+	std::vector<Zone::Ptr> zones ({ targetZone });
+	std::set<Zone::Ptr> relayZones;
+	std::set<Endpoint::Ptr> endpoints;
+
+	for (const Zone::Ptr& zone : targetZone->GetAllParentsRaw()) {
+		zones.emplace_back(zone);
+	}
+
+	for (const Zone::Ptr& zone : zones) {
+		if (zone->GetGlobal()) {
+			relayZones.insert(localZone);
+
+			for (const Zone::Ptr& child : ConfigType::GetObjectsByType<Zone>()) {
+				if (child->GetParent() == localZone) {
+					relayZones.insert(child);
+				}
+			}
+		} else if (zone == localZone || zone == parentZone || zone->GetParent() == localZone) {
+			relayZones.insert(zone);
+		}
+	}
+
+	for (const Zone::Ptr& zone : relayZones) {
+		for (const Endpoint::Ptr& endpoint : zone->GetEndpoints()) {
+			if (endpoint != localEndpoint) {
+				endpoints.insert(endpoint);
+			}
+		}
+	}
+
+	return std::vector<Endpoint::Ptr>(endpoints.begin(), endpoints.end());
+}
+
+void ApiListener::PersistMessage(const Dictionary::Ptr& message, const EncodedJsonRpcMessage::Ptr& encodedMessage, const ConfigObject::Ptr& secobj)
 {
 	double ts = message->Get("ts");
 
 	ASSERT(ts != 0);
 
-	Dictionary::Ptr pmessage = new Dictionary();
-	pmessage->Set("timestamp", ts);
-
-	pmessage->Set("message", JsonEncode(message));
+	String secobjType, secobjName, zoneName;
 
 	if (secobj) {
-		Dictionary::Ptr secname = new Dictionary();
-		secname->Set("type", secobj->GetReflectionType()->GetName());
-		secname->Set("name", secobj->GetName());
-		pmessage->Set("secobj", secname);
+		secobjType = secobj->GetReflectionType()->GetName();
+		secobjName = secobj->GetName();
+
+		/* Lets ReplayLog() filter the messages by zone without looking up the objects. */
+		Zone::Ptr zone = Zone::GetObjectZone(secobj);
+
+		if (zone)
+			zoneName = zone->GetName();
 	}
 
+	String method = message->Get("method");
+
 	std::unique_lock<std::mutex> lock(m_LogLock);
 	if (m_LogFile) {
-		NetString::WriteStringToStream(m_LogFile, JsonEncode(pmessage));
+		/* Messages are stamped when they're queued for relaying, so a message may be written after
+		 * the log file was opened at a later time. Replaying the log relies on increasing timestamps,
+		 * so rather replay it once too often than never.
+		 */
+		ts = std::max(ts, std::nextafter(GetLogMessageTimestamp(), std::numeric_limits<double>::infinity()));
+
+		m_LogFile->Write(ts, secobjType, secobjName, zoneName, method, encodedMessage->GetJson());
 		m_LogMessageCount++;
 		SetLogMessageTimestamp(ts);
 
@@ -1225,10 +1341,30 @@ void ApiListener::PersistMessage(const Dictionary::Ptr& message, const ConfigObj
 }
 
 void ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message)
+{
+	size_t sent = 0;
+
+	SyncSendMessage(endpoint, message, nullptr, sent);
+}
+
+/**
+ * Sends a message to the most recent connection of an endpoint.
+ *
+ * @param endpoint The endpoint to send the message to
+ * @param message The message
+ * @param encodedMessage The already encoded message, if any
+ * @param sent Incremented by the number of connections the encoded message has been queued for
+ * @return false if the encoded message couldn't be queued and must be persisted in the replay log, true otherwise
+ */
+bool ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message,
+	const EncodedJsonRpcMessage::Ptr& encodedMessage, size_t& sent)
 {
 	ObjectLock olock(endpoint);
 
-	if (!endpoint->GetSyncing()) {
+	/* The endpoint is catching up via the replay log, see ReplayLog(). */
+	bool queued = !endpoint->GetSyncing();
+
+	if (queued) {
 		Log(LogNotice, "ApiListener")
 			<< "Sending message '" << message->Get("method") << "' to '" << endpoint->GetName() << "'";
 
@@ -1244,13 +1380,23 @@ void ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionar
 				continue;
 
 			try {
-				client->SendMessage(message);
+				if (!encodedMessage) {
+					client->SendMessage(message);
+				} else if (client->SendEncodedMessage(encodedMessage)) {
+					sent++;
+				} else {
+					queued = false;
+				}
 			} catch (const std::runtime_error& ex) {
 				Log(LogNotice, "ApiListener")
 					<< "Error while sending message to endpoint '" << endpoint->GetName() << "': " << DiagnosticInformation(ex, false);
+
+				queued = false;
 			}
 		}
 	}
+
+	return queued;
 }
 
 /**
@@ -1261,10 +1407,13 @@ void ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionar
  * @param origin Information about where this message is relayed from (if it was not generated locally)
  * @param message The message to relay
  * @param currentZoneMaster The current master node of the local zone
+ * @param targetEndpoints Receives the endpoints to send the message to
+ * @param skippedEndpoints Receives the endpoints which don't need the message, their log position is advanced when it's sent
  * @return true if the message has been relayed to all relevant endpoints,
  *         false if it hasn't and must be persisted in the replay log
  */
-bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrigin::Ptr& origin, const Dictionary::Ptr& message, const Endpoint::Ptr& currentZoneMaster)
+bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrigin::Ptr& origin, const Dictionary::Ptr& message,
+	const Endpoint::Ptr& currentZoneMaster, std::vector<Endpoint::Ptr>& targetEndpoints, std::vector<Endpoint::Ptr>& skippedEndpoints)
 {
 	ASSERT(targetZone);
 
@@ -1281,8 +1430,6 @@ bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrig
 
 	Endpoint::Ptr localEndpoint = GetLocalEndpoint();
 
-	std::vector<Endpoint::Ptr> skippedEndpoints;
-
 	std::set<Zone::Ptr> allTargetZones;
 	if (targetZone->GetGlobal()) {
 		/* if the zone is global, the message has to be relayed to our local zone and direct children */
@@ -1375,7 +1522,7 @@ bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrig
 				}
 			}
 
-			SyncSendMessage(targetEndpoint, message);
+			targetEndpoints.emplace_back(targetEndpoint);
 		}
 
 		if (log_needed && !log_done) {
@@ -1383,20 +1530,26 @@ bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrig
 		}
 	}
 
-	if (!skippedEndpoints.empty()) {
-		double ts = message->Get("ts");
-
-		for (const Endpoint::Ptr& skippedEndpoint : skippedEndpoints)
-			skippedEndpoint->SetLocalLogPosition(ts);
-	}
-
 	return !needsReplay;
 }
 
 void ApiListener::SyncRelayMessage(const MessageOrigin::Ptr& origin,
-	const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log)
+	const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log, const RelayTicket& ticket)
 {
-	double ts = Utility::GetTime();
+	/* Every endpoint of the ticket has to get its part, even if there's nothing to send to it,
+	 * or all later messages to that endpoint would wait forever.
+	 */
+	std::map<Endpoint::Ptr, std::function<void()>> sends;
+
+	Defer deliver ([this, &ticket, &sends]() {
+		for (auto& kv : ticket.Sequences) {
+			auto send (sends.find(kv.first));
+
+			m_RelaySequencer.Deliver(ticket, kv.first, send == sends.end() ? std::function<void()>() : std::move(send->second));
+		}
+	});
+
+	double ts = ticket.Timestamp;
 	message->Set("ts", ts);
 
 	Log(LogNotice, "ApiListener")
@@ -1405,29 +1558,87 @@ void ApiListener::SyncRelayMessage(const MessageOrigin::Ptr& origin,
 	if (origin && origin->FromZone)
 		message->Set("originZone", origin->FromZone->GetName());
 
-	Zone::Ptr target_zone;
-
-	if (secobj) {
-		if (secobj->GetReflectionType() == Zone::TypeInstance)
-			target_zone = static_pointer_cast<Zone>(secobj);
-		else
-			target_zone = static_pointer_cast<Zone>(secobj->GetZone());
-	}
-
-	if (!target_zone)
-		target_zone = Zone::GetLocalZone();
+	Zone::Ptr target_zone = GetRelayTargetZone(secobj);
 
 	Endpoint::Ptr master = GetMaster();
 
-	bool need_log = !RelayMessageOne(target_zone, origin, message, master);
+	std::vector<Endpoint::Ptr> targetEndpoints, skippedEndpoints;
+
+	bool need_log = !RelayMessageOne(target_zone, origin, message, master, targetEndpoints, skippedEndpoints);
 
 	for (const Zone::Ptr& zone : target_zone->GetAllParentsRaw()) {
-		if (!RelayMessageOne(zone, origin, message, master))
+		if (!RelayMessageOne(zone, origin, message, master, targetEndpoints, skippedEndpoints))
 			need_log = true;
 	}
 
-	if (log && need_log)
-		PersistMessage(message, secobj);
+	for (const Endpoint::Ptr& skippedEndpoint : skippedEndpoints) {
+		sends[skippedEndpoint] = [skippedEndpoint, ts]() { skippedEndpoint->SetLocalLogPosition(ts); };
+	}
+
+	if (targetEndpoints.empty() && !(log && need_log))
+		return;
+
+	/* Encode the message only once for all endpoints and the replay log. */
+	auto encodeStart (AtomicDuration::Clock::now());
+	EncodedJsonRpcMessage::Ptr encodedMessage = new EncodedJsonRpcMessage(JsonEncode(message), JsonRpc::GetMessagePriority(message), message);
+	auto encodeTime (AtomicDuration::Clock::now() - encodeStart);
+
+	struct Progress
+	{
+		Atomic<size_t> Remaining {0};
+		Atomic<bool> NeedLog {false};
+		Atomic<size_t> Uses {0};
+	};
+
+	auto progress (std::make_shared<Progress>());
+	progress->Remaining.store(targetEndpoints.size());
+	progress->NeedLog.store(need_log);
+
+	/* Persists the message once it has been sent to all endpoints which may be backlogged to a different degree. */
+	auto finish ([this, secobj, message, log, encodedMessage, encodeTime, progress]() {
+		size_t uses = progress->Uses.load();
+
+		if (log && progress->NeedLog.load()) {
+			PersistMessage(message, encodedMessage, secobj);
+			uses++;
+		}
+
+		m_RelayEncodes.fetch_add(1);
+
+		if (uses > 1) {
+			m_RelayEncodesSaved.fetch_add(uses - 1);
+			m_RelayEncodeTimeSaved += encodeTime * (uses - 1);
+		}
+	});
+
+	if (targetEndpoints.empty()) {
+		finish();
+		return;
+	}
+
+	for (const Endpoint::Ptr& endpoint : targetEndpoints) {
+		auto send ([this, endpoint, message, encodedMessage, progress, finish]() {
+			size_t sent = 0;
+
+			/* The endpoint will catch up via the replay log if its outgoing queue is full. */
+			if (!SyncSendMessage(endpoint, message, encodedMessage, sent))
+				progress->NeedLog.store(true);
+
+			progress->Uses.fetch_add(sent);
+
+			if (progress->Remaining.fetch_sub(1) == 1)
+				finish();
+		});
+
+		/* The endpoint has been added after the message was stamped, it hasn't got any earlier ones. */
+		if (std::find_if(ticket.Sequences.begin(), ticket.Sequences.end(),
+			[&endpoint](const std::pair<Endpoint::Ptr, std::uint_fast64_t>& kv) { return kv.first == endpoint; }) == ticket.Sequences.end()) {
+			send();
+			continue;
+		}
+
+		sends[endpoint] = std::move(send);
+	}
 }
 
 /* must hold m_LogLock */
@@ -1437,15 +1648,15 @@ void ApiListener::OpenLogFile()
 
 	Utility::MkDirP(Utility::DirName(path), 0750);
 
-	std::unique_ptr<std::fstream> fp = std::make_unique<std::fstream>(path.CStr(), std::fstream::out | std::ofstream::app);
+	auto logFile (std::make_unique<ReplayLogWriter>(path));
 
-	if (!fp->good()) {
+	if (!logFile->IsOpen()) {
 		Log(LogWarning, "ApiListener")
 			<< "Could not open spool file: " << path;
 		return;
 	}
 
-	m_LogFile = new StdioStream(fp.release(), true);
+	m_LogFile = std::move(logFile);
 	SetLogMessageTimestamp(Utility::GetTime());
 }
 
@@ -1459,6 +1670,34 @@ void ApiListener::CloseLogFile()
 	m_LogFile.reset();
 }
 
+/**
+ * Converts the replay log files written by older versions, so that they can be replayed.
+ *
+ * must hold m_LogLock
+ */
+void ApiListener::ConvertLegacyLogFiles()
+{
+	std::vector<std::uint64_t> files;
+	Utility::Glob(GetApiDir() + "log/*", [&files](const String& file) { LogGlobHandler(files, file); }, GlobFile);
+
+	std::vector<String> paths;
+
+	for (auto ts : files) {
+		paths.emplace_back(GetApiDir() + "log/" + Convert::ToString(ts));
+	}
+
+	paths.emplace_back(GetApiDir() + "log/current");
+
+	for (auto& path : paths) {
+		try {
+			ReplayLogWriter::ConvertLegacyFile(path);
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "ApiListener")
+				<< "Cannot convert replay log file '" << path << "': " << DiagnosticInformation(ex, false);
+		}
+	}
+}
+
 /* must hold m_LogLock */
 void ApiListener::RotateLogFile()
 {
@@ -1482,173 +1721,76 @@ void ApiListener::RotateLogFile()
 			Log(LogCritical, "ApiListener")
 				<< "Cannot rotate replay log file from '" << oldpath << "' to '"
 				<< newpath << "': " << ex.what();
+			return;
 		}
-	}
-}
 
-void ApiListener::LogGlobHandler(std::vector<std::uint64_t>& files, const String& file)
-{
-	String name = Utility::BaseName(file);
-
-	if (name == "current")
-		return;
-
-	try {
-		files.emplace_back(boost::lexical_cast<std::uint64_t>(name));
-	} catch (const std::exception& ex) {
-		Log(LogCritical, "ApiListener")
-			<< "Error converting log file name " << file << " to uint64: " << ex.what();
-		return;
+		if (GetCompressReplayLog()) {
+			// Don't hold up the messages waiting for m_LogLock.
+			Utility::QueueAsyncCallback([this, newpath]() { CompressLogFile(newpath); });
+		}
 	}
 }
 
-void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client)
+/**
+ * Compresses a rotated replay log file, see ReplayLogWriter::CompressFile().
+ *
+ * @param path The log file
+ */
+void ApiListener::CompressLogFile(const String& path)
 {
-	Endpoint::Ptr endpoint = client->GetEndpoint();
-	Defer resetEndpointSyncing ([&endpoint]() {
-		ObjectLock olock(endpoint);
-		endpoint->SetSyncing(false);
-	});
+	String tempPath = path + ".tmp";
+	std::uint64_t inputBytes, outputBytes;
+	auto start (AtomicDuration::Clock::now());
 
-	if (endpoint->GetLogDuration() == 0) {
-		return;
-	}
-
-	CONTEXT("Replaying log for Endpoint '" << endpoint->GetName() << "'");
-
-	int count = -1;
-	double peer_ts = endpoint->GetLocalLogPosition();
-	double logpos_ts = peer_ts;
-	bool last_sync = false;
-
-	Endpoint::Ptr target_endpoint = client->GetEndpoint();
-	ASSERT(target_endpoint);
-
-	Zone::Ptr target_zone = target_endpoint->GetZone();
-
-	if (!target_zone) {
-		return;
-	}
-
-	for (;;) {
-		std::unique_lock<std::mutex> lock(m_LogLock);
+	try {
+		ReplayLogWriter::CompressFile(path, tempPath, inputBytes, outputBytes);
 
-		CloseLogFile();
-		Defer reopenLog;
+		/* ApiTimerHandler() removes old files while holding m_LogLock. Don't bring back one removed meanwhile. */
+		std::unique_lock<std::mutex> lock (m_LogLock);
 
-		if (count == -1 || count > 50000) {
-			OpenLogFile();
+		if (!Utility::PathExists(path)) {
 			lock.unlock();
-		} else {
-			last_sync = true;
-			reopenLog.SetFunc([this]() { OpenLogFile(); });
-		}
-
-		count = 0;
-
-		std::vector<std::uint64_t> files;
-		Utility::Glob(GetApiDir() + "log/*", [&files](const String& file) { LogGlobHandler(files, file); }, GlobFile);
-		std::sort(files.begin(), files.end());
 
-		std::vector<std::pair<std::uint64_t, String>> allFiles;
-
-		for (auto ts : files) {
-			if (ts >= peer_ts) {
-				allFiles.emplace_back(ts, GetApiDir() + "log/" + Convert::ToString(ts));
-			}
-		}
-
-		allFiles.emplace_back(static_cast<std::uint64_t>(Utility::GetTime()) + 1, GetApiDir() + "log/current");
-
-		for (auto& file : allFiles) {
 			Log(LogNotice, "ApiListener")
-				<< "Replaying log: " << file.second;
-
-			auto *fp = new std::fstream(file.second.CStr(), std::fstream::in | std::fstream::binary);
-			StdioStream::Ptr logStream = new StdioStream(fp, true);
-
-			String message;
-			StreamReadContext src;
-			while (true) {
-				Dictionary::Ptr pmessage;
-
-				try {
-					StreamReadStatus srs = NetString::ReadStringFromStream(logStream, &message, src);
-
-					if (srs == StatusEof)
-						break;
-
-					if (srs != StatusNewItem)
-						continue;
-
-					pmessage = JsonDecode(message);
-				} catch (const std::exception&) {
-					Log(LogWarning, "ApiListener")
-						<< "Unexpected end-of-file for cluster log: " << file.second;
-
-					/* Log files may be incomplete or corrupted. This is perfectly OK. */
-					break;
-				}
-
-				if (pmessage->Get("timestamp") <= peer_ts)
-					continue;
-
-				Dictionary::Ptr secname = pmessage->Get("secobj");
+				<< "Not compressing replay log file '" << path << "', it has been removed meanwhile.";
 
-				if (secname) {
-					ConfigObject::Ptr secobj = ConfigObject::GetObject(secname->Get("type"), secname->Get("name"));
-
-					if (!secobj)
-						continue;
-
-					if (!target_zone->CanAccessObject(secobj))
-						continue;
-				}
-
-				try  {
-					client->SendRawMessage(pmessage->Get("message"));
-					count++;
-				} catch (const std::exception& ex) {
-					Log(LogWarning, "ApiListener")
-						<< "Error while replaying log for endpoint '" << endpoint->GetName() << "': " << ex.what();
-
-					Log(LogDebug, "ApiListener")
-						<< "Error while replaying log for endpoint '" << endpoint->GetName() << "': " << DiagnosticInformation(ex);
-					return;
-				}
+			(void)unlink(tempPath.CStr());
+			return;
+		}
 
-				peer_ts = pmessage->Get("timestamp");
+		Utility::RenameFile(tempPath, path);
+	} catch (const std::exception& ex) {
+		// The file may have been removed meanwhile as it's too old.
+		Log(LogWarning, "ApiListener")
+			<< "Cannot compress replay log file '" << path << "': " << DiagnosticInformation(ex, false);
 
-				if (file.first > logpos_ts + 10) {
-					logpos_ts = file.first;
+		(void)unlink(tempPath.CStr());
+		return;
+	}
 
-					Dictionary::Ptr lmessage = new Dictionary({
-						{ "jsonrpc", "2.0" },
-						{ "method", "log::SetLogPosition" },
-						{ "params", new Dictionary({
-							{ "log_position", logpos_ts }
-						}) }
-					});
+	m_LogCompressionTime += AtomicDuration::Clock::now() - start;
+	m_LogFilesCompressed.fetch_add(1);
+	m_LogBytesBeforeCompression.fetch_add(inputBytes);
+	m_LogBytesAfterCompression.fetch_add(outputBytes);
 
-					client->SendMessage(lmessage);
-				}
-			}
+	Log(LogNotice, "ApiListener")
+		<< "Compressed replay log file '" << path << "' from " << inputBytes << " to " << outputBytes << " bytes.";
+}
 
-			logStream->Close();
-		}
+void ApiListener::LogGlobHandler(std::vector<std::uint64_t>& files, const String& file)
+{
+	String name = Utility::BaseName(file);
 
-		if (count > 0) {
-			Log(LogInformation, "ApiListener")
-				<< "Replayed " << count << " messages.";
-		}
-		else {
-			Log(LogNotice, "ApiListener")
-				<< "Replayed " << count << " messages.";
-		}
+	/* Left behind by an interrupted conversion of a replay log file. */
+	if (name == "current" || boost::algorithm::ends_with(name, ".tmp"))
+		return;
 
-		if (last_sync) {
-			return;
-		}
+	try {
+		files.emplace_back(boost::lexical_cast<std::uint64_t>(name));
+	} catch (const std::exception& ex) {
+		Log(LogCritical, "ApiListener")
+			<< "Error converting log file name " << file << " to uint64: " << ex.what();
+		return;
 	}
 }
 
@@ -1743,10 +1885,73 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus()
 	size_t jsonRpcAnonymousClients = GetAnonymousClients().size();
 	size_t httpClients = GetHttpClients().size();
 	size_t syncQueueItems = m_SyncQueue.GetLength();
-	size_t relayQueueItems = m_RelayQueue.GetLength();
+	size_t relayQueueItems = 0;
+	double relayQueueItemRate = 0;
+	ArrayData relayQueues;
+
+	for (auto& queue : m_RelayQueues) {
+		size_t items = queue->GetLength();
+		double itemRate = queue->GetTaskCount(60) / 60.0;
+
+		relayQueueItems += items;
+		relayQueueItemRate += itemRate;
+
+		perfdata->Set("num_json_rpc_relay_queue_" + Convert::ToString(relayQueues.size()) + "_items", items);
+		perfdata->Set("num_json_rpc_relay_queue_" + Convert::ToString(relayQueues.size()) + "_item_rate", itemRate);
+
+		relayQueues.emplace_back(new Dictionary({
+			{ "items", items },
+			{ "item_rate", itemRate }
+		}));
+	}
+
 	double workQueueItemRate = JsonRpcConnection::GetWorkQueueRate();
 	double syncQueueItemRate = m_SyncQueue.GetTaskCount(60) / 60.0;
-	double relayQueueItemRate = m_RelayQueue.GetTaskCount(60) / 60.0;
+	size_t outgoingQueueMessages = 0;
+	size_t outgoingQueueBytes = 0;
+	size_t maxOutgoingQueueBytes = 0;
+
+	for (const Endpoint::Ptr& endpoint : ConfigType::GetObjectsByType<Endpoint>()) {
+		for (const JsonRpcConnection::Ptr& client : endpoint->GetClients()) {
+			size_t bytes = client->GetOutgoingQueueBytes();
+
+			outgoingQueueMessages += client->GetOutgoingQueueMessages();
+			outgoingQueueBytes += bytes;
+			maxOutgoingQueueBytes = std::max(maxOutgoingQueueBytes, bytes);
+		}
+	}
+
+	uint_fast64_t outgoingMessagesDropped = JsonRpcConnection::GetDroppedMessages();
+	uint_fast64_t outgoingMessagesSpilled = JsonRpcConnection::GetSpilledMessages();
+	uint_fast64_t outgoingMessagesCoalesced = JsonRpcConnection::GetCoalescedMessages();
+	uint_fast64_t relayEncodes = m_RelayEncodes.load();
+	uint_fast64_t relayEncodesSaved = m_RelayEncodesSaved.load();
+	double relayEncodeTimeSaved = m_RelayEncodeTimeSaved;
+	uint_fast64_t replayPasses = m_ReplayPasses.load();
+	uint_fast64_t replayedMessages = m_ReplayedMessages.load();
+	size_t replayEndpoints;
+
+	uint_fast64_t binaryMessagesEncoded = BinaryMessageType::GetEncodedMessages();
+	uint_fast64_t binaryMessagesDecoded = BinaryMessageType::GetDecodedMessages();
+
+	JsonRpcCompressionStats compression = JsonRpc::GetCompressionStats();
+	double compressionRatio = compression.BytesBeforeCompression
+		? double(compression.BytesAfterCompression) / compression.BytesBeforeCompression : 0;
+
+	uint_fast64_t logBytesBeforeCompression = m_LogBytesBeforeCompression.load();
+	uint_fast64_t logFilesCompressed = m_LogFilesCompressed.load();
+	double logCompressionRatio = logBytesBeforeCompression
+		? double(m_LogBytesAfterCompression.load()) / logBytesBeforeCompression : 0;
+	double logCompressionTime = m_LogCompressionTime;
+
+	{
+		std::unique_lock<std::mutex> lock (m_ReplayMutex);
+		replayEndpoints = m_ReplayParticipants.size();
+	}
+
+	CpuBoundWorkStats jsonRpcCpuBoundWork = IoEngine::Get().GetCpuBoundWorkStats(CpuBoundWorkPool::JsonRpc);
+	CpuBoundWorkStats httpCpuBoundWork = IoEngine::Get().GetCpuBoundWorkStats(CpuBoundWorkPool::Http);
+	CpuBoundWorkStats pluginResultsCpuBoundWork = IoEngine::Get().GetCpuBoundWorkStats(CpuBoundWorkPool::PluginResults);
 
 	Dictionary::Ptr status = new Dictionary({
 		{ "identity", GetIdentity() },
@@ -1764,11 +1969,49 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus()
 			{ "relay_queue_items", relayQueueItems },
 			{ "work_queue_item_rate", workQueueItemRate },
 			{ "sync_queue_item_rate", syncQueueItemRate },
-			{ "relay_queue_item_rate", relayQueueItemRate }
+			{ "relay_queue_item_rate", relayQueueItemRate },
+			{ "relay_queues", new Array(std::move(relayQueues)) },
+			{ "relay_encodes", relayEncodes },
+			{ "relay_encodes_saved", relayEncodesSaved },
+			{ "relay_encode_time_saved", relayEncodeTimeSaved },
+			{ "outgoing_queue_messages", outgoingQueueMessages },
+			{ "outgoing_queue_bytes", outgoingQueueBytes },
+			{ "max_outgoing_queue_bytes", maxOutgoingQueueBytes },
+			{ "outgoing_messages_dropped", outgoingMessagesDropped },
+			{ "outgoing_messages_spilled", outgoingMessagesSpilled },
+			{ "outgoing_messages_coalesced", outgoingMessagesCoalesced },
+			{ "replay_endpoints", replayEndpoints },
+			{ "replay_passes", replayPasses },
+			{ "replayed_messages", replayedMessages },
+			{ "binary_messages_encoded", binaryMessagesEncoded },
+			{ "binary_messages_decoded", binaryMessagesDecoded },
+			{ "compressed_messages", compression.CompressedMessages },
+			{ "compression_ratio", compressionRatio },
+			{ "compression_time", compression.CompressionTime },
+			{ "decompressed_messages", compression.DecompressedMessages },
+			{ "decompression_time", compression.DecompressionTime },
+			{ "replay_log_files_compressed", logFilesCompressed },
+			{ "replay_log_compression_ratio", logCompressionRatio },
+			{ "replay_log_compression_time", logCompressionTime },
+			{ "cpu_bound_work_slots", jsonRpcCpuBoundWork.Slots },
+			{ "cpu_bound_work_queue_length", jsonRpcCpuBoundWork.QueueLength },
+			{ "cpu_bound_work_waits", jsonRpcCpuBoundWork.Waits },
+			{ "cpu_bound_work_wait_time", jsonRpcCpuBoundWork.WaitTime }
 		}) },
 
 		{ "http", new Dictionary({
-			{ "clients", httpClients }
+			{ "clients", httpClients },
+			{ "cpu_bound_work_slots", httpCpuBoundWork.Slots },
+			{ "cpu_bound_work_queue_length", httpCpuBoundWork.QueueLength },
+			{ "cpu_bound_work_waits", httpCpuBoundWork.Waits },
+			{ "cpu_bound_work_wait_time", httpCpuBoundWork.WaitTime }
+		}) },
+
+		{ "plugin_results", new Dictionary({
+			{ "cpu_bound_work_slots", pluginResultsCpuBoundWork.Slots },
+			{ "cpu_bound_work_queue_length", pluginResultsCpuBoundWork.QueueLength },
+			{ "cpu_bound_work_waits", pluginResultsCpuBoundWork.Waits },
+			{ "cpu_bound_work_wait_time", pluginResultsCpuBoundWork.WaitTime }
 		}) }
 	});
 
@@ -1786,6 +2029,43 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus()
 	perfdata->Set("num_json_rpc_sync_queue_item_rate", syncQueueItemRate);
 	perfdata->Set("num_json_rpc_relay_queue_item_rate", relayQueueItemRate);
 
+	perfdata->Set("num_json_rpc_relay_encodes", relayEncodes);
+	perfdata->Set("num_json_rpc_relay_encodes_saved", relayEncodesSaved);
+	perfdata->Set("num_json_rpc_relay_encode_time_saved", relayEncodeTimeSaved);
+
+	perfdata->Set("num_json_rpc_outgoing_queue_messages", outgoingQueueMessages);
+	perfdata->Set("num_json_rpc_outgoing_queue_bytes", outgoingQueueBytes);
+	perfdata->Set("num_json_rpc_max_outgoing_queue_bytes", maxOutgoingQueueBytes);
+	perfdata->Set("num_json_rpc_outgoing_messages_dropped", outgoingMessagesDropped);
+	perfdata->Set("num_json_rpc_outgoing_messages_spilled", outgoingMessagesSpilled);
+	perfdata->Set("num_json_rpc_outgoing_messages_coalesced", outgoingMessagesCoalesced);
+
+	perfdata->Set("num_json_rpc_replay_endpoints", replayEndpoints);
+	perfdata->Set("num_json_rpc_replay_passes", replayPasses);
+	perfdata->Set("num_json_rpc_replayed_messages", replayedMessages);
+
+	perfdata->Set("num_json_rpc_binary_messages_encoded", binaryMessagesEncoded);
+	perfdata->Set("num_json_rpc_binary_messages_decoded", binaryMessagesDecoded);
+
+	perfdata->Set("num_json_rpc_compressed_messages", compression.CompressedMessages);
+	perfdata->Set("num_json_rpc_compression_ratio", compressionRatio);
+	perfdata->Set("num_json_rpc_compression_time", compression.CompressionTime);
+	perfdata->Set("num_json_rpc_decompressed_messages", compression.DecompressedMessages);
+	perfdata->Set("num_json_rpc_decompression_time", compression.DecompressionTime);
+	perfdata->Set("num_json_rpc_replay_log_files_compressed", logFilesCompressed);
+	perfdata->Set("num_json_rpc_replay_log_compression_ratio", logCompressionRatio);
+	perfdata->Set("num_json_rpc_replay_log_compression_time", logCompressionTime);
+
+	perfdata->Set("num_json_rpc_cpu_bound_work_queue_length", jsonRpcCpuBoundWork.QueueLength);
+	perfdata->Set("num_json_rpc_cpu_bound_work_waits", jsonRpcCpuBoundWork.Waits);
+	perfdata->Set("num_json_rpc_cpu_bound_work_wait_time", jsonRpcCpuBoundWork.WaitTime);
+	perfdata->Set("num_http_cpu_bound_work_queue_length", httpCpuBoundWork.QueueLength);
+	perfdata->Set("num_http_cpu_bound_work_waits", httpCpuBoundWork.Waits);
+	perfdata->Set("num_http_cpu_bound_work_wait_time", httpCpuBoundWork.WaitTime);
+	perfdata->Set("num_plugin_results_cpu_bound_work_queue_length", pluginResultsCpuBoundWork.QueueLength);
+	perfdata->Set("num_plugin_results_cpu_bound_work_waits", pluginResultsCpuBoundWork.Waits);
+	perfdata->Set("num_plugin_results_cpu_bound_work_wait_time", pluginResultsCpuBoundWork.WaitTime);
+
 	return std::make_pair(status, perfdata);
 }
 
@@ -2008,6 +2288,22 @@ void ApiListener::ValidateTlsHandshakeTimeout(const Lazy<double>& lvalue, const
 		BOOST_THROW_EXCEPTION(ValidationError(this, { "tls_handshake_timeout" }, "Value must be greater than 0."));
 }
 
+void ApiListener::ValidateMaxWriteBatchSize(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ApiListener>::ValidateMaxWriteBatchSize(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "max_write_batch_size" }, "Value must be greater than 0."));
+}
+
+void ApiListener::ValidateMaxOutgoingQueueSize(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ApiListener>::ValidateMaxOutgoingQueueSize(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "max_outgoing_queue_size" }, "Value must not be negative."));
+}
+
 bool ApiListener::IsHACluster()
 {
 	Zone::Ptr zone = Zone::GetLocalZone();
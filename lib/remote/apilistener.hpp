@@ -4,10 +4,13 @@
 #define APILISTENER_H
 
 #include "remote/apilistener-ti.hpp"
+#include "remote/jsonrpc.hpp"
 #include "remote/jsonrpcconnection.hpp"
 #include "remote/httpserverconnection.hpp"
 #include "remote/endpoint.hpp"
 #include "remote/messageorigin.hpp"
+#include "remote/relaysequencer.hpp"
+#include "remote/replaylog.hpp"
 #include "base/atomic.hpp"
 #include "base/configobject.hpp"
 #include "base/process.hpp"
@@ -25,8 +28,12 @@
 #include <boost/asio/ssl/context.hpp>
 #include <boost/thread/shared_mutex.hpp>
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <set>
+#include <unordered_map>
+#include <vector>
 
 namespace icinga
 {
@@ -72,8 +79,11 @@ enum class ApiCapabilities : uint_fast64_t
 	ExecuteArbitraryCommand = 1u << 0u,
 	IfwApiCheckCommand = 1u << 1u,
 	HostChildrenInheritObjectAuthority = 1u << 2u,
+	MessageCompression = 1u << 3u,
+	BinaryMessages = 1u << 4u,
 
-	MyCapabilities = ExecuteArbitraryCommand | IfwApiCheckCommand | HostChildrenInheritObjectAuthority
+	MyCapabilities = ExecuteArbitraryCommand | IfwApiCheckCommand | HostChildrenInheritObjectAuthority | MessageCompression
+		| BinaryMessages
 };
 
 /**
@@ -108,6 +118,7 @@ public:
 
 	void SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message);
 	void RelayMessage(const MessageOrigin::Ptr& origin, const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log);
+	bool CatchUp(const JsonRpcConnection::Ptr& client);
 
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 	std::pair<Dictionary::Ptr, Dictionary::Ptr> GetStatus();
@@ -170,6 +181,8 @@ public:
 protected:
 	void ValidateTlsProtocolmin(const Lazy<String>& lvalue, const ValidationUtils& utils) override;
 	void ValidateTlsHandshakeTimeout(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+	void ValidateMaxWriteBatchSize(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateMaxOutgoingQueueSize(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
 
 private:
 	Shared<boost::asio::ssl::context>::Ptr m_SSLContext;
@@ -216,22 +229,76 @@ private:
 	);
 	void ListenerCoroutineProc(boost::asio::yield_context yc, const Shared<boost::asio::ip::tcp::acceptor>::Ptr& server);
 
-	WorkQueue m_RelayQueue;
+	/* Relaying is partitioned by the target zone, see RelayMessage(). */
+	std::vector<std::unique_ptr<WorkQueue>> m_RelayQueues;
+	RelaySequencer m_RelaySequencer;
 	WorkQueue m_SyncQueue{0, 4};
 
 	std::mutex m_LogLock;
-	Stream::Ptr m_LogFile;
+	std::unique_ptr<ReplayLogWriter> m_LogFile;
 	size_t m_LogMessageCount{0};
 
-	bool RelayMessageOne(const Zone::Ptr& zone, const MessageOrigin::Ptr& origin, const Dictionary::Ptr& message, const Endpoint::Ptr& currentZoneMaster);
-	void SyncRelayMessage(const MessageOrigin::Ptr& origin, const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log);
-	void PersistMessage(const Dictionary::Ptr& message, const ConfigObject::Ptr& secobj);
+	Atomic<uint_fast64_t> m_LogFilesCompressed {0};
+	Atomic<uint_fast64_t> m_LogBytesBeforeCompression {0};
+	Atomic<uint_fast64_t> m_LogBytesAfterCompression {0};
+	AtomicDuration m_LogCompressionTime;
+
+	Atomic<uint_fast64_t> m_RelayEncodes {0};
+	Atomic<uint_fast64_t> m_RelayEncodesSaved {0};
+	AtomicDuration m_RelayEncodeTimeSaved;
+
+	bool SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message,
+		const EncodedJsonRpcMessage::Ptr& encodedMessage, size_t& sent);
+	bool RelayMessageOne(const Zone::Ptr& zone, const MessageOrigin::Ptr& origin, const Dictionary::Ptr& message,
+		const Endpoint::Ptr& currentZoneMaster, std::vector<Endpoint::Ptr>& targetEndpoints, std::vector<Endpoint::Ptr>& skippedEndpoints);
+	void SyncRelayMessage(const MessageOrigin::Ptr& origin, const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log,
+		const RelayTicket& ticket);
+	static Zone::Ptr GetRelayTargetZone(const ConfigObject::Ptr& secobj);
+	std::vector<Endpoint::Ptr> GetRelayEndpoints(const Zone::Ptr& targetZone);
+	void PersistMessage(const Dictionary::Ptr& message, const EncodedJsonRpcMessage::Ptr& encodedMessage, const ConfigObject::Ptr& secobj);
 
 	void OpenLogFile();
 	void RotateLogFile();
+	void CompressLogFile(const String& path);
 	void CloseLogFile();
+	void ConvertLegacyLogFiles();
 	static void LogGlobHandler(std::vector<std::uint64_t>& files, const String& file);
-	void ReplayLog(const JsonRpcConnection::Ptr& client);
+
+	/* replay */
+
+	/* An endpoint catching up via the replay log, see ReplayLog(). */
+	struct ReplayParticipant
+	{
+		JsonRpcConnection::Ptr Client;
+		Zone::Ptr TargetZone;
+		std::function<void()> Callback;
+
+		/* The timestamp of the last message the endpoint got. */
+		double PeerTs;
+		double LogPosTs;
+
+		/* Messages replayed in the current or last pass, -1 before the first one. */
+		int Count{-1};
+		bool LastSync{false};
+		bool Detached{false};
+		bool Failed{false};
+
+		/* Whether TargetZone may see the objects of a zone, by the zone's name. */
+		std::unordered_map<String, bool> ZoneAccess;
+
+		bool Wants(const ReplayLogRecord& record);
+	};
+
+	std::mutex m_ReplayMutex;
+	std::vector<std::shared_ptr<ReplayParticipant>> m_ReplayParticipants;
+	bool m_ReplayRunning{false};
+	Atomic<uint_fast64_t> m_ReplayPasses {0};
+	Atomic<uint_fast64_t> m_ReplayedMessages {0};
+
+	void ReplayLog(const JsonRpcConnection::Ptr& client, const std::function<void()>& callback);
+	void RunReplay();
+	void RunReplayPass(const std::vector<std::shared_ptr<ReplayParticipant>>& participants, bool lastSync);
+	void FinishReplay(const ReplayParticipant& participant);
 
 	static void CopyCertificateFile(const String& oldCertPath, const String& newCertPath);
 
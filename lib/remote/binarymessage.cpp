@@ -0,0 +1,240 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "remote/binarymessage.hpp"
+#include "base/array.hpp"
+#include "base/atomic.hpp"
+#include "base/debug.hpp"
+#include "base/exception.hpp"
+#include "base/object-packer.hpp"
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace icinga;
+
+/* Binary messages start with a byte which can't start a JSON text, followed by the format. */
+static const char l_BinaryMessagePrefix[] = { '\0', 'b' };
+
+/* Only written by REGISTER_BINARY_MESSAGE() during startup, so reading them needs no lock. */
+static std::array<BinaryMessageType::Ptr, 256> l_BinaryMessageTypesById;
+static std::unordered_map<String, BinaryMessageType::Ptr> l_BinaryMessageTypesByMethod;
+
+static Atomic<uint_fast64_t> l_BinaryMessagesEncoded (0);
+static Atomic<uint_fast64_t> l_BinaryMessagesDecoded (0);
+
+BinaryMessageReader::BinaryMessageReader(const char *begin, const char *end)
+	: m_Begin(begin), m_End(end)
+{ }
+
+/**
+ * Reads the next value.
+ *
+ * @return The value
+ */
+Value BinaryMessageReader::Read()
+{
+	return UnpackObject(m_Begin, m_End);
+}
+
+double BinaryMessageReader::ReadNumber()
+{
+	Value value = Read();
+
+	if (!value.IsNumber()) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Expected a number in binary message."));
+	}
+
+	return value;
+}
+
+String BinaryMessageReader::ReadString()
+{
+	Value value = Read();
+
+	if (!value.IsString()) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Expected a string in binary message."));
+	}
+
+	return value;
+}
+
+bool BinaryMessageReader::ReadBoolean()
+{
+	Value value = Read();
+
+	if (!value.IsBoolean()) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Expected a boolean in binary message."));
+	}
+
+	return value;
+}
+
+/**
+ * Reads the next value, which must be a dictionary or null.
+ *
+ * @return The dictionary or nullptr
+ */
+Dictionary::Ptr BinaryMessageReader::ReadDictionary()
+{
+	Value value = Read();
+
+	if (value.IsEmpty()) {
+		return nullptr;
+	}
+
+	if (!value.IsObjectType<Dictionary>()) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Expected a dictionary in binary message."));
+	}
+
+	return value;
+}
+
+/**
+ * Reads the next value, which must be an array or null.
+ *
+ * @return The array or nullptr
+ */
+Array::Ptr BinaryMessageReader::ReadArray()
+{
+	Value value = Read();
+
+	if (value.IsEmpty()) {
+		return nullptr;
+	}
+
+	if (!value.IsObjectType<Array>()) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Expected an array in binary message."));
+	}
+
+	return value;
+}
+
+bool BinaryMessageReader::AtEnd() const
+{
+	return m_Begin == m_End;
+}
+
+BinaryMessageType::BinaryMessageType(std::uint8_t id, const char *method, EncodeCallback encode, HandleCallback handle)
+	: m_Id(id), m_Method(method), m_Encode(std::move(encode)), m_Handle(std::move(handle))
+{ }
+
+void BinaryMessageType::Handle(const MessageOrigin::Ptr& origin, BinaryMessageReader& reader) const
+{
+	m_Handle(origin, reader);
+
+	if (!reader.AtEnd()) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Trailing data in binary message '" + String(m_Method) + "'."));
+	}
+
+	l_BinaryMessagesDecoded.fetch_add(1);
+}
+
+void BinaryMessageType::Register(const BinaryMessageType::Ptr& type)
+{
+	VERIFY(!l_BinaryMessageTypesById[type->GetId()]);
+
+	l_BinaryMessageTypesById[type->GetId()] = type;
+	l_BinaryMessageTypesByMethod.emplace(type->GetMethod(), type);
+}
+
+BinaryMessageType::Ptr BinaryMessageType::GetById(std::uint8_t id)
+{
+	return l_BinaryMessageTypesById[id];
+}
+
+/**
+ * Encodes a JSON-RPC notification as a binary message, if there's a type for its method.
+ *
+ * @param message The message
+ *
+ * @return The binary message or an empty string if the message can't be encoded
+ */
+String BinaryMessageType::EncodeMessage(const Dictionary::Ptr& message)
+{
+	auto type (l_BinaryMessageTypesByMethod.find(message->Get("method")));
+
+	if (type == l_BinaryMessageTypesByMethod.end() || message->Contains("id")) {
+		return String();
+	}
+
+	Dictionary::Ptr params = message->Get("params");
+
+	if (!params) {
+		return String();
+	}
+
+	String binary (l_BinaryMessagePrefix, l_BinaryMessagePrefix + sizeof(l_BinaryMessagePrefix));
+	auto& builder (binary.GetData());
+
+	builder += char(type->second->GetId());
+	PackObject(message->Get("ts"), builder);
+	PackObject(message->Get("originZone"), builder);
+
+	if (!type->second->m_Encode(params, builder)) {
+		return String();
+	}
+
+	l_BinaryMessagesEncoded.fetch_add(1);
+
+	return binary;
+}
+
+/**
+ * Checks whether a received message has been encoded by EncodeMessage().
+ *
+ * @param message The message
+ *
+ * @return Whether the message is a binary one
+ */
+bool BinaryMessageType::IsBinaryMessage(const String& message)
+{
+	return message.GetLength() >= sizeof(l_BinaryMessagePrefix)
+		&& memcmp(message.CStr(), l_BinaryMessagePrefix, sizeof(l_BinaryMessagePrefix)) == 0;
+}
+
+/**
+ * Decodes the header of a binary message.
+ *
+ * @param message The message
+ * @param ts Receives the message's timestamp, 0 if it hasn't any
+ * @param originZone Receives the zone the message originates from, if any
+ * @param params Receives the position of the params in message
+ *
+ * @return The message's type
+ */
+BinaryMessageType::Ptr BinaryMessageType::DecodeMessage(const String& message, double& ts, String& originZone, const char*& params)
+{
+	const char *begin = message.CStr() + sizeof(l_BinaryMessagePrefix);
+	const char *end = message.CStr() + message.GetLength();
+
+	if (begin >= end) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Binary message without type."));
+	}
+
+	auto type (GetById(*begin++));
+
+	if (!type) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Binary message of unknown type."));
+	}
+
+	Value vts = UnpackObject(begin, end);
+	ts = vts.IsNumber() ? double(vts) : 0;
+
+	Value vzone = UnpackObject(begin, end);
+	originZone = vzone.IsString() ? String(vzone) : String();
+
+	params = begin;
+
+	return type;
+}
+
+uint_fast64_t BinaryMessageType::GetEncodedMessages()
+{
+	return l_BinaryMessagesEncoded.load();
+}
+
+uint_fast64_t BinaryMessageType::GetDecodedMessages()
+{
+	return l_BinaryMessagesDecoded.load();
+}
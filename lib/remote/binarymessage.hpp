@@ -0,0 +1,102 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#ifndef BINARYMESSAGE_H
+#define BINARYMESSAGE_H
+
+#include "remote/i2-remote.hpp"
+#include "remote/messageorigin.hpp"
+#include "base/dictionary.hpp"
+#include "base/initialize.hpp"
+#include "base/value.hpp"
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace icinga
+{
+
+/**
+ * Reads the params of a binary message, see BinaryMessageType.
+ *
+ * @ingroup remote
+ */
+class BinaryMessageReader
+{
+public:
+	BinaryMessageReader(const char *begin, const char *end);
+
+	Value Read();
+	double ReadNumber();
+	String ReadString();
+	bool ReadBoolean();
+	Dictionary::Ptr ReadDictionary();
+	Array::Ptr ReadArray();
+
+	bool AtEnd() const;
+
+private:
+	const char *m_Begin;
+	const char *m_End;
+};
+
+/**
+ * A compact binary encoding of a frequently sent JSON-RPC message, used for peers which
+ * have announced ApiCapabilities::BinaryMessages.
+ *
+ * Rather than the whole message as JSON, only the message's params are sent, as values
+ * packed by PackObject() in an order fixed by the message type. The receiver decodes them
+ * directly into the objects they describe. Messages the type can't encode, e.g. because
+ * of params it doesn't know, are sent as JSON instead.
+ *
+ * The ID of a message type identifies it on the wire and must never be reused for another one.
+ * The handler has to read all params before acting on them, trailing ones are an error.
+ *
+ * @ingroup remote
+ */
+class BinaryMessageType final : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(BinaryMessageType);
+
+	typedef std::function<bool (const Dictionary::Ptr& params, std::string& builder)> EncodeCallback;
+	typedef std::function<void (const MessageOrigin::Ptr& origin, BinaryMessageReader& reader)> HandleCallback;
+
+	BinaryMessageType(std::uint8_t id, const char *method, EncodeCallback encode, HandleCallback handle);
+
+	std::uint8_t GetId() const noexcept
+	{
+		return m_Id;
+	}
+
+	const char *GetMethod() const noexcept
+	{
+		return m_Method;
+	}
+
+	void Handle(const MessageOrigin::Ptr& origin, BinaryMessageReader& reader) const;
+
+	static void Register(const BinaryMessageType::Ptr& type);
+	static BinaryMessageType::Ptr GetById(std::uint8_t id);
+
+	static String EncodeMessage(const Dictionary::Ptr& message);
+	static bool IsBinaryMessage(const String& message);
+	static BinaryMessageType::Ptr DecodeMessage(const String& message, double& ts, String& originZone, const char*& params);
+
+	static uint_fast64_t GetEncodedMessages();
+	static uint_fast64_t GetDecodedMessages();
+
+private:
+	std::uint8_t m_Id;
+	const char *m_Method;
+	EncodeCallback m_Encode;
+	HandleCallback m_Handle;
+};
+
+#define REGISTER_BINARY_MESSAGE(id, name, ns, encode, handle) \
+	INITIALIZE_ONCE([]() { \
+		BinaryMessageType::Register(new BinaryMessageType(id, #ns "::" #name, encode, handle)); \
+	})
+
+}
+
+#endif /* BINARYMESSAGE_H */
@@ -117,6 +117,14 @@ void Endpoint::AddMessageSent(int bytes)
 	SetLastMessageSent(time);
 }
 
+/**
+ * Counts a write of queued messages to the connection, see AddMessageSent() for the messages themselves.
+ */
+void Endpoint::AddMessagesFlushed()
+{
+	m_Flushes.InsertValue(Utility::GetTime(), 1);
+}
+
 void Endpoint::AddMessageReceived(int bytes)
 {
 	double time = Utility::GetTime();
@@ -135,6 +143,14 @@ void Endpoint::AddMessageProcessed(const AtomicDuration::Clock::duration& durati
 	m_InputProcessingTime += duration;
 }
 
+/**
+ * Counts a queued message which has been replaced by a newer one before it was sent, see JsonRpc::GetCoalescingKey().
+ */
+void Endpoint::AddMessageCoalesced()
+{
+	m_MessagesCoalesced.fetch_add(1);
+}
+
 double Endpoint::GetMessagesSentPerSecond() const
 {
 	return m_MessagesSent.CalculateRate(Utility::GetTime(), 60);
@@ -155,6 +171,20 @@ double Endpoint::GetBytesReceivedPerSecond() const
 	return m_BytesReceived.CalculateRate(Utility::GetTime(), 60);
 }
 
+double Endpoint::GetMessagesPerFlush() const
+{
+	double flushes = m_Flushes.CalculateRate(Utility::GetTime(), 60);
+
+	return flushes ? GetMessagesSentPerSecond() / flushes : 0;
+}
+
+double Endpoint::GetBytesPerFlush() const
+{
+	double flushes = m_Flushes.CalculateRate(Utility::GetTime(), 60);
+
+	return flushes ? GetBytesSentPerSecond() / flushes : 0;
+}
+
 Dictionary::Ptr Endpoint::GetMessagesReceivedPerType() const
 {
 	DictionaryData result;
@@ -172,3 +202,8 @@ double Endpoint::GetSecondsProcessingMessages() const
 {
 	return m_InputProcessingTime;
 }
+
+uint_fast64_t Endpoint::GetMessagesCoalesced() const
+{
+	return m_MessagesCoalesced.load();
+}
@@ -47,9 +47,11 @@ public:
 	void SetCachedZone(const intrusive_ptr<Zone>& zone);
 
 	void AddMessageSent(int bytes);
+	void AddMessagesFlushed();
 	void AddMessageReceived(int bytes);
 	void AddMessageReceived(const intrusive_ptr<ApiFunction>& method);
 	void AddMessageProcessed(const AtomicDuration::Clock::duration& duration);
+	void AddMessageCoalesced();
 
 	double GetMessagesSentPerSecond() const override;
 	double GetMessagesReceivedPerSecond() const override;
@@ -57,10 +59,15 @@ public:
 	double GetBytesSentPerSecond() const override;
 	double GetBytesReceivedPerSecond() const override;
 
+	double GetMessagesPerFlush() const override;
+	double GetBytesPerFlush() const override;
+
 	Dictionary::Ptr GetMessagesReceivedPerType() const override;
 
 	double GetSecondsProcessingMessages() const override;
 
+	uint_fast64_t GetMessagesCoalesced() const override;
+
 protected:
 	void OnAllConfigLoaded() override;
 
@@ -74,8 +81,10 @@ private:
 	mutable RingBuffer m_MessagesReceived{60};
 	mutable RingBuffer m_BytesSent{60};
 	mutable RingBuffer m_BytesReceived{60};
+	mutable RingBuffer m_Flushes{60};
 
 	AtomicDuration m_InputProcessingTime;
+	Atomic<uint_fast64_t> m_MessagesCoalesced {0};
 };
 
 }
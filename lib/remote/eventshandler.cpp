@@ -100,7 +100,7 @@ bool EventsHandler::HandleRequest(
 
 	EventsSubscriber subscriber (std::move(eventTypes), HttpUtility::GetLastParameter(params, "filter"), l_ApiQuery);
 
-	IoBoundWorkSlot dontLockTheIoThread (yc);
+	IoBoundWorkSlot dontLockTheIoThread (yc, CpuBoundWorkPool::Http);
 
 	response.result(http::status::ok);
 	response.set(http::field::content_type, "application/json");
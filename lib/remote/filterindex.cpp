@@ -0,0 +1,600 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "remote/filterindex.hpp"
+#include "remote/apilistener.hpp"
+#include "base/array.hpp"
+#include "base/configtype.hpp"
+#include "base/dictionary.hpp"
+#include "base/initialize.hpp"
+#include "base/logger.hpp"
+#include "base/objectlock.hpp"
+#include "base/utility.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+using namespace icinga;
+
+/* The attributes which are indexed for all types having them, besides custom variables. */
+static const std::unordered_set<String> l_IndexedAttributes { "name", "groups", "state", "state_type" };
+
+/**
+ * The keys of an object's attribute in an AttributeIndex.
+ */
+struct FilterIndexKeys
+{
+	/* The key of the value itself, unless it's irregular. */
+	std::vector<String> Values;
+	bool ValuesIrregular = false;
+
+	/* The keys of the elements, if the value is an array. */
+	std::vector<String> Elements;
+	bool ElementsIrregular = false;
+
+	bool operator==(const FilterIndexKeys& other) const
+	{
+		return Values == other.Values && ValuesIrregular == other.ValuesIrregular
+			&& Elements == other.Elements && ElementsIrregular == other.ElementsIrregular;
+	}
+};
+
+struct AttributeIndex
+{
+	std::unordered_map<String, std::unordered_set<uint_fast64_t>> Values;
+	std::unordered_set<uint_fast64_t> ValuesIrregular;
+
+	std::unordered_map<String, std::unordered_set<uint_fast64_t>> Elements;
+	std::unordered_set<uint_fast64_t> ElementsIrregular;
+};
+
+struct IndexedObject
+{
+	uint_fast64_t Id;
+	std::map<String, FilterIndexKeys> Keys;
+};
+
+/**
+ * The indexes of a type. Objects get increasing IDs in the order they're indexed,
+ * so that candidates can be returned in the same order as ConfigType::GetObjects().
+ */
+struct TypeIndex
+{
+	std::shared_timed_mutex Mutex;
+	std::map<String, AttributeIndex> Attributes;
+	std::unordered_map<ConfigObject*, IndexedObject> Objects;
+	std::map<uint_fast64_t, ConfigObject::Ptr> ById;
+	uint_fast64_t NextId = 0;
+};
+
+static std::shared_timed_mutex l_TypeIndexesMutex;
+static std::unordered_map<Type*, std::unique_ptr<TypeIndex>> l_TypeIndexes;
+
+INITIALIZE_ONCE([]() {
+	ConfigObject::OnActiveChanged.connect([](const ConfigObject::Ptr& object, const Value&) {
+		if (object->IsActive()) {
+			FilterIndex::Update(object);
+		} else {
+			FilterIndex::Remove(object);
+		}
+	});
+
+	ConfigObject::OnVersionChanged.connect([](const ConfigObject::Ptr& object, const Value&) {
+		FilterIndex::Update(object);
+	});
+});
+
+static TypeIndex* GetTypeIndex(Type* type, bool create)
+{
+	{
+		std::shared_lock<std::shared_timed_mutex> lock (l_TypeIndexesMutex);
+		auto pos (l_TypeIndexes.find(type));
+
+		if (pos != l_TypeIndexes.end()) {
+			return pos->second.get();
+		}
+	}
+
+	if (!create) {
+		return nullptr;
+	}
+
+	std::unique_lock<std::shared_timed_mutex> lock (l_TypeIndexesMutex);
+	auto& index (l_TypeIndexes[type]);
+
+	if (!index) {
+		index = std::make_unique<TypeIndex>();
+	}
+
+	return index.get();
+}
+
+/**
+ * Maps a value to a string which is the same for two values if and only if they're equal according to Value::operator==.
+ *
+ * @return false if there's no such string, e.g. for arrays
+ */
+static bool GetKey(const Value& value, String& key)
+{
+	if (value.IsEmpty() || value.IsString()) {
+		key = "s" + static_cast<String>(value);
+		return true;
+	}
+
+	if (value.IsNumber() || value.IsBoolean()) {
+		double number = value;
+
+		if (std::isnan(number)) {
+			return false;
+		}
+
+		/* -0 == 0 */
+		if (number == 0) {
+			number = 0;
+		}
+
+		char buf[64];
+		snprintf(buf, sizeof(buf), "n%a", number);
+		key = buf;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Gets the value an attribute has in filters, e.g. vars.os for host.vars.os.
+ *
+ * @return false if the value can't be known without evaluating the filter
+ */
+static bool GetAttributeValue(const ConfigObject::Ptr& object, const String& attribute, Value& value)
+{
+	Type::Ptr type = object->GetReflectionType();
+
+	if (attribute.GetLength() > 5 && attribute.SubStr(0, 5) == "vars.") {
+		String name = attribute.SubStr(5);
+		Value vars = object->GetField(type->GetFieldId("vars"));
+
+		if (vars.IsEmpty()) {
+			value = Empty;
+			return true;
+		}
+
+		if (!vars.IsObjectType<Dictionary>()) {
+			return false;
+		}
+
+		Dictionary::Ptr dict = vars;
+
+		if (dict->Get(name, &value)) {
+			return true;
+		}
+
+		/* Otherwise the filter would find a prototype method like keys(). */
+		if (Dictionary::GetPrototype()->HasOwnField(name) || Object::GetPrototype()->HasOwnField(name)) {
+			return false;
+		}
+
+		value = Empty;
+		return true;
+	}
+
+	value = object->GetField(type->GetFieldId(attribute));
+	return true;
+}
+
+static FilterIndexKeys GetKeys(const ConfigObject::Ptr& object, const String& attribute)
+{
+	FilterIndexKeys keys;
+	Value value;
+	String key;
+
+	if (!GetAttributeValue(object, attribute, value)) {
+		keys.ValuesIrregular = true;
+		keys.ElementsIrregular = true;
+		return keys;
+	}
+
+	if (GetKey(value, key)) {
+		keys.Values.emplace_back(std::move(key));
+	} else {
+		keys.ValuesIrregular = true;
+	}
+
+	/* 'in' is false for null and fails for anything but arrays. */
+	if (value.IsObjectType<Array>()) {
+		Array::Ptr elements = value;
+		ObjectLock olock (elements);
+
+		for (const Value& element : elements) {
+			if (GetKey(element, key)) {
+				keys.Elements.emplace_back(std::move(key));
+			}
+		}
+	} else if (!value.IsEmpty()) {
+		keys.ElementsIrregular = true;
+	}
+
+	return keys;
+}
+
+static void AddKeys(AttributeIndex& index, uint_fast64_t id, const FilterIndexKeys& keys)
+{
+	for (auto& key : keys.Values) {
+		index.Values[key].emplace(id);
+	}
+
+	for (auto& key : keys.Elements) {
+		index.Elements[key].emplace(id);
+	}
+
+	if (keys.ValuesIrregular) {
+		index.ValuesIrregular.emplace(id);
+	}
+
+	if (keys.ElementsIrregular) {
+		index.ElementsIrregular.emplace(id);
+	}
+}
+
+static void RemoveKeys(AttributeIndex& index, uint_fast64_t id, const FilterIndexKeys& keys)
+{
+	auto remove ([id](std::unordered_map<String, std::unordered_set<uint_fast64_t>>& buckets, const String& key) {
+		auto pos (buckets.find(key));
+
+		if (pos != buckets.end()) {
+			pos->second.erase(id);
+
+			if (pos->second.empty()) {
+				buckets.erase(pos);
+			}
+		}
+	});
+
+	for (auto& key : keys.Values) {
+		remove(index.Values, key);
+	}
+
+	for (auto& key : keys.Elements) {
+		remove(index.Elements, key);
+	}
+
+	index.ValuesIrregular.erase(id);
+	index.ElementsIrregular.erase(id);
+}
+
+/**
+ * Adds an object to all indexes of its type or updates it.
+ *
+ * @param index The indexes, locked exclusively
+ */
+static void UpdateObject(TypeIndex& index, const ConfigObject::Ptr& object)
+{
+	auto [pos, inserted] = index.Objects.try_emplace(object.get());
+	auto& entry (pos->second);
+
+	if (inserted) {
+		entry.Id = index.NextId++;
+		index.ById.emplace(entry.Id, object);
+	}
+
+	for (auto& [attribute, attributeIndex] : index.Attributes) {
+		auto keys (GetKeys(object, attribute));
+		auto old (entry.Keys.find(attribute));
+
+		if (old != entry.Keys.end()) {
+			if (old->second == keys) {
+				continue;
+			}
+
+			RemoveKeys(attributeIndex, entry.Id, old->second);
+		}
+
+		AddKeys(attributeIndex, entry.Id, keys);
+		entry.Keys[attribute] = std::move(keys);
+	}
+}
+
+/**
+ * Checks whether the given attribute of objects of the given type can be indexed.
+ *
+ * @param type The type
+ * @param attribute The attribute, custom variables as vars.NAME
+ */
+bool FilterIndex::IsIndexable(const Type::Ptr& type, const String& attribute)
+{
+	if (!dynamic_cast<ConfigType*>(type.get())) {
+		return false;
+	}
+
+	if (l_IndexedAttributes.find(attribute) != l_IndexedAttributes.end()) {
+		return type->GetFieldId(attribute) >= 0;
+	}
+
+	if (attribute.GetLength() <= 5 || attribute.SubStr(0, 5) != "vars." || type->GetFieldId("vars") < 0) {
+		return false;
+	}
+
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	if (!listener) {
+		return false;
+	}
+
+	Array::Ptr vars = listener->GetFilterIndexVars();
+
+	return vars && vars->Contains(attribute.SubStr(5));
+}
+
+/**
+ * Looks up the objects a predicate may be true for. Builds the attribute's index if necessary.
+ *
+ * @param type The type of the objects
+ * @param attribute The attribute, see IsIndexable()
+ * @param predicate The predicate
+ * @param operand The other operand of the predicate, see FilterIndexPredicate
+ * @param candidates Receives the objects
+ *
+ * @return false if the predicate can't be looked up, e.g. because the operand is an array
+ */
+bool FilterIndex::Lookup(const Type::Ptr& type, const String& attribute, FilterIndexPredicate predicate,
+	const Value& operand, FilterIndexCandidates& candidates)
+{
+	String key;
+
+	if (predicate == FilterIndexPredicate::Match) {
+		if (!operand.IsString()) {
+			return false;
+		}
+	} else if (!GetKey(operand, key)) {
+		return false;
+	}
+
+	if (!IsIndexable(type, attribute)) {
+		return false;
+	}
+
+	auto& index (*GetTypeIndex(type.get(), true));
+
+	{
+		std::unique_lock<std::shared_timed_mutex> lock (index.Mutex);
+
+		if (index.Attributes.find(attribute) == index.Attributes.end()) {
+			if (index.Attributes.empty()) {
+				index.Objects.clear();
+				index.ById.clear();
+			}
+
+			index.Attributes[attribute];
+
+			if (index.Attributes.size() == 1u) {
+				for (auto& object : dynamic_cast<ConfigType*>(type.get())->GetObjects()) {
+					UpdateObject(index, object);
+				}
+			} else {
+				auto& attributeIndex (index.Attributes[attribute]);
+
+				for (auto& [object, entry] : index.Objects) {
+					auto keys (GetKeys(index.ById.at(entry.Id), attribute));
+
+					AddKeys(attributeIndex, entry.Id, keys);
+					entry.Keys[attribute] = std::move(keys);
+				}
+			}
+
+			Log(LogNotice, "FilterIndex")
+				<< "Indexed attribute '" << attribute << "' of " << index.Objects.size() << " objects of type '" << type->GetName() << "'.";
+		}
+	}
+
+	std::shared_lock<std::shared_timed_mutex> lock (index.Mutex);
+	auto& attributeIndex (index.Attributes.at(attribute));
+
+	auto addAll ([&candidates](const std::unordered_set<uint_fast64_t>& ids) {
+		candidates.Objects.insert(ids.begin(), ids.end());
+	});
+
+	switch (predicate) {
+		case FilterIndexPredicate::Equal: {
+			auto pos (attributeIndex.Values.find(key));
+
+			if (pos != attributeIndex.Values.end()) {
+				addAll(pos->second);
+			}
+
+			addAll(attributeIndex.ValuesIrregular);
+			candidates.Irregular = attributeIndex.ValuesIrregular;
+			break;
+		}
+
+		case FilterIndexPredicate::NotEqual:
+			for (auto& [value, ids] : attributeIndex.Values) {
+				if (value != key) {
+					addAll(ids);
+				}
+			}
+
+			addAll(attributeIndex.ValuesIrregular);
+			candidates.Irregular = attributeIndex.ValuesIrregular;
+			break;
+
+		case FilterIndexPredicate::Contains: {
+			auto pos (attributeIndex.Elements.find(key));
+
+			if (pos != attributeIndex.Elements.end()) {
+				addAll(pos->second);
+			}
+
+			addAll(attributeIndex.ElementsIrregular);
+			candidates.Irregular = attributeIndex.ElementsIrregular;
+			break;
+		}
+
+		case FilterIndexPredicate::Match: {
+			String pattern = operand;
+
+			for (auto& [value, ids] : attributeIndex.Values) {
+				/* Numbers are converted to strings by match(), don't bother. */
+				if (value[0] != 's' || Utility::Match(pattern, value.SubStr(1))) {
+					addAll(ids);
+				}
+			}
+
+			addAll(attributeIndex.ValuesIrregular);
+			candidates.Irregular = attributeIndex.ValuesIrregular;
+			break;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Gets the objects with the given IDs, in the same order as ConfigType::GetObjects().
+ *
+ * @param type The type of the objects
+ * @param candidates The IDs as returned by Lookup()
+ */
+std::vector<ConfigObject::Ptr> FilterIndex::GetObjects(const Type::Ptr& type, const std::unordered_set<uint_fast64_t>& candidates)
+{
+	std::vector<uint_fast64_t> ids (candidates.begin(), candidates.end());
+	std::vector<ConfigObject::Ptr> objects;
+
+	std::sort(ids.begin(), ids.end());
+	objects.reserve(ids.size());
+
+	auto index (GetTypeIndex(type.get(), false));
+
+	if (!index) {
+		return objects;
+	}
+
+	std::shared_lock<std::shared_timed_mutex> lock (index->Mutex);
+
+	for (auto id : ids) {
+		auto pos (index->ById.find(id));
+
+		if (pos != index->ById.end()) {
+			objects.emplace_back(pos->second);
+		}
+	}
+
+	return objects;
+}
+
+/**
+ * Updates the indexes of the object's type, if there are any. Call this after the object has changed.
+ *
+ * @param object The object
+ */
+void FilterIndex::Update(const ConfigObject::Ptr& object)
+{
+	auto index (GetTypeIndex(object->GetReflectionType().get(), false));
+
+	if (!index) {
+		return;
+	}
+
+	std::unique_lock<std::shared_timed_mutex> lock (index->Mutex);
+
+	if (!index->Attributes.empty()) {
+		UpdateObject(*index, object);
+	}
+}
+
+/**
+ * Updates only the given attributes of the object in the indexes of its type, if they're indexed.
+ * Cheaper than Update() if only these attributes may have changed, the indexes aren't locked
+ * exclusively unless their keys have changed.
+ *
+ * @param object The object
+ * @param attributes The attributes which may have changed
+ */
+void FilterIndex::UpdateAttributes(const ConfigObject::Ptr& object, const std::vector<String>& attributes)
+{
+	auto index (GetTypeIndex(object->GetReflectionType().get(), false));
+
+	if (!index) {
+		return;
+	}
+
+	std::vector<String> changed;
+
+	{
+		std::shared_lock<std::shared_timed_mutex> lock (index->Mutex);
+		auto pos (index->Objects.find(object.get()));
+
+		if (pos == index->Objects.end()) {
+			return;
+		}
+
+		for (auto& attribute : attributes) {
+			auto old (pos->second.Keys.find(attribute));
+
+			if (old != pos->second.Keys.end() && !(old->second == GetKeys(object, attribute))) {
+				changed.emplace_back(attribute);
+			}
+		}
+	}
+
+	if (changed.empty()) {
+		return;
+	}
+
+	std::unique_lock<std::shared_timed_mutex> lock (index->Mutex);
+	auto pos (index->Objects.find(object.get()));
+
+	if (pos == index->Objects.end()) {
+		return;
+	}
+
+	auto& entry (pos->second);
+
+	for (auto& attribute : changed) {
+		auto old (entry.Keys.find(attribute));
+
+		if (old == entry.Keys.end()) {
+			continue;
+		}
+
+		/* The object may have changed again meanwhile. */
+		auto keys (GetKeys(object, attribute));
+		auto& attributeIndex (index->Attributes.at(attribute));
+
+		RemoveKeys(attributeIndex, entry.Id, old->second);
+		AddKeys(attributeIndex, entry.Id, keys);
+		old->second = std::move(keys);
+	}
+}
+
+/**
+ * Removes the object from the indexes of its type, if there are any.
+ *
+ * @param object The object
+ */
+void FilterIndex::Remove(const ConfigObject::Ptr& object)
+{
+	auto index (GetTypeIndex(object->GetReflectionType().get(), false));
+
+	if (!index) {
+		return;
+	}
+
+	std::unique_lock<std::shared_timed_mutex> lock (index->Mutex);
+	auto pos (index->Objects.find(object.get()));
+
+	if (pos == index->Objects.end()) {
+		return;
+	}
+
+	for (auto& [attribute, keys] : pos->second.Keys) {
+		RemoveKeys(index->Attributes.at(attribute), pos->second.Id, keys);
+	}
+
+	index->ById.erase(pos->second.Id);
+	index->Objects.erase(pos);
+}
@@ -0,0 +1,77 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#ifndef FILTERINDEX_H
+#define FILTERINDEX_H
+
+#include "remote/i2-remote.hpp"
+#include "base/configobject.hpp"
+#include "base/type.hpp"
+#include "base/value.hpp"
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * The predicates FilterIndex::Lookup() supports.
+ *
+ * @ingroup remote
+ */
+enum class FilterIndexPredicate
+{
+	/* attr == operand */
+	Equal,
+	/* attr != operand */
+	NotEqual,
+	/* operand in attr */
+	Contains,
+	/* match(operand, attr) */
+	Match
+};
+
+/**
+ * The objects a predicate may be true for, as returned by FilterIndex::Lookup().
+ *
+ * Irregular are the ones the index can't tell anything about and for which evaluating the
+ * predicate may even fail, e.g. 'in' with a string. They are part of Objects as well.
+ *
+ * @ingroup remote
+ */
+struct FilterIndexCandidates
+{
+	std::unordered_set<uint_fast64_t> Objects;
+	std::unordered_set<uint_fast64_t> Irregular;
+};
+
+/**
+ * Secondary indexes of config object attributes, which let FilterUtility skip the objects
+ * a filter can't be true for.
+ *
+ * The name, groups, state and state_type attributes are indexed, as well as the custom
+ * variables listed in the ApiListener's filter_index_vars. An attribute's index is built
+ * the first time a filter uses it and kept up to date when objects are (de)activated or
+ * modified at runtime. The state and state_type keys are also updated on each check result.
+ *
+ * The index only narrows down the candidates, filters are still evaluated for all of them.
+ *
+ * @ingroup remote
+ */
+class FilterIndex
+{
+public:
+	static bool IsIndexable(const Type::Ptr& type, const String& attribute);
+
+	static bool Lookup(const Type::Ptr& type, const String& attribute, FilterIndexPredicate predicate,
+		const Value& operand, FilterIndexCandidates& candidates);
+	static std::vector<ConfigObject::Ptr> GetObjects(const Type::Ptr& type, const std::unordered_set<uint_fast64_t>& candidates);
+
+	static void Update(const ConfigObject::Ptr& object);
+	static void UpdateAttributes(const ConfigObject::Ptr& object, const std::vector<String>& attributes);
+	static void Remove(const ConfigObject::Ptr& object);
+};
+
+}
+
+#endif /* FILTERINDEX_H */
@@ -1,17 +1,27 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "remote/filterutility.hpp"
+#include "remote/filterindex.hpp"
 #include "remote/httputility.hpp"
 #include "config/applyrule.hpp"
 #include "config/configcompiler.hpp"
 #include "config/expression.hpp"
 #include "base/namespace.hpp"
 #include "base/json.hpp"
+#include "base/configuration.hpp"
 #include "base/configtype.hpp"
 #include "base/logger.hpp"
 #include "base/utility.hpp"
 #include <boost/algorithm/string/case_conv.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <iterator>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
 
 using namespace icinga;
 
@@ -230,6 +240,115 @@ bool FilterUtility::EvaluateFilter(ScriptFrame& frame, Expression *filter,
 	return Convert::ToBool(filter->Evaluate(frame));
 }
 
+/* How many compiled filters CompileFilter() keeps. */
+static constexpr size_t l_FilterCacheSize = 256;
+
+static std::mutex l_FilterCacheMutex;
+
+/* The most recently used filters first. */
+static std::list<std::pair<String, Expression::Ptr>> l_FilterCache;
+static std::unordered_map<String, decltype(l_FilterCache)::iterator> l_FilterCacheIndex;
+
+/**
+ * Compiles a filter and folds the given constants into it, see FoldConstants().
+ *
+ * The most recently used filters are cached by their text and constants, so that filters
+ * which are used again and again, e.g. by dashboards, don't have to be compiled every time.
+ * The returned expression is shared and must not be modified.
+ *
+ * @param fileName The name of the filter's source in error messages
+ * @param filter The filter
+ * @param constants The filter variables which can't be shadowed, if any
+ *
+ * @return The compiled filter
+ */
+Expression::Ptr FilterUtility::CompileFilter(const String& fileName, const String& filter, const Dictionary::Ptr& constants)
+{
+	String key = JsonEncode(new Array({ fileName, filter, constants }));
+
+	auto lookup ([&key]() -> Expression::Ptr {
+		auto pos (l_FilterCacheIndex.find(key));
+
+		if (pos == l_FilterCacheIndex.end()) {
+			return nullptr;
+		}
+
+		l_FilterCache.splice(l_FilterCache.begin(), l_FilterCache, pos->second);
+		return pos->second->second;
+	});
+
+	{
+		std::unique_lock<std::mutex> lock (l_FilterCacheMutex);
+		auto cached (lookup());
+
+		if (cached) {
+			return cached;
+		}
+	}
+
+	std::unique_ptr<Expression> expr = ConfigCompiler::CompileText(fileName, filter);
+	FoldConstants(expr, constants);
+
+	Expression::Ptr compiled (expr.release());
+	std::unique_lock<std::mutex> lock (l_FilterCacheMutex);
+	auto cached (lookup());
+
+	if (cached) {
+		return cached;
+	}
+
+	l_FilterCache.emplace_front(key, compiled);
+	l_FilterCacheIndex.emplace(std::move(key), l_FilterCache.begin());
+
+	if (l_FilterCache.size() > l_FilterCacheSize) {
+		l_FilterCacheIndex.erase(l_FilterCache.back().first);
+		l_FilterCache.pop_back();
+	}
+
+	return compiled;
+}
+
+/**
+ * @returns The variables EvaluateFilter() sets to the given type's objects or their navigated ones.
+ */
+static std::set<String> GetFilterObjectNames(const Type::Ptr& type, const String& variableName)
+{
+	std::set<String> names { "obj", variableName.IsEmpty() ? type->GetName().ToLower() : variableName };
+
+	for (int fid = 0; fid < type->GetFieldCount(); fid++) {
+		Field field = type->GetFieldInfo(fid);
+
+		if (field.Attributes & FANavigation) {
+			names.emplace(field.NavigationName ? field.NavigationName : field.Name);
+		}
+	}
+
+	return names;
+}
+
+/**
+ * @returns The filter variables which can be folded into filters for the given type's objects, see FoldConstants().
+ */
+static Dictionary::Ptr GetFilterConstants(const TargetProvider::Ptr& provider, const String& type,
+	const String& variableName, const Dictionary::Ptr& filterVars)
+{
+	if (!filterVars || !dynamic_cast<ConfigObjectTargetProvider*>(provider.get())) {
+		return nullptr;
+	}
+
+	auto objectNames (GetFilterObjectNames(Type::GetByName(type), variableName));
+	Dictionary::Ptr constants = new Dictionary();
+	ObjectLock olock (filterVars);
+
+	for (auto& kv : filterVars) {
+		if (objectNames.find(kv.first) == objectNames.end()) {
+			constants->Set(kv.first, kv.second);
+		}
+	}
+
+	return constants;
+}
+
 static void FilteredAddTarget(ScriptFrame& permissionFrame, Expression *permissionFilter,
 	ScriptFrame& frame, Expression *ufilter, std::vector<Value>& result, const String& variableName, const Object::Ptr& target)
 {
@@ -240,6 +359,418 @@ static void FilteredAddTarget(ScriptFrame& permissionFrame, Expression *permissi
 	}
 }
 
+/* Types with fewer objects are filtered in the calling thread only. */
+static constexpr size_t l_ParallelFilterMinObjects = 4096;
+
+/* The objects are split into chunks of at least that many objects. */
+static constexpr size_t l_ParallelFilterMinChunkSize = 1024;
+
+/**
+ * Does what FilteredAddTarget() does for all objects of a type, but in parallel on the thread pool.
+ *
+ * The objects are split into chunks, each of them is filtered with its own permission checker
+ * and ScriptFrames. Only the compiled filter is shared between the threads, it isn't modified.
+ * The calling thread takes chunks as well, so this is never slower than filtering all objects in
+ * it, even if the thread pool is busy. The results are merged in the order of the objects.
+ *
+ * @param objects The objects to filter
+ * @param user The API user whose permissions apply
+ * @param permission The permission whose filter applies
+ * @param filter The user's compiled filter, if any
+ * @param filterVars The user's filter variables, if any
+ * @param variableName The name of the objects in the filters
+ *
+ * @return The objects which pass both filters
+ */
+static std::vector<Value> ParallelFilterTargets(const std::vector<ConfigObject::Ptr>& objects, const ApiUser::Ptr& user,
+	const String& permission, Expression *filter, const Dictionary::Ptr& filterVars, const String& variableName)
+{
+	struct State
+	{
+		std::mutex Mutex;
+		std::condition_variable CV;
+		size_t NextChunk = 0;
+		size_t DoneChunks = 0;
+		std::exception_ptr Exception;
+	};
+
+	size_t chunkCount = std::min<size_t>(objects.size() / l_ParallelFilterMinChunkSize, Configuration::Concurrency * 4u);
+	chunkCount = std::max<size_t>(chunkCount, 1);
+
+	auto state (std::make_shared<State>());
+	std::vector<std::vector<Value>> chunkResults (chunkCount);
+
+	auto filterChunk ([&](size_t chunk) {
+		size_t begin = objects.size() * chunk / chunkCount;
+		size_t end = objects.size() * (chunk + 1u) / chunkCount;
+
+		FilterExprPermissionChecker::Ptr permissionChecker = new FilterExprPermissionChecker{user};
+		auto* permissionFilter = permissionChecker->CheckPermission(permission);
+
+		ScriptFrame permissionFrame(false, new Namespace());
+
+		Namespace::Ptr frameNS = new Namespace();
+		ScriptFrame frame(false, frameNS);
+		frame.Sandboxed = true;
+		frame.PermChecker = permissionChecker;
+
+		if (filterVars) {
+			ObjectLock olock (filterVars);
+
+			for (auto& kv : filterVars) {
+				frameNS->Set(kv.first, kv.second);
+			}
+		}
+
+		auto& result (chunkResults[chunk]);
+
+		for (size_t i = begin; i < end; i++) {
+			FilteredAddTarget(permissionFrame, permissionFilter, frame, filter, result, variableName, objects[i]);
+		}
+	});
+
+	/* Takes chunks until there are none left. */
+	auto work ([state, filterChunk, chunkCount]() {
+		for (;;) {
+			size_t chunk;
+
+			{
+				std::unique_lock<std::mutex> lock (state->Mutex);
+
+				if (state->NextChunk >= chunkCount || state->Exception) {
+					return;
+				}
+
+				chunk = state->NextChunk++;
+			}
+
+			std::exception_ptr exception;
+
+			try {
+				filterChunk(chunk);
+			} catch (...) {
+				exception = std::current_exception();
+			}
+
+			std::unique_lock<std::mutex> lock (state->Mutex);
+
+			if (exception && !state->Exception) {
+				state->Exception = exception;
+			}
+
+			state->DoneChunks++;
+			state->CV.notify_all();
+		}
+	});
+
+	/* A worker which starts after all chunks have been taken only looks at the state,
+	 * which is why that one may outlive this function, unlike the objects and results.
+	 */
+	for (size_t i = 1; i < std::min<size_t>(chunkCount, Configuration::Concurrency); i++) {
+		Utility::QueueAsyncCallback(work, LowLatencyScheduler);
+	}
+
+	work();
+
+	{
+		std::unique_lock<std::mutex> lock (state->Mutex);
+
+		state->CV.wait(lock, [&state]() {
+			return state->DoneChunks == state->NextChunk;
+		});
+
+		if (state->Exception) {
+			std::rethrow_exception(state->Exception);
+		}
+	}
+
+	std::vector<Value> result;
+	size_t total = 0;
+
+	for (auto& chunkResult : chunkResults) {
+		total += chunkResult.size();
+	}
+
+	result.reserve(total);
+
+	for (auto& chunkResult : chunkResults) {
+		std::move(chunkResult.begin(), chunkResult.end(), std::back_inserter(result));
+	}
+
+	return result;
+}
+
+/**
+ * Returns the objects of the given type if there are enough of them to filter them in parallel.
+ *
+ * @param provider The target provider of the query
+ * @param type The type of the objects
+ * @param objects Receives the objects
+ *
+ * @return Whether the objects shall be filtered in parallel
+ */
+static bool GetParallelFilterObjects(const TargetProvider::Ptr& provider, const String& type, std::vector<ConfigObject::Ptr>& objects)
+{
+	if (Configuration::Concurrency < 2u || !dynamic_cast<ConfigObjectTargetProvider*>(provider.get())) {
+		return false;
+	}
+
+	Type::Ptr ptype = Type::GetByName(type);
+	auto *ctype = dynamic_cast<ConfigType*>(ptype.get());
+
+	if (!ctype || size_t(ctype->GetObjectCount()) < l_ParallelFilterMinObjects) {
+		return false;
+	}
+
+	objects = ctype->GetObjects();
+
+	return objects.size() >= l_ParallelFilterMinObjects;
+}
+
+/**
+ * What an API filter refers to, as far as GetIndexedFilterCandidates() is concerned.
+ */
+struct IndexedFilterScope
+{
+	Type::Ptr ObjectType;
+	Dictionary::Ptr FilterVars;
+
+	/* The variables EvaluateFilter() sets to the object or its navigated ones. */
+	std::set<String> ObjectNames;
+
+	/* Whether a variable refers to the object itself. */
+	std::set<String> SelfNames;
+};
+
+/**
+ * @returns If the given expression is a literal or a filter variable, its address. nullptr otherwise.
+ */
+static const Value *GetIndexedFilterConst(Expression *exp, const IndexedFilterScope& scope)
+{
+	auto lit (dynamic_cast<LiteralExpression*>(exp));
+
+	if (lit) {
+		return &lit->GetValue();
+	}
+
+	auto var (dynamic_cast<VariableExpression*>(exp));
+
+	if (var && scope.FilterVars && scope.ObjectNames.find(var->GetVariable()) == scope.ObjectNames.end()) {
+		return scope.FilterVars->GetRef(var->GetVariable());
+	}
+
+	return nullptr;
+}
+
+/**
+ * If the given expression is like host.ATTR or host.vars.VAR, get the attribute name (ATTR or vars.VAR).
+ *
+ * @returns Whether the expression is like above.
+ */
+static bool GetFilterAttributePath(Expression *exp, const IndexedFilterScope& scope, String& attribute)
+{
+	auto ixr (dynamic_cast<IndexerExpression*>(exp));
+
+	if (!ixr) {
+		return false;
+	}
+
+	auto name (GetIndexedFilterConst(ixr->GetOperand2().get(), scope));
+
+	if (!name || !name->IsString()) {
+		return false;
+	}
+
+	auto var (dynamic_cast<VariableExpression*>(ixr->GetOperand1().get()));
+
+	if (var) {
+		if (scope.SelfNames.find(var->GetVariable()) == scope.SelfNames.end()) {
+			return false;
+		}
+
+		attribute = *name;
+		return true;
+	}
+
+	String parent;
+
+	if (!GetFilterAttributePath(ixr->GetOperand1().get(), scope, parent)) {
+		return false;
+	}
+
+	attribute = parent + "." + name->Get<String>();
+	return true;
+}
+
+/**
+ * @returns Whether the given expression is an attribute of the object (see GetFilterAttributePath()) which FilterIndex has.
+ */
+static bool GetIndexedFilterAttribute(Expression *exp, const IndexedFilterScope& scope, String& attribute)
+{
+	return GetFilterAttributePath(exp, scope, attribute) && FilterIndex::IsIndexable(scope.ObjectType, attribute);
+}
+
+/**
+ * Narrows down the objects the given filter may be true for by looking up the parts of it
+ * like the following in FilterIndex:
+ *
+ * host.ATTR == C, host.ATTR != C, C in host.ATTR, match(C, host.ATTR)
+ *
+ * ... combined by && and ||. C has to be a literal or a filter variable.
+ * The order of operands of && || == != doesn't matter.
+ *
+ * The right side of && may be unlike the above, it's just not used for narrowing down then.
+ * The candidates always include the objects the filter may fail for, so that the result is
+ * the same as with evaluating the filter for all objects, including errors.
+ *
+ * @returns Whether the objects could be narrowed down.
+ */
+static bool GetIndexedFilterCandidates(Expression *filter, const IndexedFilterScope& scope, FilterIndexCandidates& candidates)
+{
+	auto land (dynamic_cast<LogicalAndExpression*>(filter));
+	auto lor (dynamic_cast<LogicalOrExpression*>(filter));
+
+	if (land || lor) {
+		auto binary (static_cast<BinaryExpression*>(filter));
+		FilterIndexCandidates left, right;
+		bool haveLeft = GetIndexedFilterCandidates(binary->GetOperand1().get(), scope, left);
+		bool haveRight = GetIndexedFilterCandidates(binary->GetOperand2().get(), scope, right);
+
+		if (lor) {
+			if (!haveLeft || !haveRight) {
+				return false;
+			}
+
+			candidates = std::move(left);
+			candidates.Objects.insert(right.Objects.begin(), right.Objects.end());
+			candidates.Irregular.insert(right.Irregular.begin(), right.Irregular.end());
+			return true;
+		}
+
+		/* The left side may be anything, even fail for any object. */
+		if (!haveLeft) {
+			return false;
+		}
+
+		/* The right side is only evaluated if the left one is true, so it may fail only for the left side's candidates. */
+		if (!haveRight) {
+			candidates.Objects = std::move(left.Objects);
+			candidates.Irregular = candidates.Objects;
+			return true;
+		}
+
+		auto& smaller (left.Objects.size() < right.Objects.size() ? left.Objects : right.Objects);
+		auto& larger (left.Objects.size() < right.Objects.size() ? right.Objects : left.Objects);
+
+		for (auto id : smaller) {
+			if (larger.find(id) != larger.end()) {
+				candidates.Objects.emplace(id);
+			}
+		}
+
+		candidates.Irregular = std::move(left.Irregular);
+		candidates.Irregular.insert(right.Irregular.begin(), right.Irregular.end());
+		candidates.Objects.insert(candidates.Irregular.begin(), candidates.Irregular.end());
+		return true;
+	}
+
+	String attribute;
+	const Value *operand = nullptr;
+	FilterIndexPredicate predicate;
+
+	if (dynamic_cast<EqualExpression*>(filter) || dynamic_cast<NotEqualExpression*>(filter)) {
+		auto binary (static_cast<BinaryExpression*>(filter));
+		auto op1 (binary->GetOperand1().get());
+		auto op2 (binary->GetOperand2().get());
+
+		if (!GetIndexedFilterAttribute(op1, scope, attribute)) {
+			std::swap(op1, op2);
+
+			if (!GetIndexedFilterAttribute(op1, scope, attribute)) {
+				return false;
+			}
+		}
+
+		operand = GetIndexedFilterConst(op2, scope);
+		predicate = dynamic_cast<EqualExpression*>(filter) ? FilterIndexPredicate::Equal : FilterIndexPredicate::NotEqual;
+	} else if (auto in = dynamic_cast<InExpression*>(filter); in) {
+		if (!GetIndexedFilterAttribute(in->GetOperand2().get(), scope, attribute)) {
+			return false;
+		}
+
+		operand = GetIndexedFilterConst(in->GetOperand1().get(), scope);
+		predicate = FilterIndexPredicate::Contains;
+	} else if (auto call = dynamic_cast<FunctionCallExpression*>(filter); call) {
+		auto fname (dynamic_cast<VariableExpression*>(call->m_FName.get()));
+
+		/* Just the global match(), not one from the filter variables. */
+		if (!fname || fname->GetVariable() != "match" || call->m_Args.size() != 2u
+			|| scope.ObjectNames.find("match") != scope.ObjectNames.end()
+			|| (scope.FilterVars && scope.FilterVars->Contains("match"))) {
+			return false;
+		}
+
+		if (!GetIndexedFilterAttribute(call->m_Args[1].get(), scope, attribute)) {
+			return false;
+		}
+
+		operand = GetIndexedFilterConst(call->m_Args[0].get(), scope);
+		predicate = FilterIndexPredicate::Match;
+	}
+
+	if (!operand) {
+		return false;
+	}
+
+	return FilterIndex::Lookup(scope.ObjectType, attribute, predicate, *operand, candidates);
+}
+
+/**
+ * Looks up the objects of the given type the given filter may be true for, see GetIndexedFilterCandidates().
+ *
+ * @param provider The target provider of the query
+ * @param type The type of the objects
+ * @param filter The user's filter
+ * @param filterVars The user's filter variables, if any
+ * @param variableName The name of the objects in the filter
+ * @param objects Receives the objects
+ *
+ * @return Whether the objects could be narrowed down
+ */
+static bool GetIndexedFilterObjects(const TargetProvider::Ptr& provider, const String& type, Expression *filter,
+	const Dictionary::Ptr& filterVars, const String& variableName, std::vector<ConfigObject::Ptr>& objects)
+{
+	if (!dynamic_cast<ConfigObjectTargetProvider*>(provider.get())) {
+		return false;
+	}
+
+	auto dict (dynamic_cast<DictExpression*>(filter));
+
+	if (!dict || dict->GetExpressions().size() != 1u) {
+		return false;
+	}
+
+	IndexedFilterScope scope;
+	scope.ObjectType = Type::GetByName(type);
+	scope.FilterVars = filterVars;
+
+	if (!dynamic_cast<ConfigType*>(scope.ObjectType.get())) {
+		return false;
+	}
+
+	scope.SelfNames = { "obj", variableName.IsEmpty() ? scope.ObjectType->GetName().ToLower() : variableName };
+	scope.ObjectNames = GetFilterObjectNames(scope.ObjectType, variableName);
+
+	FilterIndexCandidates candidates;
+
+	if (!GetIndexedFilterCandidates(dict->GetExpressions().at(0).get(), scope, candidates)) {
+		return false;
+	}
+
+	objects = FilterIndex::GetObjects(scope.ObjectType, candidates.Objects);
+	return true;
+}
+
 /**
  * Checks whether the given API user is granted the given permission
  *
@@ -386,8 +917,9 @@ std::vector<Value> FilterUtility::GetFilterTargets(const QueryDescription& qd, c
 
 		if (query->Contains("filter")) {
 			String filter = HttpUtility::GetLastParameter(query, "filter");
-			std::unique_ptr<Expression> ufilter = ConfigCompiler::CompileText("<API query>", filter);
 			Dictionary::Ptr filter_vars = query->Get("filter_vars");
+			Expression::Ptr ufilter = FilterUtility::CompileFilter("<API query>", filter,
+				GetFilterConstants(provider, type, variableName, filter_vars));
 			bool targeted = false;
 			std::vector<ConfigObject::Ptr> targets;
 
@@ -435,12 +967,38 @@ std::vector<Value> FilterUtility::GetFilterTargets(const QueryDescription& qd, c
 				}
 			}
 
+			std::vector<ConfigObject::Ptr> objects;
+
 			if (targeted) {
 				for (auto& target : targets) {
 					if (FilterUtility::EvaluateFilter(permissionFrame, permissionFilter, target, variableName)) {
 						result.emplace_back(std::move(target));
 					}
 				}
+			} else if (GetIndexedFilterObjects(provider, type, ufilter.get(), filter_vars, variableName, objects)) {
+				if (!qd.Limit && Configuration::Concurrency > 1u && objects.size() >= l_ParallelFilterMinObjects) {
+					auto targets (ParallelFilterTargets(objects, user, qd.Permission, ufilter.get(), filter_vars, variableName));
+					std::move(targets.begin(), targets.end(), std::back_inserter(result));
+				} else {
+					if (filter_vars) {
+						ObjectLock olock (filter_vars);
+
+						for (auto& kv : filter_vars) {
+							frameNS->Set(kv.first, kv.second);
+						}
+					}
+
+					for (auto& object : objects) {
+						if (qd.Limit && result.size() >= qd.Limit) {
+							break;
+						}
+
+						FilteredAddTarget(permissionFrame, permissionFilter, frame, &*ufilter, result, variableName, object);
+					}
+				}
+			} else if (!qd.Limit && GetParallelFilterObjects(provider, type, objects)) {
+				auto targets (ParallelFilterTargets(objects, user, qd.Permission, ufilter.get(), filter_vars, variableName));
+				std::move(targets.begin(), targets.end(), std::back_inserter(result));
 			} else {
 				if (filter_vars) {
 					ObjectLock olock (filter_vars);
@@ -450,19 +1008,30 @@ std::vector<Value> FilterUtility::GetFilterTargets(const QueryDescription& qd, c
 					}
 				}
 
-				provider->FindTargets(type, [&permissionFrame, permissionFilter, &frame, &ufilter, &result, variableName](const Object::Ptr& target) {
-					FilteredAddTarget(permissionFrame, permissionFilter, frame, &*ufilter, result, variableName, target);
+				provider->FindTargets(type, [&permissionFrame, permissionFilter, &frame, &ufilter, &result, variableName, &qd](const Object::Ptr& target) {
+					if (!qd.Limit || result.size() < qd.Limit) {
+						FilteredAddTarget(permissionFrame, permissionFilter, frame, &*ufilter, result, variableName, target);
+					}
 				});
 			}
+		} else if (std::vector<ConfigObject::Ptr> objects; !qd.Limit && GetParallelFilterObjects(provider, type, objects)) {
+			auto targets (ParallelFilterTargets(objects, user, qd.Permission, nullptr, nullptr, variableName));
+			std::move(targets.begin(), targets.end(), std::back_inserter(result));
 		} else {
 			/* Ensure to pass a nullptr as filter expression.
 			 * GCC 8.1.1 on F28 causes problems, see GH #6533.
 			 */
-			provider->FindTargets(type, [&permissionFrame, permissionFilter, &frame, &result, variableName](const Object::Ptr& target) {
-				FilteredAddTarget(permissionFrame, permissionFilter, frame, nullptr, result, variableName, target);
+			provider->FindTargets(type, [&permissionFrame, permissionFilter, &frame, &result, variableName, &qd](const Object::Ptr& target) {
+				if (!qd.Limit || result.size() < qd.Limit) {
+					FilteredAddTarget(permissionFrame, permissionFilter, frame, nullptr, result, variableName, target);
+				}
 			});
 		}
 	}
 
+	if (qd.Limit && result.size() > qd.Limit) {
+		result.resize(qd.Limit);
+	}
+
 	return result;
 }
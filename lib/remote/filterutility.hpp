@@ -40,6 +40,9 @@ struct QueryDescription
 	std::set<String> Types;
 	TargetProvider::Ptr Provider;
 	String Permission;
+
+	/* If not 0, at most that many targets are looked for, the first ones found. */
+	size_t Limit = 0;
 };
 
 /**
@@ -59,6 +62,7 @@ public:
 		const ApiUser::Ptr& user, const String& variableName = String());
 	static bool EvaluateFilter(ScriptFrame& frame, Expression *filter,
 		const Object::Ptr& target, const String& variableName = String());
+	static Expression::Ptr CompileFilter(const String& fileName, const String& filter, const Dictionary::Ptr& constants = nullptr);
 };
 
 }
@@ -423,7 +423,7 @@ void ProcessRequest(
 	try {
 		// Cache the elapsed time to acquire a CPU semaphore used to detect extremely heavy workloads.
 		auto start (std::chrono::steady_clock::now());
-		CpuBoundWork handlingRequest (yc);
+		CpuBoundWork handlingRequest (yc, CpuBoundWorkPool::Http);
 		cpuBoundWorkTime = std::chrono::steady_clock::now() - start;
 
 		HttpHandler::ProcessRequest(waitGroup, request, response, yc);
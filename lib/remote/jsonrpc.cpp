@@ -1,19 +1,40 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "remote/jsonrpc.hpp"
+#include "remote/binarymessage.hpp"
+#include "base/atomic.hpp"
+#include "base/compression.hpp"
 #include "base/netstring.hpp"
 #include "base/json.hpp"
 #include "base/console.hpp"
 #include "base/scriptglobal.hpp"
 #include "base/convert.hpp"
 #include "base/tlsstream.hpp"
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <set>
 #include <utility>
 #include <boost/asio/spawn.hpp>
 
 using namespace icinga;
 
+/* Compressed messages start with a byte which can't start a JSON text, followed by the format. */
+static const char l_CompressedMessagePrefix[] = { '\0', 'z' };
+
+/* Smaller messages aren't worth the CPU time. */
+static constexpr size_t l_MinCompressedMessageSize = 1024;
+
+/* A decompressed message mustn't exceed what a netstring can carry (a length of at most 9 digits). */
+static constexpr size_t l_MaxDecompressedMessageSize = 999999999;
+
+static Atomic<uint_fast64_t> l_CompressedMessages (0);
+static Atomic<uint_fast64_t> l_BytesBeforeCompression (0);
+static Atomic<uint_fast64_t> l_BytesAfterCompression (0);
+static AtomicDuration l_CompressionTime;
+static Atomic<uint_fast64_t> l_DecompressedMessages (0);
+static AtomicDuration l_DecompressionTime;
+
 #ifdef I2_DEBUG
 /**
  * Determine whether the developer wants to see raw JSON messages.
@@ -95,6 +116,24 @@ size_t JsonRpc::SendRawMessage(const Shared<AsioTlsStream>::Ptr& stream, const S
 	return NetString::WriteStringToStream(stream, json, yc);
 }
 
+/**
+ * Appends a raw message to a buffer, so that multiple messages can be sent at once.
+ *
+ * @param buffer The buffer
+ * @param json message
+ *
+ * @return bytes appended
+ */
+size_t JsonRpc::WriteRawMessageToBuffer(std::string& buffer, const String& json)
+{
+#ifdef I2_DEBUG
+	if (GetDebugJsonRpcCached())
+		std::cerr << ConsoleColorTag(Console_ForegroundBlue) << ">> " << json << ConsoleColorTag(Console_Normal) << "\n";
+#endif /* I2_DEBUG */
+
+	return NetString::WriteStringToBuffer(buffer, json);
+}
+
 /**
  * Reads a message from the connected peer.
  *
@@ -155,3 +194,163 @@ Dictionary::Ptr JsonRpc::DecodeMessage(const String& message)
 
 	return value;
 }
+
+/**
+ * Determines the priority of a message by its method.
+ *
+ * @param message The message
+ *
+ * @return The priority
+ */
+JsonRpcPriority JsonRpc::GetMessagePriority(const Dictionary::Ptr& message)
+{
+	static const std::set<String> highPriorityMethods {
+		"config::DeleteObject", "config::Update", "config::UpdateObject", "event::Heartbeat",
+		"icinga::Hello", "log::SetLogPosition", "pki::RequestCertificate", "pki::UpdateCertificate"
+	};
+
+	static const std::set<String> lowPriorityMethods {
+		"event::SetLastCheckStarted", "event::SetNextCheck", "event::SetNextNotification"
+	};
+
+	String method = message->Get("method");
+
+	/* High priority messages overtake the queued ones, but the peer drops every message older than the last "ts"
+	 * it has seen. So only messages sent by the connection itself, e.g. the config sync on connect, qualify.
+	 * Relayed ones, e.g. runtime config changes, carry a "ts" and have to stay in order.
+	 */
+	if (highPriorityMethods.find(method) != highPriorityMethods.end() && !message->Contains("ts")) {
+		return JsonRpcPriority::High;
+	}
+
+	if (lowPriorityMethods.find(method) != lowPriorityMethods.end()) {
+		return JsonRpcPriority::Low;
+	}
+
+	return JsonRpcPriority::Normal;
+}
+
+/**
+ * Determines which queued messages a message supersedes, see JsonRpcConnection::EnqueueMessage().
+ *
+ * Of the low priority messages, which only carry an object's latest state, only the newest one per
+ * method and object is of any use.
+ *
+ * @param message The message
+ *
+ * @return The same key for all messages only the newest of which is needed, an empty string for the others
+ */
+String JsonRpc::GetCoalescingKey(const Dictionary::Ptr& message)
+{
+	if (GetMessagePriority(message) != JsonRpcPriority::Low) {
+		return String();
+	}
+
+	Dictionary::Ptr params = message->Get("params");
+
+	if (!params) {
+		return String();
+	}
+
+	String key = message->Get("method");
+
+	for (auto param : { "host", "service", "notification" }) {
+		key += "\n";
+		key += params->Get(param);
+	}
+
+	return key;
+}
+
+/**
+ * Compresses a message for a peer which has announced ApiCapabilities::MessageCompression.
+ *
+ * @param json The message
+ *
+ * @return The compressed message or the plain one if it's too small or doesn't get smaller
+ */
+String JsonRpc::CompressMessage(const String& json)
+{
+	if (json.GetLength() < l_MinCompressedMessageSize) {
+		return json;
+	}
+
+	auto start (AtomicDuration::Clock::now());
+
+	String compressed (l_CompressedMessagePrefix, l_CompressedMessagePrefix + sizeof(l_CompressedMessagePrefix));
+	compressed += Compression::Compress(json, 1);
+
+	l_CompressionTime += AtomicDuration::Clock::now() - start;
+
+	if (compressed.GetLength() >= json.GetLength()) {
+		return json;
+	}
+
+	l_CompressedMessages.fetch_add(1);
+	l_BytesBeforeCompression.fetch_add(json.GetLength());
+	l_BytesAfterCompression.fetch_add(compressed.GetLength());
+
+	return compressed;
+}
+
+/**
+ * Checks whether a received message has been compressed by CompressMessage().
+ *
+ * @param message The message
+ *
+ * @return Whether the message is compressed
+ */
+bool JsonRpc::IsCompressedMessage(const String& message)
+{
+	return message.GetLength() >= sizeof(l_CompressedMessagePrefix)
+		&& memcmp(message.CStr(), l_CompressedMessagePrefix, sizeof(l_CompressedMessagePrefix)) == 0;
+}
+
+/**
+ * Decompresses a message compressed by CompressMessage().
+ *
+ * @param message The compressed message
+ *
+ * @return The JSON string
+ * @throws std::length_error if the message would exceed the maximum message size
+ */
+String JsonRpc::DecompressMessage(const String& message)
+{
+	auto start (AtomicDuration::Clock::now());
+
+	String json = Compression::Decompress(message.SubStr(sizeof(l_CompressedMessagePrefix)), l_MaxDecompressedMessageSize);
+
+	l_DecompressionTime += AtomicDuration::Clock::now() - start;
+	l_DecompressedMessages.fetch_add(1);
+
+	return json;
+}
+
+JsonRpcCompressionStats JsonRpc::GetCompressionStats()
+{
+	return JsonRpcCompressionStats {
+		l_CompressedMessages.load(),
+		l_BytesBeforeCompression.load(),
+		l_BytesAfterCompression.load(),
+		l_CompressionTime,
+		l_DecompressedMessages.load(),
+		l_DecompressionTime
+	};
+}
+
+/**
+ * Returns the message for peers which accept binary messages. It's encoded once, on the first call.
+ *
+ * @return The binary message or an empty string if there's no binary encoding for it
+ */
+const String& EncodedJsonRpcMessage::GetBinary() const
+{
+	std::call_once(m_BinaryOnce, [this]() {
+		if (m_Message) {
+			m_Binary = BinaryMessageType::EncodeMessage(m_Message);
+			m_Message = nullptr;
+		}
+	});
+
+	return m_Binary;
+}
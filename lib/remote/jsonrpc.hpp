@@ -5,14 +5,46 @@
 
 #include "base/stream.hpp"
 #include "base/dictionary.hpp"
+#include "base/shared-object.hpp"
 #include "base/tlsstream.hpp"
 #include "remote/i2-remote.hpp"
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
 #include <boost/asio/spawn.hpp>
 
 namespace icinga
 {
 
+/**
+ * The order in which queued JSON-RPC messages are sent and whether they may be dropped.
+ *
+ * @ingroup remote
+ */
+enum class JsonRpcPriority
+{
+	Low, /**< State-only messages which are superseded by newer ones and may be dropped. */
+	Normal,
+	High /**< Heartbeats and config sync without a "ts", sent before all other messages. */
+};
+
+/**
+ * Totals of the JSON-RPC message compression, see JsonRpc::CompressMessage().
+ *
+ * @ingroup remote
+ */
+struct JsonRpcCompressionStats
+{
+	uint_fast64_t CompressedMessages;
+	uint_fast64_t BytesBeforeCompression;
+	uint_fast64_t BytesAfterCompression;
+	double CompressionTime;
+	uint_fast64_t DecompressedMessages;
+	double DecompressionTime;
+};
+
 /**
  * A JSON-RPC connection.
  *
@@ -24,16 +56,89 @@ public:
 	static size_t SendMessage(const Shared<AsioTlsStream>::Ptr& stream, const Dictionary::Ptr& message);
 	static size_t SendMessage(const Shared<AsioTlsStream>::Ptr& stream, const Dictionary::Ptr& message, boost::asio::yield_context yc);
 	static size_t SendRawMessage(const Shared<AsioTlsStream>::Ptr& stream, const String& json, boost::asio::yield_context yc);
+	static size_t WriteRawMessageToBuffer(std::string& buffer, const String& json);
 
 	static String ReadMessage(const Shared<AsioTlsStream>::Ptr& stream, ssize_t maxMessageLength = -1);
 	static String ReadMessage(const Shared<AsioTlsStream>::Ptr& stream, boost::asio::yield_context yc, ssize_t maxMessageLength = -1);
 
 	static Dictionary::Ptr DecodeMessage(const String& message);
 
+	static JsonRpcPriority GetMessagePriority(const Dictionary::Ptr& message);
+	static String GetCoalescingKey(const Dictionary::Ptr& message);
+
+	static String CompressMessage(const String& json);
+	static bool IsCompressedMessage(const String& message);
+	static String DecompressMessage(const String& message);
+	static JsonRpcCompressionStats GetCompressionStats();
+
 private:
 	JsonRpc();
 };
 
+/**
+ * A JSON-RPC message which has been encoded once and is shared by all the connections it's sent to.
+ *
+ * @ingroup remote
+ */
+class EncodedJsonRpcMessage final : public SharedObject
+{
+public:
+	DECLARE_PTR_TYPEDEFS(EncodedJsonRpcMessage);
+
+	/**
+	 * @param json The encoded message
+	 * @param priority The message's priority, see JsonRpc::GetMessagePriority()
+	 * @param message The decoded message if it's not going to be modified anymore, allows for GetBinary() and GetCoalescingKey()
+	 */
+	explicit EncodedJsonRpcMessage(String json, JsonRpcPriority priority = JsonRpcPriority::Normal, Dictionary::Ptr message = nullptr)
+		: m_Json(std::move(json)), m_Priority(priority), m_CoalescingKey(message ? JsonRpc::GetCoalescingKey(message) : String()),
+		m_Message(std::move(message))
+	{
+	}
+
+	const String& GetJson() const
+	{
+		return m_Json;
+	}
+
+	JsonRpcPriority GetPriority() const
+	{
+		return m_Priority;
+	}
+
+	const String& GetCoalescingKey() const
+	{
+		return m_CoalescingKey;
+	}
+
+	/**
+	 * Returns the message for peers which accept compressed messages. It's compressed once, on the first call.
+	 *
+	 * @return The compressed message or the plain one if compressing it isn't worth it
+	 */
+	const String& GetCompressedJson() const
+	{
+		std::call_once(m_CompressOnce, [this]() { m_CompressedJson = JsonRpc::CompressMessage(m_Json); });
+
+		return m_CompressedJson;
+	}
+
+	const String& GetBinary() const;
+
+private:
+	const String m_Json;
+	const JsonRpcPriority m_Priority;
+	const String m_CoalescingKey;
+
+	mutable std::once_flag m_CompressOnce;
+	mutable String m_CompressedJson;
+
+	/* The decoded message, until it's been encoded as a binary message. */
+	mutable Dictionary::Ptr m_Message;
+	mutable std::once_flag m_BinaryOnce;
+	mutable String m_Binary;
+};
+
 }
 
 #endif /* JSONRPC_H */
@@ -3,6 +3,7 @@
 #include "remote/jsonrpcconnection.hpp"
 #include "remote/apilistener.hpp"
 #include "remote/apifunction.hpp"
+#include "remote/binarymessage.hpp"
 #include "remote/jsonrpc.hpp"
 #include "base/defer.hpp"
 #include "base/configtype.hpp"
@@ -28,6 +29,19 @@ static Value SetLogPositionHandler(const MessageOrigin::Ptr& origin, const Dicti
 REGISTER_APIFUNCTION(SetLogPosition, log, &SetLogPositionHandler);
 
 static RingBuffer l_TaskStats (15 * 60);
+static Atomic<uint_fast64_t> l_DroppedMessages (0);
+static Atomic<uint_fast64_t> l_SpilledMessages (0);
+static Atomic<uint_fast64_t> l_CoalescedMessages (0);
+
+/**
+ * Returns the byte budget of each connection's outgoing queue, 0 if it's unlimited.
+ */
+static size_t GetOutgoingQueueBudget()
+{
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	return listener ? listener->GetMaxOutgoingQueueSize() : 0;
+}
 
 JsonRpcConnection::JsonRpcConnection(const WaitGroup::Ptr& waitGroup, const String& identity, bool authenticated,
 	const Shared<AsioTlsStream>::Ptr& stream, ConnectionRole role)
@@ -38,8 +52,8 @@ JsonRpcConnection::JsonRpcConnection(const WaitGroup::Ptr& waitGroup, const Stri
 JsonRpcConnection::JsonRpcConnection(const WaitGroup::Ptr& waitGroup, const String& identity, bool authenticated,
 	const Shared<AsioTlsStream>::Ptr& stream, ConnectionRole role, boost::asio::io_context& io)
 	: m_Identity(identity), m_Authenticated(authenticated), m_Stream(stream), m_Role(role),
-	m_Timestamp(Utility::GetTime()), m_Seen(Utility::GetTime()), m_IoStrand(io),
-	m_OutgoingMessagesQueued(io), m_WriterDone(io), m_ShuttingDown(false), m_WaitGroup(waitGroup),
+	m_Timestamp(Utility::GetTime()), m_Seen(Utility::GetTime()), m_IoStrand(io), m_NextDroppableMessage(0),
+	m_OutgoingMessagesQueued(io), m_OutgoingMessages(0), m_OutgoingBytes(0), m_BudgetedBytes(0), m_DroppableBytes(0), m_WriterDone(io), m_ShuttingDown(false), m_WaitGroup(waitGroup),
 	m_CheckLivenessTimer(io), m_HeartbeatTimer(io)
 {
 	if (authenticated)
@@ -91,17 +105,35 @@ void JsonRpcConnection::HandleIncomingMessages(boost::asio::yield_context yc)
 		auto start (ch::steady_clock::now());
 
 		try {
-			CpuBoundWork handleMessage (yc);
+			CpuBoundWork handleMessage (yc, CpuBoundWorkPool::JsonRpc);
 
 			// Cache the elapsed time to acquire a CPU semaphore used to detect extremely heavy workloads.
 			cpuBoundDuration = ch::steady_clock::now() - start;
 
-			Dictionary::Ptr message = JsonRpc::DecodeMessage(jsonString);
-			if (String method = message->Get("method"); !method.IsEmpty()) {
-				rpcMethod = std::move(method);
-			}
+			if (BinaryMessageType::IsBinaryMessage(jsonString)) {
+				// Only peers which have announced ApiCapabilities::BinaryMessages get binary messages.
+				if (!m_Endpoint) {
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Binary messages are not accepted from anonymous clients."));
+				}
+
+				BinaryMessageHandler(jsonString, rpcMethod);
+			} else {
+				if (JsonRpc::IsCompressedMessage(jsonString)) {
+					// Only peers which have announced ApiCapabilities::MessageCompression get compressed messages.
+					if (!m_Endpoint) {
+						BOOST_THROW_EXCEPTION(std::invalid_argument("Compressed messages are not accepted from anonymous clients."));
+					}
+
+					jsonString = JsonRpc::DecompressMessage(jsonString);
+				}
 
-			MessageHandler(message);
+				Dictionary::Ptr message = JsonRpc::DecodeMessage(jsonString);
+				if (String method = message->Get("method"); !method.IsEmpty()) {
+					rpcMethod = std::move(method);
+				}
+
+				MessageHandler(message);
+			}
 
 			l_TaskStats.InsertValue(Utility::GetTime(), 1);
 
@@ -139,38 +171,109 @@ void JsonRpcConnection::HandleIncomingMessages(boost::asio::yield_context yc)
 
 void JsonRpcConnection::WriteOutgoingMessages(boost::asio::yield_context yc)
 {
+	namespace asio = boost::asio;
+
 	Defer signalWriterDone ([this]() { m_WriterDone.Set(); });
 
+	/* Queued messages are written in batches to reduce the number of TLS records and syscalls.
+	 * The batch is written to the TLS stream directly, as the buffered stream would split it into small chunks.
+	 * Nothing else writes to m_Stream, so its write buffer is always empty.
+	 */
+	std::string batch;
+	std::vector<EncodedJsonRpcMessage::Ptr> batchMessages;
+
+	auto writeBatch ([this, &batch, &batchMessages, &yc]() {
+		asio::async_write(m_Stream->next_layer(), asio::buffer(batch), yc);
+
+		if (m_Endpoint) {
+			m_Endpoint->AddMessagesFlushed();
+		}
+
+		for (auto& message : batchMessages) {
+			DequeueMessage(message);
+		}
+
+		batch.clear();
+		batchMessages.clear();
+	});
+
 	do {
 		m_OutgoingMessagesQueued.Wait(yc);
+		m_OutgoingMessagesQueued.Clear();
 
-		auto queue (std::move(m_OutgoingMessagesQueue));
+		try {
+			size_t maxBatchSize = 256 * 1024;
+			bool compress = false;
+			bool binary = m_Endpoint && (m_Endpoint->GetCapabilities() & (uint_fast64_t)ApiCapabilities::BinaryMessages);
 
-		m_OutgoingMessagesQueue.clear();
-		m_OutgoingMessagesQueued.Clear();
+			if (auto listener = ApiListener::GetInstance(); listener) {
+				maxBatchSize = listener->GetMaxWriteBatchSize();
+
+				compress = m_Endpoint && listener->GetCompressMessages()
+					&& (m_Endpoint->GetCapabilities() & (uint_fast64_t)ApiCapabilities::MessageCompression);
+			}
+
+			/* Messages queued while a batch is being written are picked up as well,
+			 * high priority ones before all others.
+			 */
+			while (!m_ShuttingDown) {
+				EncodedJsonRpcMessage::Ptr message;
+
+				if (!m_OutgoingHighPriorityMessagesQueue.empty()) {
+					message = std::move(m_OutgoingHighPriorityMessagesQueue.front());
+					m_OutgoingHighPriorityMessagesQueue.pop_front();
+				} else if (!m_OutgoingMessagesQueue.empty()) {
+					message = std::move(m_OutgoingMessagesQueue.front());
+					m_OutgoingMessagesQueue.pop_front();
+
+					/* Too late to coalesce it, see EnqueueMessage(). */
+					if (message && !message->GetCoalescingKey().IsEmpty()) {
+						m_CoalescableMessages.erase(message->GetCoalescingKey());
+					}
 
-		if (!queue.empty()) {
-			try {
-				for (auto& message : queue) {
-					if (m_ShuttingDown) {
-						break;
+					if (m_NextDroppableMessage) {
+						m_NextDroppableMessage--;
 					}
 
-					size_t bytesSent = JsonRpc::SendRawMessage(m_Stream, message, yc);
+					/* Dropped already. */
+					if (!message) {
+						continue;
+					}
 
-					if (m_Endpoint) {
-						m_Endpoint->AddMessageSent(bytesSent);
+					if (message->GetPriority() == JsonRpcPriority::Low) {
+						m_DroppableBytes.fetch_sub(message->GetJson().GetLength());
 					}
+				} else {
+					break;
 				}
 
-				m_Stream->async_flush(yc);
-			} catch (const std::exception& ex) {
-				Log(m_ShuttingDown ? LogDebug : LogWarning, "JsonRpcConnection")
-					<< "Error while sending JSON-RPC message for identity '"
-					<< m_Identity << "'\n" << DiagnosticInformation(ex);
+				size_t bytesSent;
 
-				break;
+				if (binary && !message->GetBinary().IsEmpty()) {
+					bytesSent = JsonRpc::WriteRawMessageToBuffer(batch, message->GetBinary());
+				} else {
+					bytesSent = JsonRpc::WriteRawMessageToBuffer(batch, compress ? message->GetCompressedJson() : message->GetJson());
+				}
+				batchMessages.emplace_back(std::move(message));
+
+				if (m_Endpoint) {
+					m_Endpoint->AddMessageSent(bytesSent);
+				}
+
+				if (batch.size() >= maxBatchSize) {
+					writeBatch();
+				}
+			}
+
+			if (!batch.empty() && !m_ShuttingDown) {
+				writeBatch();
 			}
+		} catch (const std::exception& ex) {
+			Log(m_ShuttingDown ? LogDebug : LogWarning, "JsonRpcConnection")
+				<< "Error while sending JSON-RPC message for identity '"
+				<< m_Identity << "'\n" << DiagnosticInformation(ex);
+
+			break;
 		}
 	} while (!m_ShuttingDown);
 
@@ -224,16 +327,38 @@ void JsonRpcConnection::SendRawMessage(const String& message)
 		BOOST_THROW_EXCEPTION(std::runtime_error("Cannot send message to already disconnected API client '" + GetIdentity() + "'!"));
 	}
 
+	EncodedJsonRpcMessage::Ptr encodedMessage = new EncodedJsonRpcMessage(message);
+
+	/* Used for replaying the log, which has to respect IsOutgoingQueueFull() on its own. */
+	AdmitMessage(encodedMessage, true);
+
 	Ptr keepAlive (this);
 
-	boost::asio::post(m_IoStrand, [this, keepAlive, message] {
-		if (m_ShuttingDown) {
-			return;
-		}
+	boost::asio::post(m_IoStrand, [this, keepAlive, encodedMessage] { EnqueueMessage(encodedMessage); });
+}
 
-		m_OutgoingMessagesQueue.emplace_back(message);
-		m_OutgoingMessagesQueued.Set();
-	});
+/**
+ * Sends an already encoded message, which may be shared with other connections.
+ *
+ * @param message The encoded message
+ * @param force Whether to queue the message regardless of the queue's budget, see AdmitMessage()
+ * @return false if the message has been rejected as the outgoing queue is full, true otherwise
+ */
+bool JsonRpcConnection::SendEncodedMessage(const EncodedJsonRpcMessage::Ptr& message, bool force)
+{
+	if (m_ShuttingDown) {
+		BOOST_THROW_EXCEPTION(std::runtime_error("Cannot send message to already disconnected API client '" + GetIdentity() + "'!"));
+	}
+
+	if (!AdmitMessage(message, force)) {
+		return false;
+	}
+
+	Ptr keepAlive (this);
+
+	boost::asio::post(m_IoStrand, [this, keepAlive, message] { EnqueueMessage(message); });
+
+	return true;
 }
 
 void JsonRpcConnection::SendMessageInternal(const Dictionary::Ptr& message)
@@ -242,10 +367,175 @@ void JsonRpcConnection::SendMessageInternal(const Dictionary::Ptr& message)
 		return;
 	}
 
-	m_OutgoingMessagesQueue.emplace_back(JsonEncode(message));
+	EncodedJsonRpcMessage::Ptr encodedMessage = new EncodedJsonRpcMessage(JsonEncode(message), JsonRpc::GetMessagePriority(message));
+
+	if (AdmitMessage(encodedMessage, false)) {
+		EnqueueMessage(encodedMessage);
+	}
+}
+
+/**
+ * Accounts a message for the outgoing queue unless it exceeds the queue's byte budget.
+ *
+ * High priority messages are always admitted and don't count against the budget. Low priority
+ * messages are admitted as well, EnqueueMessage() drops the oldest of them to keep the budget.
+ * Normal priority messages are rejected if they don't fit into the budget even without the low
+ * priority ones. In that case the endpoint catches up via the replay log, which the rejected
+ * message is written to, while the connection stays open. See ApiListener::CatchUp().
+ *
+ * @param message The message
+ * @param force Whether to admit the message regardless of the budget
+ * @return true if the message has been admitted, false otherwise
+ */
+bool JsonRpcConnection::AdmitMessage(const EncodedJsonRpcMessage::Ptr& message, bool force)
+{
+	size_t size = message->GetJson().GetLength();
+
+	if (message->GetPriority() != JsonRpcPriority::High) {
+		size_t budget = GetOutgoingQueueBudget();
+
+		if (!force && budget && message->GetPriority() == JsonRpcPriority::Normal) {
+			size_t budgeted = m_BudgetedBytes.load();
+			size_t droppable = m_DroppableBytes.load();
+
+			if ((budgeted > droppable ? budgeted - droppable : 0) + size > budget) {
+				l_SpilledMessages.fetch_add(1);
+
+				if (!m_ShuttingDown) {
+					ApiListener::Ptr listener = ApiListener::GetInstance();
+
+					if (m_Endpoint && listener) {
+						if (listener->CatchUp(this)) {
+							Log(LogWarning, "JsonRpcConnection")
+								<< "Outgoing queue for identity '" << m_Identity << "' exceeds its budget of " << budget
+								<< " bytes. The endpoint will catch up via the replay log.";
+						}
+					} else {
+						/* Nothing to catch up from without an endpoint. */
+						Log(LogWarning, "JsonRpcConnection")
+							<< "Outgoing queue for identity '" << m_Identity << "' exceeds its budget of " << budget
+							<< " bytes, disconnecting.";
+
+						Disconnect();
+					}
+				}
+
+				return false;
+			}
+		}
+
+		m_BudgetedBytes.fetch_add(size);
+	}
+
+	m_OutgoingMessages.fetch_add(1);
+	m_OutgoingBytes.fetch_add(size);
+
+	return true;
+}
+
+/**
+ * Appends an admitted message to the outgoing queue and drops the oldest low priority messages
+ * if the queue exceeds its byte budget.
+ *
+ * @param message The message
+ */
+void JsonRpcConnection::EnqueueMessage(const EncodedJsonRpcMessage::Ptr& message)
+{
+	if (m_ShuttingDown) {
+		DequeueMessage(message);
+		return;
+	}
+
+	if (message->GetPriority() == JsonRpcPriority::High) {
+		m_OutgoingHighPriorityMessagesQueue.emplace_back(message);
+	} else {
+		const String& key (message->GetCoalescingKey());
+
+		if (key.IsEmpty()) {
+			m_OutgoingMessagesQueue.emplace_back(message);
+		} else {
+			auto& queued (m_CoalescableMessages[key]);
+
+			/* The new state message supersedes the one still queued for the same object. */
+			if (queued) {
+				m_DroppableBytes.fetch_sub((*queued)->GetJson().GetLength());
+				DequeueMessage(*queued);
+				*queued = nullptr;
+
+				l_CoalescedMessages.fetch_add(1);
+
+				if (m_Endpoint) {
+					m_Endpoint->AddMessageCoalesced();
+				}
+			}
+
+			m_OutgoingMessagesQueue.emplace_back(message);
+			queued = &m_OutgoingMessagesQueue.back();
+		}
+
+		if (message->GetPriority() == JsonRpcPriority::Low) {
+			m_DroppableBytes.fetch_add(message->GetJson().GetLength());
+		}
+	}
+
+	size_t budget = GetOutgoingQueueBudget();
+
+	while (budget && m_BudgetedBytes.load() > budget && m_DroppableBytes.load()
+		&& m_NextDroppableMessage < m_OutgoingMessagesQueue.size()) {
+		auto& queued (m_OutgoingMessagesQueue[m_NextDroppableMessage++]);
+
+		if (queued && queued->GetPriority() == JsonRpcPriority::Low) {
+			m_DroppableBytes.fetch_sub(queued->GetJson().GetLength());
+			m_CoalescableMessages.erase(queued->GetCoalescingKey());
+			DequeueMessage(queued);
+			queued = nullptr;
+
+			l_DroppedMessages.fetch_add(1);
+		}
+	}
+
 	m_OutgoingMessagesQueued.Set();
 }
 
+/**
+ * Removes a message which has been sent or dropped from the outgoing queue's accounting.
+ *
+ * @param message The message
+ */
+void JsonRpcConnection::DequeueMessage(const EncodedJsonRpcMessage::Ptr& message)
+{
+	size_t size = message->GetJson().GetLength();
+
+	if (message->GetPriority() != JsonRpcPriority::High) {
+		m_BudgetedBytes.fetch_sub(size);
+	}
+
+	m_OutgoingMessages.fetch_sub(1);
+	m_OutgoingBytes.fetch_sub(size);
+}
+
+size_t JsonRpcConnection::GetOutgoingQueueMessages() const
+{
+	return m_OutgoingMessages.load();
+}
+
+size_t JsonRpcConnection::GetOutgoingQueueBytes() const
+{
+	return m_OutgoingBytes.load();
+}
+
+/**
+ * Returns whether the outgoing queue has reached its byte budget.
+ *
+ * @return true if no more messages should be sent for now, false otherwise
+ */
+bool JsonRpcConnection::IsOutgoingQueueFull() const
+{
+	size_t budget = GetOutgoingQueueBudget();
+
+	return budget && !m_ShuttingDown && m_BudgetedBytes.load() >= budget;
+}
+
 void JsonRpcConnection::Disconnect()
 {
 	namespace asio = boost::asio;
@@ -293,6 +583,80 @@ void JsonRpcConnection::Disconnect()
 	}
 }
 
+/**
+ * Handles a message encoded by BinaryMessageType::EncodeMessage() like MessageHandler() handles JSON ones.
+ *
+ * @param message The binary message
+ * @param method Receives the message's method
+ */
+void JsonRpcConnection::BinaryMessageHandler(const String& message, String& method)
+{
+	std::shared_lock wgLock(*m_WaitGroup, std::try_to_lock);
+	if (!wgLock) {
+		return;
+	}
+
+	double ts;
+	String originZone;
+	const char *params;
+	auto type (BinaryMessageType::DecodeMessage(message, ts, originZone, params));
+
+	method = type->GetMethod();
+
+	/* ignore old messages */
+	if (ts && !UpdateRemoteLogPosition(ts))
+		return;
+
+	Log(LogNotice, "JsonRpcConnection")
+		<< "Received binary '" << method << "' message from identity '" << m_Identity << "'.";
+
+	ApiFunction::Ptr afunc = ApiFunction::GetByName(method);
+
+	if (afunc) {
+		m_Endpoint->AddMessageReceived(afunc);
+	}
+
+	BinaryMessageReader reader (params, message.CStr() + message.GetLength());
+
+	try {
+		type->Handle(MakeMessageOrigin(originZone), reader);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "JsonRpcConnection")
+			<< "Error while processing message for identity '" << m_Identity << "'\n" << DiagnosticInformation(ex);
+	}
+}
+
+/**
+ * Advances the endpoint's remote log position to a received message's timestamp.
+ *
+ * @param ts The message's timestamp
+ * @return false if the message is older than the position and must be ignored, true otherwise
+ */
+bool JsonRpcConnection::UpdateRemoteLogPosition(double ts)
+{
+	if (ts < m_Endpoint->GetRemoteLogPosition())
+		return false;
+
+	m_Endpoint->SetRemoteLogPosition(ts);
+
+	return true;
+}
+
+MessageOrigin::Ptr JsonRpcConnection::MakeMessageOrigin(const String& originZone)
+{
+	MessageOrigin::Ptr origin = new MessageOrigin();
+	origin->FromClient = this;
+
+	if (m_Endpoint) {
+		if (m_Endpoint->GetZone() != Zone::GetLocalZone())
+			origin->FromZone = m_Endpoint->GetZone();
+		else
+			origin->FromZone = Zone::GetByName(originZone);
+	}
+
+	return origin;
+}
+
 /**
  * Route the provided message to its corresponding handler (if any).
  *
@@ -312,24 +676,12 @@ void JsonRpcConnection::MessageHandler(const Dictionary::Ptr& message)
 	}
 
 	if (m_Endpoint && message->Contains("ts")) {
-		double ts = message->Get("ts");
-
 		/* ignore old messages */
-		if (ts < m_Endpoint->GetRemoteLogPosition())
+		if (!UpdateRemoteLogPosition(message->Get("ts")))
 			return;
-
-		m_Endpoint->SetRemoteLogPosition(ts);
 	}
 
-	MessageOrigin::Ptr origin = new MessageOrigin();
-	origin->FromClient = this;
-
-	if (m_Endpoint) {
-		if (m_Endpoint->GetZone() != Zone::GetLocalZone())
-			origin->FromZone = m_Endpoint->GetZone();
-		else
-			origin->FromZone = Zone::GetByName(message->Get("originZone"));
-	}
+	MessageOrigin::Ptr origin = MakeMessageOrigin(message->Get("originZone"));
 
 	Value vmethod;
 
@@ -448,3 +800,18 @@ double JsonRpcConnection::GetWorkQueueRate()
 {
 	return l_TaskStats.UpdateAndGetValues(Utility::GetTime(), 60) / 60.0;
 }
+
+uint_fast64_t JsonRpcConnection::GetDroppedMessages()
+{
+	return l_DroppedMessages.load();
+}
+
+uint_fast64_t JsonRpcConnection::GetSpilledMessages()
+{
+	return l_SpilledMessages.load();
+}
+
+uint_fast64_t JsonRpcConnection::GetCoalescedMessages()
+{
+	return l_CoalescedMessages.load();
+}
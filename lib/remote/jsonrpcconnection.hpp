@@ -5,13 +5,17 @@
 
 #include "remote/i2-remote.hpp"
 #include "remote/endpoint.hpp"
+#include "remote/jsonrpc.hpp"
 #include "base/atomic.hpp"
 #include "base/io-engine.hpp"
 #include "base/tlsstream.hpp"
 #include "base/wait-group.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/io_context_strand.hpp>
@@ -60,10 +64,18 @@ public:
 
 	void SendMessage(const Dictionary::Ptr& request);
 	void SendRawMessage(const String& request);
+	bool SendEncodedMessage(const EncodedJsonRpcMessage::Ptr& request, bool force = false);
+
+	size_t GetOutgoingQueueMessages() const;
+	size_t GetOutgoingQueueBytes() const;
+	bool IsOutgoingQueueFull() const;
 
 	static Value HeartbeatAPIHandler(const intrusive_ptr<MessageOrigin>& origin, const Dictionary::Ptr& params);
 
 	static double GetWorkQueueRate();
+	static uint_fast64_t GetDroppedMessages();
+	static uint_fast64_t GetSpilledMessages();
+	static uint_fast64_t GetCoalescedMessages();
 
 	static void SendCertificateRequest(const JsonRpcConnection::Ptr& aclient, const intrusive_ptr<MessageOrigin>& origin, const String& path);
 
@@ -76,8 +88,29 @@ private:
 	double m_Timestamp;
 	double m_Seen;
 	boost::asio::io_context::strand m_IoStrand;
-	std::vector<String> m_OutgoingMessagesQueue;
+	std::deque<EncodedJsonRpcMessage::Ptr> m_OutgoingMessagesQueue;
+	std::deque<EncodedJsonRpcMessage::Ptr> m_OutgoingHighPriorityMessagesQueue;
+
+	/* Index into m_OutgoingMessagesQueue of the oldest message not yet checked for dropping, follows its pop_front()s. */
+	size_t m_NextDroppableMessage;
+
+	/* The slots of the queued messages by their coalescing key, see EncodedJsonRpcMessage::GetCoalescingKey().
+	 * A std::deque keeps references to its elements on push_back() and pop_front(), the writer erases
+	 * a slot's key before popping it.
+	 */
+	std::unordered_map<String, EncodedJsonRpcMessage::Ptr*> m_CoalescableMessages;
 	AsioEvent m_OutgoingMessagesQueued;
+
+	/* Queued messages not written yet, including the ones taken by the writer. */
+	Atomic<size_t> m_OutgoingMessages;
+	Atomic<size_t> m_OutgoingBytes;
+
+	/* Bytes which count against the outgoing queue's byte budget, i.e. of all messages not of high priority. */
+	Atomic<size_t> m_BudgetedBytes;
+
+	/* Bytes of low priority messages which haven't been taken by the writer yet and can still be dropped. */
+	Atomic<size_t> m_DroppableBytes;
+
 	AsioEvent m_WriterDone;
 	Atomic<bool> m_ShuttingDown;
 	WaitGroup::Ptr m_WaitGroup;
@@ -94,10 +127,17 @@ private:
 	bool ProcessMessage();
 
 	void MessageHandler(const Dictionary::Ptr& message);
+	void BinaryMessageHandler(const String& message, String& method);
+	bool UpdateRemoteLogPosition(double ts);
+	intrusive_ptr<MessageOrigin> MakeMessageOrigin(const String& originZone);
 
 	void CertificateRequestResponseHandler(const Dictionary::Ptr& message);
 
 	void SendMessageInternal(const Dictionary::Ptr& request);
+
+	bool AdmitMessage(const EncodedJsonRpcMessage::Ptr& message, bool force);
+	void EnqueueMessage(const EncodedJsonRpcMessage::Ptr& message);
+	void DequeueMessage(const EncodedJsonRpcMessage::Ptr& message);
 };
 
 }
@@ -1,6 +1,7 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "remote/objectqueryhandler.hpp"
+#include "base/base64.hpp"
 #include "base/generator.hpp"
 #include "base/json.hpp"
 #include "remote/httputility.hpp"
@@ -9,6 +10,10 @@
 #include "base/dependencygraph.hpp"
 #include "base/configtype.hpp"
 #include <boost/algorithm/string/case_conv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <set>
 #include <unordered_map>
 #include <memory>
@@ -91,6 +96,119 @@ Dictionary::Ptr ObjectQueryHandler::SerializeObjectAttrs(const Object::Ptr& obje
 	return new Dictionary(std::move(resultAttrs));
 }
 
+/**
+ * An object in the order requested by order_by, see ObjectQueryOrder.
+ */
+struct OrderedObject
+{
+	Value Key;
+	String Name;
+	Value Target;
+};
+
+/**
+ * The order requested by order_by and order.
+ *
+ * Objects are ordered by the attribute's value and, if that's the same, by their names.
+ * So the order is total and a cursor can refer to a position in it by the last object's
+ * value and name. Values which aren't numbers, strings or booleans are ordered like null,
+ * null before numbers and booleans and those before strings.
+ */
+struct ObjectQueryOrder
+{
+	int FieldId;
+	bool Descending;
+
+	static Value GetKey(const Value& value)
+	{
+		if (value.IsNumber() || value.IsBoolean() || value.IsString()) {
+			return value;
+		}
+
+		return Empty;
+	}
+
+	static int GetRank(const Value& key)
+	{
+		if (key.IsEmpty()) {
+			return 0;
+		}
+
+		return key.IsString() ? 2 : 1;
+	}
+
+	static int Compare(const Value& lhs, const Value& rhs)
+	{
+		int lrank = GetRank(lhs);
+		int rrank = GetRank(rhs);
+
+		if (lrank != rrank) {
+			return lrank < rrank ? -1 : 1;
+		}
+
+		if (lrank == 1) {
+			double l = lhs;
+			double r = rhs;
+
+			return l < r ? -1 : (r < l ? 1 : 0);
+		}
+
+		if (lrank == 2) {
+			const String& l = lhs.Get<String>();
+			const String& r = rhs.Get<String>();
+
+			return l < r ? -1 : (r < l ? 1 : 0);
+		}
+
+		return 0;
+	}
+
+	bool operator()(const OrderedObject& lhs, const OrderedObject& rhs) const
+	{
+		int cmp = Compare(lhs.Key, rhs.Key);
+
+		if (cmp) {
+			return Descending ? cmp > 0 : cmp < 0;
+		}
+
+		return lhs.Name < rhs.Name;
+	}
+};
+
+/* Larger limits and offsets are treated as this one, no query has that many objects anyway. */
+static const size_t l_MaxCount = std::numeric_limits<std::uint32_t>::max();
+
+/**
+ * Reads a URL parameter which has to be a non-negative integer.
+ *
+ * @return false if the parameter isn't set
+ */
+static bool GetCountParameter(const Dictionary::Ptr& params, const String& name, size_t& count)
+{
+	Value value = HttpUtility::GetLastParameter(params, name);
+
+	if (value.IsEmpty()) {
+		return false;
+	}
+
+	double number = value;
+
+	if (number < 0 || std::floor(number) != number) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid value for '" + name + "' specified. Non-negative integer is required."));
+	}
+
+	count = number < l_MaxCount ? static_cast<size_t>(number) : l_MaxCount;
+	return true;
+}
+
+/**
+ * Adds two counts, without wrapping around.
+ */
+static size_t AddCounts(size_t lhs, size_t rhs)
+{
+	return lhs > std::numeric_limits<size_t>::max() - rhs ? std::numeric_limits<size_t>::max() : lhs + rhs;
+}
+
 bool ObjectQueryHandler::HandleRequest(
 	const WaitGroup::Ptr&,
 	const HttpRequest& request,
@@ -165,6 +283,79 @@ bool ObjectQueryHandler::HandleRequest(
 
 	bool allJoins = HttpUtility::GetLastParameter(params, "all_joins");
 
+	size_t limit = 0, offset = 0;
+	bool hasLimit;
+
+	try {
+		hasLimit = GetCountParameter(params, "limit", limit);
+		GetCountParameter(params, "offset", offset);
+	} catch (const std::exception& ex) {
+		HttpUtility::SendJsonError(response, params, 400, ex.what());
+		return true;
+	}
+
+	String orderBy = HttpUtility::GetLastParameter(params, "order_by");
+	String order = HttpUtility::GetLastParameter(params, "order");
+	String cursorParam = HttpUtility::GetLastParameter(params, "cursor");
+	Dictionary::Ptr cursor;
+
+	if (!order.IsEmpty() && order != "asc" && order != "desc") {
+		HttpUtility::SendJsonError(response, params, 400, "Invalid value for 'order' specified. Must be 'asc' or 'desc'.");
+		return true;
+	}
+
+	if (!cursorParam.IsEmpty()) {
+		String cursorOrderBy, cursorOrder;
+		size_t cursorOffset = 0;
+
+		try {
+			cursor = JsonDecode(Base64::Decode(cursorParam));
+
+			if (cursor) {
+				cursorOrderBy = cursor->Get("order_by");
+				cursorOrder = cursor->Get("order");
+				GetCountParameter(cursor, "offset", cursorOffset);
+			}
+		} catch (const std::exception&) {
+			cursor = nullptr;
+		}
+
+		if (!cursor || cursor->Contains("order_by") == cursor->Contains("offset")) {
+			HttpUtility::SendJsonError(response, params, 400, "Invalid cursor specified.");
+			return true;
+		}
+
+		/* The cursor continues the query it has been returned for, in the same order. */
+		if ((!orderBy.IsEmpty() && orderBy != cursorOrderBy) || (!order.IsEmpty() && order != cursorOrder)) {
+			HttpUtility::SendJsonError(response, params, 400, "The cursor doesn't match the specified order.");
+			return true;
+		}
+
+		orderBy = cursorOrderBy;
+		order = cursorOrder;
+		offset = AddCounts(offset, cursorOffset);
+	}
+
+	std::unique_ptr<ObjectQueryOrder> ordering;
+
+	if (!orderBy.IsEmpty()) {
+		int fid = type->GetFieldId(orderBy);
+
+		if (fid < 0 || (type->GetFieldInfo(fid).Attributes & FANoUserView)) {
+			HttpUtility::SendJsonError(response, params, 400, "Invalid field specified for order_by: " + orderBy);
+			return true;
+		}
+
+		ordering.reset(new ObjectQueryOrder{fid, order == "desc"});
+	}
+
+	/* Without ordering, the objects are returned in the order they're found in,
+	 * so there's no need to look for more than the requested ones and the next one.
+	 */
+	if (!ordering && hasLimit) {
+		qd.Limit = AddCounts(AddCounts(offset, limit), 1);
+	}
+
 	params->Set("type", type->GetName());
 
 	if (url->GetPath().size() >= 4) {
@@ -184,6 +375,76 @@ bool ObjectQueryHandler::HandleRequest(
 		return true;
 	}
 
+	Dictionary::Ptr nextCursor;
+
+	if (ordering) {
+		OrderedObject position;
+		bool hasPosition = cursor != nullptr;
+
+		if (hasPosition) {
+			position.Key = ObjectQueryOrder::GetKey(cursor->Get("key"));
+			position.Name = cursor->Get("name");
+		}
+
+		/* Keep only the first objects in a heap, the last of them on top. */
+		size_t keep = hasLimit ? AddCounts(AddCounts(offset, limit), 1) : objs.size();
+		std::vector<OrderedObject> heap;
+
+		heap.reserve(std::min(keep, objs.size()));
+
+		for (auto& object : objs) {
+			ConfigObject::Ptr obj = object;
+			OrderedObject entry {ObjectQueryOrder::GetKey(obj->GetField(ordering->FieldId)), obj->GetName(), obj};
+
+			if (hasPosition && !(*ordering)(position, entry)) {
+				continue;
+			}
+
+			if (heap.size() < keep) {
+				heap.emplace_back(std::move(entry));
+				std::push_heap(heap.begin(), heap.end(), *ordering);
+			} else if (keep && (*ordering)(entry, heap.front())) {
+				std::pop_heap(heap.begin(), heap.end(), *ordering);
+				heap.back() = std::move(entry);
+				std::push_heap(heap.begin(), heap.end(), *ordering);
+			}
+		}
+
+		std::sort_heap(heap.begin(), heap.end(), *ordering);
+
+		objs.clear();
+
+		if (heap.size() > offset) {
+			bool more = hasLimit && heap.size() > AddCounts(offset, limit);
+			auto end (more ? heap.begin() + offset + limit : heap.end());
+
+			for (auto current (heap.begin() + offset); current != end; ++current) {
+				objs.emplace_back(std::move(current->Target));
+			}
+
+			if (more && limit) {
+				auto& last (*(end - 1));
+
+				nextCursor = new Dictionary({
+					{ "order_by", orderBy },
+					{ "order", ordering->Descending ? "desc" : "asc" },
+					{ "key", last.Key },
+					{ "name", last.Name }
+				});
+			}
+		}
+	} else if (offset || hasLimit) {
+		objs.erase(objs.begin(), objs.begin() + std::min(offset, objs.size()));
+
+		if (hasLimit && objs.size() > limit) {
+			objs.resize(limit);
+
+			if (limit) {
+				nextCursor = new Dictionary({ { "offset", offset + limit } });
+			}
+		}
+	}
+
 	std::set<int> joinAttrs;
 	std::set<String> userJoinAttrs;
 
@@ -331,6 +592,11 @@ bool ObjectQueryHandler::HandleRequest(
 	response.StartStreaming();
 
 	Dictionary::Ptr results = new Dictionary{{"results", new ValueGenerator{generatorFunc}}};
+
+	if (nextCursor) {
+		results->Set("next_cursor", Base64::Encode(JsonEncode(nextCursor)));
+	}
+
 	results->Freeze();
 
 	bool pretty = HttpUtility::GetLastParameter(params, "pretty");
@@ -0,0 +1,104 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "remote/relaysequencer.hpp"
+#include "base/debug.hpp"
+#include "base/exception.hpp"
+#include "base/logger.hpp"
+#include "base/utility.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace icinga;
+
+/**
+ * Reserves the next place in the send order of each endpoint the message may be sent to.
+ * Must be called once per message, in the order the messages are relayed in, and followed
+ * by exactly one Deliver() per endpoint.
+ *
+ * @param endpoints The endpoints the message may be sent to, each of them once
+ * @return The message's (strictly increasing) timestamp and its sequence number per endpoint
+ */
+RelayTicket RelaySequencer::Stamp(const std::vector<Endpoint::Ptr>& endpoints)
+{
+	RelayTicket ticket;
+	ticket.Sequences.reserve(endpoints.size());
+
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	m_LastTimestamp = std::max(Utility::GetTime(), std::nextafter(m_LastTimestamp, std::numeric_limits<double>::infinity()));
+	ticket.Timestamp = m_LastTimestamp;
+
+	for (auto& endpoint : endpoints) {
+		ticket.Sequences.emplace_back(endpoint, m_Endpoints[endpoint].NextSequence++);
+	}
+
+	return ticket;
+}
+
+/**
+ * Sends a message to an endpoint once all messages stamped before it for that endpoint have been sent.
+ *
+ * If earlier messages for the endpoint are still being routed, the message is left to the thread
+ * delivering those and this returns immediately.
+ *
+ * @param ticket The message's ticket from Stamp()
+ * @param endpoint One of the endpoints passed to Stamp()
+ * @param send Sends the message to the endpoint, may be empty if there's nothing to send
+ */
+void RelaySequencer::Deliver(const RelayTicket& ticket, const Endpoint::Ptr& endpoint, std::function<void()> send)
+{
+	auto sequence (std::find_if(ticket.Sequences.begin(), ticket.Sequences.end(),
+		[&endpoint](const std::pair<Endpoint::Ptr, std::uint_fast64_t>& kv) { return kv.first == endpoint; }));
+
+	ASSERT(sequence != ticket.Sequences.end());
+
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	auto order (m_Endpoints.find(endpoint));
+
+	ASSERT(order != m_Endpoints.end());
+
+	auto& pending (order->second.Pending);
+
+	pending.emplace(sequence->second, std::move(send));
+
+	if (order->second.Delivering) {
+		return;
+	}
+
+	order->second.Delivering = true;
+
+	for (;;) {
+		auto next (pending.begin());
+
+		if (next == pending.end() || next->first != order->second.NextDelivery) {
+			break;
+		}
+
+		auto func (std::move(next->second));
+
+		pending.erase(next);
+		order->second.NextDelivery++;
+
+		if (func) {
+			lock.unlock();
+
+			try {
+				func();
+			} catch (const std::exception& ex) {
+				Log(LogCritical, "ApiListener")
+					<< "Error while relaying message: " << DiagnosticInformation(ex, false);
+			}
+
+			lock.lock();
+		}
+	}
+
+	order->second.Delivering = false;
+
+	/* Nothing is in flight for the endpoint, so it can start from scratch next time. */
+	if (pending.empty() && order->second.NextDelivery == order->second.NextSequence) {
+		m_Endpoints.erase(order);
+	}
+}
@@ -0,0 +1,63 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#ifndef RELAYSEQUENCER_H
+#define RELAYSEQUENCER_H
+
+#include "remote/i2-remote.hpp"
+#include "remote/endpoint.hpp"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A relayed message's place in the order messages are sent to each endpoint in.
+ *
+ * @ingroup remote
+ */
+struct RelayTicket
+{
+	double Timestamp;
+	std::vector<std::pair<Endpoint::Ptr, std::uint_fast64_t>> Sequences;
+};
+
+/**
+ * Keeps messages relayed by several queues in the order they were relayed in, per endpoint.
+ *
+ * An endpoint drops every message with an older "ts" than the last one it got (see
+ * JsonRpcConnection::UpdateRemoteLogPosition()). As one endpoint may get messages
+ * from several relay queues, Stamp() hands out increasing timestamps when a message is
+ * queued and Deliver() sends the messages to each endpoint in that order, no matter which
+ * queue finishes first. A message only waits for earlier ones to the same endpoint,
+ * so a backlog of messages for one zone doesn't hold up the endpoints of other zones.
+ *
+ * @ingroup remote
+ */
+class RelaySequencer
+{
+public:
+	RelayTicket Stamp(const std::vector<Endpoint::Ptr>& endpoints);
+	void Deliver(const RelayTicket& ticket, const Endpoint::Ptr& endpoint, std::function<void()> send);
+
+private:
+	struct EndpointOrder
+	{
+		std::uint_fast64_t NextSequence = 0;
+		std::uint_fast64_t NextDelivery = 0;
+		bool Delivering = false;
+		std::map<std::uint_fast64_t, std::function<void()>> Pending;
+	};
+
+	std::mutex m_Mutex;
+	double m_LastTimestamp = 0;
+	std::map<Endpoint::Ptr, EndpointOrder> m_Endpoints;
+};
+
+}
+
+#endif /* RELAYSEQUENCER_H */
@@ -0,0 +1,661 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "remote/replaylog.hpp"
+#include "base/compression.hpp"
+#include "base/dictionary.hpp"
+#include "base/exception.hpp"
+#include "base/json.hpp"
+#include "base/logger.hpp"
+#include "base/netstring.hpp"
+#include "base/stdiostream.hpp"
+#include "base/utility.hpp"
+#include <algorithm>
+#include <boost/filesystem/operations.hpp>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+using namespace icinga;
+
+/* "I2RL" */
+static constexpr std::uint32_t l_ReplayLogMagic = 0x4c523249;
+
+/* "I2RX" */
+static constexpr std::uint32_t l_ReplayLogIndexMagic = 0x58523249;
+
+/* An index entry is added every that many messages. */
+static constexpr size_t l_ReplayLogIndexInterval = 256;
+
+enum ReplayLogRecordType : std::uint16_t
+{
+	ReplayLogMessageRecord = 0,
+	ReplayLogIndexRecord = 1,
+
+	/* Compressed message records. The header's Timestamp is the highest one of them, Reserved their number. */
+	ReplayLogBlockRecord = 2
+};
+
+struct ReplayLogRecordHeader
+{
+	std::uint32_t Magic;
+	std::uint16_t Type;
+	std::uint16_t Flags;
+	double Timestamp;
+	std::uint32_t SecobjTypeLength;
+	std::uint32_t SecobjNameLength;
+	std::uint32_t ZoneLength;
+	std::uint32_t MethodLength;
+	std::uint32_t PayloadLength;
+	std::uint32_t Reserved;
+};
+
+/* Terminates the payload of an index record, so that it can be found from the end of the file. */
+struct ReplayLogIndexTrailer
+{
+	std::uint64_t Offset;
+	std::uint32_t Magic;
+	std::uint32_t Reserved;
+};
+
+static_assert(sizeof(ReplayLogRecordHeader) == 40, "Unexpected padding in ReplayLogRecordHeader");
+static_assert(sizeof(ReplayLogIndexEntry) == 16, "Unexpected padding in ReplayLogIndexEntry");
+static_assert(sizeof(ReplayLogIndexTrailer) == 16, "Unexpected padding in ReplayLogIndexTrailer");
+
+static std::uint64_t GetRecordLength(const ReplayLogRecordHeader& header)
+{
+	return sizeof(header) + std::uint64_t(header.SecobjTypeLength) + header.SecobjNameLength
+		+ header.ZoneLength + header.MethodLength + header.PayloadLength;
+}
+
+ReplayLogWriter::ReplayLogWriter(const String& path, bool compress)
+	: m_Path(path), m_Compress(compress)
+{
+	/* Don't append to files written by older versions. */
+	try {
+		ConvertLegacyFile(path);
+	} catch (const std::exception& ex) {
+		Log(LogCritical, "ReplayLogWriter")
+			<< "Cannot convert replay log file '" << path << "': " << DiagnosticInformation(ex, false);
+	}
+
+	m_File.open(path.CStr(), std::ios::in | std::ios::out | std::ios::binary);
+
+	if (!m_File.is_open()) {
+		m_File.clear();
+		m_File.open(path.CStr(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+	}
+
+	if (m_File.is_open()) {
+		Recover();
+	}
+}
+
+ReplayLogWriter::~ReplayLogWriter()
+{
+	try {
+		Close();
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ReplayLogWriter")
+			<< "Cannot close replay log file '" << m_Path << "': " << DiagnosticInformation(ex, false);
+	}
+}
+
+bool ReplayLogWriter::IsOpen() const
+{
+	return m_File.is_open();
+}
+
+size_t ReplayLogWriter::GetRecordCount() const
+{
+	return m_RecordCount;
+}
+
+/**
+ * Restores the state of an existing file and cuts off an incomplete record at its end, e.g. after a crash.
+ * An index written by Close() is dropped as well, it's written again with the new records.
+ */
+void ReplayLogWriter::Recover()
+{
+	m_File.seekg(0, std::ios::end);
+	std::uint64_t size = m_File.tellg();
+	std::uint64_t end = 0;
+	m_File.seekg(0);
+
+	ReplayLogRecordHeader header;
+
+	while (m_Offset + sizeof(header) <= size) {
+		if (!m_File.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.Magic != l_ReplayLogMagic
+			|| m_Offset + GetRecordLength(header) > size) {
+			break;
+		}
+
+		if (header.Type == ReplayLogMessageRecord) {
+			if (m_RecordCount % l_ReplayLogIndexInterval == 0) {
+				m_Index.push_back({ m_MaxTimestamp, m_Offset });
+			}
+
+			m_RecordCount++;
+			m_MaxTimestamp = std::max(m_MaxTimestamp, header.Timestamp);
+		} else if (header.Type == ReplayLogBlockRecord) {
+			m_Index.push_back({ m_MaxTimestamp, m_Offset });
+			m_RecordCount += header.Reserved;
+			m_MaxTimestamp = std::max(m_MaxTimestamp, header.Timestamp);
+		}
+
+		m_Offset += GetRecordLength(header);
+
+		if (header.Type != ReplayLogIndexRecord) {
+			end = m_Offset;
+		}
+
+		m_File.seekg(m_Offset);
+	}
+
+	m_File.clear();
+
+	if (m_Offset < size) {
+		Log(LogWarning, "ReplayLogWriter")
+			<< "Discarding incomplete record at the end of replay log file '" << m_Path << "'.";
+	}
+
+	m_Offset = end;
+
+	if (m_Offset < size) {
+		m_File.close();
+		boost::filesystem::resize_file(m_Path.GetData(), m_Offset);
+		m_File.open(m_Path.CStr(), std::ios::in | std::ios::out | std::ios::binary);
+	}
+
+	m_File.seekp(m_Offset);
+}
+
+/**
+ * Appends a message.
+ *
+ * @param timestamp The message's timestamp
+ * @param secobjType The type of the object the message belongs to, if any
+ * @param secobjName The name of the object the message belongs to, if any
+ * @param zone The zone of the object the message belongs to, if any
+ * @param method The message's method
+ * @param message The JSON-encoded message
+ */
+void ReplayLogWriter::Write(double timestamp, const String& secobjType, const String& secobjName,
+	const String& zone, const String& method, const String& message)
+{
+	if (m_RecordCount % l_ReplayLogIndexInterval == 0) {
+		m_Index.push_back({ m_MaxTimestamp, m_Offset });
+	}
+
+	ReplayLogRecordHeader header {};
+	header.Magic = l_ReplayLogMagic;
+	header.Type = ReplayLogMessageRecord;
+	header.Timestamp = timestamp;
+	header.SecobjTypeLength = secobjType.GetLength();
+	header.SecobjNameLength = secobjName.GetLength();
+	header.ZoneLength = zone.GetLength();
+	header.MethodLength = method.GetLength();
+	header.PayloadLength = message.GetLength();
+
+	if (m_Compress) {
+		m_Block.append(reinterpret_cast<const char*>(&header), sizeof(header));
+		m_Block.append(secobjType.CStr(), secobjType.GetLength());
+		m_Block.append(secobjName.CStr(), secobjName.GetLength());
+		m_Block.append(zone.CStr(), zone.GetLength());
+		m_Block.append(method.CStr(), method.GetLength());
+		m_Block.append(message.CStr(), message.GetLength());
+
+		m_BlockRecords++;
+		m_BlockMaxTimestamp = std::max(m_BlockMaxTimestamp, timestamp);
+	} else {
+		m_File.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		m_File.write(secobjType.CStr(), secobjType.GetLength());
+		m_File.write(secobjName.CStr(), secobjName.GetLength());
+		m_File.write(zone.CStr(), zone.GetLength());
+		m_File.write(method.CStr(), method.GetLength());
+		m_File.write(message.CStr(), message.GetLength());
+
+		if (!m_File) {
+			BOOST_THROW_EXCEPTION(std::runtime_error("Cannot write to replay log file '" + m_Path + "'."));
+		}
+
+		m_Offset += GetRecordLength(header);
+	}
+
+	m_RecordCount++;
+	m_MaxTimestamp = std::max(m_MaxTimestamp, timestamp);
+
+	/* Blocks match the index entries, so that Seek() can skip whole blocks. */
+	if (m_Compress && m_RecordCount % l_ReplayLogIndexInterval == 0) {
+		WriteBlock();
+	}
+}
+
+/**
+ * Compresses and writes the records collected for the current block.
+ */
+void ReplayLogWriter::WriteBlock()
+{
+	if (!m_BlockRecords) {
+		return;
+	}
+
+	String compressed = Compression::Compress(m_Block);
+
+	ReplayLogRecordHeader header {};
+	header.Magic = l_ReplayLogMagic;
+	header.Type = ReplayLogBlockRecord;
+	header.Timestamp = m_BlockMaxTimestamp;
+	header.PayloadLength = compressed.GetLength();
+	header.Reserved = m_BlockRecords;
+
+	m_File.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	m_File.write(compressed.CStr(), compressed.GetLength());
+
+	if (!m_File) {
+		BOOST_THROW_EXCEPTION(std::runtime_error("Cannot write to replay log file '" + m_Path + "'."));
+	}
+
+	m_Offset += GetRecordLength(header);
+
+	m_Block.clear();
+	m_BlockRecords = 0;
+	m_BlockMaxTimestamp = 0;
+}
+
+/**
+ * Makes all written messages visible to readers of the file.
+ */
+void ReplayLogWriter::Flush()
+{
+	m_File.flush();
+}
+
+/**
+ * Appends the index and closes the file.
+ */
+void ReplayLogWriter::Close()
+{
+	if (!m_File.is_open()) {
+		return;
+	}
+
+	WriteBlock();
+
+	if (m_RecordCount) {
+		ReplayLogIndexTrailer trailer {};
+		trailer.Offset = m_Offset;
+		trailer.Magic = l_ReplayLogIndexMagic;
+
+		ReplayLogRecordHeader header {};
+		header.Magic = l_ReplayLogMagic;
+		header.Type = ReplayLogIndexRecord;
+		header.Timestamp = m_MaxTimestamp;
+		header.PayloadLength = m_Index.size() * sizeof(ReplayLogIndexEntry) + sizeof(trailer);
+
+		m_File.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		m_File.write(reinterpret_cast<const char*>(m_Index.data()), m_Index.size() * sizeof(ReplayLogIndexEntry));
+		m_File.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+
+		m_Offset += GetRecordLength(header);
+	}
+
+	m_File.close();
+}
+
+/**
+ * Converts a replay log file written by older versions (JSON objects in netstrings) to the current format.
+ *
+ * @param path The file
+ * @return true if the file has been converted, false if there was nothing to convert
+ */
+bool ReplayLogWriter::ConvertLegacyFile(const String& path)
+{
+	{
+		std::ifstream fp (path.CStr(), std::ios::in | std::ios::binary);
+		std::uint32_t magic = 0;
+
+		if (!fp.read(reinterpret_cast<char*>(&magic), sizeof(magic)) || magic == l_ReplayLogMagic) {
+			return false;
+		}
+	}
+
+	Log(LogInformation, "ReplayLogWriter")
+		<< "Converting replay log file '" << path << "' to the current format.";
+
+	String tempPath = path + ".tmp";
+	size_t count = 0;
+
+	boost::filesystem::remove(tempPath.GetData());
+
+	{
+		ReplayLogWriter writer (tempPath);
+
+		if (!writer.IsOpen()) {
+			BOOST_THROW_EXCEPTION(std::runtime_error("Cannot open replay log file '" + tempPath + "'."));
+		}
+
+		auto *fp = new std::fstream(path.CStr(), std::fstream::in | std::fstream::binary);
+		StdioStream::Ptr logStream = new StdioStream(fp, true);
+
+		String message;
+		StreamReadContext src;
+
+		for (;;) {
+			Dictionary::Ptr pmessage;
+
+			try {
+				StreamReadStatus srs = NetString::ReadStringFromStream(logStream, &message, src);
+
+				if (srs == StatusEof)
+					break;
+
+				if (srs != StatusNewItem)
+					continue;
+
+				pmessage = JsonDecode(message);
+			} catch (const std::exception&) {
+				/* Log files may be incomplete or corrupted. This is perfectly OK. */
+				break;
+			}
+
+			String secobjType, secobjName;
+			Dictionary::Ptr secname = pmessage->Get("secobj");
+
+			if (secname) {
+				secobjType = secname->Get("type");
+				secobjName = secname->Get("name");
+			}
+
+			/* The zone and method are unknown here, readers have to look at the secobj. */
+			writer.Write(pmessage->Get("timestamp"), secobjType, secobjName, "", "", pmessage->Get("message"));
+			count++;
+		}
+
+		logStream->Close();
+		writer.Close();
+	}
+
+	Utility::RenameFile(tempPath, path);
+
+	Log(LogInformation, "ReplayLogWriter")
+		<< "Converted " << count << " messages in replay log file '" << path << "'.";
+
+	return true;
+}
+
+/**
+ * Writes a copy of a replay log file with its records compressed. Meant for files which have been rotated.
+ * Replacing the file with the copy is up to the caller, as the file may be removed meanwhile.
+ *
+ * @param path The file
+ * @param compressedPath The copy, overwritten if it exists
+ * @param inputBytes Receives the size of the file
+ * @param outputBytes Receives the size of the copy
+ */
+void ReplayLogWriter::CompressFile(const String& path, const String& compressedPath, std::uint64_t& inputBytes, std::uint64_t& outputBytes)
+{
+	boost::filesystem::remove(compressedPath.GetData());
+
+	{
+		ReplayLogReader reader (path);
+
+		if (!reader.IsOpen()) {
+			BOOST_THROW_EXCEPTION(std::runtime_error("Cannot open replay log file '" + path + "'."));
+		}
+
+		ReplayLogWriter writer (compressedPath, true);
+
+		if (!writer.IsOpen()) {
+			BOOST_THROW_EXCEPTION(std::runtime_error("Cannot open replay log file '" + compressedPath + "'."));
+		}
+
+		ReplayLogRecord record;
+
+		try {
+			while (reader.Read(record)) {
+				writer.Write(record.Timestamp, record.SecobjType, record.SecobjName, record.Zone, record.Method, record.Message);
+			}
+		} catch (const std::runtime_error&) {
+			/* Keep what's readable, just like replaying the file would. */
+		}
+
+		writer.Close();
+	}
+
+	inputBytes = boost::filesystem::file_size(path.GetData());
+	outputBytes = boost::filesystem::file_size(compressedPath.GetData());
+}
+
+ReplayLogReader::ReplayLogReader(const String& path)
+	: m_File(path.CStr(), std::ios::in | std::ios::binary)
+{
+	if (m_File.is_open()) {
+		m_File.seekg(0, std::ios::end);
+		m_Size = m_File.tellg();
+		m_File.seekg(0);
+	}
+}
+
+bool ReplayLogReader::IsOpen() const
+{
+	return m_File.is_open();
+}
+
+/**
+ * Skips the messages which are known not to be newer than the given timestamp.
+ * Must be called before Read(). Read() may still return some older messages.
+ *
+ * @param timestamp The timestamp
+ */
+void ReplayLogReader::Seek(double timestamp)
+{
+	std::vector<ReplayLogIndexEntry> index;
+
+	if (ReadIndex(index)) {
+		/* MaxTimestamp never decreases, so everything before the last entry not exceeding timestamp can be skipped. */
+		auto pos (std::upper_bound(index.begin(), index.end(), timestamp, [](double ts, const ReplayLogIndexEntry& entry) {
+			return ts < entry.MaxTimestamp;
+		}));
+
+		if (pos != index.begin()) {
+			m_Offset = std::max(m_Offset, std::prev(pos)->Offset);
+		}
+	} else {
+		/* Not closed yet, look at the record headers only. */
+		ReplayLogRecordHeader header;
+
+		m_File.clear();
+		m_File.seekg(m_Offset);
+
+		while (m_Offset + sizeof(header) <= m_Size) {
+			if (!m_File.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.Magic != l_ReplayLogMagic
+				|| m_Offset + GetRecordLength(header) > m_Size
+				|| (header.Type != ReplayLogIndexRecord && header.Timestamp > timestamp)) {
+				break;
+			}
+
+			m_Offset += GetRecordLength(header);
+			m_File.seekg(m_Offset);
+		}
+	}
+
+	m_File.clear();
+	m_File.seekg(m_Offset);
+}
+
+/**
+ * Reads the index from the end of the file, if the file has been closed properly.
+ *
+ * @param index Receives the index entries
+ * @return whether there is a valid index
+ */
+bool ReplayLogReader::ReadIndex(std::vector<ReplayLogIndexEntry>& index)
+{
+	ReplayLogIndexTrailer trailer;
+	ReplayLogRecordHeader header;
+
+	if (m_Size < sizeof(header) + sizeof(trailer)) {
+		return false;
+	}
+
+	m_File.clear();
+	m_File.seekg(m_Size - sizeof(trailer));
+
+	if (!m_File.read(reinterpret_cast<char*>(&trailer), sizeof(trailer)) || trailer.Magic != l_ReplayLogIndexMagic
+		|| trailer.Offset > m_Size - sizeof(header) - sizeof(trailer)) {
+		return false;
+	}
+
+	m_File.seekg(trailer.Offset);
+
+	if (!m_File.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.Magic != l_ReplayLogMagic
+		|| header.Type != ReplayLogIndexRecord || trailer.Offset + GetRecordLength(header) != m_Size
+		|| header.SecobjTypeLength || header.SecobjNameLength || header.ZoneLength || header.MethodLength
+		|| header.PayloadLength < sizeof(trailer)
+		|| (header.PayloadLength - sizeof(trailer)) % sizeof(ReplayLogIndexEntry)) {
+		return false;
+	}
+
+	index.resize((header.PayloadLength - sizeof(trailer)) / sizeof(ReplayLogIndexEntry));
+
+	if (!m_File.read(reinterpret_cast<char*>(index.data()), index.size() * sizeof(ReplayLogIndexEntry))) {
+		return false;
+	}
+
+	/* The index record itself carries the highest timestamp of all messages. */
+	index.push_back({ header.Timestamp, trailer.Offset });
+
+	return true;
+}
+
+static void ReadRecordString(std::ifstream& fp, String& str, std::uint32_t length)
+{
+	auto& data (str.GetData());
+
+	data.resize(length);
+
+	if (length) {
+		fp.read(&data[0], length);
+	}
+}
+
+/**
+ * Reads the next message.
+ *
+ * @param record Receives the message
+ * @param filter If given, skips the messages it returns false for. It only sees the metadata, not the message.
+ * @return false at the end of the file
+ * @throws std::runtime_error if the file is incomplete or corrupted
+ */
+bool ReplayLogReader::Read(ReplayLogRecord& record, const std::function<bool (const ReplayLogRecord&)>& filter)
+{
+	ReplayLogRecordHeader header;
+
+	for (;;) {
+		if (m_BlockOffset < m_Block.size()) {
+			size_t offset = m_BlockOffset;
+
+			if (m_Block.size() - offset < sizeof(header)) {
+				BOOST_THROW_EXCEPTION(std::runtime_error("Corrupted compressed replay log block before offset "
+					+ std::to_string(m_Offset) + "."));
+			}
+
+			memcpy(&header, m_Block.data() + offset, sizeof(header));
+
+			if (header.Magic != l_ReplayLogMagic || header.Type != ReplayLogMessageRecord
+				|| GetRecordLength(header) > m_Block.size() - offset) {
+				BOOST_THROW_EXCEPTION(std::runtime_error("Corrupted compressed replay log block before offset "
+					+ std::to_string(m_Offset) + "."));
+			}
+
+			m_BlockOffset += GetRecordLength(header);
+			offset += sizeof(header);
+
+			auto next ([this, &offset](String& str, std::uint32_t length) {
+				str.GetData().assign(m_Block, offset, length);
+				offset += length;
+			});
+
+			record.Timestamp = header.Timestamp;
+
+			next(record.SecobjType, header.SecobjTypeLength);
+			next(record.SecobjName, header.SecobjNameLength);
+			next(record.Zone, header.ZoneLength);
+			next(record.Method, header.MethodLength);
+
+			if (filter && !filter(record)) {
+				continue;
+			}
+
+			next(record.Message, header.PayloadLength);
+
+			return true;
+		}
+
+		m_Block.clear();
+		m_BlockOffset = 0;
+
+		if (m_Offset >= m_Size) {
+			return false;
+		}
+
+		std::uint64_t offset = m_Offset;
+
+		if (m_Offset + sizeof(header) > m_Size || !m_File.read(reinterpret_cast<char*>(&header), sizeof(header))
+			|| header.Magic != l_ReplayLogMagic || m_Offset + GetRecordLength(header) > m_Size) {
+			BOOST_THROW_EXCEPTION(std::runtime_error("Incomplete or corrupted replay log record at offset "
+				+ std::to_string(offset) + "."));
+		}
+
+		m_Offset += GetRecordLength(header);
+
+		if (header.Type == ReplayLogBlockRecord) {
+			String compressed;
+
+			m_File.seekg(offset + sizeof(header) + header.SecobjTypeLength + header.SecobjNameLength
+				+ header.ZoneLength + header.MethodLength);
+
+			ReadRecordString(m_File, compressed, header.PayloadLength);
+
+			if (!m_File) {
+				BOOST_THROW_EXCEPTION(std::runtime_error("Cannot read replay log record at offset "
+					+ std::to_string(offset) + "."));
+			}
+
+			try {
+				m_Block = std::move(Compression::Decompress(compressed).GetData());
+			} catch (const std::exception&) {
+				BOOST_THROW_EXCEPTION(std::runtime_error("Corrupted compressed replay log block at offset "
+					+ std::to_string(offset) + "."));
+			}
+
+			continue;
+		}
+
+		if (header.Type != ReplayLogMessageRecord) {
+			m_File.seekg(m_Offset);
+			continue;
+		}
+
+		record.Timestamp = header.Timestamp;
+
+		ReadRecordString(m_File, record.SecobjType, header.SecobjTypeLength);
+		ReadRecordString(m_File, record.SecobjName, header.SecobjNameLength);
+		ReadRecordString(m_File, record.Zone, header.ZoneLength);
+		ReadRecordString(m_File, record.Method, header.MethodLength);
+
+		if (m_File && filter && !filter(record)) {
+			m_File.ignore(header.PayloadLength);
+			continue;
+		}
+
+		ReadRecordString(m_File, record.Message, header.PayloadLength);
+
+		if (!m_File) {
+			BOOST_THROW_EXCEPTION(std::runtime_error("Cannot read replay log record at offset "
+				+ std::to_string(offset) + "."));
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,125 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#ifndef REPLAYLOG_H
+#define REPLAYLOG_H
+
+#include "remote/i2-remote.hpp"
+#include "base/string.hpp"
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A message stored in the replay log.
+ *
+ * @ingroup remote
+ */
+struct ReplayLogRecord
+{
+	double Timestamp = 0;
+	String SecobjType;
+	String SecobjName;
+	/* The zone of the secobj as of writing the record, see Zone::GetObjectZone(). */
+	String Zone;
+	String Method;
+	String Message;
+};
+
+/**
+ * An entry of the sparse index of a replay log file.
+ *
+ * @ingroup remote
+ */
+struct ReplayLogIndexEntry
+{
+	/* The highest timestamp of all records before Offset. */
+	double MaxTimestamp;
+	std::uint64_t Offset;
+};
+
+/**
+ * Appends messages to a replay log file.
+ *
+ * Each record consists of a fixed size binary header (timestamp, length of the secobj
+ * type and name, its zone, the message's method and the message) followed by these
+ * strings. Close() appends a sparse index of the records which lets ReplayLogReader::Seek()
+ * skip the records a peer already got without reading them.
+ *
+ * If compression is enabled, the records are compressed in blocks, one per index entry.
+ *
+ * The files are written in the machine's byte order, they're not meant to be copied elsewhere.
+ *
+ * @ingroup remote
+ */
+class ReplayLogWriter
+{
+public:
+	explicit ReplayLogWriter(const String& path, bool compress = false);
+	~ReplayLogWriter();
+
+	ReplayLogWriter(const ReplayLogWriter&) = delete;
+	ReplayLogWriter& operator=(const ReplayLogWriter&) = delete;
+
+	bool IsOpen() const;
+	size_t GetRecordCount() const;
+
+	void Write(double timestamp, const String& secobjType, const String& secobjName,
+		const String& zone, const String& method, const String& message);
+	void Flush();
+	void Close();
+
+	static bool ConvertLegacyFile(const String& path);
+	static void CompressFile(const String& path, const String& compressedPath, std::uint64_t& inputBytes, std::uint64_t& outputBytes);
+
+private:
+	String m_Path;
+	std::fstream m_File;
+	std::uint64_t m_Offset{0};
+	size_t m_RecordCount{0};
+	double m_MaxTimestamp{0};
+	std::vector<ReplayLogIndexEntry> m_Index;
+
+	bool m_Compress;
+	std::string m_Block;
+	size_t m_BlockRecords{0};
+	double m_BlockMaxTimestamp{0};
+
+	void Recover();
+	void WriteBlock();
+};
+
+/**
+ * Reads messages from a replay log file written by ReplayLogWriter.
+ *
+ * @ingroup remote
+ */
+class ReplayLogReader
+{
+public:
+	explicit ReplayLogReader(const String& path);
+
+	bool IsOpen() const;
+
+	void Seek(double timestamp);
+	bool Read(ReplayLogRecord& record, const std::function<bool (const ReplayLogRecord&)>& filter = nullptr);
+
+private:
+	std::ifstream m_File;
+	std::uint64_t m_Size{0};
+	std::uint64_t m_Offset{0};
+
+	/* The decompressed records of the current block and the position of the next one in there. */
+	std::string m_Block;
+	size_t m_BlockOffset{0};
+
+	bool ReadIndex(std::vector<ReplayLogIndexEntry>& index);
+};
+
+}
+
+#endif /* REPLAYLOG_H */
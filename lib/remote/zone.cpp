@@ -89,20 +89,21 @@ Array::Ptr Zone::GetAllParents() const
 
 bool Zone::CanAccessObject(const ConfigObject::Ptr& object)
 {
-	Zone::Ptr object_zone;
-
-	if (object->GetReflectionType() == Zone::TypeInstance)
-		object_zone = static_pointer_cast<Zone>(object);
-	else
-		object_zone = static_pointer_cast<Zone>(object->GetZone());
-
-	if (!object_zone)
-		object_zone = Zone::GetLocalZone();
+	return CanAccessZone(GetObjectZone(object));
+}
 
-	if (object_zone->GetGlobal())
+/**
+ * Checks whether this zone may see the objects in the given zone, see GetObjectZone().
+ *
+ * @param zone The zone of the objects
+ * @return Whether this zone may see the objects
+ */
+bool Zone::CanAccessZone(const Zone::Ptr& zone)
+{
+	if (zone->GetGlobal())
 		return true;
 
-	return object_zone->IsChildOf(this);
+	return zone->IsChildOf(this);
 }
 
 bool Zone::IsChildOf(const Zone::Ptr& zone)
@@ -130,6 +131,28 @@ bool Zone::IsHACluster() const
 	return endpoints && endpoints->GetLength() >= 2;
 }
 
+/**
+ * Returns the zone an object belongs to regarding access checks: the zone itself for zones,
+ * the local zone for objects without a zone.
+ *
+ * @param object The object
+ * @return The object's zone
+ */
+Zone::Ptr Zone::GetObjectZone(const ConfigObject::Ptr& object)
+{
+	Zone::Ptr object_zone;
+
+	if (object->GetReflectionType() == Zone::TypeInstance)
+		object_zone = static_pointer_cast<Zone>(object);
+	else
+		object_zone = static_pointer_cast<Zone>(object->GetZone());
+
+	if (!object_zone)
+		object_zone = Zone::GetLocalZone();
+
+	return object_zone;
+}
+
 Zone::Ptr Zone::GetLocalZone()
 {
 	Endpoint::Ptr local = Endpoint::GetLocalEndpoint();
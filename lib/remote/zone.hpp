@@ -27,11 +27,13 @@ public:
 	Array::Ptr GetAllParents() const override;
 
 	bool CanAccessObject(const ConfigObject::Ptr& object);
+	bool CanAccessZone(const Zone::Ptr& zone);
 	bool IsChildOf(const Zone::Ptr& zone);
 	bool IsGlobal() const;
 	bool IsHACluster() const;
 
 	static Zone::Ptr GetLocalZone();
+	static Zone::Ptr GetObjectZone(const ConfigObject::Ptr& object);
 
 protected:
 	void ValidateEndpointsRaw(const Lazy<Array::Ptr>& lvalue, const ValidationUtils& utils) override;
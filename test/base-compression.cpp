@@ -0,0 +1,50 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "base/compression.hpp"
+#include <BoostTestTargetConfig.h>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <stdexcept>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_compression)
+
+BOOST_AUTO_TEST_CASE(roundtrip)
+{
+	String json;
+
+	for (int i = 0; i < 1000; i++) {
+		json += "{\"jsonrpc\":\"2.0\",\"method\":\"event::CheckResult\",\"params\":{\"host\":\"host" + std::to_string(i) + "\"}}";
+	}
+
+	for (const String& data : { String(), String("1"), json }) {
+		for (int level : { 1, 6, 9 }) {
+			String compressed = Compression::Compress(data, level);
+
+			BOOST_CHECK_EQUAL(Compression::Decompress(compressed), data);
+		}
+	}
+
+	BOOST_CHECK(Compression::Compress(json).GetLength() < json.GetLength() / 10);
+}
+
+BOOST_AUTO_TEST_CASE(corrupted)
+{
+	String compressed = Compression::Compress(String(1000, 'x'));
+
+	compressed[compressed.GetLength() / 2] ^= 0x55;
+
+	BOOST_CHECK_THROW(Compression::Decompress(compressed), boost::iostreams::zlib_error);
+	BOOST_CHECK_THROW(Compression::Decompress("not compressed"), boost::iostreams::zlib_error);
+}
+
+BOOST_AUTO_TEST_CASE(limit)
+{
+	String compressed = Compression::Compress(String(1000000, 'x'));
+
+	BOOST_CHECK(compressed.GetLength() < 10000);
+	BOOST_CHECK_EQUAL(Compression::Decompress(compressed, 1000000).GetLength(), 1000000);
+	BOOST_CHECK_THROW(Compression::Decompress(compressed, 999999), std::length_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,86 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "base/histogram.hpp"
+#include <BoostTestTargetConfig.h>
+#include <memory>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_histogram)
+
+BOOST_AUTO_TEST_CASE(empty)
+{
+	Histogram histogram;
+
+	BOOST_CHECK_EQUAL(histogram.GetCount(), 0);
+	BOOST_CHECK_EQUAL(histogram.GetMax(), 0);
+	BOOST_CHECK_EQUAL(histogram.GetPercentile(50), 0);
+}
+
+BOOST_AUTO_TEST_CASE(percentiles)
+{
+	Histogram histogram;
+
+	for (int i = 1; i <= 1000; i++) {
+		histogram.Record(i / 1000.0);
+	}
+
+	BOOST_CHECK_EQUAL(histogram.GetCount(), 1000);
+	BOOST_CHECK_CLOSE(histogram.GetMax(), 1.0, 0.0001);
+	BOOST_CHECK_CLOSE(histogram.GetPercentile(50), 0.5, 100.0 / 16);
+	BOOST_CHECK_CLOSE(histogram.GetPercentile(90), 0.9, 100.0 / 16);
+	BOOST_CHECK_CLOSE(histogram.GetPercentile(99), 0.99, 100.0 / 16);
+	BOOST_CHECK(histogram.GetPercentile(100) <= histogram.GetMax());
+}
+
+BOOST_AUTO_TEST_CASE(clamping)
+{
+	Histogram histogram;
+
+	histogram.Record(-5);
+	histogram.Record(0.000003);
+	histogram.Record(1e9);
+
+	BOOST_CHECK_EQUAL(histogram.GetCount(), 3);
+	BOOST_CHECK_EQUAL(histogram.GetPercentile(1), 0);
+	BOOST_CHECK_CLOSE(histogram.GetPercentile(50), 0.000003, 0.0001);
+	BOOST_CHECK(histogram.GetMax() > 60 * 60 * 19);
+}
+
+BOOST_AUTO_TEST_CASE(window)
+{
+	WindowedHistogram durations (60, 3);
+
+	auto getWindow ([&durations](double now) {
+		auto histogram (std::make_unique<Histogram>());
+		durations.GetWindow(now, *histogram);
+		return histogram;
+	});
+
+	// In the slices 960-1020, 1020-1080 and 1080-1140.
+	durations.Record(1, 1000);
+	durations.Record(2, 1030);
+	durations.Record(3, 1100);
+
+	BOOST_CHECK_EQUAL(getWindow(1100)->GetCount(), 3);
+	BOOST_CHECK_CLOSE(getWindow(1100)->GetMax(), 3, 0.0001);
+
+	// The window consists of the current slice and the two before it.
+	BOOST_CHECK_EQUAL(getWindow(1150)->GetCount(), 2);
+	BOOST_CHECK_CLOSE(getWindow(1150)->GetMax(), 3, 0.0001);
+
+	BOOST_CHECK_EQUAL(getWindow(1210)->GetCount(), 1);
+	BOOST_CHECK_CLOSE(getWindow(1210)->GetPercentile(50), 3, 100.0 / 16);
+
+	// The slice 1140-1200 reuses the one of 960-1020, durations for the latter are dropped now.
+	durations.Record(4, 1180);
+	durations.Record(5, 1000);
+
+	auto window (getWindow(1180));
+	BOOST_CHECK_EQUAL(window->GetCount(), 3);
+	BOOST_CHECK_CLOSE(window->GetMax(), 4, 0.0001);
+
+	BOOST_CHECK_EQUAL(getWindow(10000)->GetCount(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,7 +5,11 @@
 #include <boost/asio.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <BoostTestTargetConfig.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 using namespace icinga;
 
@@ -156,4 +160,143 @@ BOOST_AUTO_TEST_CASE(timeout_due_scope)
 	BOOST_CHECK_EQUAL(called, 0);
 }
 
+static void WaitFor(const std::function<bool()>& condition)
+{
+	for (int i = 0; i < 500 && !condition(); ++i) {
+		Utility::Sleep(0.01);
+	}
+
+	BOOST_REQUIRE(condition());
+}
+
+BOOST_AUTO_TEST_CASE(cpu_bound_work_fifo)
+{
+	auto& engine (IoEngine::Get());
+	auto& io (engine.GetIoContext());
+	const auto pool (CpuBoundWorkPool::Http);
+	const auto before (engine.GetCpuBoundWorkStats(pool));
+	const auto slots (before.Slots);
+
+	BOOST_REQUIRE_GT(slots, 0);
+
+	std::vector<std::shared_ptr<boost::asio::io_context::strand>> strands;
+	std::vector<std::unique_ptr<std::atomic<bool>>> release;
+	std::atomic<int> holding (0);
+	std::mutex mutex;
+	std::vector<int> order;
+
+	for (int i = 0; i < slots * 2; ++i) {
+		strands.emplace_back(std::make_shared<boost::asio::io_context::strand>(io));
+		release.emplace_back(new std::atomic<bool>(false));
+	}
+
+	auto hold ([&](boost::asio::yield_context yc, int i) {
+		{
+			CpuBoundWork work (yc, pool);
+			boost::asio::deadline_timer timer (io);
+
+			if (i >= slots) {
+				std::unique_lock<std::mutex> lock (mutex);
+				order.push_back(i);
+			}
+
+			++holding;
+
+			while (!release[i]->load()) {
+				timer.expires_from_now(boost::posix_time::millisec(10));
+				timer.async_wait(yc);
+			}
+		}
+
+		--holding;
+	});
+
+	// Take all slots...
+	for (int i = 0; i < slots; ++i) {
+		IoEngine::SpawnCoroutine(*strands[i], [&hold, i, strand = strands[i]](boost::asio::yield_context yc) { hold(yc, i); });
+	}
+
+	WaitFor([&]() { return holding.load() == slots; });
+
+	// ... and queue up as many coroutines, one after another.
+	for (int i = slots; i < slots * 2; ++i) {
+		IoEngine::SpawnCoroutine(*strands[i], [&hold, i, strand = strands[i]](boost::asio::yield_context yc) { hold(yc, i); });
+
+		WaitFor([&]() { return engine.GetCpuBoundWorkStats(pool).QueueLength == size_t(i - slots + 1); });
+	}
+
+	// Every released slot resumes exactly the longest waiting coroutine.
+	for (int i = 0; i < slots; ++i) {
+		release[i]->store(true);
+
+		WaitFor([&]() { std::unique_lock<std::mutex> lock (mutex); return order.size() == size_t(i + 1); });
+
+		BOOST_CHECK_EQUAL(order.back(), slots + i);
+		BOOST_CHECK_EQUAL(engine.GetCpuBoundWorkStats(pool).QueueLength, size_t(slots - i - 1));
+	}
+
+	for (int i = slots; i < slots * 2; ++i) {
+		release[i]->store(true);
+	}
+
+	WaitFor([&]() { return holding.load() == 0; });
+
+	auto after (engine.GetCpuBoundWorkStats(pool));
+
+	BOOST_CHECK_EQUAL(after.QueueLength, 0);
+	BOOST_CHECK_EQUAL(after.Waits - before.Waits, uint_fast64_t(slots));
+	BOOST_CHECK(after.WaitTime > before.WaitTime);
+}
+
+BOOST_AUTO_TEST_CASE(cpu_bound_work_pools_independent)
+{
+	auto& engine (IoEngine::Get());
+	auto& io (engine.GetIoContext());
+	const auto slots (engine.GetCpuBoundWorkStats(CpuBoundWorkPool::PluginResults).Slots);
+
+	BOOST_REQUIRE_GT(slots, 0);
+	BOOST_REQUIRE_GT(engine.GetCpuBoundWorkStats(CpuBoundWorkPool::JsonRpc).Slots, 0);
+
+	std::atomic<bool> release (false);
+	std::atomic<int> holding (0);
+	std::atomic<bool> jsonRpcDone (false);
+
+	for (int i = 0; i < slots; ++i) {
+		auto strand (std::make_shared<boost::asio::io_context::strand>(io));
+
+		IoEngine::SpawnCoroutine(*strand, [&, strand](boost::asio::yield_context yc) {
+			{
+				CpuBoundWork work (yc, CpuBoundWorkPool::PluginResults);
+				boost::asio::deadline_timer timer (io);
+
+				++holding;
+
+				while (!release.load()) {
+					timer.expires_from_now(boost::posix_time::millisec(10));
+					timer.async_wait(yc);
+				}
+			}
+
+			--holding;
+		});
+	}
+
+	WaitFor([&]() { return holding.load() == slots; });
+
+	// Plugin results taking all of their slots don't hold up JSON-RPC messages.
+	auto strand (std::make_shared<boost::asio::io_context::strand>(io));
+
+	IoEngine::SpawnCoroutine(*strand, [&jsonRpcDone, strand](boost::asio::yield_context yc) {
+		CpuBoundWork work (yc, CpuBoundWorkPool::JsonRpc);
+
+		jsonRpcDone.store(true);
+	});
+
+	WaitFor([&]() { return jsonRpcDone.load(); });
+
+	release.store(true);
+
+	WaitFor([&]() { return holding.load() == 0; });
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -22,4 +22,25 @@ BOOST_AUTO_TEST_CASE(netstring)
 	fifo->Close();
 }
 
+BOOST_AUTO_TEST_CASE(buffer)
+{
+	std::string buffer;
+
+	BOOST_CHECK_EQUAL(NetString::WriteStringToBuffer(buffer, "hello"), 8);
+	BOOST_CHECK_EQUAL(NetString::WriteStringToBuffer(buffer, ""), 3);
+	BOOST_CHECK_EQUAL(buffer, "5:hello,0:,");
+
+	FIFO::Ptr fifo = new FIFO();
+	fifo->Write(buffer.c_str(), buffer.size());
+
+	String s;
+	StreamReadContext src;
+	BOOST_CHECK(NetString::ReadStringFromStream(fifo, &s, src) == StatusNewItem);
+	BOOST_CHECK(s == "hello");
+	BOOST_CHECK(NetString::ReadStringFromStream(fifo, &s, src) == StatusNewItem);
+	BOOST_CHECK(s == "");
+
+	fifo->Close();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -261,4 +261,74 @@ BOOST_AUTO_TEST_CASE(pack_object)
 	));
 }
 
+BOOST_AUTO_TEST_CASE(unpack)
+{
+	Dictionary::Ptr dict = new Dictionary({
+		{"null", Empty},
+		{"false", false},
+		{"true", true},
+		{"42.125", 42.125},
+		{"foobar", "foobar"},
+		{"array", (Array::Ptr)new Array({Empty, "foo", (Array::Ptr)new Array({1.0})})}
+	});
+
+	Dictionary::Ptr unpacked = UnpackObject(PackObject(dict));
+
+	BOOST_REQUIRE(unpacked);
+	BOOST_CHECK_EQUAL(PackObject(unpacked), PackObject(dict));
+	BOOST_CHECK(unpacked->Get("null").IsEmpty());
+	BOOST_CHECK_EQUAL(unpacked->Get("42.125"), 42.125);
+	BOOST_CHECK_EQUAL(unpacked->Get("foobar"), "foobar");
+
+	std::string builder;
+	PackObject("foo", builder);
+	PackObject(42.0, builder);
+
+	const char *begin = builder.c_str();
+	const char *end = begin + builder.size();
+
+	BOOST_CHECK_EQUAL(UnpackObject(begin, end), "foo");
+	BOOST_CHECK_EQUAL(UnpackObject(begin, end), 42);
+	BOOST_CHECK(begin == end);
+}
+
+BOOST_AUTO_TEST_CASE(unpack_invalid)
+{
+	String packed = PackObject((Array::Ptr)new Array({"foobar"}));
+
+	BOOST_CHECK_THROW(UnpackObject(packed.SubStr(0, packed.GetLength() - 1)), std::invalid_argument);
+	BOOST_CHECK_THROW(UnpackObject(packed + String(1, '\0')), std::invalid_argument);
+	BOOST_CHECK_THROW(UnpackObject(String("\7")), std::invalid_argument);
+	BOOST_CHECK_THROW(UnpackObject(String("\5\xff\xff\xff\xff\xff\xff\xff\xff")), std::invalid_argument);
+	BOOST_CHECK_THROW(UnpackObject(String()), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(unpack_nested)
+{
+	/* An array containing an array containing ... an array containing null. */
+	auto nest ([](size_t depth) {
+		std::string packed;
+
+		for (size_t i = 0; i < depth; i++) {
+			packed += std::string("\5\0\0\0\0\0\0\0\1", 9);
+		}
+
+		packed += '\0';
+
+		return String(std::move(packed));
+	});
+
+	Value value = UnpackObject(nest(100));
+
+	for (int i = 0; i < 100; i++) {
+		BOOST_REQUIRE(value.IsObjectType<Array>());
+		value = static_cast<Array::Ptr>(value)->Get(0);
+	}
+
+	BOOST_CHECK(value.IsEmpty());
+
+	/* Without a limit, unpacking this would overflow the stack. */
+	BOOST_CHECK_THROW(UnpackObject(nest(1000000)), std::invalid_argument);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
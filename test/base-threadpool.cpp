@@ -0,0 +1,183 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "base/threadpool.hpp"
+#include <BoostTestTargetConfig.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace icinga;
+
+/* Runs the pools with two threads. */
+struct ThreadPoolConcurrencyFixture
+{
+	ThreadPoolConcurrencyFixture() : m_PrevConcurrency(Configuration::Concurrency)
+	{
+		Configuration::Concurrency = 1;
+	}
+
+	~ThreadPoolConcurrencyFixture()
+	{
+		Configuration::Concurrency = m_PrevConcurrency;
+	}
+
+	int m_PrevConcurrency;
+};
+
+/* Blocks the threads of a pool until it's opened. */
+class ThreadPoolGate
+{
+public:
+	void Wait()
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		m_Waiting++;
+		m_CV.notify_all();
+		m_CV.wait(lock, [this]() { return m_Open; });
+	}
+
+	void WaitFor(int waiting)
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+		m_CV.wait(lock, [this, waiting]() { return m_Waiting >= waiting; });
+	}
+
+	void Open()
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		m_Open = true;
+		m_CV.notify_all();
+	}
+
+private:
+	std::mutex m_Mutex;
+	std::condition_variable m_CV;
+	int m_Waiting = 0;
+	bool m_Open = false;
+};
+
+BOOST_FIXTURE_TEST_SUITE(base_threadpool, ThreadPoolConcurrencyFixture)
+
+BOOST_AUTO_TEST_CASE(post_stop)
+{
+	ThreadPool tp;
+	std::atomic<int> done (0);
+
+	for (int i = 0; i < 10000; i++) {
+		BOOST_CHECK(tp.Post([&done]() { done++; }, i % 2 ? LowLatencyScheduler : DefaultScheduler));
+	}
+
+	/* Stop() finishes all queued work items. */
+	tp.Stop();
+
+	BOOST_CHECK_EQUAL(done.load(), 10000);
+	BOOST_CHECK_EQUAL(tp.GetPending(), 0);
+	BOOST_CHECK(!tp.Post([&done]() { done++; }, DefaultScheduler));
+
+	tp.Start();
+
+	BOOST_CHECK(tp.Post([&done]() { done++; }, DefaultScheduler));
+
+	tp.Stop();
+
+	BOOST_CHECK_EQUAL(done.load(), 10001);
+}
+
+BOOST_AUTO_TEST_CASE(post_while_stopping)
+{
+	for (int round = 0; round < 100; round++) {
+		ThreadPool tp;
+		std::atomic<int> accepted (0);
+		std::atomic<int> done (0);
+		std::vector<std::thread> threads;
+
+		for (int i = 0; i < 4; i++) {
+			threads.emplace_back([&tp, &accepted, &done]() {
+				for (int j = 0; j < 1000; j++) {
+					if (tp.Post([&done]() { done++; }, j % 2 ? LowLatencyScheduler : DefaultScheduler)) {
+						accepted++;
+					}
+				}
+			});
+		}
+
+		/* Every accepted work item runs, even if it's posted while the pool stops. */
+		tp.Stop();
+
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		BOOST_CHECK_EQUAL(done.load(), accepted.load());
+		BOOST_CHECK_EQUAL(tp.GetPending(), 0);
+		BOOST_CHECK_EQUAL(tp.GetPending(DefaultScheduler), 0);
+		BOOST_CHECK_EQUAL(tp.GetPending(LowLatencyScheduler), 0);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(low_latency_first)
+{
+	ThreadPool tp;
+	ThreadPoolGate gate;
+	std::mutex mutex;
+	std::vector<SchedulerPolicy> order;
+
+	for (int i = 0; i < 2; i++) {
+		tp.Post([&gate]() { gate.Wait(); }, DefaultScheduler);
+	}
+
+	gate.WaitFor(2);
+
+	for (auto policy : { DefaultScheduler, LowLatencyScheduler }) {
+		for (int i = 0; i < 10; i++) {
+			tp.Post([&mutex, &order, policy]() {
+				std::unique_lock<std::mutex> lock (mutex);
+				order.push_back(policy);
+			}, policy);
+		}
+	}
+
+	BOOST_CHECK_EQUAL(tp.GetPending(DefaultScheduler), 10);
+	BOOST_CHECK_EQUAL(tp.GetPending(LowLatencyScheduler), 10);
+
+	gate.Open();
+	tp.Stop();
+
+	BOOST_REQUIRE_EQUAL(order.size(), 20);
+
+	/* The other thread may start a default item while the last low latency one is being recorded. */
+	for (int i = 0; i < 9; i++) {
+		BOOST_CHECK_EQUAL(order[i], LowLatencyScheduler);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(steal)
+{
+	ThreadPool tp;
+	ThreadPoolGate gate;
+	std::atomic<int> done (0);
+
+	/* Work items posted by a pool thread are queued for that thread, the other one has to steal them. */
+	tp.Post([&tp, &gate, &done]() {
+		for (int i = 0; i < 100; i++) {
+			tp.Post([&done]() { done++; }, DefaultScheduler);
+		}
+
+		gate.Wait();
+	}, DefaultScheduler);
+
+	while (done.load() < 100) {
+		std::this_thread::yield();
+	}
+
+	BOOST_CHECK(tp.GetStolen() >= 100);
+
+	gate.Open();
+	tp.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,250 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "base/timingwheel.hpp"
+#include <BoostTestTargetConfig.h>
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_timingwheel)
+
+BOOST_AUTO_TEST_CASE(insert_remove)
+{
+	TimingWheel<int> wheel (0.01, 1000);
+
+	BOOST_CHECK(wheel.IsEmpty());
+
+	wheel.Insert(1, 1001);
+	wheel.Insert(2, 1002);
+	wheel.Insert(1, 1003);
+
+	BOOST_CHECK_EQUAL(wheel.GetLength(), 2);
+	BOOST_CHECK(wheel.Contains(1));
+	BOOST_CHECK(wheel.Remove(1));
+	BOOST_CHECK(!wheel.Remove(1));
+	BOOST_CHECK(!wheel.Contains(1));
+	BOOST_CHECK_EQUAL(wheel.GetLength(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(expire_in_order)
+{
+	TimingWheel<int> wheel (0.01, 1000);
+
+	/* Covers all wheel levels as well as overdue items. */
+	wheel.Insert(1, 1000.5);
+	wheel.Insert(2, 1500);
+	wheel.Insert(3, 999);
+	wheel.Insert(4, 1000 + 86400);
+	wheel.Insert(5, 1000 + 86400 * 30);
+	wheel.Insert(6, 1000 + 86400 * 365 * 3);
+
+	int item;
+	double when;
+
+	BOOST_CHECK(wheel.GetNextExpiry(1000, when));
+	BOOST_CHECK_EQUAL(when, 999);
+	BOOST_CHECK(wheel.PopExpired(1000, item, when));
+	BOOST_CHECK_EQUAL(item, 3);
+	BOOST_CHECK(!wheel.PopExpired(1000, item, when));
+
+	BOOST_CHECK(wheel.GetNextExpiry(1000, when));
+	BOOST_CHECK(when <= 1000.5);
+
+	std::vector<int> order;
+	double now = 1000;
+
+	while (!wheel.IsEmpty()) {
+		BOOST_REQUIRE(wheel.GetNextExpiry(now, when));
+		BOOST_REQUIRE(when >= now - 0.01);
+
+		now = std::max(now, when);
+
+		while (wheel.PopExpired(now, item, when)) {
+			BOOST_CHECK(when <= now);
+			order.push_back(item);
+		}
+	}
+
+	BOOST_CHECK((order == std::vector<int>{1, 2, 4, 5, 6}));
+}
+
+BOOST_AUTO_TEST_CASE(reschedule)
+{
+	TimingWheel<int> wheel (0.01, 1000);
+
+	wheel.Insert(1, 1010);
+	wheel.Insert(2, 1020);
+
+	int item;
+	double when;
+
+	BOOST_CHECK(!wheel.PopExpired(1005, item, when));
+	BOOST_CHECK(wheel.Contains(1));
+
+	wheel.Insert(2, 1003);
+
+	BOOST_CHECK(wheel.PopExpired(1005, item, when));
+	BOOST_CHECK_EQUAL(item, 2);
+	BOOST_CHECK_EQUAL(when, 1003);
+	BOOST_CHECK(!wheel.PopExpired(1005, item, when));
+
+	wheel.Insert(1, 1004);
+
+	BOOST_CHECK(wheel.PopExpired(1005, item, when));
+	BOOST_CHECK_EQUAL(item, 1);
+	BOOST_CHECK(wheel.IsEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(randomized)
+{
+	TimingWheel<int> wheel (0.01, 0);
+	std::mt19937 rng (42);
+	std::uniform_real_distribution<double> dist (0, 10000);
+	std::vector<double> due (10000);
+
+	for (int i = 0; i < 10000; i++) {
+		due[i] = dist(rng);
+		wheel.Insert(i, due[i]);
+	}
+
+	for (int i = 0; i < 10000; i += 3) {
+		due[i] = dist(rng);
+		wheel.Insert(i, due[i]);
+	}
+
+	int item, expired = 0;
+	double when, last = 0;
+
+	for (double now = 0; now <= 10000; now += 0.5) {
+		while (wheel.PopExpired(now, item, when)) {
+			BOOST_REQUIRE_EQUAL(when, due[item]);
+			BOOST_REQUIRE(when <= now);
+			BOOST_REQUIRE(when > now - 0.5 - 0.01);
+			BOOST_REQUIRE(when >= last - 0.5);
+
+			last = when;
+			expired++;
+		}
+	}
+
+	BOOST_CHECK_EQUAL(expired, 10000);
+	BOOST_CHECK(wheel.IsEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(overdue_in_order)
+{
+	TimingWheel<int> wheel (0.01, 1000);
+	std::mt19937 rng (7);
+	std::uniform_real_distribution<double> dist (0, 1000);
+
+	for (int i = 0; i < 1000; i++) {
+		wheel.Insert(i, dist(rng));
+	}
+
+	/* Overdue items are due in the order of their due time, not of their insertion. */
+	int item;
+	double when, next, last = -1;
+
+	for (int i = 0; i < 1000; i++) {
+		if (i % 10 == 0) {
+			wheel.Insert(1000 + i, dist(rng));
+		}
+
+		BOOST_REQUIRE(wheel.GetNextExpiry(1000, next));
+		BOOST_REQUIRE(wheel.PopExpired(1000, item, when));
+		BOOST_CHECK_EQUAL(when, next);
+
+		if (item < 1000) {
+			BOOST_CHECK_GE(when, last);
+			last = when;
+		}
+	}
+}
+
+struct BenchmarkEntry
+{
+	int Item;
+	double When;
+};
+
+typedef boost::multi_index_container<
+	BenchmarkEntry,
+	boost::multi_index::indexed_by<
+		boost::multi_index::ordered_unique<boost::multi_index::member<BenchmarkEntry, int, &BenchmarkEntry::Item>>,
+		boost::multi_index::ordered_non_unique<boost::multi_index::member<BenchmarkEntry, double, &BenchmarkEntry::When>>
+	>
+> BenchmarkSet;
+
+/* Mimics the check scheduler: schedule all items, reschedule each of them once
+ * (as NextCheckChangedHandler does) and expire them all in order.
+ * Run explicitly with --run_test=base_timingwheel/benchmark. */
+BOOST_AUTO_TEST_CASE(benchmark, *boost::unit_test::disabled())
+{
+	typedef std::chrono::steady_clock Clock;
+
+	for (int count : { 100000, 250000, 500000, 1000000 }) {
+		std::mt19937 rng (count);
+		std::uniform_real_distribution<double> dist (0, 300);
+		std::vector<double> first (count), second (count);
+
+		for (int i = 0; i < count; i++) {
+			first[i] = dist(rng);
+			second[i] = dist(rng);
+		}
+
+		auto start (Clock::now());
+
+		{
+			BenchmarkSet set;
+
+			for (int i = 0; i < count; i++)
+				set.insert({ i, first[i] });
+
+			auto& items (set.get<0>());
+
+			for (int i = 0; i < count; i++) {
+				items.erase(i);
+				items.insert({ i, second[i] });
+			}
+
+			auto& times (set.get<1>());
+
+			while (!times.empty())
+				times.erase(times.begin());
+		}
+
+		auto mid (Clock::now());
+
+		{
+			TimingWheel<int> wheel (0.01, 0);
+
+			for (int i = 0; i < count; i++)
+				wheel.Insert(i, first[i]);
+
+			for (int i = 0; i < count; i++)
+				wheel.Insert(i, second[i]);
+
+			int item;
+			double when;
+
+			for (double now = 0; !wheel.IsEmpty(); now += 0.01) {
+				while (wheel.PopExpired(now, item, when))
+					;
+			}
+		}
+
+		auto end (Clock::now());
+
+		std::cout << count << " items: multi_index "
+			<< std::chrono::duration_cast<std::chrono::milliseconds>(mid - start).count() << "ms, timing wheel "
+			<< std::chrono::duration_cast<std::chrono::milliseconds>(end - mid).count() << "ms\n";
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,104 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include <BoostTestTargetConfig.h>
+#include "checker/checkercomponent.hpp"
+#include "config/configcompiler.hpp"
+#include "config/configitem.hpp"
+#include "icinga/host.hpp"
+#include "remote/apilistener.hpp"
+#include <mutex>
+#include <vector>
+
+using namespace icinga;
+
+namespace {
+
+/**
+ * Moves the checks to their shard's pending checkables like the scheduler thread does,
+ * by using Friend-Injection to access the private members (see notification-notificationcomponent.cpp).
+ */
+template<auto setChecksPendingFnPtr, auto getShardFnPtr>
+struct SetChecksPendingImpl
+{
+	friend std::vector<Checkable::Ptr> SetChecksPending(const CheckerComponent::Ptr& cc, std::vector<Checkable::Ptr>& checks)
+	{
+		auto& shard ((*cc.*getShardFnPtr)(checks.front()));
+		std::unique_lock<std::mutex> lock (shard.Mutex);
+
+		return (*cc.*setChecksPendingFnPtr)(shard, checks);
+	}
+};
+std::vector<Checkable::Ptr> SetChecksPending(const CheckerComponent::Ptr& cc, std::vector<Checkable::Ptr>& checks);
+
+template struct SetChecksPendingImpl<&CheckerComponent::SetChecksPending, &CheckerComponent::GetShard>;
+
+} // namespace
+
+class CheckerComponentFixture
+{
+public:
+	CheckerComponentFixture()
+	{
+		auto createObjects = []() {
+			String config = R"CONFIG({
+object CheckCommand "checker-dummy" {
+	command = "/bin/true"
+}
+object Host "checker-h1" {
+	check_command = "checker-dummy"
+	check_interval = 1d
+	enable_active_checks = false
+}
+object Host "checker-h2" {
+	check_command = "checker-dummy"
+	check_interval = 1d
+	enable_active_checks = false
+}
+object CheckerComponent "checker" {
+	scheduler_shards = 1
+}
+})CONFIG";
+			std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<test>", config);
+			expr->Evaluate(*ScriptFrame::GetCurrentFrame());
+		};
+
+		auto ret = ConfigItem::RunWithActivationContext(new Function("CreateTestObjects", createObjects));
+		BOOST_REQUIRE(ret);
+
+		ApiListener::UpdateObjectAuthority();
+		BOOST_REQUIRE(ApiListener::UpdatedObjectAuthority());
+
+		m_Checker = CheckerComponent::GetByName("checker");
+		BOOST_REQUIRE(m_Checker);
+	}
+
+	CheckerComponent::Ptr m_Checker;
+};
+
+BOOST_FIXTURE_TEST_SUITE(checker_checkercomponent, CheckerComponentFixture)
+
+/* A checkable which is paused (e.g. by an HA failover) between being taken as due
+ * and being marked as pending must not be checked.
+ */
+BOOST_AUTO_TEST_CASE(paused_while_due)
+{
+	Host::Ptr h1 = Host::GetByName("checker-h1");
+	Host::Ptr h2 = Host::GetByName("checker-h2");
+	BOOST_REQUIRE(h1 && h2);
+
+	h2->SetAuthority(false);
+	BOOST_REQUIRE(h2->IsPaused());
+
+	std::vector<Checkable::Ptr> checks { h1, h2 };
+	auto pendingBefore (m_Checker->GetPendingCheckables());
+
+	std::vector<Checkable::Ptr> dropped = SetChecksPending(m_Checker, checks);
+
+	BOOST_REQUIRE_EQUAL(dropped.size(), 1);
+	BOOST_CHECK(dropped.front() == h2);
+	BOOST_REQUIRE_EQUAL(checks.size(), 1);
+	BOOST_CHECK(checks.front() == h1);
+	BOOST_CHECK_EQUAL(m_Checker->GetPendingCheckables(), pendingBefore + 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
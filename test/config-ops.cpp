@@ -2,6 +2,7 @@
 
 #include "config/configcompiler.hpp"
 #include "base/exception.hpp"
+#include "base/scriptglobal.hpp"
 #include <BoostTestTargetConfig.h>
 
 using namespace icinga;
@@ -288,4 +289,129 @@ BOOST_AUTO_TEST_CASE(sandboxed_ticket_salt)
 	BOOST_CHECK_THROW(expr->Evaluate(frame), ScriptError);
 }
 
+BOOST_AUTO_TEST_CASE(constant_folding)
+{
+	Dictionary::Ptr constants = new Dictionary({ { "x", 2 }, { "names", new Array({ "a", "b" }) } });
+	std::unique_ptr<Expression> expr;
+
+	auto eval ([](const std::unique_ptr<Expression>& expr, bool sandboxed = true) {
+		Namespace::Ptr ns = new Namespace();
+		ns->Set("x", 3);
+		ns->Set("y", 4);
+		ns->Set("names", new Array({ "c" }));
+
+		ScriptFrame frame(true, ns);
+		frame.Sandboxed = sandboxed;
+		return expr->Evaluate(frame).GetValue();
+	});
+
+	// Operations on literals and constants are replaced by their results.
+	expr = ConfigCompiler::CompileText("<test>", "x * 3 + 1");
+	FoldConstants(expr, constants);
+	BOOST_CHECK(dynamic_cast<DictExpression*>(expr.get()));
+	BOOST_CHECK(dynamic_cast<LiteralExpression*>(static_cast<DictExpression*>(expr.get())->GetExpressions().at(0).get()));
+	BOOST_CHECK(eval(expr) == 7);
+
+	// Other variables are left as they are.
+	expr = ConfigCompiler::CompileText("<test>", "x + y");
+	FoldConstants(expr, constants);
+	BOOST_CHECK(eval(expr) == 6);
+
+	// Containers stay variables, in takes a copy of constant arrays.
+	expr = ConfigCompiler::CompileText("<test>", "\"a\" in names && len(names) == x - 1 && names.contains(\"c\")");
+	FoldConstants(expr, constants);
+	BOOST_CHECK(eval(expr) == true);
+
+	// Changes to containers don't affect later evaluations.
+	expr = ConfigCompiler::CompileText("<test>", "names.add(\"d\"); len(names)");
+	FoldConstants(expr, constants);
+	BOOST_CHECK(eval(expr, false) == 2);
+	BOOST_CHECK(eval(expr, false) == 2);
+	BOOST_CHECK(Array::Ptr(constants->Get("names"))->GetLength() == 2);
+
+	// Constants aren't replaced if they may be changed.
+	expr = ConfigCompiler::CompileText("<test>", "x = 5; x + 1");
+	FoldConstants(expr, constants);
+	BOOST_CHECK(eval(expr, false) == 6);
+
+	// Errors are still raised once evaluated.
+	expr = ConfigCompiler::CompileText("<test>", "x / 0");
+	BOOST_CHECK_NO_THROW(FoldConstants(expr, constants));
+	BOOST_CHECK_THROW(eval(expr), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(specialized_expressions)
+{
+	Dictionary::Ptr constants = new Dictionary({ { "names", new Array({ "a", "b" }) } });
+
+	auto eval ([](const std::unique_ptr<Expression>& expr) {
+		Namespace::Ptr ns = new Namespace();
+		ns->Set("host", new Dictionary({
+			{ "name", "a" },
+			{ "vars", new Dictionary({ { "os", "Linux" }, { "port", 22 }, { "empty", "" } }) }
+		}));
+		ns->Set("names", new Array({ "a", "b" }));
+
+		ScriptFrame frame(true, ns);
+		frame.Sandboxed = true;
+		return expr->Evaluate(frame).GetValue();
+	});
+
+	auto expression ([](const std::unique_ptr<Expression>& expr) {
+		return static_cast<DictExpression*>(expr.get())->GetExpressions().at(0).get();
+	});
+
+	// Specialized expressions evaluate to what the generic ones would.
+	for (const char *filter : {
+		"host.vars.os == \"Linux\"", "\"Windows\" == host.vars.os", "host.vars.port == \"22\"", "host.vars.missing == null",
+		"host.name in names", "host.vars.os in names", "host.vars.port in [ 22, 23 ]", "host.vars.missing in [ \"\" ]",
+		"host.vars.empty in [ null ]", "host[\"vars\"].os", "host.vars.missing.os", "host.name.len()",
+		"match(\"L*\", host.vars.os)", "match(\"linux\", host.vars.os)", "match(\"W*\", host.vars.os)",
+		"match(\"2?\", host.vars.port)", "match(\"*\", host.vars.missing)", "match(\"L*\", [ host.vars.os, host.name ])",
+		"match(\"L*\", [ host.vars.os, host.name ], MatchAny)"
+	}) {
+		auto generic (ConfigCompiler::CompileText("<test>", filter));
+		auto specialized (ConfigCompiler::CompileText("<test>", filter));
+		FoldConstants(specialized, constants);
+
+		BOOST_CHECK_MESSAGE(eval(generic) == eval(specialized), filter);
+	}
+
+	std::unique_ptr<Expression> expr;
+
+	expr = ConfigCompiler::CompileText("<test>", "host.vars.os == \"Linux\"");
+	FoldConstants(expr, constants);
+	BOOST_CHECK(dynamic_cast<LiteralEqualExpression*>(expression(expr)));
+	BOOST_CHECK(dynamic_cast<LiteralIndexerExpression*>(static_cast<BinaryExpression*>(expression(expr))->GetOperand1().get()));
+
+	expr = ConfigCompiler::CompileText("<test>", "host.name in names");
+	FoldConstants(expr, constants);
+	BOOST_CHECK(dynamic_cast<LiteralInExpression*>(expression(expr)));
+
+	expr = ConfigCompiler::CompileText("<test>", "match(\"L*\", host.vars.os)");
+	FoldConstants(expr, constants);
+	BOOST_CHECK(dynamic_cast<LiteralMatchExpression*>(expression(expr)));
+
+	// Only the global match() is taken as is, not e.g. a local variable named so.
+	expr = ConfigCompiler::CompileText("<test>", "match(\"W*\", host.vars.os)");
+	FoldConstants(expr, constants);
+	BOOST_CHECK(dynamic_cast<LiteralMatchExpression*>(expression(expr)));
+
+	{
+		Namespace::Ptr ns = new Namespace();
+		ns->Set("host", new Dictionary({ { "vars", new Dictionary({ { "os", "Linux" } }) } }));
+		ns->Set("match", Namespace::Ptr(ScriptGlobal::Get("System"))->Get("regex"));
+
+		ScriptFrame frame(true, ns);
+		frame.Sandboxed = true;
+		BOOST_CHECK(expr->Evaluate(frame).GetValue() == true);
+	}
+
+	// The right side of in is only taken as is if it's an array of literals.
+	expr = ConfigCompiler::CompileText("<test>", "host.name in [ host.vars.os ]");
+	FoldConstants(expr, constants);
+	BOOST_CHECK(!dynamic_cast<LiteralInExpression*>(expression(expr)));
+	BOOST_CHECK(eval(expr) == false);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,158 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "methods/pluginworkerpool.hpp"
+#include "base/array.hpp"
+#include "base/convert.hpp"
+#include "base/dictionary.hpp"
+#include <BoostTestTargetConfig.h>
+#include <chrono>
+#include <future>
+#include <memory>
+
+using namespace icinga;
+
+#ifndef _WIN32
+
+/* Answers each check with its own PID, exits on "crash" and hangs on "hang". */
+static const char *l_WorkerScript =
+	"while read -r line; do"
+	"  id=$(printf '%s\\n' \"$line\" | sed -e 's/.*\"id\":\\([0-9]*\\).*/\\1/');"
+	"  case \"$line\" in"
+	"    *'\"crash\"'*) exit 1 ;;"
+	"    *'\"hang\"'*) sleep 60 ;;"
+	"  esac;"
+	"  printf '{\"id\":%s,\"exit_status\":0,\"output\":\"%s\"}\\n' \"$id\" \"$$\";"
+	"done";
+
+static Process::Arguments GetWorkerCommand()
+{
+	return { "/bin/sh", "-c", l_WorkerScript };
+}
+
+static ProcessResult RunCheck(const PluginWorkerPool::Ptr& pool, const String& argument, double timeout = 0)
+{
+	auto promise (std::make_shared<std::promise<ProcessResult>>());
+	auto future (promise->get_future());
+
+	Dictionary::Ptr request = new Dictionary({
+		{ "arguments", new Array({ argument }) },
+		{ "env", new Dictionary() },
+		{ "timeout", timeout }
+	});
+
+	pool->Execute(request, timeout, [promise](const ProcessResult& pr) { promise->set_value(pr); });
+
+	BOOST_REQUIRE(future.wait_for(std::chrono::seconds(30)) == std::future_status::ready);
+
+	return future.get();
+}
+
+BOOST_AUTO_TEST_SUITE(methods_pluginworkerpool)
+
+BOOST_AUTO_TEST_CASE(reuse)
+{
+	auto pool (PluginWorkerPool::GetPool("pluginworkerpool-reuse"));
+
+	pool->Configure(GetWorkerCommand(), 1, 1, 0);
+
+	auto first (RunCheck(pool, "ok"));
+
+	BOOST_CHECK_EQUAL(first.ExitStatus, 0);
+	BOOST_CHECK_EQUAL(first.Output, Convert::ToString(first.PID));
+
+	for (int i = 0; i < 5; ++i) {
+		auto pr (RunCheck(pool, "ok"));
+
+		BOOST_CHECK_EQUAL(pr.ExitStatus, 0);
+		BOOST_CHECK_EQUAL(pr.PID, first.PID);
+	}
+
+	BOOST_CHECK(PluginWorkerPool::GetPool("pluginworkerpool-reuse") == pool);
+}
+
+BOOST_AUTO_TEST_CASE(recycle_after_max_checks)
+{
+	auto pool (PluginWorkerPool::GetPool("pluginworkerpool-recycle"));
+
+	pool->Configure(GetWorkerCommand(), 1, 1, 2);
+
+	auto first (RunCheck(pool, "ok"));
+	auto second (RunCheck(pool, "ok"));
+	auto third (RunCheck(pool, "ok"));
+	auto fourth (RunCheck(pool, "ok"));
+	auto fifth (RunCheck(pool, "ok"));
+
+	BOOST_CHECK_EQUAL(first.ExitStatus, 0);
+	BOOST_CHECK_EQUAL(third.ExitStatus, 0);
+	BOOST_CHECK_EQUAL(fifth.ExitStatus, 0);
+
+	BOOST_CHECK_EQUAL(second.PID, first.PID);
+	BOOST_CHECK_NE(third.PID, first.PID);
+	BOOST_CHECK_EQUAL(fourth.PID, third.PID);
+	BOOST_CHECK_NE(fifth.PID, third.PID);
+}
+
+BOOST_AUTO_TEST_CASE(recycle_after_command_change)
+{
+	auto pool (PluginWorkerPool::GetPool("pluginworkerpool-command"));
+	auto command (GetWorkerCommand());
+
+	pool->Configure(command, 1, 1, 0);
+
+	auto first (RunCheck(pool, "ok"));
+
+	pool->Configure(command, 1, 1, 0);
+
+	BOOST_CHECK_EQUAL(RunCheck(pool, "ok").PID, first.PID);
+
+	command.emplace_back("changed");
+	pool->Configure(command, 1, 1, 0);
+
+	auto pr (RunCheck(pool, "ok"));
+
+	BOOST_CHECK_EQUAL(pr.ExitStatus, 0);
+	BOOST_CHECK_NE(pr.PID, first.PID);
+}
+
+BOOST_AUTO_TEST_CASE(timeout)
+{
+	auto pool (PluginWorkerPool::GetPool("pluginworkerpool-timeout"));
+
+	pool->Configure(GetWorkerCommand(), 1, 1, 0);
+
+	auto hung (RunCheck(pool, "hang", 0.5));
+
+	BOOST_CHECK_EQUAL(hung.ExitStatus, 128);
+	BOOST_CHECK_EQUAL(hung.Output, "<Timeout exceeded.>");
+	BOOST_CHECK(hung.ExecutionEnd - hung.ExecutionStart < 30);
+
+	/* The hung worker has been killed and is replaced. */
+	auto pr (RunCheck(pool, "ok"));
+
+	BOOST_CHECK_EQUAL(pr.ExitStatus, 0);
+	BOOST_CHECK_NE(pr.PID, hung.PID);
+}
+
+BOOST_AUTO_TEST_CASE(crash)
+{
+	auto pool (PluginWorkerPool::GetPool("pluginworkerpool-crash"));
+
+	pool->Configure(GetWorkerCommand(), 1, 1, 0);
+
+	auto first (RunCheck(pool, "ok"));
+	auto crashed (RunCheck(pool, "crash"));
+
+	BOOST_CHECK_EQUAL(crashed.ExitStatus, 128);
+	BOOST_CHECK(crashed.Output.Contains("Plugin worker exited unexpectedly."));
+	BOOST_CHECK_EQUAL(crashed.PID, first.PID);
+
+	/* The crashed worker is replaced. */
+	auto pr (RunCheck(pool, "ok"));
+
+	BOOST_CHECK_EQUAL(pr.ExitStatus, 0);
+	BOOST_CHECK_NE(pr.PID, first.PID);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#endif /* _WIN32 */
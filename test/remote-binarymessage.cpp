@@ -0,0 +1,109 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "remote/binarymessage.hpp"
+#include "base/object-packer.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+static String l_LastHost;
+static double l_LastValue;
+
+/* Stands in for the cluster events, which register their message types in the icinga library. */
+REGISTER_BINARY_MESSAGE(255, SetTestValue, test, [](const Dictionary::Ptr& params, std::string& builder) {
+	if (params->GetLength() != 2)
+		return false;
+
+	PackObject(params->Get("host"), builder);
+	PackObject(params->Get("value"), builder);
+	return true;
+}, [](const MessageOrigin::Ptr&, BinaryMessageReader& reader) {
+	l_LastHost = reader.ReadString();
+	l_LastValue = reader.ReadNumber();
+});
+
+static Dictionary::Ptr MakeTestMessage(const String& method, const Dictionary::Ptr& params)
+{
+	return new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", method },
+		{ "params", params },
+		{ "ts", 1234.5 },
+		{ "originZone", "master" }
+	});
+}
+
+BOOST_AUTO_TEST_SUITE(remote_binarymessage)
+
+BOOST_AUTO_TEST_CASE(roundtrip)
+{
+	String binary = BinaryMessageType::EncodeMessage(MakeTestMessage("test::SetTestValue", new Dictionary({
+		{ "host", "host1" },
+		{ "value", 42 }
+	})));
+
+	BOOST_REQUIRE(BinaryMessageType::IsBinaryMessage(binary));
+	BOOST_CHECK(!BinaryMessageType::IsBinaryMessage("{\"jsonrpc\":\"2.0\"}"));
+
+	double ts;
+	String originZone;
+	const char *params;
+	auto type (BinaryMessageType::DecodeMessage(binary, ts, originZone, params));
+
+	BOOST_REQUIRE(type);
+	BOOST_CHECK_EQUAL(type->GetMethod(), "test::SetTestValue");
+	BOOST_CHECK_EQUAL(ts, 1234.5);
+	BOOST_CHECK_EQUAL(originZone, "master");
+
+	BinaryMessageReader reader (params, binary.CStr() + binary.GetLength());
+	type->Handle(nullptr, reader);
+
+	BOOST_CHECK_EQUAL(l_LastHost, "host1");
+	BOOST_CHECK_EQUAL(l_LastValue, 42);
+}
+
+BOOST_AUTO_TEST_CASE(fallback)
+{
+	/* No binary encoding for the method. */
+	BOOST_CHECK(BinaryMessageType::EncodeMessage(MakeTestMessage("test::Unknown", new Dictionary({
+		{ "host", "host1" }
+	}))).IsEmpty());
+
+	/* Params the encoding doesn't know. */
+	BOOST_CHECK(BinaryMessageType::EncodeMessage(MakeTestMessage("test::SetTestValue", new Dictionary({
+		{ "host", "host1" },
+		{ "value", 42 },
+		{ "other", 1 }
+	}))).IsEmpty());
+
+	/* Requests expect a JSON response. */
+	Dictionary::Ptr request = MakeTestMessage("test::SetTestValue", new Dictionary({
+		{ "host", "host1" },
+		{ "value", 42 }
+	}));
+
+	request->Set("id", 1);
+
+	BOOST_CHECK(BinaryMessageType::EncodeMessage(request).IsEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(invalid)
+{
+	String binary = BinaryMessageType::EncodeMessage(MakeTestMessage("test::SetTestValue", new Dictionary({
+		{ "host", "host1" },
+		{ "value", "not a number" }
+	})));
+
+	double ts;
+	String originZone;
+	const char *params;
+	auto type (BinaryMessageType::DecodeMessage(binary, ts, originZone, params));
+
+	BinaryMessageReader reader (params, binary.CStr() + binary.GetLength());
+	BOOST_CHECK_THROW(type->Handle(nullptr, reader), std::invalid_argument);
+
+	BOOST_CHECK_THROW(BinaryMessageType::DecodeMessage(String(std::string("\0b\x7f", 3)), ts, originZone, params), std::invalid_argument);
+	BOOST_CHECK_THROW(BinaryMessageType::DecodeMessage(binary.SubStr(0, 4), ts, originZone, params), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,6 +2,8 @@
 
 #include <BoostTestTargetConfig.h>
 #include "icinga/host.hpp"
+#include "icinga/checkresult.hpp"
+#include "base/wait-group.hpp"
 #include "remote/apiuser.hpp"
 #include "remote/filterutility.hpp"
 #include "test/icingaapplication-fixture.hpp"
@@ -318,4 +320,216 @@ object Host "host1" {
 	BOOST_CHECK_EQUAL(objs.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(parallel_filter, IcingaApplicationFixture)
+{
+	auto createObjects = []() {
+		String config = R"CONFIG({
+object CheckCommand "dummy" {
+  command = "/bin/echo"
+}
+
+object ApiUser "allPermissionsUser" {
+  permissions = [ "*" ]
+}
+
+object ApiUser "permissionFilterUser" {
+  permissions = [
+    {
+      permission = "objects/query/Host"
+      filter = {{ host.vars.n % 3 != 0 }}
+    }
+  ]
+}
+
+for (n in range(10000)) {
+  object Host "host" + n {
+    address = "host" + n
+    check_command = "dummy"
+    vars.n = n
+  }
+}
+})CONFIG";
+		std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<test>", config);
+		expr->Evaluate(*ScriptFrame::GetCurrentFrame());
+	};
+
+	ConfigItem::RunWithActivationContext(new Function("CreateTestObjects", createObjects));
+
+	auto allPermissionsUser = ApiUser::GetByName("allPermissionsUser");
+	auto permissionFilterUser = ApiUser::GetByName("permissionFilterUser");
+
+	QueryDescription qd;
+	qd.Types.insert("Host");
+	qd.Permission = "objects/query/Host";
+
+	Dictionary::Ptr queryParams = new Dictionary();
+	queryParams->Set("type", "Host");
+	queryParams->Set("filter", "host.vars.n % 2 == divisor");
+	queryParams->Set("filter_vars", new Dictionary({ { "divisor", 0 } }));
+
+	// The objects are split across threads, but the result has to be the same as if they weren't.
+	std::vector<Value> expectedAll, expectedFiltered;
+
+	for (auto& host : ConfigType::GetObjectsByType<Host>()) {
+		int n = host->GetVars()->Get("n");
+
+		if (n % 2 == 0) {
+			expectedAll.emplace_back(host);
+
+			if (n % 3 != 0) {
+				expectedFiltered.emplace_back(host);
+			}
+		}
+	}
+
+	BOOST_REQUIRE_EQUAL(expectedAll.size(), 5000);
+
+	std::vector<Value> objs;
+	BOOST_REQUIRE_NO_THROW(objs = FilterUtility::GetFilterTargets(qd, queryParams, allPermissionsUser));
+	BOOST_CHECK(objs == expectedAll);
+
+	BOOST_REQUIRE_NO_THROW(objs = FilterUtility::GetFilterTargets(qd, queryParams, permissionFilterUser));
+	BOOST_CHECK(objs == expectedFiltered);
+
+	// Errors in any of the threads are reported to the caller.
+	queryParams->Set("filter", "host.vars.n < 9999 || host.vars.n.nonexistent()");
+	BOOST_REQUIRE_THROW(objs = FilterUtility::GetFilterTargets(qd, queryParams, allPermissionsUser), ScriptError);
+}
+
+BOOST_FIXTURE_TEST_CASE(indexed_filter, IcingaApplicationFixture)
+{
+	auto createObjects = []() {
+		String config = R"CONFIG({
+object CheckCommand "dummy" {
+  command = "/bin/echo"
+}
+
+object ApiUser "indexedFilterUser" {
+  permissions = [ "*" ]
+}
+
+for (n in range(100)) {
+  object Host "indexed" + n {
+    check_command = "dummy"
+    vars.n = n
+  }
+}
+})CONFIG";
+		std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<test>", config);
+		expr->Evaluate(*ScriptFrame::GetCurrentFrame());
+	};
+
+	ConfigItem::RunWithActivationContext(new Function("CreateTestObjects", createObjects));
+
+	auto user = ApiUser::GetByName("indexedFilterUser");
+
+	QueryDescription qd;
+	qd.Types.insert("Host");
+	qd.Permission = "objects/query/Host";
+
+	// Filters starting with "true &&" can't be looked up in the index, so all objects are evaluated.
+	auto query ([&user, &qd](const String& filter, bool indexed) {
+		Dictionary::Ptr queryParams = new Dictionary();
+		queryParams->Set("type", "Host");
+		queryParams->Set("filter", indexed ? filter : "true && (" + filter + ")");
+		queryParams->Set("filter_vars", new Dictionary({ { "name", "indexed42" } }));
+
+		return FilterUtility::GetFilterTargets(qd, queryParams, user);
+	});
+
+	std::vector<String> filters {
+		R"(host.name == "indexed7")",
+		R"(name == host.name)",
+		R"(host.name != "indexed7" && host.vars.n < 10)",
+		R"(match("indexed1*", host.name) || obj.name == "indexed99")",
+		R"(match("indexed1*", host.name) && host.vars.n % 2 == 0)",
+	};
+
+	for (auto& filter : filters) {
+		BOOST_TEST_INFO(filter);
+		BOOST_CHECK(query(filter, true) == query(filter, false));
+	}
+
+	BOOST_CHECK_EQUAL(query(R"(host.name == "indexed7")", true).size(), 1);
+	BOOST_CHECK_EQUAL(query(R"(match("indexed1*", host.name))", true).size(), 11);
+
+	// The index is kept up to date when objects are modified.
+	auto host (Host::GetByName("indexed7"));
+	auto filter (R"(host.name == "indexed7" && host.vars.n == 7)");
+
+	BOOST_CHECK_EQUAL(query(filter, true).size(), 1);
+	host->ModifyAttribute("vars.n", 8);
+	BOOST_CHECK(query(filter, true).empty());
+
+	// ... and when they get a check result.
+	CheckResult::Ptr cr = new CheckResult();
+	cr->SetState(ServiceCritical);
+	cr->SetExecutionStart(Utility::GetTime());
+	cr->SetExecutionEnd(cr->GetExecutionStart());
+
+	BOOST_CHECK(query("host.state == 1", true).empty());
+	host->SetAuthority(true);
+	host->ProcessCheckResult(cr, new StoppableWaitGroup());
+	BOOST_CHECK_EQUAL(query("host.state == 1", true).size(), 1);
+	BOOST_CHECK(query("host.state == 1", true) == query("host.state == 1", false));
+
+	// Errors are still reported for the objects the filter fails for.
+	BOOST_CHECK_THROW(query(R"(host.name == "indexed1" && host.vars.n.nonexistent())", true), ScriptError);
+}
+
+BOOST_FIXTURE_TEST_CASE(limit, IcingaApplicationFixture)
+{
+	auto createObjects = []() {
+		String config = R"CONFIG({
+object CheckCommand "dummy" {
+  command = "/bin/echo"
+}
+
+object ApiUser "limitUser" {
+  permissions = [ "*" ]
+}
+
+for (n in range(20)) {
+  object Host "limited" + n {
+    check_command = "dummy"
+    vars.n = n
+  }
+}
+})CONFIG";
+		std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<test>", config);
+		expr->Evaluate(*ScriptFrame::GetCurrentFrame());
+	};
+
+	ConfigItem::RunWithActivationContext(new Function("CreateTestObjects", createObjects));
+
+	auto user = ApiUser::GetByName("limitUser");
+
+	QueryDescription qd;
+	qd.Types.insert("Host");
+	qd.Permission = "objects/query/Host";
+
+	Dictionary::Ptr queryParams = new Dictionary();
+	queryParams->Set("type", "Host");
+	queryParams->Set("filter", R"(match("limited*", host.name) && host.vars.n % 2 == 1)");
+
+	std::vector<Value> all, limited;
+	BOOST_REQUIRE_NO_THROW(all = FilterUtility::GetFilterTargets(qd, queryParams, user));
+	BOOST_REQUIRE_EQUAL(all.size(), 10);
+
+	// The first ones found are returned, in the same order.
+	qd.Limit = 3;
+	BOOST_REQUIRE_NO_THROW(limited = FilterUtility::GetFilterTargets(qd, queryParams, user));
+	BOOST_CHECK(limited == std::vector<Value>(all.begin(), all.begin() + 3));
+
+	qd.Limit = 100;
+	BOOST_REQUIRE_NO_THROW(limited = FilterUtility::GetFilterTargets(qd, queryParams, user));
+	BOOST_CHECK(limited == all);
+
+	queryParams->Remove("filter");
+	queryParams->Set("hosts", new Array({ "limited1", "limited2", "limited3" }));
+	qd.Limit = 2;
+	BOOST_REQUIRE_NO_THROW(limited = FilterUtility::GetFilterTargets(qd, queryParams, user));
+	BOOST_CHECK_EQUAL(limited.size(), 2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,245 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include <BoostTestTargetConfig.h>
+#include "base/convert.hpp"
+#include "base/defer.hpp"
+#include "base/json.hpp"
+#include "base/scriptglobal.hpp"
+#include "remote/apilistener.hpp"
+#include "remote/endpoint.hpp"
+#include "remote/jsonrpc.hpp"
+#include "remote/jsonrpcconnection.hpp"
+#include "test/base-configuration-fixture.hpp"
+#include "test/base-tlsstream-fixture.hpp"
+#include "test/test-ctest.hpp"
+#include <vector>
+
+using namespace icinga;
+
+struct JsonRpcConnectionFixture : TlsStreamFixture, ConfigurationCacheDirFixture
+{
+	JsonRpcConnectionFixture()
+	{
+		ScriptGlobal::Set("NodeName", "server");
+
+		/* There can only be one ApiListener, so the test cases share it. */
+		if (!ApiListener::GetInstance()) {
+			ApiListener::Ptr listener = new ApiListener;
+			listener->OnConfigLoaded();
+		}
+	}
+};
+
+static Dictionary::Ptr MakeMessage(const String& method, double ts)
+{
+	return new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", method },
+		{ "ts", ts },
+		{ "params", new Dictionary() }
+	});
+}
+
+static Dictionary::Ptr MakeSetNextCheck(const String& host, double nextCheck)
+{
+	return new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "event::SetNextCheck" },
+		{ "ts", 1 },
+		{ "params", new Dictionary({
+			{ "host", host },
+			{ "next_check", nextCheck }
+		}) }
+	});
+}
+
+static void SendEncodedMessage(const JsonRpcConnection::Ptr& connection, const Dictionary::Ptr& message, bool force = false)
+{
+	EncodedJsonRpcMessage::Ptr encodedMessage = new EncodedJsonRpcMessage(JsonEncode(message), JsonRpc::GetMessagePriority(message), message);
+
+	BOOST_REQUIRE(connection->SendEncodedMessage(encodedMessage, force));
+}
+
+/* Reads the messages with a "ts" up to and including the check result with the given one. */
+static std::vector<Dictionary::Ptr> ReadMessagesUntil(const Shared<AsioTlsStream>::Ptr& stream, double ts)
+{
+	std::vector<Dictionary::Ptr> messages;
+
+	for (;;) {
+		Dictionary::Ptr message = JsonRpc::DecodeMessage(JsonRpc::ReadMessage(stream));
+
+		/* Heartbeats don't carry a "ts" and may be sent at any time. */
+		if (!message->Contains("ts")) {
+			continue;
+		}
+
+		messages.push_back(message);
+
+		if (message->Get("method") == "event::CheckResult" && message->Get("ts") == ts) {
+			return messages;
+		}
+	}
+}
+
+// clang-format off
+BOOST_FIXTURE_TEST_SUITE(remote_jsonrpcconnection, JsonRpcConnectionFixture,
+	*CTestProperties("FIXTURES_REQUIRED ssl_certs")
+	*boost::unit_test::label("cluster"))
+// clang-format on
+
+BOOST_AUTO_TEST_CASE(priority)
+{
+	BOOST_CHECK(JsonRpc::GetMessagePriority(new Dictionary({{ "method", "event::Heartbeat" }})) == JsonRpcPriority::High);
+	BOOST_CHECK(JsonRpc::GetMessagePriority(new Dictionary({{ "method", "config::UpdateObject" }})) == JsonRpcPriority::High);
+
+	/* Relayed messages carry a "ts" and must never overtake each other. */
+	BOOST_CHECK(JsonRpc::GetMessagePriority(MakeMessage("config::UpdateObject", 1)) == JsonRpcPriority::Normal);
+	BOOST_CHECK(JsonRpc::GetMessagePriority(MakeMessage("config::DeleteObject", 1)) == JsonRpcPriority::Normal);
+	BOOST_CHECK(JsonRpc::GetMessagePriority(MakeMessage("event::Heartbeat", 1)) == JsonRpcPriority::Normal);
+}
+
+BOOST_AUTO_TEST_CASE(no_overtaking)
+{
+	JsonRpcConnection::Ptr connection = new JsonRpcConnection(new StoppableWaitGroup(), "client", false, server, RoleServer);
+
+	/* Queue check results and then a config update, all before the writer runs. */
+	for (int i = 1; i <= 10; i++) {
+		connection->SendMessage(MakeMessage("event::CheckResult", i));
+	}
+
+	connection->SendMessage(MakeMessage("config::UpdateObject", 11));
+	connection->SendMessage(new Dictionary({{ "jsonrpc", "2.0" }, { "method", "event::Heartbeat" }, { "params", new Dictionary() }}));
+
+	connection->Start();
+
+	std::vector<double> timestamps;
+
+	while (timestamps.size() < 11) {
+		Dictionary::Ptr message = JsonRpc::DecodeMessage(JsonRpc::ReadMessage(client));
+
+		/* Heartbeats don't carry a "ts" and may be sent at any time. */
+		if (message->Contains("ts")) {
+			timestamps.push_back(message->Get("ts"));
+		}
+	}
+
+	/* The receiver would drop every message older than the config update. */
+	for (size_t i = 1; i < timestamps.size(); i++) {
+		BOOST_CHECK_LT(timestamps[i - 1], timestamps[i]);
+	}
+
+	connection->Disconnect();
+	BOOST_REQUIRE(Shutdown(client));
+}
+
+BOOST_AUTO_TEST_CASE(coalescing)
+{
+	Endpoint::Ptr endpoint = new Endpoint();
+	endpoint->SetName("client", true);
+	endpoint->Register();
+
+	Defer unregister ([&endpoint]() { endpoint->Unregister(); });
+
+	JsonRpcConnection::Ptr connection = new JsonRpcConnection(new StoppableWaitGroup(), "client", true, server, RoleServer);
+	BOOST_REQUIRE(connection->GetEndpoint() == endpoint);
+
+	auto coalesced (JsonRpcConnection::GetCoalescedMessages());
+
+	/* Queue several next checks per host, all before the writer runs. */
+	SendEncodedMessage(connection, MakeSetNextCheck("h1", 1));
+	SendEncodedMessage(connection, MakeSetNextCheck("h2", 1));
+	SendEncodedMessage(connection, MakeMessage("event::CheckResult", 1));
+	SendEncodedMessage(connection, MakeSetNextCheck("h1", 2));
+	SendEncodedMessage(connection, MakeSetNextCheck("h1", 3));
+	SendEncodedMessage(connection, MakeSetNextCheck("h2", 2));
+	SendEncodedMessage(connection, MakeMessage("event::CheckResult", 2));
+
+	connection->Start();
+
+	auto messages (ReadMessagesUntil(client, 2));
+
+	/* Only the newest next check per host is sent, in place of the last one queued. */
+	BOOST_REQUIRE_EQUAL(messages.size(), 4);
+	BOOST_CHECK_EQUAL(messages[0]->Get("method"), "event::CheckResult");
+	BOOST_CHECK_EQUAL(messages[0]->Get("ts"), 1);
+
+	for (size_t i : { 1, 2 }) {
+		Dictionary::Ptr params = messages[i]->Get("params");
+
+		BOOST_CHECK_EQUAL(messages[i]->Get("method"), "event::SetNextCheck");
+		BOOST_CHECK_EQUAL(params->Get("host"), i == 1 ? "h1" : "h2");
+		BOOST_CHECK_EQUAL(params->Get("next_check"), i == 1 ? 3 : 2);
+	}
+
+	BOOST_CHECK_EQUAL(messages[3]->Get("method"), "event::CheckResult");
+	BOOST_CHECK_EQUAL(messages[3]->Get("ts"), 2);
+
+	BOOST_CHECK_EQUAL(endpoint->GetMessagesCoalesced(), 3);
+	BOOST_CHECK_EQUAL(JsonRpcConnection::GetCoalescedMessages() - coalesced, 3);
+
+	connection->Disconnect();
+	BOOST_REQUIRE(Shutdown(client));
+}
+
+BOOST_AUTO_TEST_CASE(dropping)
+{
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+	auto maxOutgoingQueueSize (listener->GetMaxOutgoingQueueSize());
+
+	Defer restore ([&listener, maxOutgoingQueueSize]() { listener->SetMaxOutgoingQueueSize(maxOutgoingQueueSize); });
+
+	std::vector<Dictionary::Ptr> nextChecks;
+
+	for (int i = 0; i < 10; i++) {
+		nextChecks.emplace_back(MakeSetNextCheck("h" + Convert::ToString(i), 1));
+	}
+
+	Dictionary::Ptr checkResult = MakeMessage("event::CheckResult", 1);
+	size_t nextCheckSize = JsonEncode(nextChecks[0]).GetLength();
+	size_t checkResultSize = JsonEncode(checkResult).GetLength();
+
+	for (auto& nextCheck : nextChecks) {
+		BOOST_REQUIRE_EQUAL(JsonEncode(nextCheck).GetLength(), nextCheckSize);
+	}
+
+	/* Room for a few next checks besides the check result, but not for all of them. */
+	size_t budget = 5 * nextCheckSize;
+	size_t kept = (budget - checkResultSize) / nextCheckSize;
+
+	BOOST_REQUIRE(checkResultSize < budget);
+	BOOST_REQUIRE(kept > 0);
+
+	listener->SetMaxOutgoingQueueSize(budget);
+
+	JsonRpcConnection::Ptr connection = new JsonRpcConnection(new StoppableWaitGroup(), "client", false, server, RoleServer);
+	auto dropped (JsonRpcConnection::GetDroppedMessages());
+
+	for (auto& nextCheck : nextChecks) {
+		SendEncodedMessage(connection, nextCheck);
+	}
+
+	/* Forced, so that it's queued no matter how far the next checks have been queued yet. */
+	SendEncodedMessage(connection, checkResult, true);
+
+	connection->Start();
+
+	auto messages (ReadMessagesUntil(client, 1));
+
+	/* The oldest next checks have been dropped to make room for the check result. */
+	BOOST_REQUIRE_EQUAL(messages.size(), kept + 1);
+
+	for (size_t i = 0; i < kept; i++) {
+		Dictionary::Ptr params = messages[i]->Get("params");
+
+		BOOST_CHECK_EQUAL(messages[i]->Get("method"), "event::SetNextCheck");
+		BOOST_CHECK_EQUAL(params->Get("host"), "h" + Convert::ToString(nextChecks.size() - kept + i));
+	}
+
+	BOOST_CHECK_EQUAL(messages[kept]->Get("method"), "event::CheckResult");
+	BOOST_CHECK_EQUAL(JsonRpcConnection::GetDroppedMessages() - dropped, nextChecks.size() - kept);
+
+	connection->Disconnect();
+	BOOST_REQUIRE(Shutdown(client));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
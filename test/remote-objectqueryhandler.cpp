@@ -0,0 +1,339 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include <BoostTestTargetConfig.h>
+#include "base/base64.hpp"
+#include "base/io-engine.hpp"
+#include "base/json.hpp"
+#include "config/configcompiler.hpp"
+#include "config/configitem.hpp"
+#include "icinga/host.hpp"
+#include "remote/apiuser.hpp"
+#include "remote/httpmessage.hpp"
+#include "remote/objectqueryhandler.hpp"
+#include "remote/url-characters.hpp"
+#include "test/icingaapplication-fixture.hpp"
+#include <boost/beast/core/buffers_to_string.hpp>
+#include <future>
+
+using namespace icinga;
+
+struct ObjectQueryHandlerFixture : IcingaApplicationFixture
+{
+	ApiUser::Ptr m_User;
+
+	ObjectQueryHandlerFixture()
+	{
+		m_User = ApiUser::GetByName("pagingUser");
+
+		if (!m_User) {
+			CreateObjects(R"CONFIG(
+object CheckCommand "paging-dummy" {
+  command = "/bin/echo"
+}
+
+object ApiUser "pagingUser" {
+  permissions = [ "*" ]
+}
+)CONFIG");
+
+			m_User = ApiUser::GetByName("pagingUser");
+		}
+
+		/* Three objects each with the same check_interval, to test the order by name. */
+		CreateObjects(R"CONFIG(
+for (n in range(12)) {
+  object Host "paged" + n {
+    check_command = "paging-dummy"
+    check_interval = 60 + n % 4
+    vars.paged = true
+  }
+}
+)CONFIG");
+	}
+
+	~ObjectQueryHandlerFixture()
+	{
+		for (auto& host : ConfigType::GetObjectsByType<Host>()) {
+			if (host->GetVars() && host->GetVars()->Get("paged")) {
+				DeleteHost(host->GetName());
+			}
+		}
+	}
+
+	static void DeleteHost(const String& name)
+	{
+		Host::GetByName(name)->Deactivate(true);
+		ConfigItem::GetByTypeAndName(Host::TypeInstance, name)->Unregister();
+	}
+
+	static String EscapeCursor(const String& cursor)
+	{
+		return Utility::EscapeString(cursor, ACQUERY_ENCODE, false);
+	}
+
+	static void CreateObjects(const String& config)
+	{
+		ConfigItem::RunWithActivationContext(new Function("CreateTestObjects", [config]() {
+			std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<test>", config);
+			expr->Evaluate(*ScriptFrame::GetCurrentFrame());
+		}));
+	}
+
+	/**
+	 * Queries the paged hosts.
+	 *
+	 * @param query The URL parameters
+	 * @param status Receives the HTTP status
+	 * @return The response body
+	 */
+	Dictionary::Ptr Query(const String& query, unsigned& status)
+	{
+		HttpRequest request (nullptr);
+		HttpResponse response (nullptr);
+
+		request.target("/v1/objects/hosts?attrs=name&" + query);
+		request.body() = JsonEncode(new Dictionary({ { "filter", "host.vars.paged" } }));
+		request.User(m_User);
+		request.DecodeParams();
+
+		std::promise<void> done;
+
+		IoEngine::SpawnCoroutine(IoEngine::Get().GetIoContext(), [&](boost::asio::yield_context yc) {
+			try {
+				ObjectQueryHandler::Ptr handler = new ObjectQueryHandler();
+				handler->HandleRequest(nullptr, request, response, yc);
+			} catch (const std::exception&) {
+				done.set_exception(std::current_exception());
+				return;
+			}
+
+			done.set_value();
+		});
+
+		done.get_future().get();
+
+		status = response.result_int();
+		return JsonDecode(boost::beast::buffers_to_string(response.body().Buffer().data()));
+	}
+
+	/**
+	 * Queries the paged hosts and expects the query to succeed.
+	 *
+	 * @param query The URL parameters
+	 * @param names Receives the names of the hosts found
+	 * @return The next cursor, if any
+	 */
+	String QueryNames(const String& query, std::vector<String>& names)
+	{
+		unsigned status;
+		Dictionary::Ptr body = Query(query, status);
+
+		BOOST_REQUIRE_EQUAL(status, 200);
+
+		Array::Ptr results = body->Get("results");
+
+		names.clear();
+
+		ObjectLock olock (results);
+
+		for (Dictionary::Ptr result : results) {
+			names.emplace_back(result->Get("name"));
+		}
+
+		return body->Get("next_cursor");
+	}
+
+	/**
+	 * Queries the paged hosts page by page, following the cursors.
+	 */
+	std::vector<String> QueryAllPages(const String& query)
+	{
+		std::vector<String> all, page;
+		String cursor = QueryNames(query, page);
+
+		all.insert(all.end(), page.begin(), page.end());
+
+		while (!cursor.IsEmpty()) {
+			BOOST_REQUIRE(!page.empty());
+
+			cursor = QueryNames("limit=5&cursor=" + EscapeCursor(cursor), page);
+			all.insert(all.end(), page.begin(), page.end());
+		}
+
+		return all;
+	}
+
+	/**
+	 * The names of the paged hosts ordered by check_interval and name.
+	 */
+	static std::vector<String> GetOrderedNames(bool descending)
+	{
+		std::vector<std::pair<double, String>> hosts;
+
+		for (auto& host : ConfigType::GetObjectsByType<Host>()) {
+			if (host->GetVars() && host->GetVars()->Get("paged")) {
+				hosts.emplace_back(host->GetCheckInterval(), host->GetName());
+			}
+		}
+
+		std::sort(hosts.begin(), hosts.end(), [descending](const auto& lhs, const auto& rhs) {
+			if (lhs.first != rhs.first) {
+				return descending ? lhs.first > rhs.first : lhs.first < rhs.first;
+			}
+
+			return lhs.second < rhs.second;
+		});
+
+		std::vector<String> names;
+
+		for (auto& host : hosts) {
+			names.emplace_back(host.second);
+		}
+
+		return names;
+	}
+};
+
+// clang-format off
+BOOST_FIXTURE_TEST_SUITE(remote_objectqueryhandler, ObjectQueryHandlerFixture,
+	*boost::unit_test::label("config"))
+// clang-format on
+
+BOOST_AUTO_TEST_CASE(order)
+{
+	std::vector<String> names;
+
+	BOOST_CHECK(QueryNames("order_by=check_interval", names).IsEmpty());
+	BOOST_CHECK(names == GetOrderedNames(false));
+
+	BOOST_CHECK(QueryNames("order_by=check_interval&order=desc", names).IsEmpty());
+	BOOST_CHECK(names == GetOrderedNames(true));
+}
+
+BOOST_AUTO_TEST_CASE(limit_offset)
+{
+	auto ordered (GetOrderedNames(false));
+	std::vector<String> names;
+
+	// Only the first offset + limit + 1 objects are kept in the heap, that must not change the result.
+	BOOST_CHECK(!QueryNames("order_by=check_interval&limit=4&offset=2", names).IsEmpty());
+	BOOST_CHECK(names == std::vector<String>(ordered.begin() + 2, ordered.begin() + 6));
+
+	// No cursor if there are no more objects.
+	BOOST_CHECK(QueryNames("order_by=check_interval&limit=4&offset=8", names).IsEmpty());
+	BOOST_CHECK(names == std::vector<String>(ordered.begin() + 8, ordered.end()));
+
+	BOOST_CHECK(QueryNames("order_by=check_interval&limit=4&offset=12", names).IsEmpty());
+	BOOST_CHECK(names.empty());
+
+	BOOST_CHECK(QueryNames("order_by=check_interval&limit=0", names).IsEmpty());
+	BOOST_CHECK(names.empty());
+
+	// Huge values are capped rather than wrapping around.
+	BOOST_CHECK(QueryNames("order_by=check_interval&limit=1e300&offset=1e300", names).IsEmpty());
+	BOOST_CHECK(names.empty());
+
+	BOOST_CHECK(QueryNames("limit=1e300", names).IsEmpty());
+	BOOST_CHECK_EQUAL(names.size(), 12);
+
+	BOOST_CHECK(QueryNames("limit=5&offset=9", names).IsEmpty());
+	BOOST_CHECK_EQUAL(names.size(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(cursor)
+{
+	// Ordered cursors continue after the (key, name) of the last object.
+	BOOST_CHECK(QueryAllPages("order_by=check_interval&limit=5") == GetOrderedNames(false));
+	BOOST_CHECK(QueryAllPages("order_by=check_interval&order=desc&limit=5") == GetOrderedNames(true));
+
+	// Unordered cursors continue at an offset.
+	auto all (QueryAllPages("limit=5"));
+	std::sort(all.begin(), all.end());
+
+	auto ordered (GetOrderedNames(false));
+	std::sort(ordered.begin(), ordered.end());
+
+	BOOST_CHECK(all == ordered);
+
+	std::vector<String> names;
+	String cursor = QueryNames("limit=5", names);
+
+	Dictionary::Ptr position = JsonDecode(Base64::Decode(cursor));
+	BOOST_CHECK_EQUAL(position->Get("offset"), 5);
+	BOOST_CHECK(!position->Contains("order_by"));
+}
+
+BOOST_AUTO_TEST_CASE(cursor_across_changes)
+{
+	auto ordered (GetOrderedNames(false));
+	std::vector<String> names;
+
+	String cursor = QueryNames("order_by=check_interval&limit=5", names);
+	BOOST_REQUIRE(names == std::vector<String>(ordered.begin(), ordered.begin() + 5));
+
+	Dictionary::Ptr position = JsonDecode(Base64::Decode(cursor));
+	BOOST_CHECK_EQUAL(position->Get("order_by"), "check_interval");
+	BOOST_CHECK_EQUAL(position->Get("order"), "asc");
+	BOOST_CHECK_EQUAL(position->Get("name"), ordered[4]);
+
+	// Neither deleting an object before the cursor nor creating one there shifts the next page.
+	DeleteHost(ordered[0]);
+
+	CreateObjects(R"CONFIG(
+object Host "paged-before" {
+  check_command = "paging-dummy"
+  check_interval = 1
+  vars.paged = true
+}
+
+object Host "paged-after" {
+  check_command = "paging-dummy"
+  check_interval = 1000
+  vars.paged = true
+}
+)CONFIG");
+
+	BOOST_CHECK(!QueryNames("limit=5&cursor=" + EscapeCursor(cursor), names).IsEmpty());
+	BOOST_CHECK(names == std::vector<String>(ordered.begin() + 5, ordered.begin() + 10));
+
+	// The object the cursor refers to may be gone, too.
+	DeleteHost(ordered[5]);
+
+	BOOST_CHECK(QueryNames("limit=10&cursor=" + EscapeCursor(cursor), names).IsEmpty());
+
+	std::vector<String> expected (ordered.begin() + 6, ordered.end());
+	expected.emplace_back("paged-after");
+
+	BOOST_CHECK(names == expected);
+}
+
+BOOST_AUTO_TEST_CASE(errors)
+{
+	std::vector<String> names;
+	String cursor = QueryNames("order_by=check_interval&limit=5", names);
+	String offsetCursor = QueryNames("limit=5", names);
+
+	auto checkError ([this](const String& query, const String& message) {
+		unsigned status;
+		Dictionary::Ptr body = Query(query, status);
+
+		BOOST_CHECK_EQUAL(status, 400);
+		BOOST_CHECK_EQUAL(body->Get("status"), message);
+	});
+
+	checkError("limit=-1", "Invalid value for 'limit' specified. Non-negative integer is required.");
+	checkError("offset=1.5", "Invalid value for 'offset' specified. Non-negative integer is required.");
+	checkError("order=sideways", "Invalid value for 'order' specified. Must be 'asc' or 'desc'.");
+	checkError("order_by=nonexistent", "Invalid field specified for order_by: nonexistent");
+	checkError("cursor=garbage", "Invalid cursor specified.");
+	checkError("cursor=" + EscapeCursor(Base64::Encode("{}")), "Invalid cursor specified.");
+
+	// The cursor must be used with the order it has been returned for.
+	checkError("order_by=name&cursor=" + EscapeCursor(cursor), "The cursor doesn't match the specified order.");
+	checkError("order=desc&cursor=" + EscapeCursor(cursor), "The cursor doesn't match the specified order.");
+	checkError("order_by=check_interval&cursor=" + EscapeCursor(offsetCursor), "The cursor doesn't match the specified order.");
+
+	BOOST_CHECK(!QueryNames("order_by=check_interval&order=asc&limit=5&cursor=" + EscapeCursor(cursor), names).IsEmpty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,140 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "remote/relaysequencer.hpp"
+#include "base/utility.hpp"
+#include "base/workqueue.hpp"
+#include <BoostTestTargetConfig.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(remote_relaysequencer)
+
+BOOST_AUTO_TEST_CASE(later_queue_waits)
+{
+	RelaySequencer sequencer;
+	Endpoint::Ptr endpoint = new Endpoint();
+	std::vector<double> received;
+
+	RelayTicket zoneA = sequencer.Stamp({ endpoint });
+	RelayTicket zoneB = sequencer.Stamp({ endpoint });
+
+	BOOST_CHECK_LT(zoneA.Timestamp, zoneB.Timestamp);
+
+	/* The queue of zone B is done first, but its message must not overtake the one of zone A. */
+	sequencer.Deliver(zoneB, endpoint, [&received, zoneB]() { received.push_back(zoneB.Timestamp); });
+	BOOST_CHECK(received.empty());
+
+	sequencer.Deliver(zoneA, endpoint, [&received, zoneA]() { received.push_back(zoneA.Timestamp); });
+	BOOST_REQUIRE_EQUAL(received.size(), 2);
+	BOOST_CHECK_EQUAL(received[0], zoneA.Timestamp);
+	BOOST_CHECK_EQUAL(received[1], zoneB.Timestamp);
+
+	/* Messages with nothing to send still keep their place. */
+	RelayTicket empty = sequencer.Stamp({ endpoint });
+	RelayTicket zoneC = sequencer.Stamp({ endpoint });
+
+	sequencer.Deliver(zoneC, endpoint, [&received, zoneC]() { received.push_back(zoneC.Timestamp); });
+	BOOST_CHECK_EQUAL(received.size(), 2);
+
+	sequencer.Deliver(empty, endpoint, nullptr);
+	BOOST_CHECK_EQUAL(received.size(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(other_endpoints_dont_wait)
+{
+	RelaySequencer sequencer;
+	Endpoint::Ptr childA = new Endpoint();
+	Endpoint::Ptr childB = new Endpoint();
+	Endpoint::Ptr parent = new Endpoint();
+	std::vector<double> receivedA, receivedB, receivedParent;
+
+	RelayTicket zoneA = sequencer.Stamp({ childA, parent });
+	RelayTicket zoneB = sequencer.Stamp({ childB, parent });
+
+	/* Zone A's message is still being routed, zone B's endpoint gets its message anyway... */
+	sequencer.Deliver(zoneB, childB, [&receivedB, zoneB]() { receivedB.push_back(zoneB.Timestamp); });
+	sequencer.Deliver(zoneB, parent, [&receivedParent, zoneB]() { receivedParent.push_back(zoneB.Timestamp); });
+
+	BOOST_CHECK_EQUAL(receivedB.size(), 1);
+
+	/* ... but the endpoint both messages go to has to wait for zone A's. */
+	BOOST_CHECK(receivedParent.empty());
+
+	sequencer.Deliver(zoneA, childA, [&receivedA, zoneA]() { receivedA.push_back(zoneA.Timestamp); });
+	sequencer.Deliver(zoneA, parent, [&receivedParent, zoneA]() { receivedParent.push_back(zoneA.Timestamp); });
+
+	BOOST_CHECK_EQUAL(receivedA.size(), 1);
+	BOOST_REQUIRE_EQUAL(receivedParent.size(), 2);
+	BOOST_CHECK_EQUAL(receivedParent[0], zoneA.Timestamp);
+	BOOST_CHECK_EQUAL(receivedParent[1], zoneB.Timestamp);
+}
+
+BOOST_AUTO_TEST_CASE(backlogged_zone)
+{
+	RelaySequencer sequencer;
+	WorkQueue zoneA, zoneB;
+	Endpoint::Ptr childA = new Endpoint();
+	Endpoint::Ptr childB = new Endpoint();
+	Endpoint::Ptr parent = new Endpoint();
+	std::atomic<bool> releaseA (false);
+	std::mutex mutex;
+	std::vector<double> receivedA, receivedB, receivedParent;
+
+	/* Like ApiListener::RelayMessage(): route in the zone's queue, then send to the zone's endpoint and to the parent. */
+	auto relay ([&sequencer, &mutex, &receivedParent, &parent](WorkQueue& queue, const Endpoint::Ptr& child, std::vector<double>& received) {
+		RelayTicket ticket = sequencer.Stamp({ child, parent });
+
+		queue.Enqueue([&sequencer, &mutex, &received, &receivedParent, child, parent, ticket]() {
+			sequencer.Deliver(ticket, child, [&mutex, &received, ticket]() {
+				std::unique_lock<std::mutex> lock (mutex);
+				received.push_back(ticket.Timestamp);
+			});
+
+			sequencer.Deliver(ticket, parent, [&mutex, &receivedParent, ticket]() {
+				std::unique_lock<std::mutex> lock (mutex);
+				receivedParent.push_back(ticket.Timestamp);
+			});
+		});
+	});
+
+	/* Zone A's queue is stuck... */
+	zoneA.Enqueue([&releaseA]() {
+		while (!releaseA.load()) {
+			Utility::Sleep(0.001);
+		}
+	});
+
+	for (int i = 0; i < 1000; i++) {
+		relay(i % 2 ? zoneB : zoneA, i % 2 ? childB : childA, i % 2 ? receivedB : receivedA);
+	}
+
+	/* ... which doesn't keep zone B's endpoint from getting its messages. */
+	zoneB.Join();
+
+	{
+		std::unique_lock<std::mutex> lock (mutex);
+
+		BOOST_CHECK_EQUAL(receivedA.size(), 0);
+		BOOST_CHECK_EQUAL(receivedB.size(), 500);
+		BOOST_CHECK_EQUAL(receivedParent.size(), 0);
+	}
+
+	releaseA.store(true);
+	zoneA.Join();
+
+	BOOST_CHECK_EQUAL(receivedA.size(), 500);
+	BOOST_REQUIRE_EQUAL(receivedParent.size(), 1000);
+
+	for (size_t i = 1; i < receivedParent.size(); i++) {
+		BOOST_CHECK_LT(receivedParent[i - 1], receivedParent[i]);
+	}
+
+	for (size_t i = 1; i < receivedB.size(); i++) {
+		BOOST_CHECK_LT(receivedB[i - 1], receivedB[i]);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,371 @@
+/* Icinga 2 | (c) 2025 Icinga GmbH | GPLv2+ */
+
+#include "remote/replaylog.hpp"
+#include "base/json.hpp"
+#include "base/dictionary.hpp"
+#include "base/netstring.hpp"
+#include "base/stdiostream.hpp"
+#include "test/base-configuration-fixture.hpp"
+#include <BoostTestTargetConfig.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+using namespace icinga;
+
+static void WriteMessages(const String& path, int from, int to)
+{
+	ReplayLogWriter writer (path);
+
+	BOOST_REQUIRE(writer.IsOpen());
+
+	for (int i = from; i < to; i++) {
+		writer.Write(i, i % 2 ? "Host" : "", i % 2 ? "host" + std::to_string(i) : "", i % 2 ? "zone" + std::to_string(i % 3) : "",
+			"event::CheckResult", "message" + std::to_string(i));
+	}
+}
+
+static std::vector<double> ReadTimestamps(const String& path, double seek = -1)
+{
+	ReplayLogReader reader (path);
+	ReplayLogRecord record;
+	std::vector<double> timestamps;
+
+	BOOST_REQUIRE(reader.IsOpen());
+
+	if (seek >= 0) {
+		reader.Seek(seek);
+	}
+
+	while (reader.Read(record)) {
+		timestamps.emplace_back(record.Timestamp);
+	}
+
+	return timestamps;
+}
+
+BOOST_FIXTURE_TEST_SUITE(remote_replaylog, ConfigurationDataDirFixture)
+
+BOOST_AUTO_TEST_CASE(write_read)
+{
+	String path = (m_DataDir / "current").string();
+
+	WriteMessages(path, 0, 3);
+
+	ReplayLogReader reader (path);
+	ReplayLogRecord record;
+
+	for (int i = 0; i < 3; i++) {
+		BOOST_REQUIRE(reader.Read(record));
+		BOOST_CHECK_EQUAL(record.Timestamp, i);
+		BOOST_CHECK_EQUAL(record.SecobjType, i % 2 ? "Host" : "");
+		BOOST_CHECK_EQUAL(record.SecobjName, i % 2 ? "host" + std::to_string(i) : "");
+		BOOST_CHECK_EQUAL(record.Zone, i % 2 ? "zone" + std::to_string(i % 3) : "");
+		BOOST_CHECK_EQUAL(record.Method, "event::CheckResult");
+		BOOST_CHECK_EQUAL(record.Message, "message" + std::to_string(i));
+	}
+
+	BOOST_CHECK(!reader.Read(record));
+}
+
+BOOST_AUTO_TEST_CASE(filter)
+{
+	String path = (m_DataDir / "current").string();
+
+	WriteMessages(path, 0, 12);
+
+	ReplayLogReader reader (path);
+	ReplayLogRecord record;
+	std::vector<double> timestamps;
+
+	auto filter ([](const ReplayLogRecord& record) {
+		/* The message isn't read yet. */
+		BOOST_CHECK(record.Message.IsEmpty());
+
+		return record.Zone == "zone1";
+	});
+
+	while (reader.Read(record, filter)) {
+		timestamps.emplace_back(record.Timestamp);
+		BOOST_CHECK_EQUAL(record.Message, "message" + std::to_string(int(record.Timestamp)));
+		record.Message = "";
+	}
+
+	BOOST_CHECK(timestamps == std::vector<double>({ 1, 7 }));
+}
+
+BOOST_AUTO_TEST_CASE(seek)
+{
+	String path = (m_DataDir / "current").string();
+	ReplayLogWriter writer (path);
+
+	for (int i = 0; i < 1000; i++) {
+		writer.Write(i, "", "", "", "", "message");
+	}
+
+	/* Not closed yet, so there's no index. */
+	writer.Flush();
+
+	auto timestamps (ReadTimestamps(path, 700));
+	BOOST_REQUIRE(!timestamps.empty());
+	BOOST_CHECK_EQUAL(timestamps.front(), 701);
+	BOOST_CHECK_EQUAL(timestamps.back(), 999);
+
+	writer.Close();
+
+	/* The index only allows to skip whole blocks of messages. */
+	timestamps = ReadTimestamps(path, 700);
+	BOOST_REQUIRE(!timestamps.empty());
+	BOOST_CHECK(timestamps.front() <= 701);
+	BOOST_CHECK(timestamps.front() > 400);
+	BOOST_CHECK_EQUAL(timestamps.back(), 999);
+
+	BOOST_CHECK_EQUAL(ReadTimestamps(path, 0).size(), 1000);
+	BOOST_CHECK_EQUAL(ReadTimestamps(path, 5000).size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(append)
+{
+	String path = (m_DataDir / "current").string();
+
+	WriteMessages(path, 0, 300);
+	WriteMessages(path, 300, 600);
+
+	{
+		ReplayLogWriter writer (path);
+		BOOST_CHECK_EQUAL(writer.GetRecordCount(), 600);
+	}
+
+	auto timestamps (ReadTimestamps(path));
+	BOOST_REQUIRE_EQUAL(timestamps.size(), 600);
+
+	for (int i = 0; i < 600; i++) {
+		BOOST_CHECK_EQUAL(timestamps[i], i);
+	}
+
+	BOOST_CHECK_EQUAL(ReadTimestamps(path, 550).back(), 599);
+}
+
+BOOST_AUTO_TEST_CASE(recover)
+{
+	String path = (m_DataDir / "current").string();
+
+	WriteMessages(path, 0, 10);
+
+	{
+		/* Simulate a crash in the middle of a record. */
+		std::ifstream ifp (path.CStr(), std::ios::binary);
+		char header[20];
+		ifp.read(header, sizeof(header));
+
+		std::ofstream ofp (path.CStr(), std::ios::binary | std::ios::app);
+		ofp.write(header, sizeof(header));
+	}
+
+	BOOST_CHECK_THROW(ReadTimestamps(path), std::runtime_error);
+
+	WriteMessages(path, 100, 101);
+
+	auto timestamps (ReadTimestamps(path));
+	BOOST_REQUIRE_EQUAL(timestamps.size(), 11);
+	BOOST_CHECK_EQUAL(timestamps[9], 9);
+	BOOST_CHECK_EQUAL(timestamps[10], 100);
+}
+
+BOOST_AUTO_TEST_CASE(compress)
+{
+	String path = (m_DataDir / "1000").string();
+
+	WriteMessages(path, 0, 1000);
+
+	String compressedPath = path + ".tmp";
+	std::uint64_t inputBytes, outputBytes;
+	ReplayLogWriter::CompressFile(path, compressedPath, inputBytes, outputBytes);
+
+	BOOST_CHECK(outputBytes < inputBytes / 2);
+	BOOST_CHECK_EQUAL(boost::filesystem::file_size(path.GetData()), inputBytes);
+	BOOST_CHECK_EQUAL(boost::filesystem::file_size(compressedPath.GetData()), outputBytes);
+
+	boost::filesystem::rename(compressedPath.GetData(), path.GetData());
+
+	{
+		ReplayLogReader reader (path);
+		ReplayLogRecord record;
+
+		for (int i = 0; i < 1000; i++) {
+			BOOST_REQUIRE(reader.Read(record));
+			BOOST_CHECK_EQUAL(record.Timestamp, i);
+			BOOST_CHECK_EQUAL(record.SecobjName, i % 2 ? "host" + std::to_string(i) : "");
+			BOOST_CHECK_EQUAL(record.Zone, i % 2 ? "zone" + std::to_string(i % 3) : "");
+			BOOST_CHECK_EQUAL(record.Message, "message" + std::to_string(i));
+		}
+
+		BOOST_CHECK(!reader.Read(record));
+	}
+
+	auto timestamps (ReadTimestamps(path, 700));
+	BOOST_REQUIRE(!timestamps.empty());
+	BOOST_CHECK(timestamps.front() <= 701);
+	BOOST_CHECK(timestamps.front() > 400);
+	BOOST_CHECK_EQUAL(timestamps.back(), 999);
+
+	ReplayLogReader reader (path);
+	ReplayLogRecord record;
+	size_t count = 0;
+
+	while (reader.Read(record, [](const ReplayLogRecord& record) { return record.Zone == "zone1"; })) {
+		count++;
+	}
+
+	BOOST_CHECK_EQUAL(count, 167);
+}
+
+BOOST_AUTO_TEST_CASE(legacy)
+{
+	String path = (m_DataDir / "1000").string();
+
+	{
+		auto *fp = new std::fstream(path.CStr(), std::fstream::out | std::fstream::binary);
+		StdioStream::Ptr logStream = new StdioStream(fp, true);
+
+		for (int i = 0; i < 3; i++) {
+			Dictionary::Ptr pmessage = new Dictionary({
+				{ "timestamp", double(i) },
+				{ "message", String("message" + std::to_string(i)) }
+			});
+
+			if (i % 2) {
+				pmessage->Set("secobj", new Dictionary({
+					{ "type", "Host" },
+					{ "name", String("host" + std::to_string(i)) }
+				}));
+			}
+
+			NetString::WriteStringToStream(logStream, JsonEncode(pmessage));
+		}
+
+		logStream->Close();
+	}
+
+	BOOST_CHECK(ReplayLogWriter::ConvertLegacyFile(path));
+	BOOST_CHECK(!ReplayLogWriter::ConvertLegacyFile(path));
+	BOOST_CHECK(!boost::filesystem::exists(path.GetData() + ".tmp"));
+
+	ReplayLogReader reader (path);
+	ReplayLogRecord record;
+
+	for (int i = 0; i < 3; i++) {
+		BOOST_REQUIRE(reader.Read(record));
+		BOOST_CHECK_EQUAL(record.Timestamp, i);
+		BOOST_CHECK_EQUAL(record.SecobjType, i % 2 ? "Host" : "");
+		BOOST_CHECK_EQUAL(record.SecobjName, i % 2 ? "host" + std::to_string(i) : "");
+		BOOST_CHECK_EQUAL(record.Message, "message" + std::to_string(i));
+	}
+
+	BOOST_CHECK(!reader.Read(record));
+}
+
+/* Replays a log of about 1 GiB to a zone which may see a tenth of the messages, once in the
+ * old format (JSON in netstrings, the object's zone has to be looked up) and once in the
+ * current one. Run explicitly with --run_test=remote_replaylog/benchmark. */
+BOOST_AUTO_TEST_CASE(benchmark, *boost::unit_test::disabled())
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const int count = 1000000;
+	String legacyPath = (m_DataDir / "legacy").string();
+	String path = (m_DataDir / "current").string();
+
+	String message = JsonEncode(new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "event::CheckResult" },
+		{ "params", new Dictionary({
+			{ "host", "host" },
+			{ "cr", String(950, 'x') }
+		}) }
+	}));
+
+	/* Stands in for the object lookup the old format requires. */
+	std::unordered_map<String, String> hostZones;
+
+	for (int i = 0; i < 10000; i++) {
+		hostZones.emplace("host" + std::to_string(i), "zone" + std::to_string(i % 10));
+	}
+
+	{
+		auto *fp = new std::fstream(legacyPath.CStr(), std::fstream::out | std::fstream::binary);
+		StdioStream::Ptr logStream = new StdioStream(fp, true);
+		ReplayLogWriter writer (path);
+
+		for (int i = 0; i < count; i++) {
+			String host = "host" + std::to_string(i % 10000);
+
+			NetString::WriteStringToStream(logStream, JsonEncode(new Dictionary({
+				{ "timestamp", double(i) },
+				{ "message", message },
+				{ "secobj", new Dictionary({
+					{ "type", "Host" },
+					{ "name", host }
+				}) }
+			})));
+
+			writer.Write(i, "Host", host, hostZones[host], "event::CheckResult", message);
+		}
+
+		logStream->Close();
+	}
+
+	auto start (Clock::now());
+	int legacyReplayed = 0;
+
+	{
+		auto *fp = new std::fstream(legacyPath.CStr(), std::fstream::in | std::fstream::binary);
+		StdioStream::Ptr logStream = new StdioStream(fp, true);
+		String raw;
+		StreamReadContext src;
+
+		for (;;) {
+			StreamReadStatus srs = NetString::ReadStringFromStream(logStream, &raw, src);
+
+			if (srs == StatusEof)
+				break;
+
+			if (srs != StatusNewItem)
+				continue;
+
+			Dictionary::Ptr pmessage = JsonDecode(raw);
+			Dictionary::Ptr secname = pmessage->Get("secobj");
+
+			if (hostZones[secname->Get("name")] == "zone0") {
+				String payload = pmessage->Get("message");
+				legacyReplayed++;
+			}
+		}
+
+		logStream->Close();
+	}
+
+	auto mid (Clock::now());
+	int replayed = 0;
+
+	{
+		ReplayLogReader reader (path);
+		ReplayLogRecord record;
+
+		while (reader.Read(record, [](const ReplayLogRecord& record) { return record.Zone == "zone0"; })) {
+			replayed++;
+		}
+	}
+
+	auto end (Clock::now());
+
+	BOOST_CHECK_EQUAL(legacyReplayed, count / 10);
+	BOOST_CHECK_EQUAL(replayed, count / 10);
+
+	std::cout << count << " messages, " << boost::filesystem::file_size(path.GetData()) / 1024 / 1024 << " MiB: old format "
+		<< std::chrono::duration_cast<std::chrono::milliseconds>(mid - start).count() << "ms, current format "
+		<< std::chrono::duration_cast<std::chrono::milliseconds>(end - mid).count() << "ms\n";
+}
+
+BOOST_AUTO_TEST_SUITE_END()